@@ -1,11 +1,41 @@
 #version 450
 
+// Runtime sized descriptor arrays
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
+// Permutation, see BaseShader.vert. Only bindless builds have textures to sample
+layout(constant_id = 0) const bool TEXTURED = true;
+
 layout(location = 0) in vec3 fragColor;
 
+// Bindless builds (-DBINDLESS) read the object's texture out of the bindless set.
+//  Set 1 matches BindlessHeap, the index comes after the model matrix in ObjectConstants
+#ifdef BINDLESS
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(set = 1, binding = 0) uniform texture2D textures[];
+layout(set = 1, binding = 2) uniform sampler linearSampler;
+
+layout(push_constant) uniform ObjectConstants {
+    layout(offset = 64) uint textureIndex;
+} object;
+
+// Same as BindlessHeap::INVALID_INDEX
+const uint INVALID_INDEX = 0xFFFFFFFFu;
+#endif
+
 // Specify the index of the frame buffer to write to
 layout(location = 0) out vec4 outColor;
 
 void main() {
     outColor = vec4(fragColor, 1.0);
-    
+
+#ifdef BINDLESS
+    // The index is the same for the whole draw, so it doesn't need nonuniformEXT.
+    //  The base pipeline draws objects still waiting on their texture, so it checks too
+    if (TEXTURED && object.textureIndex != INVALID_INDEX)
+        outColor *= texture(sampler2D(textures[object.textureIndex], linearSampler), fragTexCoord);
+#endif
 }
@@ -9,24 +9,72 @@
 //  https://registry.khronos.org/vulkan/specs/1.3-extensions/html/chap15.html#interfaces-resources-layout
 #version 450
 
-// Uniform block
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+// Permutations, set when the pipeline is created (SHADER_FEATURE_* in HelloTriangleApplication.h).
+//  Branches on them are compiled out, so each combination costs nothing at runtime
+layout(constant_id = 1) const bool VERTEX_COLOR = true;
+layout(constant_id = 2) const bool INSTANCE_COLOR = true;
+
+// Uniform block, the same for everything drawn in the frame
+layout(binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 proj;
 } ubo;
 
+// Per-object data, pushed before each object's draws
+layout(push_constant) uniform ObjectConstants {
+    mat4 model;
+} object;
+
 // Note: dvec usues two layout location slots
 // Example:
 // layout(location = 0) in dvec3 inPosition;
 // layout(location = 2) in vec3 inColor;
-// Input / Attribute variables
+// Input / Attribute variables. These match the VertexLayout in VertexFormats.h,
+//  but only by type: half float positions and 8 bit colors come in as floats,
+//  so changing their precision doesn't change this shader
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
 
+// Octahedral normals (NormalOct16), only in layouts that have them. Built with -DVERTEX_NORMALS
+#ifdef VERTEX_NORMALS
+layout(location = 7) in vec2 inNormal;
+
+// Unfold the octahedron back onto the unit sphere
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+#endif
+
+// Per-instance attributes (binding 1). The mat4 takes locations 2 through 5
+layout(location = 2) in mat4 inModel;
+layout(location = 6) in vec4 inInstanceColor;
+
 layout(location = 0) out vec3 fragColor;
 
+// Bindless builds (-DBINDLESS) texture the quad, its corners are at +-0.5
+#ifdef BINDLESS
+layout(location = 1) out vec2 fragTexCoord;
+#endif
+
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 0.0, 1.0);
-    fragColor = inColor;
+    gl_Position = ubo.proj * ubo.view * object.model * inModel * vec4(inPosition, 0.0, 1.0);
+    fragColor = vec3(1.0);
+    if (VERTEX_COLOR)
+        fragColor *= inColor;
+    if (INSTANCE_COLOR)
+        fragColor *= inInstanceColor.rgb;
+
+#ifdef BINDLESS
+    fragTexCoord = inPosition + vec2(0.5);
+#endif
+
+#ifdef VERTEX_NORMALS
+    // Simple light from the camera's side so the normals show
+    vec3 normal = normalize(mat3(object.model * inModel) * decodeOctahedral(inNormal));
+    fragColor *= 0.5 + 0.5 * max(dot(normal, normalize(vec3(1.0, 1.0, 1.0))), 0.0);
+#endif
 }
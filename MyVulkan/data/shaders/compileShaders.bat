@@ -1,3 +1,41 @@
-C:/VulkanSDK/1.3.268.0/Bin/glslc.exe BaseShader.vert -o vert.spv
-C:/VulkanSDK/1.3.268.0/Bin/glslc.exe BaseShader.frag -o frag.spv
-pause
\ No newline at end of file
+@echo off
+REM Builds every shader: glslc compiles, then spirv-opt runs its performance passes.
+REM The app reads the descriptor sets and vertex inputs back out of the .spv files,
+REM so optimizing doesn't need anything else to change. Run with nopause from a watcher
+REM or the command line, a running app with --hot-reload picks up the new files.
+setlocal
+set SDK_BIN=%VULKAN_SDK%\Bin
+if "%VULKAN_SDK%"=="" set SDK_BIN=C:/VulkanSDK/1.3.268.0/Bin
+
+REM compileShaders.bat <source> <output> [defines...] builds just that one shader.
+REM The project's build runs it this way for each shader it lists
+if "%~1"=="" goto :all
+if "%~1"=="nopause" goto :all
+call :build %1 %2 %3 %4 %5 %6
+exit /b %errorlevel%
+
+:all
+
+REM Add -DVERTEX_NORMALS to the vertex shaders when the Vertex layout in VertexFormats.h has normals.
+REM The project does that itself when it is built with /p:VertexNormals=true
+call :build BaseShader.vert vert.spv || goto :failed
+call :build BaseShader.frag frag.spv || goto :failed
+REM Bindless variants, used when the device has descriptor indexing
+call :build BaseShader.vert vert_bindless.spv -DBINDLESS || goto :failed
+call :build BaseShader.frag frag_bindless.spv -DBINDLESS || goto :failed
+call :build Cull.comp cull.spv || goto :failed
+goto :done
+
+REM build <source> <output> [defines...]
+REM A shader that fails to compile leaves its old .spv in place
+:build
+"%SDK_BIN%/glslc.exe" %3 %4 %5 %6 %1 -o %2.unopt || exit /b 1
+"%SDK_BIN%/spirv-opt.exe" -O %2.unopt -o %2 || (del %2.unopt & exit /b 1)
+del %2.unopt
+exit /b 0
+
+:failed
+echo Shader build failed!
+
+:done
+if not "%1"=="nopause" pause
@@ -0,0 +1,148 @@
+/**************************************************************************//**
+*	@file   Benchmark.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the headless benchmark runs
+******************************************************************************/
+
+#include "Benchmark.h"
+#include "HelloTriangleApplication.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+	struct Summary {
+		double min = 0.0;
+		double avg = 0.0;
+		double p50 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	// Nearest rank percentiles, so every number reported is a frame that actually happened
+	Summary summarize(std::vector<double> values) {
+		Summary summary;
+		if (values.empty())
+			return summary;
+
+		std::sort(values.begin(), values.end());
+		auto percentile = [&values](double p) {
+			size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+			return values[std::min(std::max<size_t>(rank, 1), values.size()) - 1];
+		};
+
+		double total = 0.0;
+		for (double value : values)
+			total += value;
+
+		summary.min = values.front();
+		summary.avg = total / values.size();
+		summary.p50 = percentile(0.50);
+		summary.p99 = percentile(0.99);
+		summary.max = values.back();
+		return summary;
+	}
+
+	void writeSummary(std::ostream& os, const char* name, const Summary& summary) {
+		os << "\"" << name << "\":{\"min\":" << summary.min << ",\"avg\":" << summary.avg
+			<< ",\"p50\":" << summary.p50 << ",\"p99\":" << summary.p99 << ",\"max\":" << summary.max << "}";
+	}
+}
+
+std::vector<BenchmarkScale> parseBenchmarkScales(const std::string& text) {
+	std::vector<BenchmarkScale> scales;
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		BenchmarkScale scale{};
+		char separator = 0;
+		std::stringstream itemStream(item);
+		if (!(itemStream >> scale.instanceGridSize >> separator >> scale.textureCount) || separator != 'x') {
+			throw std::runtime_error("Benchmark scales are written grid x textures, like 128x4: " + item);
+		}
+		scales.push_back(scale);
+	}
+
+	if (scales.empty()) {
+		throw std::runtime_error("No benchmark scales given!");
+	}
+	return scales;
+}
+
+//*****************************************************************************
+//	Run Benchmark
+//		One application per scale, each run from scratch so nothing one run
+//		loaded is still around for the next. Frame times are the CPU time
+//		between frames starting, GPU times are the frame's GPU scopes from
+//		the first one's start to the last one's end.
+//*****************************************************************************
+void runBenchmark(const BenchmarkSettings& settings, const std::string& outputPath) {
+	if (settings.frames <= settings.warmupFrames) {
+		throw std::runtime_error("Benchmark needs more frames than warm up frames!");
+	}
+
+	std::stringstream runs;
+	std::string deviceName;
+	RenderTier renderTier = RenderTier::Baseline;
+	for (size_t i = 0; i < settings.scales.size(); ++i) {
+		const BenchmarkScale& scale = settings.scales[i];
+		std::cout << "Benchmarking " << scale.instanceGridSize * scale.instanceGridSize << " instances, "
+			<< scale.textureCount << " textures" << std::endl;
+
+		HelloTriangleApplication app;
+		app.setHeadless(settings.frames, settings.warmupFrames);
+		app.setFramesInFlight(settings.framesInFlight);
+		app.setInstanceGridSize(scale.instanceGridSize);
+		app.setTextureCount(scale.textureCount);
+		app.setDeviceOverride(settings.device);
+		app.setMaxRenderTier(settings.maxRenderTier);
+		app.run();
+
+		const RunStats& stats = app.runStats();
+		deviceName = stats.deviceName;
+		renderTier = stats.renderTier;
+
+		std::vector<double> cpuTimes;
+		std::vector<double> gpuTimes;
+		for (const FrameTiming& frame : stats.frames) {
+			if (frame.frame < settings.warmupFrames)
+				continue;
+			cpuTimes.push_back(frame.cpuMs);
+			if (frame.gpuMs > 0.0)
+				gpuTimes.push_back(frame.gpuMs);
+		}
+
+		double uploadRate = stats.seconds > 0.0 ? stats.uploadedBytes / stats.seconds : 0.0;
+
+		if (i > 0)
+			runs << ",\n";
+		runs << "{\"instanceCount\":" << scale.instanceGridSize * scale.instanceGridSize
+			<< ",\"textureCount\":" << scale.textureCount
+			<< ",\"measuredFrames\":" << cpuTimes.size() << ",";
+		writeSummary(runs, "frameMs", summarize(cpuTimes));
+		runs << ",";
+		writeSummary(runs, "gpuMs", summarize(gpuTimes));
+		runs << ",\"seconds\":" << stats.seconds
+			<< ",\"uploadedBytes\":" << stats.uploadedBytes
+			<< ",\"uploadBytesPerSecond\":" << uploadRate
+			<< ",\"deviceMemoryUsedBytes\":" << stats.memoryUsed
+			<< ",\"deviceMemoryReservedBytes\":" << stats.memoryReserved << "}";
+	}
+
+	std::ofstream file(outputPath);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open benchmark output: " + outputPath);
+	}
+
+	// Device names don't have quotes in them, so they go in as they are
+	file << "{\"device\":\"" << deviceName << "\",\"renderTier\":\"" << renderTierName(renderTier) << "\",\"frames\":" << settings.frames
+		<< ",\"warmupFrames\":" << settings.warmupFrames << ",\"framesInFlight\":" << settings.framesInFlight
+		<< ",\"runs\":[\n" << runs.str() << "\n]}\n";
+}
@@ -0,0 +1,40 @@
+/**************************************************************************//**
+*	@file   Benchmark.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Headless benchmark runs. Every scene scale gets its own application,
+*		rendering offscreen with fixed time steps so runs only differ by
+*		the build and the device. The frame times after the warm up are
+*		summed up into min/avg/p50/p99/max and written out as JSON, along
+*		with the upload throughput and device memory of each run.
+******************************************************************************/
+
+#pragma once
+
+#include "RenderTier.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// How big the scene is for one run
+struct BenchmarkScale {
+	uint32_t instanceGridSize; //!< Instances along each side of the grid
+	uint32_t textureCount;     //!< Copies of the texture loaded
+};
+
+struct BenchmarkSettings {
+	uint32_t frames = 600;       //!< Frames drawn each run, warm up included
+	uint32_t warmupFrames = 60;  //!< First frames left out of the statistics, they have loading and pipeline compiles in them
+	uint32_t framesInFlight = 2;
+	std::string device;                        //!< Device override, empty for the best one
+	RenderTier maxRenderTier = RenderTier::High; //!< Cap on the tier each run picks
+	std::vector<BenchmarkScale> scales = { { 32, 1 }, { 128, 1 }, { 128, 16 }, { 256, 64 } };
+};
+
+// Scales written as grid x textures, separated by commas: "64x1,128x8"
+std::vector<BenchmarkScale> parseBenchmarkScales(const std::string& text);
+
+// Run every scale and write the results to outputPath
+void runBenchmark(const BenchmarkSettings& settings, const std::string& outputPath);
@@ -0,0 +1,201 @@
+/**************************************************************************//**
+*	@file   BindlessHeap.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the bindless descriptor heap
+******************************************************************************/
+
+#include "BindlessHeap.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <array>
+
+//*****************************************************************************
+//	Init
+//		Each array binding is:
+//			UPDATE_AFTER_BIND - written while the set is bound to command
+//				buffers that haven't been submitted yet
+//			UPDATE_UNUSED_WHILE_PENDING - written while submissions that
+//				don't read those elements are still running
+//			PARTIALLY_BOUND - not every element has to hold something
+//		The layout and the pool both need the matching update-after-bind flag.
+//*****************************************************************************
+void BindlessHeap::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t maxImages, uint32_t maxBuffers) {
+	device_ = device;
+
+	// Update-after-bind sets have their own, possibly smaller, limits
+	VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+	indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &indexingProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	images_ = {};
+	images_.capacity = std::min({ maxImages, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages });
+	buffers_ = {};
+	buffers_.capacity = std::min({ maxBuffers, indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+		indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers });
+
+	// Every image is read with the same trilinear sampler, so it is baked into the layout
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	if (vkCreateSampler(device_, &samplerInfo, nullptr, &sampler_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless sampler!");
+	}
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+	bindings[IMAGE_BINDING].binding = IMAGE_BINDING;
+	bindings[IMAGE_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	bindings[IMAGE_BINDING].descriptorCount = images_.capacity;
+	bindings[IMAGE_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+
+	bindings[BUFFER_BINDING].binding = BUFFER_BINDING;
+	bindings[BUFFER_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[BUFFER_BINDING].descriptorCount = buffers_.capacity;
+	bindings[BUFFER_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+
+	bindings[SAMPLER_BINDING].binding = SAMPLER_BINDING;
+	bindings[SAMPLER_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	bindings[SAMPLER_BINDING].descriptorCount = 1;
+	bindings[SAMPLER_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+	bindings[SAMPLER_BINDING].pImmutableSamplers = &sampler_;
+
+	const VkDescriptorBindingFlags arrayFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+	std::array<VkDescriptorBindingFlags, 3> bindingFlags = { arrayFlags, arrayFlags, 0 };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+	flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	flagsInfo.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &flagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	if (vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &layout_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless descriptor set layout!");
+	}
+
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
+	poolSizes[0] = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, images_.capacity };
+	poolSizes[1] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffers_.capacity };
+	poolSizes[2] = { VK_DESCRIPTOR_TYPE_SAMPLER, 1 };
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = 1;
+	if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &pool_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create bindless descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = pool_;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout_;
+	if (vkAllocateDescriptorSets(device_, &allocInfo, &set_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate the bindless descriptor set!");
+	}
+}
+
+void BindlessHeap::cleanup() {
+	// The set goes with its pool
+	vkDestroyDescriptorPool(device_, pool_, nullptr);
+	vkDestroyDescriptorSetLayout(device_, layout_, nullptr);
+	vkDestroySampler(device_, sampler_, nullptr);
+
+	pool_ = VK_NULL_HANDLE;
+	layout_ = VK_NULL_HANDLE;
+	sampler_ = VK_NULL_HANDLE;
+	set_ = VK_NULL_HANDLE;
+}
+
+uint32_t BindlessHeap::Slots::take() {
+	if (!free.empty()) {
+		uint32_t index = free.back();
+		free.pop_back();
+		return index;
+	}
+
+	if (next == capacity) {
+		throw std::runtime_error("Bindless descriptor array is full!");
+	}
+	return next++;
+}
+
+uint32_t BindlessHeap::addImage(VkImageView view) {
+	uint32_t index = images_.take();
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	write(IMAGE_BINDING, index, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &imageInfo, nullptr);
+
+	return index;
+}
+
+uint32_t BindlessHeap::addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	uint32_t index = buffers_.take();
+
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = offset;
+	bufferInfo.range = range;
+	write(BUFFER_BINDING, index, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfo);
+
+	return index;
+}
+
+void BindlessHeap::removeImage(uint32_t index, uint64_t value) {
+	images_.removed.push_back({ value, index });
+}
+
+void BindlessHeap::removeBuffer(uint32_t index, uint64_t value) {
+	buffers_.removed.push_back({ value, index });
+}
+
+void BindlessHeap::release(uint64_t completedValue) {
+	for (Slots* slots : { &images_, &buffers_ }) {
+		while (!slots->removed.empty() && slots->removed.front().value <= completedValue) {
+			slots->free.push_back(slots->removed.front().index);
+			slots->removed.pop_front();
+		}
+	}
+}
+
+void BindlessHeap::write(uint32_t binding, uint32_t index, VkDescriptorType type, const VkDescriptorImageInfo* image, const VkDescriptorBufferInfo* buffer) {
+	VkWriteDescriptorSet descriptorWrite{};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = set_;
+	descriptorWrite.dstBinding = binding;
+	descriptorWrite.dstArrayElement = index;
+	descriptorWrite.descriptorType = type;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = image;
+	descriptorWrite.pBufferInfo = buffer;
+
+	vkUpdateDescriptorSets(device_, 1, &descriptorWrite, 0, nullptr);
+}
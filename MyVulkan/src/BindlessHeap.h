@@ -0,0 +1,84 @@
+/**************************************************************************//**
+*	@file   BindlessHeap.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		One descriptor set holding big arrays of every sampled image and
+*		storage buffer, built on descriptor indexing (core in Vulkan 1.2).
+*		The set is bound once and shaders pick what they read with an index
+*		out of their push constants, so adding a resource is writing one
+*		array element instead of making and binding another set.
+*		The bindings are update-after-bind and partially bound: elements can
+*		be written while the set is bound, and empty elements are fine as
+*		long as nothing reads them.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+class BindlessHeap {
+public:
+
+	// Bindings of the set. Shaders declare the same ones
+	static constexpr uint32_t IMAGE_BINDING = 0;   //!< texture2D images[]
+	static constexpr uint32_t BUFFER_BINDING = 1;  //!< Storage buffers, declared per struct type the shader reads
+	static constexpr uint32_t SAMPLER_BINDING = 2; //!< The immutable linear sampler every image is read with
+
+	// An index that doesn't point at anything, for push constants with nothing to read
+	static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+	// Descriptor counts are clamped to what the device allows for update-after-bind sets
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t maxImages, uint32_t maxBuffers);
+	void cleanup();
+
+	// Put a resource in the first free element and return its index. Views have to be
+	//	in SHADER_READ_ONLY_OPTIMAL by the time a shader reads them
+	uint32_t addImage(VkImageView view);
+	uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+	// The element is no longer used by anything submitted after value. It gets
+	//	handed out again once release sees the timeline reach it, an element
+	//	a pending submission might read can't be rewritten
+	void removeImage(uint32_t index, uint64_t value);
+	void removeBuffer(uint32_t index, uint64_t value);
+
+	// The timeline reached completedValue, so removed elements up to it can be reused
+	void release(uint64_t completedValue);
+
+	VkDescriptorSetLayout layout() const { return layout_; }
+	VkDescriptorSet set() const { return set_; }
+
+private:
+
+	// Free elements of one binding
+	struct Slots {
+		uint32_t capacity = 0;
+		uint32_t next = 0;            //!< Elements before this have been handed out at least once
+		std::vector<uint32_t> free;   //!< Handed out before, and released since
+		struct Removed {
+			uint64_t value;
+			uint32_t index;
+		};
+		std::deque<Removed> removed; //!< Oldest first
+
+		uint32_t take();
+	};
+
+	void write(uint32_t binding, uint32_t index, VkDescriptorType type, const VkDescriptorImageInfo* image, const VkDescriptorBufferInfo* buffer);
+
+	VkDevice device_ = VK_NULL_HANDLE;
+
+	VkSampler sampler_ = VK_NULL_HANDLE;             //!< Immutable sampler baked into the layout
+	VkDescriptorSetLayout layout_ = VK_NULL_HANDLE;
+	VkDescriptorPool pool_ = VK_NULL_HANDLE;         //!< Update-after-bind pool the one set comes from
+	VkDescriptorSet set_ = VK_NULL_HANDLE;
+
+	Slots images_;
+	Slots buffers_;
+};
@@ -0,0 +1,197 @@
+/**************************************************************************//**
+*	@file   DescriptorAllocator.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the growing, reset-based descriptor allocator
+******************************************************************************/
+
+#include "DescriptorAllocator.h"
+
+#include <stdexcept>
+#include <array>
+#include <functional>
+#include <algorithm>
+
+namespace {
+
+	// Descriptors of each type a pool holds for every set it can allocate.
+	//	Sets are small, so a couple of each type per set is plenty
+	const std::array<std::pair<VkDescriptorType, uint32_t>, 8> POOL_RATIOS = { {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 4 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+	} };
+
+	template<typename T>
+	void hashCombine(size_t& seed, const T& value) {
+		seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+
+	bool isImageType(VkDescriptorType type) {
+		return type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+			type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	}
+}
+
+DescriptorResource DescriptorResource::makeBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	DescriptorResource resource;
+	resource.binding = binding;
+	resource.type = type;
+	resource.buffer = { buffer, offset, range };
+	return resource;
+}
+
+DescriptorResource DescriptorResource::makeImage(uint32_t binding, VkDescriptorType type, VkImageView view, VkSampler sampler, VkImageLayout layout) {
+	DescriptorResource resource;
+	resource.binding = binding;
+	resource.type = type;
+	resource.image = { sampler, view, layout };
+	return resource;
+}
+
+// Compared field by field, the structs have padding in them
+bool DescriptorResource::operator==(const DescriptorResource& other) const {
+	return binding == other.binding && type == other.type &&
+		buffer.buffer == other.buffer.buffer && buffer.offset == other.buffer.offset && buffer.range == other.buffer.range &&
+		image.sampler == other.image.sampler && image.imageView == other.image.imageView && image.imageLayout == other.image.imageLayout;
+}
+
+size_t DescriptorAllocator::SetKeyHash::operator()(const SetKey& key) const {
+	size_t seed = 0;
+	hashCombine(seed, key.layout);
+	for (const DescriptorResource& resource : key.resources) {
+		hashCombine(seed, resource.binding);
+		hashCombine(seed, static_cast<uint32_t>(resource.type));
+		hashCombine(seed, resource.buffer.buffer);
+		hashCombine(seed, resource.buffer.offset);
+		hashCombine(seed, resource.buffer.range);
+		hashCombine(seed, resource.image.sampler);
+		hashCombine(seed, resource.image.imageView);
+		hashCombine(seed, static_cast<uint32_t>(resource.image.imageLayout));
+	}
+	return seed;
+}
+
+void DescriptorAllocator::init(VkDevice device, uint32_t frameCount) {
+	device_ = device;
+	framePools_.assign(frameCount, PoolChain{});
+	cachedPools_ = {};
+}
+
+void DescriptorAllocator::cleanup() {
+	for (PoolChain& chain : framePools_) {
+		for (VkDescriptorPool pool : chain.pools)
+			vkDestroyDescriptorPool(device_, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : cachedPools_.pools)
+		vkDestroyDescriptorPool(device_, pool, nullptr);
+
+	framePools_.clear();
+	cachedPools_ = {};
+	cache_.clear();
+}
+
+void DescriptorAllocator::beginFrame(uint32_t frame) {
+	// Resetting hands every set in the pool back at once, the pools stay around for the next time
+	PoolChain& chain = framePools_[frame];
+	for (VkDescriptorPool pool : chain.pools)
+		vkResetDescriptorPool(device_, pool, 0);
+	chain.current = 0;
+}
+
+VkDescriptorSet DescriptorAllocator::allocateFrame(uint32_t frame, VkDescriptorSetLayout layout, const std::vector<DescriptorResource>& resources) {
+	VkDescriptorSet set = allocate(framePools_[frame], layout);
+	write(set, resources);
+	return set;
+}
+
+VkDescriptorSet DescriptorAllocator::getCached(VkDescriptorSetLayout layout, const std::vector<DescriptorResource>& resources) {
+	SetKey key{ layout, resources };
+	auto found = cache_.find(key);
+	if (found != cache_.end())
+		return found->second;
+
+	VkDescriptorSet set = allocate(cachedPools_, layout);
+	write(set, resources);
+	cache_.emplace(std::move(key), set);
+	return set;
+}
+
+//*****************************************************************************
+//	Allocate
+//		Try the chain's current pool, and move on to the next one when it's
+//		out of memory or too fragmented. Running off the end of the chain
+//		makes a new, bigger pool, so a chain stops growing once it has
+//		enough for a frame's worth of sets.
+//*****************************************************************************
+VkDescriptorSet DescriptorAllocator::allocate(PoolChain& chain, VkDescriptorSetLayout layout) {
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	while (true) {
+		bool newPool = chain.current == chain.pools.size();
+		if (newPool) {
+			chain.pools.push_back(createPool(chain.nextPoolSets));
+			chain.nextPoolSets = std::min(chain.nextPoolSets * 2, MAX_POOL_SETS);
+		}
+
+		allocInfo.descriptorPool = chain.pools[chain.current];
+		VkDescriptorSet set;
+		VkResult result = vkAllocateDescriptorSets(device_, &allocInfo, &set);
+		if (result == VK_SUCCESS)
+			return set;
+
+		// A brand new pool that can't fit the set never will
+		if (newPool || (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)) {
+			throw std::runtime_error("Failed to allocate descriptor sets");
+		}
+		++chain.current;
+	}
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(uint32_t sets) {
+	std::array<VkDescriptorPoolSize, POOL_RATIOS.size()> poolSizes{};
+	for (size_t i = 0; i < POOL_RATIOS.size(); ++i) {
+		poolSizes[i].type = POOL_RATIOS[i].first;
+		poolSizes[i].descriptorCount = POOL_RATIOS[i].second * sets;
+	}
+
+	// No FREE_DESCRIPTOR_SET_BIT, sets only ever go back by resetting the whole pool
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = sets;
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor pool!");
+	}
+	return pool;
+}
+
+void DescriptorAllocator::write(VkDescriptorSet set, const std::vector<DescriptorResource>& resources) {
+	std::vector<VkWriteDescriptorSet> writes(resources.size());
+	for (size_t i = 0; i < resources.size(); ++i) {
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = resources[i].binding;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorType = resources[i].type;
+		writes[i].descriptorCount = 1;
+		if (isImageType(resources[i].type))
+			writes[i].pImageInfo = &resources[i].image;
+		else
+			writes[i].pBufferInfo = &resources[i].buffer;
+	}
+
+	vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
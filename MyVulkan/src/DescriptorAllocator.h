@@ -0,0 +1,91 @@
+/**************************************************************************//**
+*	@file   DescriptorAllocator.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Descriptor sets out of pools that grow as they fill up. Individual
+*		sets are never freed, which is what fragments a pool. Sets that are
+*		only used for one frame come from that frame's pools, and the whole
+*		lot is reset with vkResetDescriptorPool once the frame has finished.
+*		Sets that never change are cached by their layout and what they
+*		point at, so asking for the same set twice hands back the first one.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// One descriptor written into a set. Buffer types use buffer, image and sampler types use image
+struct DescriptorResource {
+	uint32_t binding = 0;
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	VkDescriptorBufferInfo buffer{};
+	VkDescriptorImageInfo image{};
+
+	static DescriptorResource makeBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	static DescriptorResource makeImage(uint32_t binding, VkDescriptorType type, VkImageView view, VkSampler sampler,
+		VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	bool operator==(const DescriptorResource& other) const;
+};
+
+class DescriptorAllocator {
+public:
+
+	// Sets in the first pool of a chain. Each new pool is twice the size of the last, up to MAX_POOL_SETS
+	static constexpr uint32_t FIRST_POOL_SETS = 16;
+	static constexpr uint32_t MAX_POOL_SETS = 1024;
+
+	void init(VkDevice device, uint32_t frameCount);
+
+	// Destroys every pool, which frees every set handed out
+	void cleanup();
+
+	// Reset the frame's pools. Only call once the frame's last submit has finished
+	void beginFrame(uint32_t frame);
+
+	// A set that is only valid until the frame's pools are reset
+	VkDescriptorSet allocateFrame(uint32_t frame, VkDescriptorSetLayout layout, const std::vector<DescriptorResource>& resources);
+
+	// A set that lives until cleanup. The same layout and resources always give back the same set,
+	//	so the resources can't be destroyed while the allocator is alive
+	VkDescriptorSet getCached(VkDescriptorSetLayout layout, const std::vector<DescriptorResource>& resources);
+
+	size_t cachedSetCount() const { return cache_.size(); }
+
+private:
+
+	// Pools handed out from one after another. Once a pool is full the next one is used
+	struct PoolChain {
+		std::vector<VkDescriptorPool> pools; //!< Every pool in the chain, the last is the one allocated from
+		uint32_t current = 0;                //!< Pool allocations are tried in first
+		uint32_t nextPoolSets = FIRST_POOL_SETS;
+	};
+
+	// What a cached set was made from
+	struct SetKey {
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorResource> resources;
+
+		bool operator==(const SetKey& other) const { return layout == other.layout && resources == other.resources; }
+	};
+	struct SetKeyHash {
+		size_t operator()(const SetKey& key) const;
+	};
+
+	VkDescriptorSet allocate(PoolChain& chain, VkDescriptorSetLayout layout);
+	VkDescriptorPool createPool(uint32_t sets);
+	void write(VkDescriptorSet set, const std::vector<DescriptorResource>& resources);
+
+	VkDevice device_ = VK_NULL_HANDLE;
+
+	std::vector<PoolChain> framePools_; //!< One chain per frame in flight, reset whole
+	PoolChain cachedPools_;             //!< Where the cached sets come from, never reset
+
+	std::unordered_map<SetKey, VkDescriptorSet, SetKeyHash> cache_;
+};
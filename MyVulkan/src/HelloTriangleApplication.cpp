@@ -8,24 +8,8 @@
 *		All code is referenced from: https://vulkan-tutorial.com/
 ******************************************************************************/
 
-//*****************************************************************************
-//	CHALLENGE:
-//		Specify a Transfer queue that is not the Graphics queue or the compute
-//		queue.
-//	The graphics queue already handles memory transfers, but then you have
-//		a queue being used for multiple purposes. May be a good idea to have
-//		a separate queue that is purely for transfering buffers over from
-//		CPU to GPU
-//*****************************************************************************
-
-//*****************************************************************************
-//	CHALLENGE:
-//		Create a setupCommandBuffer that helper functions record commands into
-//		and add a flushSetupCommands, that will execute all the commands that
-//		have been recorded.
-//*****************************************************************************
-
 #include "HelloTriangleApplication.h"
+#include "ShaderReflection.h"
 
 // Image Loading
 #define STB_IMAGE_IMPLEMENTATION
@@ -38,30 +22,117 @@
 #include <cstdint>
 #include <limits>
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <fstream>
 #include <chrono>
-
-// Hard codes vertices for our mesh
-const std::vector<Vertex> vertices = {
-	{{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-	{{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-	{{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-	{{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}}
-};
-
-const std::vector<uint16_t> indices = {
-	0, 1, 2, 2, 3, 0
-};
+#include <thread>
 
 // Window const sizes
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
-// How many frames should be in flight at once
+// How many frames can be in flight at once. Set with setFramesInFlight
 //	Two lets the CPU and GPU work on their own tasks at the same time,
-//	but three or more frames in flight may let the CPU get ahead of the GPU,
-//	causing latency frames. Extra latency isn't usually desired
-const int MAX_FRAMES_IN_FLIGHT = 2;
+//	but three frames in flight may let the CPU get ahead of the GPU,
+//	causing latency frames. Three smooths over frames that take longer
+//	than usual, so it is the throughput choice, two is the latency choice
+const uint32_t MIN_FRAMES_IN_FLIGHT = 2;
+const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+// The instance grid is split into bands of instances, and each band is an object with its own
+//	transform. The transform is pushed right before the band's draws
+static_assert((DEFAULT_INSTANCE_GRID_SIZE * DEFAULT_INSTANCE_GRID_SIZE) % OBJECT_COUNT == 0, "Every object needs the same number of instances");
+
+// Headless runs step time by a fixed amount each frame, so they all draw the same frames
+const float HEADLESS_TIME_STEP = 1.0f / 60.0f;
+
+// Format of the offscreen images, the one the window's swap chain prefers as well
+const VkFormat OFFSCREEN_FORMAT = VK_FORMAT_B8G8R8A8_SRGB;
+
+// Most samples the color and depth attachments use. Every device supports 4
+const VkSampleCountFlagBits MAX_MSAA_SAMPLES = VK_SAMPLE_COUNT_4_BIT;
+
+// Depth formats in order of preference. Only depth is used, so stencil formats are fallbacks
+const std::array<VkFormat, 3> DEPTH_FORMATS = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+
+// Longest low latency pacing waits for an image to be displayed, in nanoseconds.
+//	Presents can get stuck while the window is hidden, so it can't be forever
+const uint64_t PRESENT_WAIT_TIMEOUT = 100ull * 1000 * 1000;
+
+// The culling pass writes one indirect command per object per LOD, each one
+//	drawing the instances that picked that LOD
+const uint32_t DRAWS_PER_OBJECT = LOD_COUNT;
+const uint32_t INDIRECT_DRAW_COUNT = OBJECT_COUNT * DRAWS_PER_OBJECT;
+
+// Distance from the camera where each LOD after the first starts
+const float LOD_DISTANCES[] = { 3.5f, 5.0f, 7.0f };
+static_assert(sizeof(LOD_DISTANCES) / sizeof(LOD_DISTANCES[0]) >= LOD_COUNT - 1, "Every LOD after the first needs a distance");
+
+// Threads in each workgroup of the culling shader, has to match local_size_x in Cull.comp
+const uint32_t CULL_GROUP_SIZE = 64;
+
+// Objects each recording thread gets at least. Every object binds its pipeline, pushes its
+//	constants and draws all of its LODs, so a thread is worth giving even one of them
+const uint32_t MIN_OBJECTS_PER_RECORDING_THREAD = 1;
+
+// What each binding of the culling pass's set holds: the frame's CullUniforms, the frame's
+//	instances, the frame's indirect commands, where the visible instances go and each
+//	object's draw count. They are all per-frame, so they are dynamic and one set covers every frame
+const std::array<VkDescriptorType, 5> CULL_BINDING_TYPES = {
+	VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+};
+
+// Which half of Cull.comp a dispatch runs, pushed as its only push constant
+const uint32_t CULL_PHASE_INSTANCES = 0;
+const uint32_t CULL_PHASE_COMPACT = 1;
+
+// Size of the persistently mapped staging ring that every upload goes through
+const VkDeviceSize STAGING_RING_SIZE = 32 * 1024 * 1024;
+
+// Alignment of each staged upload. Covers buffer copies and buffer to image copies
+const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+// Longest step the instances are moved forward by, so a stall doesn't throw them across the scene
+const float MAX_SCENE_TIME_STEP = 0.1f;
+
+// Where compiled pipelines are saved between launches
+const std::string PIPELINE_CACHE_PATH = "data/pipeline.cache";
+
+// The culling pass's compute shader
+const std::string CULL_SHADER = "data/shaders/cull.spv";
+
+// The mesh we are rendering, made from data/meshes/quad.obj with --convert-mesh
+const std::string MESH_PATH = "data/meshes/quad.mesh";
+
+// Biggest piece of a buffer staged at once. Large meshes go through the ring a
+//	piece at a time, so they never need more than this much staging memory
+const VkDeviceSize STAGING_CHUNK_SIZE = STAGING_RING_SIZE / 4;
+
+// The texture we are rendering with
+const std::string TEXTURE_PATH = "data\\textures\\GupPointPlead.png";
+
+// A GPU compressed copy of a texture (BCn or ASTC, made offline with a KTX2 or DDS encoder)
+//	can sit next to it with the same name. It is loaded instead when it's there
+const std::array<const char*, 2> COMPRESSED_TEXTURE_EXTENSIONS = { ".ktx2", ".dds" };
+
+// Most memory the streamed textures can keep resident, and how much of them can start uploading each frame.
+//	With VK_EXT_memory_budget the memory budget also shrinks to what the heap has left
+const VkDeviceSize TEXTURE_STREAMING_BUDGET = 256ull * 1024 * 1024;
+const VkDeviceSize TEXTURE_UPLOAD_BUDGET = 8ull * 1024 * 1024;
+
+// Size of the bindless arrays, clamped to the device's limits. Elements are only
+//	written when something is added, so a big array costs little more than a small one
+const uint32_t MAX_BINDLESS_IMAGES = 4096;
+const uint32_t MAX_BINDLESS_BUFFERS = 1024;
+
+// Object constants are read by the vertex shader, and by the fragment shader for the texture index
+const VkShaderStageFlags OBJECT_CONSTANT_STAGES = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
 // Vulkan validation layers
 const std::vector<const char*> validationLayers = {
@@ -80,35 +151,19 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
-// Helper function for reading binary files
-static std::vector<char> readFile(const std::string& filename) {
-	// Open the filename in a binary format (ate - read from end of file)
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	// If the file is not open, throw
-	if (!file.is_open()) {
-		throw std::runtime_error("Failed to Open File!");
-	}
-
-	// Get what the file size is and create a buffer with the file info
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-
-	// Now go back to the beginning and read in all the data
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-
-	// Remember to close the file and return the buffer
-	file.close();
-	return buffer;
-}
-
 // glfw resize callback function
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
 	auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
 	app->windowResized();
 }
 
+// Windows stops returning from glfwPollEvents while the window is being dragged to a new size,
+//	but still asks for it to be redrawn. Drawing from here keeps frames coming during the resize
+static void windowRefreshCallback(GLFWwindow* window) {
+	auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+	app->windowRefreshed();
+}
+
 // Function for creating debug messenger (checks if the layer is available or not)
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
 	auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
@@ -130,7 +185,9 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
 
 // Function for running the application
 void HelloTriangleApplication::run() {
-	initWindow();
+	// Headless runs never open a window
+	if (!headless_)
+		initWindow();
 	initVulkan();
 	mainloop();
 	cleanup();
@@ -151,60 +208,161 @@ void HelloTriangleApplication::initWindow() {
 	// Make sure glfw knows the user pointer
 	glfwSetWindowUserPointer(window_, this);
 	glfwSetFramebufferSizeCallback(window_, framebufferResizeCallback);
+	glfwSetWindowRefreshCallback(window_, windowRefreshCallback);
+}
+
+// Pick how many frames can be in flight. Has to be called before run
+void HelloTriangleApplication::setFramesInFlight(uint32_t count) {
+	if (count < MIN_FRAMES_IN_FLIGHT || count > MAX_FRAMES_IN_FLIGHT) {
+		throw std::runtime_error("Frames in flight must be 2 or 3!");
+	}
+
+	framesInFlight_ = count;
+}
+
+void HelloTriangleApplication::setPresentPolicy(const PresentPolicy& policy) {
+	presentPolicy_ = policy;
+
+	// Once running, the swap chain gets remade with the new mode and image count
+	if (swapChain_ != VK_NULL_HANDLE)
+		framebufferResized_ = true;
+}
+
+void HelloTriangleApplication::setHeadless(uint32_t frameCount, uint32_t warmupFrames) {
+	headless_ = true;
+	headlessFrames_ = frameCount;
+	headlessWarmupFrames_ = std::min(warmupFrames, frameCount);
+}
+
+void HelloTriangleApplication::setInstanceGridSize(uint32_t gridSize) {
+	if (gridSize == 0 || (gridSize * gridSize) % OBJECT_COUNT != 0) {
+		throw std::runtime_error("Instance grid has to split evenly over the objects!");
+	}
+
+	instanceGridSize_ = gridSize;
+}
+
+void HelloTriangleApplication::setTextureCount(uint32_t count) {
+	if (count == 0 || count > MAX_BINDLESS_IMAGES) {
+		throw std::runtime_error("Texture count has to be between 1 and the bindless image count!");
+	}
+
+	textureCount_ = count;
 }
 
 // Initialize vulkan
 void HelloTriangleApplication::initVulkan() {
+	// Every per frame resource lives in the frame's context, created as we go
+	frames_.assign(framesInFlight_, FrameContext{});
+
+	// Start up the workers
+	jobs_.init();
+
 	// To initialize Vulkan, we need an instance
 	createInstance();
 
 	// Also setup debug messenger
 	setupDebugMessenger();
 
-	// Create the rendering surface
-	createSurface();
+	// Create the rendering surface. Headless runs don't have one
+	if (!headless_)
+		createSurface();
 
 	// Pick the physical device
 	pickPhysicalDevice();
 
 	// Create a logical device
 	createLogicalDevice();
+
+	// Every buffer and image will pull its memory from the allocator
+	allocator_.init(vkPhysicalDevice_, logicalDevice_);
+
+	// Load the pipelines the driver compiled last launch
+	pipelineCache_.init(vkPhysicalDevice_, logicalDevice_, PIPELINE_CACHE_PATH);
+
+	// Every pipeline is created through the manager, which compiles through the cache
+	pipelines_.init(logicalDevice_, pipelineCache_.handle(), jobs_);
 	
-	// Create a swap chain
-	createSwapChain();
+	// Create a swap chain, or the images it would have had when rendering offscreen
+	if (headless_)
+		createOffscreenImages();
+	else
+		createSwapChain();
 
 	// Create the image viewers
 	createImageViews();
 
+	// Build the frame's passes, which creates the multisampled color and depth the render pass draws into
+	chooseAttachmentFormats();
+	buildRenderGraph();
+
 	// Create a render pass
 	createRenderPass();
 
 	// Create a layout for uniform variables
 	createDescriptorSetLayout();
 
+	// The bindless set is set 1 of the graphics pipeline, so it has to exist before the pipeline
+	if (bindless_)
+		bindlessHeap_.init(vkPhysicalDevice_, logicalDevice_, MAX_BINDLESS_IMAGES, MAX_BINDLESS_BUFFERS);
+
 	// Create a graphics pipeline
 	createGraphicsPipeline();
 
+	// Create the compute pipeline that culls the instances
+	createCullPipeline();
+
+	// Watch every shader the pipelines came from, drawFrame rebuilds them when they change
+	if (shaderHotReload_) {
+		for (const std::string& shader : sceneShaders())
+			shaderWatcher_.watch(shader);
+		shaderWatcher_.watch(CULL_SHADER);
+	}
+
 	// Create frame buffers
 	createFramebuffers();
 
 	// Create the command pool
 	createCommandPool();
 
-	// Create a texture
+	// Create the recorders that setup work is batched into
+	createSetupCommands();
+
+	// Create the staging ring that uploads are written into
+	createStagingRing();
+
+	// Compressed textures stream their mips through the staging ring
+	textureStreamer_.init(vkPhysicalDevice_, logicalDevice_, allocator_, stagingRing_, jobs_, graphicsTimeline_, memoryBudget_);
+	textureStreamer_.setBudgets(TEXTURE_STREAMING_BUDGET, TEXTURE_UPLOAD_BUDGET);
+
+	// Create a texture. It gets decoded on a worker and finishes uploading whenever it's ready
 	createTextureImage();
 
-	// Create the vertex buffer
-	createVertexBuffer();
+	// Load the mesh, which creates the vertex and index buffers
+	loadMesh();
 
-	// Create the index buffer
-	createIndexBuffer();
+	// Create the per-instance data and the indirect commands that draw it
+	createInstanceBuffer();
+	createIndirectBuffers();
+
+	// Pick up any assets the workers have already finished loading
+	jobs_.runDeviceCallbacks();
+
+	// All of the uploads above were only queued, so send them all to the GPU at once.
+	//	No need to wait on it, the frames are submitted to the graphics queue after it
+	flushStagingUploads();
 
 	// Create the uniform buffers
 	createUniformBuffers();
 
-	// Create a descriptor pool
-	createDescriptorPool();
+	// Create the descriptor allocator. Its pools grow as sets are asked for,
+	//	and each frame in flight gets its own pools for sets that only last the frame
+	descriptors_.init(logicalDevice_, framesInFlight_);
+
+	// Create the profiler. It only records when there is somewhere to write the trace,
+	//	or when a headless run needs the frame times
+	profiler_.init(vkPhysicalDevice_, logicalDevice_, framesInFlight_, hostQueryReset_, pipelineStatistics_);
+	profiler_.setEnabled(headless_ || !profileOutput_.empty());
 
 	// Create descriptor sets
 	createDescriptorSets();
@@ -214,6 +372,9 @@ void HelloTriangleApplication::initVulkan() {
 
 	// Create the sync objects
 	createSyncObjects();
+
+	// Show how much memory all of our resources ended up using
+	allocator_.printStats(std::cout);
 }
 
 // Create the vulkan instance
@@ -231,7 +392,7 @@ void HelloTriangleApplication::createInstance() {
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = "No Engine";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = VK_API_VERSION_1_2; // Timeline semaphores are core in 1.2
 
 	// Now create a create info struct for Vulkan
 	VkInstanceCreateInfo createInfo{};
@@ -298,10 +459,13 @@ bool HelloTriangleApplication::checkValidationLayerSupport() {
 
 // Get required extensions based on validation layers being enabled
 std::vector<const char*> HelloTriangleApplication::getRequiredExtensions() {
-	// Get all the required glfw extensions
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	// Get all the required glfw extensions. Without a window there is no surface to make
+	std::vector<const char*> extensions;
+	if (!headless_) {
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	// If we are using validation layers, there is one additional layer we need
 	if (enableValidationLayers) {
@@ -326,14 +490,139 @@ void HelloTriangleApplication::setupDebugMessenger() {
 
 // loop for the application
 void HelloTriangleApplication::mainloop() {
-	// Keep processing all the inputs from the glfw window
+	if (headless_) {
+		runHeadless();
+		return;
+	}
+
+	// Keep processing all the inputs from the glfw window. Frames are paced before
+	//	the input is read, so it's as fresh as it can be when the frame uses it
 	while (!glfwWindowShouldClose(window_)) {
+		// A minimized window has nothing to draw to, so sleep until something happens
+		if (windowMinimized()) {
+			glfwWaitEvents();
+			continue;
+		}
+
+		paceFrame();
 		glfwPollEvents();
+		profiler_.markInput();
+		drawFrame();
+	}
+
+	// This will free up the semaphores
+	vkDeviceWaitIdle(logicalDevice_);
+}
+
+// Called from inside glfwPollEvents, so the events have already been read. The frame
+//	still goes through the pacing, so a resize doesn't draw as fast as the refreshes come
+void HelloTriangleApplication::windowRefreshed() {
+	if (windowMinimized())
+		return;
+
+	paceFrame();
+	profiler_.markInput();
+	drawFrame();
+}
+
+//*****************************************************************************
+//	Frame Pacing
+//		The limiter sleeps until the frame's slot comes up, and starts over
+//		from now instead of catching up once it falls behind. Low latency
+//		pacing then waits for the GPU to finish everything submitted (and
+//		with present wait, for the last image to be displayed), so the frame
+//		isn't queued up behind others and its input is read as late as it
+//		can be. That gives up the CPU and GPU overlap for latency.
+//*****************************************************************************
+void HelloTriangleApplication::paceFrame() {
+	if (presentPolicy_.maxFrameRate > 0.0) {
+		auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(1.0 / presentPolicy_.maxFrameRate));
+		auto now = std::chrono::steady_clock::now();
+		if (nextFrameTime_ + period < now)
+			nextFrameTime_ = now;
+
+		uint32_t limitScope = profiler_.beginCpuScope("Frame limiter");
+		std::this_thread::sleep_until(nextFrameTime_);
+		profiler_.endCpuScope(limitScope);
+		nextFrameTime_ += period;
+	}
+
+	if (presentPolicy_.lowLatency) {
+		uint32_t latencyScope = profiler_.beginCpuScope("Low latency wait");
+		graphicsTimeline_.wait(graphicsTimeline_.submittedValue());
+		if (presentPolicy_.presentWait && presentWait_ && !pendingPresents_.empty())
+			waitForPresent_(logicalDevice_, swapChain_, pendingPresents_.back().presentId, PRESENT_WAIT_TIMEOUT);
+		profiler_.endCpuScope(latencyScope);
+	}
+
+	pollPresents();
+}
+
+//*****************************************************************************
+//	Presents
+//		A frame's latency ends when its image is displayed, which present
+//		wait can tell us. Without it the closest we can get is the GPU
+//		finishing the frame, which leaves out the time in the display queue
+//*****************************************************************************
+void HelloTriangleApplication::pollPresents() {
+	bool displayTimes = presentPolicy_.presentWait && presentWait_;
+	while (!pendingPresents_.empty()) {
+		const PendingPresent& present = pendingPresents_.front();
+		bool done = displayTimes ?
+			waitForPresent_(logicalDevice_, swapChain_, present.presentId, 0) == VK_SUCCESS :
+			graphicsTimeline_.isComplete(present.timelineValue);
+		if (!done)
+			break;
+
+		profiler_.markDisplayed(present.frame);
+		pendingPresents_.pop_front();
+	}
+}
+
+//*****************************************************************************
+//	Headless
+//		Draws the set number of frames as fast as the device goes, then
+//		reads back every frame's timings and what the run used. The time
+//		and uploads start counting when the warm up ends, so they cover the
+//		same frames as the statistics
+//*****************************************************************************
+void HelloTriangleApplication::runHeadless() {
+	uint64_t uploadedBefore = stagingRing_.bytesRecorded();
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < headlessFrames_; ++frame) {
+		// Loading and the streamed textures upload during the warm up
+		if (frame == headlessWarmupFrames_) {
+			uploadedBefore = stagingRing_.bytesRecorded();
+			start = std::chrono::steady_clock::now();
+		}
 		drawFrame();
 	}
 
-	// This will free up the semaphores and fences
 	vkDeviceWaitIdle(logicalDevice_);
+	auto end = std::chrono::steady_clock::now();
+
+	// The last frames in flight only have their GPU times once the device is idle
+	profiler_.flush();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkPhysicalDevice_, &properties);
+	runStats_ = RunStats{};
+	runStats_.deviceName = properties.deviceName;
+	runStats_.renderTier = renderTier_;
+	runStats_.frames.assign(profiler_.frameTimings().begin(), profiler_.frameTimings().end());
+	runStats_.seconds = std::chrono::duration<double>(end - start).count();
+	runStats_.uploadedBytes = stagingRing_.bytesRecorded() - uploadedBefore;
+
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(vkPhysicalDevice_, &memProperties);
+	std::vector<HeapStats> heaps = allocator_.getHeapStats();
+	for (uint32_t heap = 0; heap < heaps.size(); ++heap) {
+		if (memProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			runStats_.memoryUsed += heaps[heap].bytesUsed;
+			runStats_.memoryReserved += heaps[heap].bytesReserved;
+		}
+	}
 }
 
 // Cleanup function
@@ -341,55 +630,106 @@ void HelloTriangleApplication::cleanup() {
 	// Note: The VkPhysicalDevice is destroyed when the instance is destroyed
 	//	so we don't need to worry about it
 
+	// Stop the workers first, they may still be writing into the staging ring
+	jobs_.shutdown();
+
+	// Write out everything the profiler recorded, then destroy its query pools
+	if (!profileOutput_.empty()) {
+		profiler_.writeChromeTrace(profileOutput_);
+		std::cout << "Wrote " << profileOutput_ << std::endl;
+	}
+	profiler_.cleanup();
+
 	// Destroy the swap chain
 	cleanupSwapChain();
 
 	// Destroy the texture image and its memory
+	vkDestroyImageView(logicalDevice_, textureImageView_, nullptr);
 	vkDestroyImage(logicalDevice_, textureImage_, nullptr);
-	vkFreeMemory(logicalDevice_, textureImageMemory_, nullptr);
-
-	// Destroy the uniform buffers
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-		// Destroying the buffer first makes it so that the memory is not in use
-		//	, allowing it to be freed with no issues
-		vkDestroyBuffer(logicalDevice_, uniformBuffers_[i], nullptr);
-		vkFreeMemory(logicalDevice_, uniformBuffersMemory_[i], nullptr);
-	}
-
-	// Destroy the descriptor pool, which will implicitly destroy any allocated sets
-	vkDestroyDescriptorPool(logicalDevice_, descriptorPool_, nullptr);
+	allocator_.free(textureImageMemory_);
+	for (ExtraTexture& texture : extraTextures_) {
+		vkDestroyImageView(logicalDevice_, texture.view, nullptr);
+		vkDestroyImage(logicalDevice_, texture.image, nullptr);
+		allocator_.free(texture.memory);
+	}
+	textureStreamer_.cleanup();
+
+	// Destroy the staging ring
+	vkDestroyBuffer(logicalDevice_, stagingRingBuffer_, nullptr);
+	allocator_.free(stagingRingMemory_);
+
+	// Destroy the uniform buffer
+	//	Destroying the buffer first makes it so that the memory is not in use
+	//	, allowing it to be freed with no issues
+	vkDestroyBuffer(logicalDevice_, uniformBuffer_, nullptr);
+	allocator_.free(uniformBufferMemory_);
+
+	// Destroy the descriptor pools, which will implicitly destroy any allocated sets
+	descriptors_.cleanup();
+	if (bindless_)
+		bindlessHeap_.cleanup();
 	
 	// Destroy the uniform layout descriptor
 	vkDestroyDescriptorSetLayout(logicalDevice_, descriptorSetLayout_, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice_, cullSetLayout_, nullptr);
 
 	// Destroy the index buffer and free its memory
 	vkDestroyBuffer(logicalDevice_, indexBuffer_, nullptr);
-	vkFreeMemory(logicalDevice_, indexBufferMemory_, nullptr);
+	allocator_.free(indexBufferMemory_);
+
+	// Destroy the instance and indirect buffers
+	vkDestroyBuffer(logicalDevice_, instanceBuffer_, nullptr);
+	allocator_.free(instanceBufferMemory_);
+	vkDestroyBuffer(logicalDevice_, drawTemplateBuffer_, nullptr);
+	allocator_.free(drawTemplateBufferMemory_);
+	vkDestroyBuffer(logicalDevice_, indirectBuffer_, nullptr);
+	allocator_.free(indirectBufferMemory_);
+	vkDestroyBuffer(logicalDevice_, visibleInstanceBuffer_, nullptr);
+	allocator_.free(visibleInstanceBufferMemory_);
+	vkDestroyBuffer(logicalDevice_, drawCountBuffer_, nullptr);
+	allocator_.free(drawCountBufferMemory_);
 
 	// Destroy the vertex buffer
 	vkDestroyBuffer(logicalDevice_, vertexBuffer_, nullptr);
 
 	// After the vertex buffer is destroyed, we can then free the memory attached to it
-	vkFreeMemory(logicalDevice_, vertexBufferMemory_, nullptr);
+	allocator_.free(vertexBufferMemory_);
 
 	// Destroy the graphics pipeline
-	vkDestroyPipeline(logicalDevice_, gfxPipeline_, nullptr);
+	pipelines_.cleanup();
 
-	// Destroy the pipeline layout
+	// Destroy the pipeline layouts
 	vkDestroyPipelineLayout(logicalDevice_, pipelineLayout_, nullptr);
+	vkDestroyPipelineLayout(logicalDevice_, cullPipelineLayout_, nullptr);
 
 	// Destroy the render passs
 	vkDestroyRenderPass(logicalDevice_, renderPass_, nullptr);
 
 	// Destroy the sync objects we have
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-		vkDestroySemaphore(logicalDevice_, renderFinishedSemaphores_[i], nullptr);
-		vkDestroySemaphore(logicalDevice_, imageAvailableSemaphores_[i], nullptr);
-		vkDestroyFence(logicalDevice_, inFlightFences_[i], nullptr);
+	for (FrameContext& frame : frames_) {
+		vkDestroySemaphore(logicalDevice_, frame.renderFinishedSemaphore, nullptr);
+		vkDestroySemaphore(logicalDevice_, frame.imageAvailableSemaphore, nullptr);
 	}
 
 	// Don't forget to destroy the command pool
 	vkDestroyCommandPool(logicalDevice_, commandPool_, nullptr);
+	vkDestroyCommandPool(logicalDevice_, transferCommandPool_, nullptr);
+	recorder_.cleanup();
+	scene_.cleanup();
+
+	// The setup recorders wait for anything they still have in flight
+	setupCommands_.cleanup();
+	transferSetupCommands_.cleanup();
+
+	// Then the queues' timelines, once nothing is left that could signal them
+	graphicsTimeline_.cleanup();
+	transferTimeline_.cleanup();
+
+	// Give all the memory blocks back before the device goes away
+	allocator_.cleanup();
+
+	// Save the compiled pipelines for next launch
+	pipelineCache_.cleanup();
 
 	// Don't forget to destroy the logical device
 	vkDestroyDevice(logicalDevice_, nullptr);
@@ -400,16 +740,19 @@ void HelloTriangleApplication::cleanup() {
 	}
 
 	// Don't forget to destroy the surface
-	vkDestroySurfaceKHR(vkInstance_, surface_, nullptr);
+	if (!headless_)
+		vkDestroySurfaceKHR(vkInstance_, surface_, nullptr);
 
 	// Destroy the vulkan instance
 	vkDestroyInstance(vkInstance_, nullptr);
 
-	// Destroy the glfw window
-	glfwDestroyWindow(window_);
+	// Destroy the glfw window, headless runs never made one
+	if (!headless_) {
+		glfwDestroyWindow(window_);
 
-	// Terminate glfw
-	glfwTerminate();
+		// Terminate glfw
+		glfwTerminate();
+	}
 }
 
 void HelloTriangleApplication::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
@@ -428,9 +771,9 @@ bool HelloTriangleApplication::isDeviceSuitable(VkPhysicalDevice device) {
 	// Also get if the needed extensions are supported
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-	// Check if the device has good enough swap chain support
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	// Check if the device has good enough swap chain support. Offscreen images don't need one
+	bool swapChainAdequate = headless_;
+	if (extensionsSupported && !headless_) {
 		// Check that the swap chain has actual formats and presentation modes
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -449,7 +792,8 @@ bool HelloTriangleApplication::checkDeviceExtensionSupport(VkPhysicalDevice devi
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
 	// Create a set of all the required extensions
-	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+	std::vector<const char*> required = requiredDeviceExtensions();
+	std::set<std::string> requiredExtensions(required.begin(), required.end());
 
 	// Iterate over all the available extensions and remove from the set any that match
 	for (const auto& extension : availableExtensions) {
@@ -460,7 +804,20 @@ bool HelloTriangleApplication::checkDeviceExtensionSupport(VkPhysicalDevice devi
 	return requiredExtensions.empty();
 }
 
-// Function to help Vulkan pick a physical device
+// Headless runs never present, so they don't need the swap chain
+std::vector<const char*> HelloTriangleApplication::requiredDeviceExtensions() const {
+	if (headless_)
+		return {};
+	return deviceExtensions;
+}
+
+//*****************************************************************************
+//	Pick Physical Device
+//		Every device is scored by what it can do rather than by name, so
+//		integrated and mobile GPUs are used when they are all there is.
+//		Discrete GPUs still come first, then the higher tier, then the one
+//		with the most memory. An override picks a device by index or name
+//*****************************************************************************
 void HelloTriangleApplication::pickPhysicalDevice() {
 	// Get how many physical devices are available
 	uint32_t deviceCount = 0;
@@ -474,53 +831,142 @@ void HelloTriangleApplication::pickPhysicalDevice() {
 	std::vector<VkPhysicalDevice> devices(deviceCount);
 	vkEnumeratePhysicalDevices(vkInstance_, &deviceCount, devices.data());
 
-	// Rate the device suitability
-	std::multimap<int, VkPhysicalDevice> candidates;
+	// An override is an index if it is only digits, otherwise part of the name
+	bool overrideIsIndex = !deviceOverride_.empty() &&
+		std::all_of(deviceOverride_.begin(), deviceOverride_.end(), [](char c) { return c >= '0' && c <= '9'; });
+
+	// An index too big to parse can't be one of the devices, so it matches none of them
+	uint32_t overrideIndex = deviceCount;
+	if (overrideIsIndex) {
+		errno = 0;
+		unsigned long long index = std::strtoull(deviceOverride_.c_str(), nullptr, 10);
+		if (errno != ERANGE && index < deviceCount)
+			overrideIndex = static_cast<uint32_t>(index);
+	}
+	auto lower = [](std::string text) {
+		std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return text;
+	};
 
-	for (const auto& device : devices) {
+	// Rate every device, and list them so the override has something to go by
+	int bestScore = 0;
+	int bestDevice = -1;
+	std::vector<DeviceCapabilities> capabilities;
+	for (uint32_t i = 0; i < deviceCount; ++i) {
+		capabilities.push_back(queryDeviceCapabilities(devices[i]));
+		const DeviceCapabilities& device = capabilities.back();
 		int score = rateDeviceSuitability(device);
-		candidates.insert(std::make_pair(score, device));
-	}
-
-	// Check best candidate
-	if (candidates.rbegin()->first > 0) {
-		VkPhysicalDeviceProperties deviceProperties;
-		vkGetPhysicalDeviceProperties(candidates.rbegin()->second, &deviceProperties);
 
-		std::cout << "Selecting Device: " << deviceProperties.deviceName << std::endl;
-
-		vkPhysicalDevice_ = candidates.rbegin()->second;
+		std::cout << "  [" << i << "] " << device.name;
+		if (device.suitable)
+			std::cout << " (" << renderTierName(device.tier) << " tier, score " << score << ")" << std::endl;
+		else
+			std::cout << " (can't run the renderer)" << std::endl;
+
+		bool wanted = deviceOverride_.empty() ? score > bestScore :
+			overrideIsIndex ? i == overrideIndex :
+			bestDevice < 0 && lower(device.name).find(lower(deviceOverride_)) != std::string::npos;
+		if (wanted) {
+			bestScore = score;
+			bestDevice = static_cast<int>(i);
+		}
 	}
-	else {
+
+	if (bestDevice < 0) {
+		if (!deviceOverride_.empty())
+			throw std::runtime_error("No device matches " + deviceOverride_ + "!");
 		throw std::runtime_error("Failed to find a suitable GPU");
 	}
+	if (!capabilities[bestDevice].suitable) {
+		throw std::runtime_error(capabilities[bestDevice].name + " can't run the renderer!");
+	}
+
+	vkPhysicalDevice_ = devices[bestDevice];
+	deviceCapabilities_ = capabilities[bestDevice];
+	renderTier_ = std::min(deviceCapabilities_.tier, maxRenderTier_);
+
+	std::cout << "Selecting Device: " << deviceCapabilities_.name << " at the " << renderTierName(renderTier_) << " tier" << std::endl;
 }
 
-int HelloTriangleApplication::rateDeviceSuitability(VkPhysicalDevice device) {
+//*****************************************************************************
+//	Device Capabilities
+//		What the renderer can't run without decides whether a device is
+//		suitable: graphics and compute on one queue, presentation, Vulkan 1.2
+//		and timeline semaphores, which every submit is synchronized with.
+//		Everything else is optional and only decides the tier
+//*****************************************************************************
+DeviceCapabilities HelloTriangleApplication::queryDeviceCapabilities(VkPhysicalDevice device) {
+	DeviceCapabilities capabilities;
+
 	// Query the device properties
 	VkPhysicalDeviceProperties deviceProperties;
 	vkGetPhysicalDeviceProperties(device, &deviceProperties);
+	capabilities.name = deviceProperties.deviceName;
+	capabilities.type = deviceProperties.deviceType;
+
+	// Frames are paced with timeline semaphores, which need Vulkan 1.2
+	if (deviceProperties.apiVersion < VK_API_VERSION_1_2)
+		return capabilities;
 
 	// Query the device features
-	VkPhysicalDeviceFeatures deviceFeatures;
-	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-	
-	// Score of the device
-	int score = 0;
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+	VkPhysicalDeviceFeatures2 features2{};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device, &features2);
+
+	// Every indirect command after the first starts at its own nonzero firstInstance,
+	//	which is where the culling pass writes that command's visible instances
+	capabilities.suitable = vulkan12Features.timelineSemaphore && features2.features.drawIndirectFirstInstance &&
+		isDeviceSuitable(device);
+
+	// Indirect draws can be done one command per call without these, they just save calls
+	capabilities.multiDrawIndirect = features2.features.multiDrawIndirect == VK_TRUE;
+	capabilities.drawIndirectCount = vulkan12Features.drawIndirectCount == VK_TRUE;
+
+	// Bindless descriptors need runtime sized arrays that can be written while bound
+	//	and don't have to be full, for both sampled images and storage buffers
+	capabilities.bindless = vulkan12Features.descriptorIndexing && vulkan12Features.runtimeDescriptorArray &&
+		vulkan12Features.descriptorBindingPartiallyBound && vulkan12Features.descriptorBindingUpdateUnusedWhilePending &&
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind && vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind;
 
-	// Discrete GPUs are desireable
-	if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-		score += 1000;
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+	for (const auto& extension : extensions)
+		capabilities.memoryBudget |= strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(device, &memProperties);
+	for (uint32_t i = 0; i < memProperties.memoryHeapCount; ++i) {
+		if (memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			capabilities.deviceLocalMemory = std::max(capabilities.deviceLocalMemory, memProperties.memoryHeaps[i].size);
 	}
 
-	// Max size for textures
-	score += deviceProperties.limits.maxImageDimension2D;
+	if (capabilities.multiDrawIndirect)
+		capabilities.tier = capabilities.bindless ? RenderTier::High : RenderTier::Standard;
 
-	// Application can't run without shaders
-	if (!deviceFeatures.geometryShader)
+	return capabilities;
+}
+
+int HelloTriangleApplication::rateDeviceSuitability(const DeviceCapabilities& capabilities) {
+	if (!capabilities.suitable)
 		return 0;
 
-	return score;
+	// Discrete GPUs are desireable, but anything that can run the renderer will do
+	int typeRank = 0;
+	switch (capabilities.type) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: typeRank = 3; break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: typeRank = 2; break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: typeRank = 1; break;
+	default: break;
+	}
+
+	// Then the tier, then the memory in 64MB steps
+	int memoryRank = static_cast<int>(std::min<VkDeviceSize>(capabilities.deviceLocalMemory / (64ull * 1024 * 1024), 9999));
+	return 1 + typeRank * 100000 + static_cast<int>(capabilities.tier) * 10000 + memoryRank;
 }
 
 // Finding queue families
@@ -538,24 +984,41 @@ QueueFamilyIndices HelloTriangleApplication::findQueueFamilies(VkPhysicalDevice
 	// Find one family that supports graphics
 	int i = 0;
 	for (const auto& queueFamily : queueFamilies) {
-		// We want the graphics bit
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-			indices.graphicsFamily = i;
-		}
+		// Keep looking for graphics and present until we have both
+		if (!indices.isComplete()) {
+			// We want the graphics bit. The culling pass runs on the same queue,
+			//	so it needs the compute bit too
+			if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+				indices.graphicsFamily = i;
+			}
 
-		// Check for surface support
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-		if (presentSupport)
-			indices.presentFamily = i;
+			// Check for surface support. Headless runs present nothing, so the graphics family stands in
+			if (headless_) {
+				indices.presentFamily = indices.graphicsFamily;
+			}
+			else {
+				VkBool32 presentSupport = false;
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+				if (presentSupport)
+					indices.presentFamily = i;
+			}
+		}
 
-		// If we already found the graphics bit, break from loop
-		if (indices.isComplete())
-			break;
+		// Look for a family that can only do transfers. These usually map to the
+		//	DMA engines, which can copy while the graphics queue keeps rendering
+		const VkQueueFlags otherWork = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+		if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & otherWork)) {
+			if (!indices.transferFamily.has_value())
+				indices.transferFamily = i;
+		}
 
 		i++;
 	}
 
+	// No dedicated transfer family, graphics queues can always do transfers
+	if (!indices.transferFamily.has_value())
+		indices.transferFamily = indices.graphicsFamily;
+
 	return indices;
 }
 
@@ -565,7 +1028,7 @@ void HelloTriangleApplication::createLogicalDevice() {
 
 	// Need multiple create structs for multiple queue families
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value() };
 
 	float queuePriority = 1.0f;
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -578,12 +1041,62 @@ void HelloTriangleApplication::createLogicalDevice() {
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	// Define device features. We will come back to this later
+	// See which of the optional features the device has
+	VkPhysicalDeviceVulkan12Features supported12{};
+	supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+	VkPhysicalDeviceFeatures2 supported{};
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supported.pNext = &supported12;
+	vkGetPhysicalDeviceFeatures2(vkPhysicalDevice_, &supported);
+
+	// The tier decides which of the optional rendering paths are turned on
+	multiDrawIndirect_ = deviceCapabilities_.multiDrawIndirect && renderTier_ >= RenderTier::Standard;
+	drawIndirectCount_ = deviceCapabilities_.drawIndirectCount && renderTier_ >= RenderTier::Standard;
+	bindless_ = deviceCapabilities_.bindless && renderTier_ >= RenderTier::High;
+
+	// Profiling resets its queries from the CPU. Statistics around the render pass are
+	//	counted in secondary command buffers, so they have to be inheritable too
+	hostQueryReset_ = supported12.hostQueryReset == VK_TRUE;
+	pipelineStatistics_ = supported.features.pipelineStatisticsQuery && supported.features.inheritedQueries;
+
+	// A transfer only family doesn't have to support timestamps at all
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice_, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(vkPhysicalDevice_, &familyCount, families.data());
+	transferTimestamps_ = families[indices.transferFamily.value()].timestampValidBits != 0;
+
+	// Define device features
 	VkPhysicalDeviceFeatures deviceFeatures{};
+	deviceFeatures.multiDrawIndirect = multiDrawIndirect_ ? VK_TRUE : VK_FALSE;
+	deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+
+	// Compressed textures are only loaded in formats the device reports it can sample,
+	//	but the families still have to be turned on to be used
+	deviceFeatures.textureCompressionBC = supported.features.textureCompressionBC;
+	deviceFeatures.textureCompressionASTC_LDR = supported.features.textureCompressionASTC_LDR;
+	deviceFeatures.pipelineStatisticsQuery = pipelineStatistics_ ? VK_TRUE : VK_FALSE;
+	deviceFeatures.inheritedQueries = pipelineStatistics_ ? VK_TRUE : VK_FALSE;
+
+	// Vulkan 1.2 features are chained on. Every queue gets a timeline semaphore
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+	vulkan12Features.timelineSemaphore = VK_TRUE;
+	vulkan12Features.drawIndirectCount = drawIndirectCount_ ? VK_TRUE : VK_FALSE;
+	vulkan12Features.hostQueryReset = supported12.hostQueryReset;
+	if (bindless_) {
+		vulkan12Features.descriptorIndexing = VK_TRUE;
+		vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+		vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+		vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+	}
 	
 	// Now moving on to creating the actual logical device
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &vulkan12Features;
 
 	// Specify the queue creation info and what features to enable
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
@@ -600,17 +1113,67 @@ void HelloTriangleApplication::createLogicalDevice() {
 		createInfo.enabledLayerCount = 0;
 	}
 
-	// Specify any extensions
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	// Specify any extensions. The memory budget extension is optional,
+	//	without it texture streaming only goes by its own budget
+	std::vector<const char*> enabledExtensions = requiredDeviceExtensions();
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(vkPhysicalDevice_, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(vkPhysicalDevice_, nullptr, &extensionCount, availableExtensions.data());
+	bool presentIdExtension = false;
+	bool presentWaitExtension = false;
+	for (const auto& extension : availableExtensions) {
+		if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+			enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			memoryBudget_ = true;
+		}
+		presentIdExtension |= strcmp(extension.extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0;
+		presentWaitExtension |= strcmp(extension.extensionName, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0;
+	}
+
+	// Present wait is optional too. It needs present ids to say which present to wait for,
+	//	and only means anything with a swap chain
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+	presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+	presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	if (!headless_ && presentIdExtension && presentWaitExtension) {
+		presentIdFeatures.pNext = &presentWaitFeatures;
+		VkPhysicalDeviceFeatures2 presentFeatures{};
+		presentFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		presentFeatures.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(vkPhysicalDevice_, &presentFeatures);
+
+		presentWait_ = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+		if (presentWait_) {
+			enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			vulkan12Features.pNext = &presentIdFeatures;
+		}
+	}
+
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 	// Now create the device
 	if (vkCreateDevice(vkPhysicalDevice_, &createInfo, nullptr, &logicalDevice_) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create logical device!");
 
+	// Extension functions have to be looked up on the device
+	if (presentWait_)
+		waitForPresent_ = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(logicalDevice_, "vkWaitForPresentKHR"));
+
 	// Get the graphics queue and present queue from the device
 	vkGetDeviceQueue(logicalDevice_, indices.graphicsFamily.value(), 0, &graphicsQueue_);
 	vkGetDeviceQueue(logicalDevice_, indices.presentFamily.value(), 0, &presentQueue_);
+
+	// Also get the queue the uploads go on. May be the graphics queue if there is no transfer family
+	vkGetDeviceQueue(logicalDevice_, indices.transferFamily.value(), 0, &transferQueue_);
+
+	// Every submit to a queue goes through its timeline. If the transfer family is the
+	//	graphics family the queues are the same, but the counters are still kept apart
+	graphicsTimeline_.init(logicalDevice_, graphicsQueue_);
+	transferTimeline_.init(logicalDevice_, transferQueue_);
 }
 
 void HelloTriangleApplication::createSurface() {
@@ -669,9 +1232,10 @@ VkPresentModeKHR HelloTriangleApplication::chooseSwapPresentMode(const std::vect
 	// mailbox (triple buffering)
 	// Ideal is mailbox if energy consumption is not a concern
 
-	// Find that one of the available modes is mailbox.
+	// Mailbox is the default, but the present policy picks. IMMEDIATE and FIFO_RELAXED tear
+	//	for lower latency, FIFO waits for vblank and uses the least power
 	for (const auto& mode : availablePresentModes) {
-		if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+		if (mode == presentPolicy_.mode) {
 			return mode;
 		}
 	}
@@ -709,7 +1273,7 @@ VkExtent2D HelloTriangleApplication::chooseSwapExtent(const VkSurfaceCapabilitie
 }
 
 // Create a swap chain
-void HelloTriangleApplication::createSwapChain() {
+void HelloTriangleApplication::createSwapChain(VkSwapchainKHR oldSwapChain) {
 	// Get swap chain support details
 	SwapChainSupportDetails swapChainSupport = querySwapChainSupport(vkPhysicalDevice_);
 
@@ -719,8 +1283,11 @@ void HelloTriangleApplication::createSwapChain() {
 	VkExtent2D extents = chooseSwapExtent(swapChainSupport.capabilities);
 
 	// Also figure out how many images will be in the swap chain
-	// recommended to always get one more than the minimum
+	// recommended to always get one more than the minimum, unless the present policy says.
+	//	Fewer images means less queued up ahead of the display
 	uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+	if (presentPolicy_.imageCount != 0)
+		imageCount = std::max(presentPolicy_.imageCount, swapChainSupport.capabilities.minImageCount);
 
 	// Also make sure the maximum is not being exceeded
 	// (A maximum of zero means no limit)
@@ -772,8 +1339,9 @@ void HelloTriangleApplication::createSwapChain() {
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
 	
-	// Null for now, but needs to be handled if the screen is resized
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// The swap chain being replaced, if any. The driver can hand its resources over,
+	//	and whatever was already presented from it still goes out
+	createInfo.oldSwapchain = oldSwapChain;
 
 	// Now try to create the swapchain
 	if (vkCreateSwapchainKHR(logicalDevice_, &createInfo, nullptr, &swapChain_) != VK_SUCCESS) {
@@ -790,6 +1358,24 @@ void HelloTriangleApplication::createSwapChain() {
 	swapChainExtent_ = extents;
 }
 
+//*****************************************************************************
+//	Offscreen Images
+//		What a headless run renders into instead of a swap chain. One image
+//		per frame in flight, so the frame's timeline wait also means its image
+//		is free again, the same job acquiring an image does
+//*****************************************************************************
+void HelloTriangleApplication::createOffscreenImages() {
+	swapChainImageFormat_ = OFFSCREEN_FORMAT;
+	swapChainExtent_ = { WIDTH, HEIGHT };
+
+	swapChainImages_.resize(framesInFlight_);
+	offscreenMemory_.resize(framesInFlight_);
+	for (uint32_t i = 0; i < framesInFlight_; ++i) {
+		createImage(WIDTH, HEIGHT, 1, OFFSCREEN_FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages_[i], offscreenMemory_[i]);
+	}
+}
+
 void HelloTriangleApplication::createImageViews() {
 	// Start with resizing the vector to how many images are in the swapchain
 	swapChainImageViews_.resize(swapChainImages_.size());
@@ -828,179 +1414,187 @@ void HelloTriangleApplication::createImageViews() {
 	}
 }
 
-void HelloTriangleApplication::createGraphicsPipeline() {
-	// Pull the code 
-	auto vertShaderCode = readFile("data/shaders/vert.spv");
-	auto fragShaderCode = readFile("data/shaders/frag.spv");
-
-	// Create the shader modules
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-	// Creation info for the vertex stage
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main"; // Entrypoint of the shader
-	// pSpecializationInfo allows specifying values for shader constants
-
-	// Creation info for the fragment stage
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main"; // Entrypoint of the shader
-
-	// Now create an array with these shader stages
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	//****************************************************************************
-	//	Dynamic State Creation information
-	//****************************************************************************
-	std::vector<VkDynamicState> dynamicStates = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR
-	};
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-	dynamicState.pDynamicStates = dynamicStates.data();
-
-	//****************************************************************************
-	//	Vertex Input State Creation information
-	//****************************************************************************
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-	// Getting binding and attribute descriptions for this pipeline
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-	// Spacing between data and whether data is per-vertex or per-instance (instancing)
-	// Optional
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-
-	// Type of attributes passed to vertex shader, what binding they associate to, and at which offset.
-	// Optional
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-	//****************************************************************************
-	//	Input Assembly State Creation information
-	//****************************************************************************
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-
-	// What kind of geometry will be drawn. Examples: Point List, Line List, Line Strip, triangle list, triangle strip, etc.
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-
-	// if true, can break up inputs for the Strip topologies
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	//****************************************************************************
-	//	Viewports and Scissors
-	//****************************************************************************
-	VkViewport viewport{};
-	
-	// These will almost always be the values for a viewport
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float) swapChainExtent_.width;
-	viewport.height = (float)swapChainExtent_.height;
-
-	// These must always be between 0 and 1
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	// Scissor will discard any pixels outside of a range
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapChainExtent_;
-
-	// We can make viewport and scissors static or dynamic. Dynamic is more desireable, but will be static for now
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	//****************************************************************************
-	//	Rasterizer
-	//		Vertex to Fragment. Runs Depth tests, face culling, and scissor test.
-	//		Can also output fragments that fill entire polys or just edges, like
-	//			wireframe rendering.
-	//****************************************************************************
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-
-	// If true, fragments outside near and far planes are clamped instead of discarded
-	// Useful for shadow maps. Required a GPU feature to be enabled
-	rasterizer.depthClampEnable = VK_FALSE;
-
-	// If true, geometry never passed through rasterizer stage. Essentially disabled output to framebuffer
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+//*****************************************************************************
+//	Attachment Formats
+//		Pick the MSAA sample count both color and depth support, and the
+//		depth format
+//*****************************************************************************
+void HelloTriangleApplication::chooseAttachmentFormats() {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkPhysicalDevice_, &properties);
+
+	// Highest count that both kinds of attachment support, up to the max
+	VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+	msaaSamples_ = VK_SAMPLE_COUNT_1_BIT;
+	for (VkSampleCountFlagBits samples = MAX_MSAA_SAMPLES; samples > VK_SAMPLE_COUNT_1_BIT;
+		samples = static_cast<VkSampleCountFlagBits>(samples >> 1)) {
+		if (counts & samples) {
+			msaaSamples_ = samples;
+			break;
+		}
+	}
 
-	// How fragments are generated for geometry. Modes available are:
-	//	Fill - fill area of polygon with fragments
-	//	Line - polygon edges are drawn as lines
-	//	Point - polygon vertices are drawn as points
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	// The subpass resolves into the single sampled image, which needs more than one sample to resolve from
+	if (msaaSamples_ == VK_SAMPLE_COUNT_1_BIT) {
+		throw std::runtime_error("Device doesn't support multisampled color and depth attachments!");
+	}
 
-	// Straight forward. Any line thicker than 1.0f required wideLines GPU feature enabled
-	rasterizer.lineWidth = 1.0f;
+	// First depth format that can be an optimal tiled depth attachment
+	depthFormat_ = VK_FORMAT_UNDEFINED;
+	for (VkFormat format : DEPTH_FORMATS) {
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice_, format, &formatProperties);
+		if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			depthFormat_ = format;
+			break;
+		}
+	}
 
-	// Cull mode and what the rasterizer considered front facing
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	// TODO: THIS SHOULD BE COUNTER CLOCK-WISE. RIGHT HAND RULE!!!
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	if (depthFormat_ == VK_FORMAT_UNDEFINED) {
+		throw std::runtime_error("Failed to find a supported depth format!");
+	}
+}
 
-	// Rasterizer can change depth values by biasing them with constant values
-	//	or biasing them based on a fragment's slope
-	rasterizer.depthBiasEnable = VK_FALSE;
-	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-	rasterizer.depthBiasClamp = 0.0f; // Optional
-	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional;
+//*****************************************************************************
+//	Render Graph
+//		The frame's passes and what each of them uses. The graph puts the
+//		barriers between them, so recording a pass is only its commands.
+//		The multisampled color and the depth are the graph's transient
+//		images: they are only attachments, so they are TRANSIENT with lazily
+//		allocated memory where the device has it, and on tilers never leave
+//		tile memory. Built again whenever the swap chain is
+//*****************************************************************************
+void HelloTriangleApplication::buildRenderGraph() {
+	renderGraph_ = std::make_unique<RenderGraph>();
+	renderGraph_->init(vkPhysicalDevice_, logicalDevice_, allocator_);
+
+	// The acquire semaphore is waited on at the color attachment stage, so the first barrier
+	//	starts there. Offscreen images are left as they were drawn
+	backbuffer_ = renderGraph_->importImage("Backbuffer", VK_IMAGE_ASPECT_COLOR_BIT, ResourceUsage::ColorAttachment,
+		headless_ ? ResourceUsage::ColorAttachment : ResourceUsage::Present);
+
+	// Each frame writes its own slice of these, so nothing from earlier frames needs waiting on
+	RenderGraph::Resource drawCommands = renderGraph_->importBuffer("Draw commands");
+	RenderGraph::Resource visibleInstances = renderGraph_->importBuffer("Visible instances");
+	RenderGraph::Resource drawCounts = renderGraph_->importBuffer("Draw counts");
+
+	RenderGraphImageDesc colorDesc{};
+	colorDesc.extent = swapChainExtent_;
+	colorDesc.format = swapChainImageFormat_;
+	colorDesc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	colorDesc.samples = msaaSamples_;
+	colorDesc.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	sceneColor_ = renderGraph_->createImage("Scene color", colorDesc);
+
+	// Depth and stencil formats have to be viewed with both aspects to be an attachment
+	RenderGraphImageDesc depthDesc = colorDesc;
+	depthDesc.format = depthFormat_;
+	depthDesc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (depthFormat_ != VK_FORMAT_D32_SFLOAT)
+		depthDesc.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	sceneDepth_ = renderGraph_->createImage("Scene depth", depthDesc);
+
+	// Uploads hand their resources over with their own barriers, and textures aren't in the graph
+	uint32_t uploads = renderGraph_->addPass("Uploads", [this](VkCommandBuffer commandBuffer) {
+		uint32_t uploadScope = profiler_.beginGpuScope(commandBuffer, "Acquire uploads and mipmaps");
+		stagingRing_.recordAcquireBarriers(commandBuffer);
+		recordMipmapGeneration(commandBuffer);
+		profiler_.endGpuScope(commandBuffer, uploadScope);
+	});
+	renderGraph_->setSideEffects(uploads);
+
+	uint32_t reset = renderGraph_->addPass("Reset draws", [this](VkCommandBuffer commandBuffer) { recordDrawReset(commandBuffer); });
+	renderGraph_->use(reset, drawCommands, ResourceUsage::TransferWrite);
+
+	// The shader adds to the instance counts the reset wrote
+	uint32_t culling = renderGraph_->addPass("Culling", [this](VkCommandBuffer commandBuffer) {
+		uint32_t cullScope = profiler_.beginGpuScope(commandBuffer, "Culling", true);
+		recordCulling(commandBuffer);
+		profiler_.endGpuScope(commandBuffer, cullScope);
+	});
+	renderGraph_->use(culling, drawCommands, ResourceUsage::ComputeWrite);
+	renderGraph_->use(culling, visibleInstances, ResourceUsage::ComputeWrite);
+
+	// Only the draw count path skips commands, the others draw the empty ones as they are
+	if (drawIndirectCount_) {
+		uint32_t compaction = renderGraph_->addPass("Compact draws", [this](VkCommandBuffer commandBuffer) {
+			uint32_t compactScope = profiler_.beginGpuScope(commandBuffer, "Compact draws");
+			recordDrawCompaction(commandBuffer);
+			profiler_.endGpuScope(commandBuffer, compactScope);
+		});
+		renderGraph_->use(compaction, drawCommands, ResourceUsage::ComputeWrite);
+		renderGraph_->use(compaction, drawCounts, ResourceUsage::ComputeWrite);
+	}
+
+	uint32_t scene = renderGraph_->addPass("Scene", [this](VkCommandBuffer commandBuffer) { recordScene(commandBuffer); });
+	renderGraph_->use(scene, drawCommands, ResourceUsage::IndirectRead);
+	if (drawIndirectCount_)
+		renderGraph_->use(scene, drawCounts, ResourceUsage::IndirectRead);
+	renderGraph_->use(scene, visibleInstances, ResourceUsage::VertexRead);
+	renderGraph_->use(scene, sceneColor_, ResourceUsage::ColorAttachment);
+	renderGraph_->use(scene, sceneDepth_, ResourceUsage::DepthAttachment);
+	renderGraph_->use(scene, backbuffer_, ResourceUsage::ColorAttachment);
+
+	renderGraph_->compile();
+}
 
+void HelloTriangleApplication::createGraphicsPipeline() {
 	//****************************************************************************
-	//	Multisampling
-	//		Helps with Anti-Aliasing. Combines fragment shader results of
-	//		multiple polygons that rasterize to same pixel.
-	// 
-	//		We will return to this later
+	//	Pipeline Layout
+	//		Uniform variables must be specified at creation time of a pipeline
+	//		Even if you don't have uniform variables, you are required to create
+	//		this layout
 	//****************************************************************************
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampling.minSampleShading = 1.0f; // Optional
-	multisampling.pSampleMask = nullptr; // Optional
-	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-	multisampling.alphaToOneEnable = VK_FALSE; // Optional
+	// Push constants are small bits of data recorded straight into the command
+	//	buffer. Each object's transform goes through them, so drawing another
+	//	object doesn't need another descriptor set
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = OBJECT_CONSTANT_STAGES;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(ObjectConstants);
+
+	// We are specifying a uniform layout. The bindless set goes after it, the same
+	//	for every pipeline, so it stays bound no matter what gets drawn
+	std::vector<VkDescriptorSetLayout> setLayouts = { descriptorSetLayout_ };
+	if (bindless_)
+		setLayouts.push_back(bindlessHeap_.layout());
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size()); // Optional
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data(); // Optional
+	pipelineLayoutInfo.pushConstantRangeCount = 1; // Optional
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange; // Optional
 
-	//****************************************************************************
-	//	Depth and Stencil Testing
-	//		We will return to this later
-	//****************************************************************************
+	if (vkCreatePipelineLayout(logicalDevice_, &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
 
 	//****************************************************************************
-	//	Color Blending
-	//		Returned color from fragment shader needs to be combined with the
-	//		color already in the FrameBuffer. Two ways to do this:
-	//			1. Mix old and new value for a final color
-	//			2. Combine the old and new value using a bitwise operation
-	//		There are also two struct types for color blending:
-	//			1. Attachment State, which configures per each frame buffer.
-	//			2. CreateInfo, which configured global color blending
+	//	Graphics Pipeline
+	//		Everything else about the pipeline goes in its description. The
+	//		manager builds the fixed function state out of it, and hands back
+	//		the same pipeline for the same description
 	//****************************************************************************
+	basePipelineDesc_ = PipelineDesc{};
+	basePipelineDesc_.vertexShader = sceneShaders()[0];
+	basePipelineDesc_.fragmentShader = sceneShaders()[1];
+
+	// Spacing between data and whether data is per-vertex or per-instance (instancing),
+	//	and the type of attributes passed to vertex shader
+	//	Binding 0 is per-vertex, binding 1 is per-instance
+	basePipelineDesc_.bindings = { Vertex::getBindingDescription(), InstanceData::getBindingDescription() };
+	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto instanceAttributes = InstanceData::getAttributeDescriptions();
+	basePipelineDesc_.attributes.assign(attributeDescriptions.begin(), attributeDescriptions.end());
+	basePipelineDesc_.attributes.insert(basePipelineDesc_.attributes.end(), instanceAttributes.begin(), instanceAttributes.end());
 
-	// We only have one Frame Buffer, so we will create one Attachment State
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask =
-		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	// Draw with the render pass's samples, and keep the nearest fragment
+	basePipelineDesc_.samples = msaaSamples_;
+	basePipelineDesc_.depthTestEnable = VK_TRUE;
+	basePipelineDesc_.depthWriteEnable = VK_TRUE;
+	basePipelineDesc_.depthCompareOp = VK_COMPARE_OP_LESS;
 
 	// Pseudo code of how the blending works:
 	/*
@@ -1015,108 +1609,92 @@ void HelloTriangleApplication::createGraphicsPipeline() {
 		finalColor = finalColor & colorWriteMask;
 	*/
 	// This implements alpha blending
-	colorBlendAttachment.blendEnable = VK_TRUE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;           // Optional | Factor of using the new color
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA; // Optional | Factor of using the old color
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional | What operation to do when blending the colors
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;  // Optional | Factor of using the new alpha
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional | Factor of using the old alpha
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional | What operation to do when blending the alpha
-
-	// Now we create the actual blend state
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-
-	// Allows the use of bitwise combination for blending. 
-	// Note: If enabled, will treat blendEnable as VK_FALSE
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f; // Optional
-	colorBlending.blendConstants[1] = 0.0f; // Optional
-	colorBlending.blendConstants[2] = 0.0f; // Optional
-	colorBlending.blendConstants[3] = 0.0f; // Optional
+	basePipelineDesc_.blendEnable = VK_TRUE;
+	basePipelineDesc_.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;           // Factor of using the new color
+	basePipelineDesc_.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA; // Factor of using the old color
+	basePipelineDesc_.colorBlendOp = VK_BLEND_OP_ADD;                            // What operation to do when blending the colors
+	basePipelineDesc_.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;                 // Factor of using the new alpha
+	basePipelineDesc_.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;                // Factor of using the old alpha
+	basePipelineDesc_.alphaBlendOp = VK_BLEND_OP_ADD;                            // What operation to do when blending the alpha
+
+	// The base pipeline has every feature the device can do, so it draws any object
+	//	correctly while the object's own permutation is still compiling
+	basePipelineDesc_.features = SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_INSTANCE_COLOR;
+	if (bindless_)
+		basePipelineDesc_.features |= SHADER_FEATURE_TEXTURED;
+
+	// Specify the pipeline layout (uniform variables) and the render pass and subpass
+	basePipelineDesc_.layout = pipelineLayout_;
+	basePipelineDesc_.renderPass = renderPass_;
+	basePipelineDesc_.subpass = 0;
+
+	// The base pipeline is compiled right away, it is also what gets drawn with
+	//	while any other pipeline is still compiling on the workers
+	gfxPipeline_ = pipelines_.get(basePipelineDesc_);
+
+	// Every other permutation differs only in its features. Start compiling the ones
+	//	this device can use, objects pick theirs while recording
+	for (uint32_t features = 0; features < permutationDescs_.size(); ++features) {
+		permutationDescs_[features] = basePipelineDesc_;
+		permutationDescs_[features].features = features;
+		if ((features & ~basePipelineDesc_.features) == 0 && features != basePipelineDesc_.features)
+			pipelines_.precompile(permutationDescs_[features]);
+	}
+}
 
-	//****************************************************************************
-	//	Pipeline Layout
-	//		Uniform variables must be specified at creation time of a pipeline
-	//		Even if you don't have uniform variables, you are required to create
-	//		this layout
-	//****************************************************************************
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+// Vertex and fragment shader the scene is drawn with
+std::array<std::string, 2> HelloTriangleApplication::sceneShaders() const {
+	// Shaders built with -DBINDLESS read the texture out of the bindless set
+	if (bindless_)
+		return { "data/shaders/vert_bindless.spv", "data/shaders/frag_bindless.spv" };
 
-	// We are specifying a uniform layout
-	pipelineLayoutInfo.setLayoutCount = 1; // Optional
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_; // Optional
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+	return { "data/shaders/vert.spv", "data/shaders/frag.spv" };
+}
 
-	if (vkCreatePipelineLayout(logicalDevice_, &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
+//*****************************************************************************
+//	Reload Changed Shaders
+//		Rebuilds the pipelines made from any shader that was compiled again
+//		since last frame. Only the shader code can change this way, the set
+//		and pipeline layouts stay what they were made as, so a shader that
+//		now needs something else is skipped until the next launch.
+//*****************************************************************************
+void HelloTriangleApplication::reloadChangedShaders() {
+	bool reloaded = false;
+	for (const std::string& shader : shaderWatcher_.poll()) {
+		ShaderReflection reflection;
+		try {
+			reflection = reflectShaderFile(shader);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Can't reload " << shader << ": " << e.what() << std::endl;
+			continue;
+		}
 
-	//****************************************************************************
-	//	Graphics Pipeline
-	//		Now that we have everything set up, we can actually create a
-	//		graphics pipeline
-	//****************************************************************************
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-
-	// Specify how many shader stages there will be
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-
-	// Specify all the fixed functions
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr; // Optional
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = &dynamicState;
-
-	// Specify the pipeline layout (uniform variables)
-	pipelineInfo.layout = pipelineLayout_;
-
-	// Specify the render pass and subpasses
-	pipelineInfo.renderPass = renderPass_;
-	pipelineInfo.subpass = 0; // Index of the subpass
-
-	// This allows for deriving a pipeline from a base pipeline
-	// Also only used if VK_PIPELINE_CREATE_DERIVATIVE_BIT flag is specified in create info
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-	pipelineInfo.basePipelineIndex = -1; // Optional
-
-	// Now create the graphics pipeline
-	if (vkCreateGraphicsPipelines(logicalDevice_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &gfxPipeline_) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create Graphics Pipeline!");
-	}
-	
-	// Don't forget to destroy the shader modules
-	vkDestroyShaderModule(logicalDevice_, fragShaderModule, nullptr);
-	vkDestroyShaderModule(logicalDevice_, vertShaderModule, nullptr);
-}
-
-VkShaderModule HelloTriangleApplication::createShaderModule(const std::vector<char>& code) {
-	// Start the creation information of the shader module
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		// Set 0 has to fit the layout it was made for. The scene shaders can also use
+		//	the bindless set, which isn't reflected, and culling only pushes its phase
+		bool compute = (reflection.stage == VK_SHADER_STAGE_COMPUTE_BIT);
+		uint32_t setCount = (!compute && bindless_) ? 2 : 1;
+		uint32_t pushConstantSpace = static_cast<uint32_t>(compute ? sizeof(uint32_t) : sizeof(ObjectConstants));
+		bool fits = matchesSetLayout(reflection, 0, compute ? cullSetBindings_ : descriptorSetBindings_) &&
+			reflection.pushConstantSize <= pushConstantSpace &&
+			std::all_of(reflection.bindings.begin(), reflection.bindings.end(),
+				[setCount](const ShaderBinding& binding) { return binding.set < setCount; });
+		if (!fits) {
+			std::cerr << shader << " changed its descriptors or push constants, restart to use it" << std::endl;
+			continue;
+		}
 
-	// Create the shader module
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(logicalDevice_, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create shader module!");
+		// Frames already submitted may still be using the old pipelines
+		size_t count = pipelines_.reload(shader, graphicsTimeline_.submittedValue());
+		std::cout << "Reloaded " << shader << " (" << count << " pipelines)" << std::endl;
+		reloaded = reloaded || count > 0;
 	}
 
-	// Return the shader module
-	return shaderModule;
+	// The handles in the manager were swapped, pick the new ones up
+	if (reloaded) {
+		gfxPipeline_ = pipelines_.get(basePipelineDesc_);
+		cullPipeline_ = pipelines_.getCompute(CULL_SHADER, cullPipelineLayout_);
+	}
 }
 
 //*****************************************************************************
@@ -1131,11 +1709,13 @@ VkShaderModule HelloTriangleApplication::createShaderModule(const std::vector<ch
 void HelloTriangleApplication::createRenderPass() {
 	//****************************************************************************
 	//	Color Attachment
-	//		Describe the color attachment in the render pass
+	//		Describe the color attachment in the render pass. Everything is
+	//		drawn into the multisampled color, which the subpass resolves into
+	//		the swap chain image at its end
 	//****************************************************************************
 	VkAttachmentDescription colorAttachment{};
 	colorAttachment.format = swapChainImageFormat_;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.samples = msaaSamples_;
 
 	// What to do with the data in attachment before rendering:
 	//	LOAD - Preserve existing contents of attachment
@@ -1146,7 +1726,9 @@ void HelloTriangleApplication::createRenderPass() {
 	// What to do with the data in attachment after rendering
 	//	STORE - Rendered contents stored in memory and can be read later
 	//	DONT_CARE - Contents of framebuffer undefined after rendering operation
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	// Only the resolved samples are needed after the subpass, so the samples themselves never
+	//	have to be written out of tile memory
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
 	// Applies to stencil data. Since we are not using stencil, don't care.
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -1159,13 +1741,47 @@ void HelloTriangleApplication::createRenderPass() {
 	//	TRANSFER_DST_OPTIMAL - Image is used as destination for memory copy operation
 
 	// Layout of the image before render pass starts
-	// We don't care what the image layout was before, so UNDEFINED
-	// Undefined does mean that contents are not guaranteed to be preserved, but we are clearing it anyways
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	// The render graph puts every attachment into its layout before the render pass
+	//	(from UNDEFINED, since it is cleared anyways), so the render pass doesn't transition anything
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-	// Layout of the image after render pass
-	// We want the image to be ready for presentation, so PRESENT_SRC_KHR
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// It never leaves the render pass, so it stays a color attachment
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	//****************************************************************************
+	//	Depth Attachment
+	//		Same samples as the color. Cleared on load and thrown away at the
+	//		end, the next frame doesn't need this one's depth
+	//****************************************************************************
+	VkAttachmentDescription depthAttachment{};
+	depthAttachment.format = depthFormat_;
+	depthAttachment.samples = msaaSamples_;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	//****************************************************************************
+	//	Resolve Attachment
+	//		The swap chain image. Every pixel is written by the resolve, so
+	//		what was there before doesn't matter
+	//****************************************************************************
+	VkAttachmentDescription resolveAttachment{};
+	resolveAttachment.format = swapChainImageFormat_;
+	resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	// The render graph moves it on to PRESENT_SRC_KHR after the render pass
+	resolveAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	// Indices match the framebuffer's attachments
+	std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, resolveAttachment };
 
 	//****************************************************************************
 	//	Subpasses & Attachment Refs.
@@ -1177,9 +1793,17 @@ void HelloTriangleApplication::createRenderPass() {
 
 	// Each subpass references one or more attachments
 	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0; // We only have one attachment, so index is zero
+	colorAttachmentRef.attachment = 0;
 	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // Attachment is a color buffer
 
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference resolveAttachmentRef{};
+	resolveAttachmentRef.attachment = 2;
+	resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
 	// Subpass Description, make sure it is known as a graphics subpass
 	VkSubpassDescription subpass{};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -1189,10 +1813,15 @@ void HelloTriangleApplication::createRenderPass() {
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentRef;
 
+	// A subpass only has one depth attachment, so there is no count
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	// Resolving at the end of the subpass lets tilers resolve straight out of tile memory,
+	//	instead of writing every sample out and resolving with another pass
+	subpass.pResolveAttachments = &resolveAttachmentRef;
+
 	// Other attachments that can be referenced by a subpass include:
 	//	pInputAttachments - Attachments read from a shader
-	//	pResolveAttachments - used for multisampling color attachments
-	//	pDepthStencilAttachment - from depth and stencil data
 	//	pPreserveAttachments - not used by this subpass, but data must be preserved
 
 	//****************************************************************************
@@ -1201,8 +1830,8 @@ void HelloTriangleApplication::createRenderPass() {
 	//****************************************************************************
 	VkRenderPassCreateInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
 
@@ -1211,23 +1840,10 @@ void HelloTriangleApplication::createRenderPass() {
 	//		- Subpasses in a render pass take care of image layout transitions,
 	//			these transitions controlled by subpass dependencies
 	//		- Specified memory and execution dependencies between subpasses
-	//		- Doing this because we need to wait to acquire the image before we
-	//			render
+	//		- There are none here: the render graph's barrier in front of the
+	//			render pass waits for the acquire, the culling writes and the
+	//			last frame's use of the shared attachments all at once
 	//*****************************************************************************
-	VkSubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL; // Implicit subpass before the render pass
-	dependency.dstSubpass = 0; // This is our subpass
-
-	// We wait for our swap chain to finish reading from the color attachment
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-
-	// Wait until the color attachment is fully written to
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
 
 	// Create the render pass
 	if (vkCreateRenderPass(logicalDevice_, &renderPassInfo, nullptr, &renderPass_) != VK_SUCCESS) {
@@ -1245,7 +1861,10 @@ void HelloTriangleApplication::createFramebuffers() {
 	// Iterate over the image views and make framebuffers for them
 	for (size_t i = 0; i < swapChainImageViews_.size(); ++i) {
 		// Array for the frame buffer to know that vk images they should be bound to
-		VkImageView attachments[] = {
+		// Every framebuffer draws into the same multisampled color and depth, only what they resolve into differs
+		std::array<VkImageView, 3> attachments = {
+			renderGraph_->view(sceneColor_),
+			renderGraph_->view(sceneDepth_),
 			swapChainImageViews_[i]
 		};
 
@@ -1257,8 +1876,8 @@ void HelloTriangleApplication::createFramebuffers() {
 		framebufferInfo.renderPass = renderPass_;
 
 		// How many attachments is this frame buffer using
-		framebufferInfo.attachmentCount = 1;
-		framebufferInfo.pAttachments = attachments;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferInfo.pAttachments = attachments.data();
 
 		// Width and height of the framebuffer
 		framebufferInfo.width = swapChainExtent_.width;
@@ -1297,14 +1916,33 @@ void HelloTriangleApplication::createCommandPool() {
 	if (vkCreateCommandPool(logicalDevice_, &poolInfo, nullptr, &commandPool_) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create command pool!");
 	}
+
+	// Command buffers for the transfer queue need a pool from the transfer family.
+	//	They are short lived, so they are also TRANSIENT
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
+	if (vkCreateCommandPool(logicalDevice_, &poolInfo, nullptr, &transferCommandPool_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create transfer command pool!");
+	}
+}
+
+//*****************************************************************************
+//	Creation of the setup command recorders
+//		Setup work is recorded into these and only submitted on a flush,
+//		instead of a submit and wait for every operation
+//*****************************************************************************
+void HelloTriangleApplication::createSetupCommands() {
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(vkPhysicalDevice_);
+	setupCommands_.init(logicalDevice_, graphicsTimeline_, queueFamilyIndices.graphicsFamily.value());
+	transferSetupCommands_.init(logicalDevice_, transferTimeline_, queueFamilyIndices.transferFamily.value());
 }
 
 //*****************************************************************************
 //	Creation of command buffer
 //*****************************************************************************
 void HelloTriangleApplication::createCommandBuffers() {
-	// Resize the command buffer vector to how many frames we want to handle
-	commandBuffers_.resize(MAX_FRAMES_IN_FLIGHT);
+	// One command buffer for each frame we want to handle
+	std::vector<VkCommandBuffer> commandBuffers(framesInFlight_);
 
 	// Creation struct
 	VkCommandBufferAllocateInfo allocInfo{};
@@ -1319,13 +1957,33 @@ void HelloTriangleApplication::createCommandBuffers() {
 	// Useful for common operations that are always reused
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 
-	// We are only allocating one command buffer
-	allocInfo.commandBufferCount = (uint32_t)commandBuffers_.size();
+	// Allocate all of the frames' command buffers at once
+	allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
 
 	// Now actually create the command buffer
-	if (vkAllocateCommandBuffers(logicalDevice_, &allocInfo, commandBuffers_.data()) != VK_SUCCESS) {
+	if (vkAllocateCommandBuffers(logicalDevice_, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to allocate command buffers!");
 	}
+
+	for (uint32_t i = 0; i < framesInFlight_; ++i) {
+		frames_[i].commandBuffer = commandBuffers[i];
+	}
+
+	// Each frame also gets a command buffer on the transfer queue for any uploads streamed in that frame
+	allocInfo.commandPool = transferCommandPool_;
+	if (vkAllocateCommandBuffers(logicalDevice_, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate transfer command buffers!");
+	}
+
+	for (uint32_t i = 0; i < framesInFlight_; ++i) {
+		frames_[i].transferCommandBuffer = commandBuffers[i];
+	}
+
+	// The draws themselves get recorded into secondary command buffers on every core.
+	//	Each recording thread gets a pool per frame from the graphics family
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(vkPhysicalDevice_);
+	recorder_.init(logicalDevice_, queueFamilyIndices.graphicsFamily.value(), std::thread::hardware_concurrency(), framesInFlight_,
+		MIN_OBJECTS_PER_RECORDING_THREAD);
 }
 
 //*****************************************************************************
@@ -1350,6 +2008,25 @@ void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer
 		throw std::runtime_error("Failed to begin recording command buffer!");
 	}
 
+	// Every pass of the frame, each behind the barrier the graph worked out for it.
+	//	Only the image being drawn to changes from frame to frame
+	curImage_ = imageIndex;
+	renderGraph_->setImage(backbuffer_, swapChainImages_[imageIndex]);
+	renderGraph_->execute(commandBuffer);
+
+	// Finish rerecording the command buffer
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record command buffer!");
+	}
+}
+
+//*****************************************************************************
+//	Record Scene
+//		The render graph's scene pass. Any uploads copied on the transfer
+//		queue this frame were handed over to the graphics queue by the
+//		uploads pass, since barriers can't happen inside of a render pass
+//*****************************************************************************
+void HelloTriangleApplication::recordScene(VkCommandBuffer commandBuffer) {
 	//*****************************************************************************
 	//	Start a render pass
 	//		Drawing starts by starting a render pass
@@ -1359,19 +2036,24 @@ void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer
 
 	// What render pass to use, and what frame buffer to use
 	renderPassInfo.renderPass = renderPass_;
-	renderPassInfo.framebuffer = swapChainFramebuffers_[imageIndex];
+	renderPassInfo.framebuffer = swapChainFramebuffers_[curImage_];
 
 	// Define the render area, should match the size of attachments for best performance
 	renderPassInfo.renderArea.offset = { 0, 0 };
 	renderPassInfo.renderArea.extent = swapChainExtent_;
 
-	// What color to clear with, just go with black to start
-	VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-	renderPassInfo.clearValueCount = 1;
-	renderPassInfo.pClearValues = &clearColor;
+	// What color to clear with, just go with black to start. Depth clears to the far plane.
+	//	The resolve attachment isn't cleared, so its value is ignored
+	std::array<VkClearValue, 3> clearValues{};
+	clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
 
-	// Now actually begin the render pass
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Now actually begin the render pass. Its scope has to start outside of it,
+	//	queries can't begin inside a render pass that executes secondaries
+	uint32_t renderPassScope = profiler_.beginGpuScope(commandBuffer, "Render pass", true);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
 	// vkCmd prefix is a function that records a command
 	// First parameter for a command is always the command buffer to record command to
@@ -1380,19 +2062,52 @@ void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer
 	// Two values:
 	//	INLINE - embedded in the primary command buffer itself & no secondary command buffer execution
 	//	SECONDARY_COMMAND_BUFFERS - Render pass commands will be executed from secondary command buffers
+	// We record the draws into secondary command buffers on several threads, so we use the second
 
+	// Secondary command buffers need to know what render pass and subpass they are in
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass_;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = swapChainFramebuffers_[curImage_]; // Optional, but can help the driver
+
+	// The render pass's statistics query is active while the secondaries execute
+	inheritanceInfo.pipelineStatistics = profiler_.statisticsFlags();
+
+	// Record the draws in parallel, then have the primary command buffer execute them in order.
+	//	The objects are split over the recording threads
+	std::vector<VkCommandBuffer> secondaries = recorder_.record(curFrame_, inheritanceInfo, OBJECT_COUNT,
+		[this](VkCommandBuffer secondary, uint32_t first, uint32_t count) { recordDraws(secondary, first, count); });
+	vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+
+	// Now we end the render pass
+	vkCmdEndRenderPass(commandBuffer);
+	profiler_.endGpuScope(commandBuffer, renderPassScope);
+}
+
+//*****************************************************************************
+//	Record Draws
+//		Records objects [first, first + count) into a secondary command buffer.
+//		Runs on the recording threads, so it only reads state. Nothing set in
+//		the primary command buffer carries over, so everything is bound here
+//*****************************************************************************
+void HelloTriangleApplication::recordDraws(VkCommandBuffer secondary, uint32_t first, uint32_t count) {
 	//*****************************************************************************
 	//	Some basic drawing commands
 	//*****************************************************************************
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gfxPipeline_);
+	vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, gfxPipeline_);
+	VkPipeline boundPipeline = gfxPipeline_;
 
-	// Specify the vertex buffer we want to use for rendering
-	VkBuffer vertexBuffers[] = { vertexBuffer_ };
-	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	// Specify the vertex buffers we want to use for rendering.
+	//	Binding 0 is the per-vertex data and binding 1 is the per-instance data,
+	//	which is only the instances from this frame's culling pass
+	const FrameContext& frame = frames_[curFrame_];
+	VkBuffer vertexBuffers[] = { vertexBuffer_, visibleInstanceBuffer_ };
+	VkDeviceSize offsets[] = { 0, frame.visibleInstancesOffset };
+	vkCmdBindVertexBuffers(secondary, 0, 2, vertexBuffers, offsets);
 
 	// Also specify the index buffer we are using
-	vkCmdBindIndexBuffer(commandBuffer, indexBuffer_, 0, VK_INDEX_TYPE_UINT16);
+	vkCmdBindIndexBuffer(secondary, indexBuffer_, 0, indexType_);
 
 	// Viewport and scissor are dynamic, so need to specify here
 	VkViewport viewport{};
@@ -1402,31 +2117,59 @@ void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer
 	viewport.height = static_cast<float>(swapChainExtent_.height);
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
-	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetViewport(secondary, 0, 1, &viewport);
 
 	VkRect2D scissor{};
 	scissor.offset = { 0,0 };
 	scissor.extent = swapChainExtent_;
-	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-	// Make sure to bind the uniforms correctly here
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1, &descriptorSets_[curFrame_], 0, nullptr);
-
-	// Now with those set, we can call the command to draw our triangles
-	// Parameters:
-	//	The command buffer to record to
-	//	How many vertices to render
-	//	How many instances to render
-	//	Offset into vertex buffer, defines lowest value of gl_VertexIndex
-	//	Offset for instanced rendering, defined lowest value of gl_InstanceIndex
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-
-	// Now we end the render pass
-	vkCmdEndRenderPass(commandBuffer);
+	vkCmdSetScissor(secondary, 0, 1, &scissor);
+
+	// Make sure to bind the uniforms correctly here. There is only one set,
+	//	the dynamic offset picks out this frame's uniforms. Nothing per object
+	//	is in it, so this is the only bind
+	vkCmdBindDescriptorSets(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1, &descriptorSet_, 1, &frame.uniformOffset);
+
+	// Every texture is in the bindless set, objects pick theirs with an index in their push constants
+	if (bindless_) {
+		VkDescriptorSet bindlessSet = bindlessHeap_.set();
+		vkCmdBindDescriptorSets(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 1, 1, &bindlessSet, 0, nullptr);
+	}
+
+	// Now with those set, we can draw our triangles. The draw parameters
+	//	(index count, instance count, first index, vertex offset, first instance)
+	//	come from the VkDrawIndexedIndirectCommands the culling pass wrote instead of the CPU
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	for (uint32_t object = first; object < first + count; ++object) {
+		// Draw with the permutation made for the object's features, or the base pipeline
+		//	until it has compiled. Binding only when it changes keeps objects that share one cheap
+		VkPipeline pipeline = pipelines_.request(permutationDescs_[objectFeatures_[object]], gfxPipeline_);
+		if (pipeline != boundPipeline) {
+			vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+		}
 
-	// Finish rerecording the command buffer
-	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to record command buffer!");
+		// The object's transform goes in through push constants
+		vkCmdPushConstants(secondary, pipelineLayout_, OBJECT_CONSTANT_STAGES, 0, sizeof(ObjectConstants), &objectConstants_[object]);
+
+		// Each object owns DRAWS_PER_OBJECT commands in a row, one per LOD
+		uint32_t firstDraw = object * DRAWS_PER_OBJECT;
+		VkDeviceSize offset = frame.drawCommandsOffset + static_cast<VkDeviceSize>(firstDraw) * stride;
+		if (drawIndirectCount_) {
+			// The GPU reads how many of the object's commands got instances from its slot in the
+			//	count buffer. Compaction moved those to the front, so the empty LODs aren't drawn at all
+			VkDeviceSize countOffset = frame.drawCountsOffset + static_cast<VkDeviceSize>(object) * sizeof(uint32_t);
+			vkCmdDrawIndexedIndirectCount(secondary, indirectBuffer_, offset, drawCountBuffer_, countOffset, DRAWS_PER_OBJECT, stride);
+		}
+		else if (multiDrawIndirect_) {
+			// All of the object's commands in one call
+			vkCmdDrawIndexedIndirect(secondary, indirectBuffer_, offset, DRAWS_PER_OBJECT, stride);
+		}
+		else {
+			// Without multiDrawIndirect each call can only draw one command
+			for (uint32_t draw = 0; draw < DRAWS_PER_OBJECT; ++draw) {
+				vkCmdDrawIndexedIndirect(secondary, indirectBuffer_, offset + static_cast<VkDeviceSize>(draw) * stride, 1, stride);
+			}
+		}
 	}
 }
 
@@ -1439,80 +2182,127 @@ void HelloTriangleApplication::recordCommandBuffer(VkCommandBuffer commandBuffer
 //		- present the swap chain image
 // 
 //	Because we need to be careful of synchronization problems, we will have
-//		Semaphores and Fences
+//		Semaphores
 // 
-//		- Semaphores are used for swapchain operations because they are on GPU
-//		  and CPU (host) doesn't need to wait around for them
-//		- Fences are used for waiting on the previous frame to finish, the CPU
-//		  (host) needs to wait so we aren't drawing more than one frame at a
-//		  time.
+//		- Binary semaphores are used for swapchain operations because they are
+//		  on GPU and CPU (host) doesn't need to wait around for them
+//		- Each queue has a timeline semaphore that every submit signals the
+//		  next value of. Waiting for a frame to finish is waiting for the
+//		  value its submit signaled, which replaces a fence per frame.
 //*****************************************************************************
 void HelloTriangleApplication::drawFrame() {
-	// Wait for the previous frame to finish
-	// Parameters:
-	//	Logical Device
-	//	How many fences
-	//	Pointer to all the fences
-	//	Wait for all fences?
-	//	Timeout
-	vkWaitForFences(logicalDevice_, 1, &inFlightFences_[curFrame_], VK_TRUE, UINT64_MAX);
+	// A minimized window has nothing to draw to, the swap chain gets remade once it's back
+	if (!headless_ && windowMinimized())
+		return;
+
+	// Everything this frame uses
+	FrameContext& frame = frames_[curFrame_];
+
+	// Wait for the last frame that used this context to finish. Its queries are done
+	//	with too, so the profiler reads them back before this frame reuses them
+	uint32_t waitScope = profiler_.beginCpuScope("Wait for frame");
+	graphicsTimeline_.wait(frame.timelineValue);
+	profiler_.endCpuScope(waitScope);
+	profiler_.beginFrame(curFrame_);
+
+	// Hand back staging space from anything that has finished, not just that frame,
+	//	and reset the frame's recording and descriptor pools. Replaced swap chains
+	//	whose last frames have finished go too
+	stagingRing_.release(graphicsTimeline_.completedValue());
+	releaseRetiredSwapChains();
+	pipelines_.releaseRetired(graphicsTimeline_.completedValue());
+
+	// Swap in pipelines for shaders that were compiled again, before anything records with them
+	if (shaderHotReload_)
+		reloadChangedShaders();
+	recorder_.beginFrame(curFrame_);
+	descriptors_.beginFrame(curFrame_);
+
+	// Finish any assets the workers have loaded since last frame.
+	//	Their copies get recorded with this frame's uploads
+	jobs_.runDeviceCallbacks();
+
+	// The streamed texture is on screen every frame, so it always wants its full detail.
+	//	Then let the streamer evict and start streams, its copies go out with this frame's uploads too
+	if (streamedTexture_ != UINT32_MAX)
+		textureStreamer_.request(streamedTexture_, 0);
+	textureStreamer_.update();
+	updateBindlessTextures();
 
 	// Now we grab an image from our swap chain
-	// Returns an index of an image in our swap chain, as well as uses the semaphore for acquiring
-	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(logicalDevice_, swapChain_, UINT64_MAX, imageAvailableSemaphores_[curFrame_], VK_NULL_HANDLE, &imageIndex);
-
-	// We need to handle if the current swap chain is invalid
-	//	ERROR_OUT_OF_DATE_KHR - 
-	//		Swap chain is incompatible with surface and can't be used for rendering. Usually window resize
-	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		framebufferResized_ = false;
-		recreateSwapChain();
-		return;
-	}
-	//	SUBOPTIMAL_KHR -
-	//		Swap chain can still be used, but surface properties don't match exactly
-	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-		throw std::runtime_error("Failed to acquire swap chain image!");
+	// Returns an index of an image in our swap chain, as well as uses the semaphore for acquiring.
+	//	Offscreen, each frame has its own image that was freed up by the wait above
+	uint32_t imageIndex = curFrame_;
+	if (!headless_) {
+		uint32_t acquireScope = profiler_.beginCpuScope("Acquire image");
+		VkResult result = vkAcquireNextImageKHR(logicalDevice_, swapChain_, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		profiler_.endCpuScope(acquireScope);
+
+		// We need to handle if the current swap chain is invalid
+		//	ERROR_OUT_OF_DATE_KHR - 
+		//		Swap chain is incompatible with surface and can't be used for rendering. Usually window resize
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			framebufferResized_ = false;
+			recreateSwapChain();
+			return;
+		}
+		//	SUBOPTIMAL_KHR -
+		//		Swap chain can still be used, but surface properties don't match exactly
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+			throw std::runtime_error("Failed to acquire swap chain image!");
+		}
 	}
 
-	// After waiting for the fence, remember to reset the fence to unsignaled
-	//	Only reset when we guarantee work is being submitted
-	vkResetFences(logicalDevice_, 1, &inFlightFences_[curFrame_]);
-
-	// Reset our command buffer, then record our command buffer
-	vkResetCommandBuffer(commandBuffers_[curFrame_], 0);
-	recordCommandBuffer(commandBuffers_[curFrame_], imageIndex);
+	// Send any uploads streamed in since the last frame over to the transfer queue.
+	//	The graphics work waits on their timeline value instead of the CPU waiting
+	uint64_t uploadValue = submitStagingUploads(curFrame_);
 
-	// Update the uniform buffer
+	// Update the uniform buffer. This also works out the object transforms,
+	//	which get recorded as push constants, so it comes before recording
 	updateUniformBuffer(curFrame_);
 
-	// Now we want to submit our command buffer
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	// Wait on these semaphores before executing commands
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores_[curFrame_] };
-
-	// Wait on writing to the color attachment until semaphore is available
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-
-	// What command buffers are being submitted
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers_[curFrame_];
+	// Move the instances and compose their matrices into the frame's instance buffer slice
+	uint32_t sceneScope = profiler_.beginCpuScope("Update instances");
+	updateInstances(curFrame_);
+	profiler_.endCpuScope(sceneScope);
 
-	// What semaphores to signal once the command buffers submitted finish execution
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores_[curFrame_] };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+	// Reset our command buffer, then record our command buffer
+	vkResetCommandBuffer(frame.commandBuffer, 0);
+	uint32_t recordScope = profiler_.beginCpuScope("Record commands");
+	recordCommandBuffer(frame.commandBuffer, imageIndex);
+	profiler_.endCpuScope(recordScope);
 
-	// Submit the command buffer to the queue
-	//	Passing inFlightFence will signal it once the commands finish
-	if (vkQueueSubmit(graphicsQueue_, 1, &submitInfo, inFlightFences_[curFrame_]) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to submit draw command buffer!");
+	// Now we want to submit our command buffer
+	// Wait on writing to the color attachment until the image is available,
+	//	and on reading any uploaded resources until the copies have finished
+	std::vector<SemaphoreWait> waits;
+	if (!headless_)
+		waits.push_back({ frame.imageAvailableSemaphore, 0, renderGraph_->firstStages(backbuffer_) });
+	if (uploadValue != 0)
+		waits.push_back(transferTimeline_.waitFor(uploadValue, StagingRing::READ_STAGES));
+
+	// What semaphores to signal once the command buffers submitted finish execution.
+	//	Presenting still needs a binary semaphore
+	//	Nothing waits on it offscreen, and a binary semaphore can't be signaled twice without a wait
+	VkSemaphore signalSemaphores[] = { frame.renderFinishedSemaphore };
+	std::vector<VkSemaphore> binarySignals;
+	if (!headless_)
+		binarySignals.push_back(frame.renderFinishedSemaphore);
+
+	// Submit the command buffer to the queue. The timeline value it signals is
+	//	what the next use of this frame context waits for
+	uint32_t submitScope = profiler_.beginCpuScope("Submit");
+	frame.timelineValue = graphicsTimeline_.submit(&frame.commandBuffer, 1, waits, binarySignals);
+	profiler_.endCpuScope(submitScope);
+
+	// Any uploads recorded this frame are read by this frame's submit
+	stagingRing_.retire(frame.timelineValue);
+	++framesDrawn_;
+
+	// Offscreen images have nowhere to be presented
+	if (headless_) {
+		curFrame_ = (curFrame_ + 1) % framesInFlight_;
+		return;
 	}
 	
 	//*****************************************************************************
@@ -1535,8 +2325,20 @@ void HelloTriangleApplication::drawFrame() {
 	// Allows specification of a VkResult array to check for each swap chain if presentation was successful
 	presentInfo.pResults = nullptr; // Optional
 
+	// Every present gets an id when present wait is on, so it can be waited for
+	uint64_t presentId = nextPresentId_++;
+	VkPresentIdKHR presentIdInfo{};
+	presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+	presentIdInfo.swapchainCount = 1;
+	presentIdInfo.pPresentIds = &presentId;
+	if (presentWait_)
+		presentInfo.pNext = &presentIdInfo;
+
 	// Now present the image!
-	result = vkQueuePresentKHR(presentQueue_, &presentInfo);
+	uint32_t presentScope = profiler_.beginCpuScope("Present");
+	VkResult result = vkQueuePresentKHR(presentQueue_, &presentInfo);
+	profiler_.endCpuScope(presentScope);
+	pendingPresents_.push_back({ presentId, frame.timelineValue, profiler_.currentFrame() });
 
 	// Recreate swap chain if out of date or suboptimal
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized_) {
@@ -1550,27 +2352,19 @@ void HelloTriangleApplication::drawFrame() {
 	}
 
 	// Remember to advance to the next frame
-	curFrame_ = (curFrame_ + 1) % MAX_FRAMES_IN_FLIGHT;
+	curFrame_ = (curFrame_ + 1) % framesInFlight_;
 }
 
 //*****************************************************************************
-//	Function for creating the semaphores and fences we need
+//	Function for creating the semaphores we need
 //*****************************************************************************
 void HelloTriangleApplication::createSyncObjects() {
-	// Reallocate the vectors for the sync objects
-	imageAvailableSemaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-	renderFinishedSemaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-	inFlightFences_.resize(MAX_FRAMES_IN_FLIGHT);
-
-	// Creation structures for semaphores and fences
+	// Creation structure for the swap chain's binary semaphores. Waiting on frames
+	//	is done with the queue timelines, so there are no fences
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // Fence starts signaled
 
-	// Create all the semaphores and fences we need
+	// Create all the semaphores we need
 	/*
 	if (vkCreateSemaphore(logicalDevice_, &semaphoreInfo, nullptr, &imageAvailableSemaphore_) != VK_SUCCESS ||
 		vkCreateSemaphore(logicalDevice_, &semaphoreInfo, nullptr, &renderFinishedSemaphore_) != VK_SUCCESS ||
@@ -1578,11 +2372,10 @@ void HelloTriangleApplication::createSyncObjects() {
 		throw std::runtime_error("Failed to create Semaphores or Fences");
 	}
 	*/
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-		if (vkCreateSemaphore(logicalDevice_, &semaphoreInfo, nullptr, &imageAvailableSemaphores_[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(logicalDevice_, &semaphoreInfo, nullptr, &renderFinishedSemaphores_[i]) != VK_SUCCESS ||
-			vkCreateFence(logicalDevice_, &fenceInfo, nullptr, &inFlightFences_[i]) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create Semaphores or Fences");
+	for (FrameContext& frame : frames_) {
+		if (vkCreateSemaphore(logicalDevice_, &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS ||
+			vkCreateSemaphore(logicalDevice_, &semaphoreInfo, nullptr, &frame.renderFinishedSemaphore) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create Semaphores");
 		}
 	}
 }
@@ -1598,67 +2391,124 @@ void HelloTriangleApplication::cleanupSwapChain() {
 		vkDestroyImageView(logicalDevice_, imageView, nullptr);
 	}
 
-	// Destroy the swapchain
-	vkDestroySwapchainKHR(logicalDevice_, swapChain_, nullptr);
+	renderGraph_->cleanup();
+	renderGraph_.reset();
+
+	// Destroy the swapchain. Offscreen images are ours to destroy instead
+	if (headless_) {
+		for (size_t i = 0; i < swapChainImages_.size(); ++i) {
+			vkDestroyImage(logicalDevice_, swapChainImages_[i], nullptr);
+			allocator_.free(offscreenMemory_[i]);
+		}
+		swapChainImages_.clear();
+		offscreenMemory_.clear();
+	}
+	else {
+		vkDestroySwapchainKHR(logicalDevice_, swapChain_, nullptr);
+	}
+
+	// Only called once the device is idle, so every replaced swap chain is done with too
+	for (RetiredSwapChain& retired : retiredSwapChains_)
+		destroyRetiredSwapChain(retired);
+	retiredSwapChains_.clear();
+}
+
+void HelloTriangleApplication::destroyRetiredSwapChain(RetiredSwapChain& retired) {
+	for (VkFramebuffer framebuffer : retired.framebuffers)
+		vkDestroyFramebuffer(logicalDevice_, framebuffer, nullptr);
+	for (VkImageView imageView : retired.imageViews)
+		vkDestroyImageView(logicalDevice_, imageView, nullptr);
+	retired.renderGraph->cleanup();
+	vkDestroySwapchainKHR(logicalDevice_, retired.swapChain, nullptr);
+}
+
+// Oldest first, so the first one that isn't finished means none after it are
+void HelloTriangleApplication::releaseRetiredSwapChains() {
+	while (!retiredSwapChains_.empty() && graphicsTimeline_.isComplete(retiredSwapChains_.front().timelineValue)) {
+		destroyRetiredSwapChain(retiredSwapChains_.front());
+		retiredSwapChains_.pop_front();
+	}
+}
+
+bool HelloTriangleApplication::windowMinimized() const {
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(window_, &width, &height);
+	return width == 0 || height == 0;
 }
 
 //*****************************************************************************
 //	This function is for recreating the swap chain to handle the window being
-//		resized
+//		resized. Nothing waits for the GPU: the old swap chain is handed to
+//		the new one, and it goes into retirement with its views, render graph
+//		and framebuffers until the last frame submitted with them has finished.
+//		Frames keep rendering into the new one in the meantime
 //*****************************************************************************
 void HelloTriangleApplication::recreateSwapChain() {
-	// Need to handle if the window is minimized
-	int width = 0, height = 0;
-	glfwGetFramebufferSize(window_, &width, &height);
-	while (width == 0 || height == 0) {
-		// Always call glfwGetFrameBuffer size
-		glfwGetFramebufferSize(window_, &width, &height);
-
-		// glfw will wait until an event is called
-		glfwWaitEvents();
+	// A minimized window can't have a swap chain made for it, so try again once it's back
+	if (windowMinimized()) {
+		framebufferResized_ = true;
+		return;
 	}
 
-	// Free up the locks
-	vkDeviceWaitIdle(logicalDevice_);
+	// Present ids belong to the swap chain, so nothing pending can be waited on anymore
+	pendingPresents_.clear();
 
-	// Clean up the current swap chain
-	cleanupSwapChain();
+	// Every frame that used the old views and framebuffers has been submitted by now
+	RetiredSwapChain retired;
+	retired.swapChain = swapChain_;
+	retired.imageViews = std::move(swapChainImageViews_);
+	retired.framebuffers = std::move(swapChainFramebuffers_);
+	retired.renderGraph = std::move(renderGraph_);
+	retired.timelineValue = graphicsTimeline_.submittedValue();
+	swapChainImageViews_.clear();
+	swapChainFramebuffers_.clear();
+	retiredSwapChains_.push_back(std::move(retired));
 
 	// Re-Create the swap chain
-	createSwapChain();
+	createSwapChain(retiredSwapChains_.back().swapChain);
 	createImageViews();
+	buildRenderGraph();
 	createFramebuffers();
 }
 
 // Function for creating an actual vertex buffer
-void HelloTriangleApplication::createVertexBuffer() {
-	// Specify the buffer size
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-	// We will create a staging buffer, that will be temporary buffer on CPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	// Two types of transfer flags:
-	//	SRC - Buffer can be used as a source in a memory transfer operation
-	//	DST - Buffer can be used as a destination in a memory transfer operation
-	VkBufferUsageFlags stagingBufferType = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+//*****************************************************************************
+//	Mesh
+//		The file is mapped, so its blobs are copied straight from the mapping
+//		into the staging ring. The mapping is only needed until then
+//*****************************************************************************
+void HelloTriangleApplication::loadMesh() {
+	MeshFile mesh;
+	mesh.open(MESH_PATH);
 
-	// This buffer is visible to the CPU
-	VkMemoryPropertyFlags stagingMemoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	createBuffer(bufferSize, stagingBufferType, stagingMemoryProps, stagingBuffer, stagingBufferMemory);
+	const MeshFileHeader& header = mesh.header();
+	if (header.vertexFormat != Vertex::FORMAT_ID || header.vertexStride != sizeof(Vertex)) {
+		throw std::runtime_error("Mesh vertices don't match the Vertex layout: " + MESH_PATH);
+	}
 
-	// Now we have data we want to copy into the buffer
-	void* data;
+	createVertexBuffer(mesh);
+	createIndexBuffer(mesh);
 
-	// Map the memory so CPU knows where to put memory
-	vkMapMemory(logicalDevice_, stagingBufferMemory, 0, bufferSize, 0, &data);
+	// Keep what the draws and the culling pass need
+	indexType_ = header.indexSize == sizeof(uint32_t) ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+	meshLods_.assign(mesh.lods(), mesh.lods() + header.lodCount);
+	meshBoundsRadius_ = header.boundsRadius;
+}
 
-	// Simply memcpy our vertex data into the buffer
-	memcpy(data, vertices.data(), (size_t)bufferSize);
+// Queue a copy of data into dst, going through the staging ring a chunk at a time
+void HelloTriangleApplication::stageBufferData(const void* data, VkDeviceSize size, VkBuffer dst) {
+	const char* bytes = static_cast<const char*>(data);
+	for (VkDeviceSize offset = 0; offset < size; offset += STAGING_CHUNK_SIZE) {
+		VkDeviceSize chunk = std::min(STAGING_CHUNK_SIZE, size - offset);
+		StagingRegion staging = stageUpload(chunk);
+		memcpy(staging.mapped, bytes + offset, (size_t)chunk);
+		stagingRing_.copyToBuffer(staging, dst, offset);
+	}
+}
 
-	// Now unmap the memory, since we have already copied the data over
-	vkUnmapMemory(logicalDevice_, stagingBufferMemory);
+void HelloTriangleApplication::createVertexBuffer(const MeshFile& mesh) {
+	// Specify the buffer size
+	VkDeviceSize bufferSize = mesh.vertexDataSize();
 
 	// Now create the vertex buffer (It can now be the destination for a memory transfer
 	VkBufferUsageFlags bufferType = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
@@ -1666,13 +2516,11 @@ void HelloTriangleApplication::createVertexBuffer() {
 	// This buffer only exists on the GPU
 	VkMemoryPropertyFlags memoryProps = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-	// Now, when we create the vertex buffer, we can copy the staging buffer info the vertex buffer
+	// Now, when we create the vertex buffer, we can queue copies from the staging ring into the vertex buffer.
+	//	The ring is already mapped, so the vertex data is simply memcpy'd into it.
+	//	The copies are batched with every other upload and recorded later
 	createBuffer(bufferSize, bufferType, memoryProps, vertexBuffer_, vertexBufferMemory_);
-	copyBuffer(stagingBuffer, vertexBuffer_, bufferSize);
-
-	// Once the data is copied over, we should free up the temporary staging buffer
-	vkDestroyBuffer(logicalDevice_, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice_, stagingBufferMemory, nullptr);
+	stageBufferData(mesh.vertexData(), bufferSize, vertexBuffer_);
 
 	// NOTES:
 	// Driver may not immediately copy data into the buffer memory (due to caching as example)
@@ -1684,35 +2532,229 @@ void HelloTriangleApplication::createVertexBuffer() {
 	// In a real world application, you should not call VkAllocateMemory for every individual buffer
 	//	Maximum number of simultaneous memory allocations is limited by the physical device,
 	//	which can be as low as 4096, meaning only 4096 buffers if allocated this way.
+	//	This is why createBuffer sub-allocates from the MemoryAllocator instead.
+}
+
+//*****************************************************************************
+//	Instance Buffer
+//		Transform and color of every instance. The culling pass reads it as
+//		a storage buffer and copies the visible ones out, which are what the
+//		vertex binding with an input rate of INSTANCE reads
+//*****************************************************************************
+void HelloTriangleApplication::createInstanceBuffer() {
+	scene_.init(std::thread::hardware_concurrency());
+
+	// Lay the instances out on a grid that covers the same area as the original quad.
+	//	Each one spins in place, some faster than others
+	const float spacing = 2.0f / instanceGridSize_;
+	for (uint32_t y = 0; y < instanceGridSize_; ++y) {
+		for (uint32_t x = 0; x < instanceGridSize_; ++x) {
+			glm::vec3 position(-1.0f + spacing * (x + 0.5f), -1.0f + spacing * (y + 0.5f), 0.0f);
+			glm::vec4 color(x / (float)instanceGridSize_, y / (float)instanceGridSize_, 1.0f, 1.0f);
+			uint32_t instance = scene_.add(position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), spacing * 0.8f, color);
+
+			float spin = 0.5f + 0.5f * ((x + y) % 4);
+			scene_.setAngularVelocity(instance, glm::vec3(0.0f, 0.0f, spin));
+		}
+	}
+
+	// The instances change every frame, so each frame gets its own slice that the scene
+	//	store writes straight into. Slices are bound with dynamic offsets
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkPhysicalDevice_, &properties);
+	VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+	VkDeviceSize sliceSize = sizeof(InstanceData) * instanceCount();
+	VkDeviceSize sliceStride = (sliceSize + alignment - 1) & ~(alignment - 1);
+	for (uint32_t i = 0; i < framesInFlight_; ++i)
+		frames_[i].instancesOffset = static_cast<uint32_t>(sliceStride * i);
+
+	VkBufferUsageFlags bufferType = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	VkMemoryPropertyFlags memProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	createBuffer(sliceStride * framesInFlight_, bufferType, memProps, instanceBuffer_, instanceBufferMemory_);
+}
+
+//*****************************************************************************
+//	Update Instances
+//		Moves every instance forward and writes the frame's slice of the
+//		instance buffer. The GPU is done with the last frame that used the
+//		slice, and the memory is coherent, so the submit makes the writes
+//		visible to the culling pass without a barrier
+//*****************************************************************************
+void HelloTriangleApplication::updateInstances(uint32_t currentFrame) {
+	// Headless runs step by a fixed time, so every run matches
+	auto now = std::chrono::steady_clock::now();
+	float dt = 0.0f;
+	if (headless_)
+		dt = HEADLESS_TIME_STEP;
+	else if (lastSceneUpdate_ != std::chrono::steady_clock::time_point{})
+		dt = std::min(std::chrono::duration<float>(now - lastSceneUpdate_).count(), MAX_SCENE_TIME_STEP);
+	lastSceneUpdate_ = now;
+
+	char* mapped = static_cast<char*>(instanceBufferMemory_.mapped);
+	scene_.update(dt, mapped + frames_[currentFrame].instancesOffset);
+}
+
+//*****************************************************************************
+//	Indirect Buffers
+//		The draw template has one VkDrawIndexedIndirectCommand per object per
+//		LOD with no instances in it. Each frame copies it over its slice of
+//		the indirect buffer and the culling pass counts instances into it.
+//		Every command gets room for all of its object's instances in the
+//		visible instance buffer, so the pass never has to compact twice
+//*****************************************************************************
+void HelloTriangleApplication::createIndirectBuffers() {
+	// Each level is a range of the index buffer from the mesh file. Meshes with
+	//	fewer levels than LOD_COUNT keep using their last one
+	VkDeviceSize commandsSize = sizeof(VkDrawIndexedIndirectCommand) * INDIRECT_DRAW_COUNT;
+	StagingRegion staging = stageUpload(commandsSize);
+	VkDrawIndexedIndirectCommand* commands = static_cast<VkDrawIndexedIndirectCommand*>(staging.mapped);
+
+	for (uint32_t draw = 0; draw < INDIRECT_DRAW_COUNT; ++draw) {
+		size_t level = std::min<size_t>(draw % LOD_COUNT, meshLods_.size() - 1);
+		const MeshFileLod& lod = meshLods_[level];
+		commands[draw].indexCount = lod.indexCount;
+		commands[draw].instanceCount = 0;
+		commands[draw].firstIndex = lod.firstIndex;
+		commands[draw].vertexOffset = 0;
+		commands[draw].firstInstance = draw * instancesPerObject();
+	}
+
+	VkBufferUsageFlags templateType = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	createBuffer(commandsSize, templateType, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawTemplateBuffer_, drawTemplateBufferMemory_);
+	stagingRing_.copyToBuffer(staging, drawTemplateBuffer_, 0);
+
+	// Each frame gets its own slice of the culling outputs, so the pass can write the next
+	//	frame's while the GPU still draws the last one. Slices are bound with dynamic offsets
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkPhysicalDevice_, &properties);
+	VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+
+	VkDeviceSize commandsStride = (commandsSize + alignment - 1) & ~(alignment - 1);
+	VkDeviceSize instancesSize = sizeof(InstanceData) * instancesPerObject() * INDIRECT_DRAW_COUNT;
+	VkDeviceSize instancesStride = (instancesSize + alignment - 1) & ~(alignment - 1);
+	VkDeviceSize countsStride = (sizeof(uint32_t) * OBJECT_COUNT + alignment - 1) & ~(alignment - 1);
+	for (uint32_t i = 0; i < framesInFlight_; ++i) {
+		frames_[i].drawCommandsOffset = static_cast<uint32_t>(commandsStride * i);
+		frames_[i].visibleInstancesOffset = static_cast<uint32_t>(instancesStride * i);
+		frames_[i].drawCountsOffset = static_cast<uint32_t>(countsStride * i);
+	}
+
+	VkBufferUsageFlags indirectType = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	createBuffer(commandsStride * framesInFlight_, indirectType, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectBuffer_, indirectBufferMemory_);
+
+	VkBufferUsageFlags visibleType = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	createBuffer(instancesStride * framesInFlight_, visibleType, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibleInstanceBuffer_, visibleInstanceBufferMemory_);
+
+	// Compaction writes every count each frame before anything reads it, so the slices start out as they are
+	VkBufferUsageFlags countType = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	createBuffer(countsStride * framesInFlight_, countType, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCountBuffer_, drawCountBufferMemory_);
+}
+
+//*****************************************************************************
+//	Cull Pipeline
+//		Compute only needs a set layout, a pipeline layout and the shader
+//*****************************************************************************
+void HelloTriangleApplication::createCullPipeline() {
+	// Which buffers are dynamic is up to how they are bound, which the shader can't say,
+	//	so this layout is written out. Reflection still checks it against the shader
+	std::vector<VkDescriptorSetLayoutBinding>& bindings = cullSetBindings_;
+	bindings.assign(CULL_BINDING_TYPES.size(), VkDescriptorSetLayoutBinding{});
+	for (uint32_t i = 0; i < bindings.size(); ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = CULL_BINDING_TYPES[i];
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	if (!matchesSetLayout(reflectShaderFile(CULL_SHADER), 0, bindings)) {
+		throw std::runtime_error("Culling shader doesn't match its descriptor set layout!");
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(logicalDevice_, &layoutInfo, nullptr, &cullSetLayout_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create culling descriptor set layout!");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &cullSetLayout_;
+
+	// Which phase a dispatch runs
+	VkPushConstantRange phaseRange{};
+	phaseRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	phaseRange.offset = 0;
+	phaseRange.size = sizeof(uint32_t);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &phaseRange;
+
+	if (vkCreatePipelineLayout(logicalDevice_, &pipelineLayoutInfo, nullptr, &cullPipelineLayout_) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline layout!");
+	}
+
+	cullPipeline_ = pipelines_.getCompute(CULL_SHADER, cullPipelineLayout_);
 }
 
-void HelloTriangleApplication::createIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+//*****************************************************************************
+//	Record Draw Reset
+//		Reset this frame's commands from the template, before culling adds
+//		the instances back into them
+//*****************************************************************************
+void HelloTriangleApplication::recordDrawReset(VkCommandBuffer commandBuffer) {
+	const FrameContext& frame = frames_[curFrame_];
+	VkDeviceSize commandsSize = sizeof(VkDrawIndexedIndirectCommand) * INDIRECT_DRAW_COUNT;
 
-	// We will create a staging buffer, that will be temporary buffer on CPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	// The last frame that used this slice finished before the frame was reused,
+	//	so the copy has nothing to wait on
+	VkBufferCopy copyRegion{};
+	copyRegion.srcOffset = 0;
+	copyRegion.dstOffset = frame.drawCommandsOffset;
+	copyRegion.size = commandsSize;
+	vkCmdCopyBuffer(commandBuffer, drawTemplateBuffer_, indirectBuffer_, 1, &copyRegion);
+}
 
-	// Two types of transfer flags:
-	//	SRC - Buffer can be used as a source in a memory transfer operation
-	//	DST - Buffer can be used as a destination in a memory transfer operation
-	VkBufferUsageFlags stagingBufferType = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+//*****************************************************************************
+//	Record Culling
+//		One thread per instance tests it against the frustum, picks its LOD
+//		and appends it to that LOD's command. The render graph puts the
+//		barriers on the reset before it and the draws after it
+//*****************************************************************************
+void HelloTriangleApplication::recordCulling(VkCommandBuffer commandBuffer) {
+	bindCulling(commandBuffer);
+	vkCmdPushConstants(commandBuffer, cullPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CULL_PHASE_INSTANCES), &CULL_PHASE_INSTANCES);
+	vkCmdDispatch(commandBuffer, (instanceCount() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
 
-	// This buffer is visible to the CPU
-	VkMemoryPropertyFlags stagingMemoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	createBuffer(bufferSize, stagingBufferType, stagingMemoryProps, stagingBuffer, stagingBufferMemory);
+//*****************************************************************************
+//	Record Draw Compaction
+//		One thread per object moves the commands culling put instances in
+//		to the front of the object's range and writes how many there are,
+//		which the draw count path reads
+//*****************************************************************************
+void HelloTriangleApplication::recordDrawCompaction(VkCommandBuffer commandBuffer) {
+	bindCulling(commandBuffer);
+	vkCmdPushConstants(commandBuffer, cullPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CULL_PHASE_COMPACT), &CULL_PHASE_COMPACT);
+	vkCmdDispatch(commandBuffer, (OBJECT_COUNT + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
 
-	// Now we have data we want to copy into the buffer
-	void* data;
+// Both phases of Cull.comp use the same pipeline and the frame's slices of every buffer
+void HelloTriangleApplication::bindCulling(VkCommandBuffer commandBuffer) {
+	const FrameContext& frame = frames_[curFrame_];
 
-	// Map the memory so CPU knows where to put memory
-	vkMapMemory(logicalDevice_, stagingBufferMemory, 0, bufferSize, 0, &data);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline_);
 
-	// Simply memcpy our vertex data into the buffer
-	memcpy(data, indices.data(), (size_t)bufferSize);
+	// Dynamic offsets go in binding order
+	uint32_t dynamicOffsets[] = { frame.cullUniformOffset, frame.instancesOffset, frame.drawCommandsOffset, frame.visibleInstancesOffset, frame.drawCountsOffset };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout_, 0, 1, &cullDescriptorSet_,
+		static_cast<uint32_t>(CULL_BINDING_TYPES.size()), dynamicOffsets);
+}
 
-	// Now unmap the memory, since we have already copied the data over
-	vkUnmapMemory(logicalDevice_, stagingBufferMemory);
+void HelloTriangleApplication::createIndexBuffer(const MeshFile& mesh) {
+	VkDeviceSize bufferSize = mesh.indexDataSize();
 
 	// Now create the index buffer (It can now be the destination for a memory transfer
 	VkBufferUsageFlags bufferType = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
@@ -1722,12 +2764,8 @@ void HelloTriangleApplication::createIndexBuffer() {
 	
 	createBuffer(bufferSize, bufferType, memoryProps, indexBuffer_, indexBufferMemory_);
 
-	// copy the temp buffer over to the GPU
-	copyBuffer(stagingBuffer, indexBuffer_, bufferSize);
-
-	// Delete the temporary staging buffer
-	vkDestroyBuffer(logicalDevice_, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice_, stagingBufferMemory, nullptr);
+	// Write the index data straight into the staging ring, and queue the copies over to the GPU
+	stageBufferData(mesh.indexData(), bufferSize, indexBuffer_);
 }
 
 // We need to figure out what types of memory our GPU has
@@ -1755,7 +2793,7 @@ uint32_t HelloTriangleApplication::findMemoryType(uint32_t typeFilter, VkMemoryP
 }
 
 // Abstract function for creating a buffer
-void HelloTriangleApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+void HelloTriangleApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory) {
 	// The usual of creating a create struct
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1779,104 +2817,88 @@ void HelloTriangleApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlag
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(logicalDevice_, buffer, &memRequirements);
 
-	// Now we want to actually allocate memory to the buffer
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-
-	// Make sure we specify the memory type we need
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(logicalDevice_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate buffer memory!");
-	}
+	// Now we want to actually allocate memory to the buffer.
+	//	Instead of a vkAllocateMemory per buffer, grab a range out of one of the allocator's blocks
+	//	Make sure we specify the memory type we need
+	uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+	bufferMemory = allocator_.allocate(memRequirements, memoryType, ResourceKind::Buffer);
 
 	// After successful memory allocation, we can now associate this memory with the vertex buffer
-	//	Last parameter is an offset into the region of memory
-	vkBindBufferMemory(logicalDevice_, buffer, bufferMemory, 0);
-}
-
-// Fucntion for copying over a buffer to another buffer
-void HelloTriangleApplication::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
-
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	// Now submit the copy buffer command
-	VkBufferCopy copyRegion{};
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
-
-	endSingleTimeCommands(commandBuffer);
+	//	Last parameter is an offset into the region of memory, which is where our range starts in the block
+	vkBindBufferMemory(logicalDevice_, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
 // Function for creating a uniform variable layout for use in shaders
+//	The bindings come out of the scene shaders themselves, so the layout always
+//	has what they read, in every stage that reads it
 void HelloTriangleApplication::createDescriptorSetLayout() {
-	// Struct for defining the binding layout
-	VkDescriptorSetLayoutBinding uboLayoutBinding{};
-
-	// Uniform buffer is laid out at 0
-	uboLayoutBinding.binding = 0;
-
-	// It is a uniform buffer
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	std::vector<ShaderReflection> shaders;
+	for (const std::string& shader : sceneShaders())
+		shaders.push_back(reflectShaderFile(shader));
 
-	// There is one uniform block
-	uboLayoutBinding.descriptorCount = 1;
-
-	// What stage are the uniforms in
-	//	Can be an or combination of multiple flags,
-	//	or just ALL_GRAPHICS
-	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-	// Only relevant for image sampling
-	uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
+	// Set 0 is the frame's uniforms. Every frame's uniforms sit in one buffer, with the
+	//	offset given when the set is bound, so its buffers are made dynamic.
+	//	One set covers every frame that way
+	descriptorSetBindings_ = reflectSetLayout(shaders, 0, true);
 
 	// Now we will actually create the layout
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = 1;
-	layoutInfo.pBindings = &uboLayoutBinding;
+	layoutInfo.bindingCount = static_cast<uint32_t>(descriptorSetBindings_.size());
+	layoutInfo.pBindings = descriptorSetBindings_.data();
 
 	if (vkCreateDescriptorSetLayout(logicalDevice_, &layoutInfo, nullptr, &descriptorSetLayout_) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create descriptor set layout!");
 	}
 }
 
+//*****************************************************************************
+//	Uniform Buffer
+//		One persistently mapped buffer holds every frame's FrameUniforms and
+//		CullUniforms. Dynamic offsets have to be a multiple of
+//		minUniformBufferOffsetAlignment, so each block is rounded up to it
+//*****************************************************************************
 void HelloTriangleApplication::createUniformBuffers() {
-	// How big is the uniform buffer
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkPhysicalDevice_, &properties);
 
-	// Resize our vectors
-	uniformBuffers_.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMemory_.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMapped_.resize(MAX_FRAMES_IN_FLIGHT);
+	// The alignment is always a power of two
+	VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+	VkDeviceSize frameUniformsSize = (sizeof(FrameUniforms) + alignment - 1) & ~(alignment - 1);
+	VkDeviceSize cullUniformsSize = (sizeof(CullUniforms) + alignment - 1) & ~(alignment - 1);
+	VkDeviceSize frameStride = frameUniformsSize + cullUniformsSize;
 
-	// Create the buffers
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-		// Create a Uniform buffer and allocate memory to it
-		VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-		VkMemoryPropertyFlags memProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-		createBuffer(bufferSize, bufferUsage, memProps, uniformBuffers_[i], uniformBuffersMemory_[i]);
+	// How big is the uniform buffer
+	VkDeviceSize bufferSize = frameStride * framesInFlight_;
 
-		// Map the memory to GPU
-		vkMapMemory(logicalDevice_, uniformBuffersMemory_[i], 0, bufferSize, 0, &uniformBuffersMapped_[i]);
+	// Create a Uniform buffer and allocate memory to it
+	VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	VkMemoryPropertyFlags memProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	createBuffer(bufferSize, bufferUsage, memProps, uniformBuffer_, uniformBufferMemory_);
+
+	// Each frame writes and binds its own slot
+	for (uint32_t i = 0; i < framesInFlight_; ++i) {
+		frames_[i].uniformOffset = static_cast<uint32_t>(frameStride * i);
+		frames_[i].cullUniformOffset = static_cast<uint32_t>(frameStride * i + frameUniformsSize);
 	}
+
+	objectConstants_.resize(OBJECT_COUNT);
+	objectFeatures_.resize(OBJECT_COUNT);
 }
 
-// Helper function for updating the uniform buffer of a given image
-void HelloTriangleApplication::updateUniformBuffer(uint32_t currentImage) {
+// Helper function for updating the uniforms of a given frame, and the object transforms
+void HelloTriangleApplication::updateUniformBuffer(uint32_t currentFrame) {
 	// Get what the start time is as a static variable
 	static auto startTime = std::chrono::high_resolution_clock::now();
 
-	// Figure out the total run time
+	// Figure out the total run time. Headless runs go by frames instead, so every run matches
 	auto curTime = std::chrono::high_resolution_clock::now();
 	float time = std::chrono::duration<float, std::chrono::seconds::period>(curTime - startTime).count();
+	if (headless_)
+		time = framesDrawn_ * HEADLESS_TIME_STEP;
 
 	// Fill the Uniform Buffer struct
-	UniformBufferObject ubo{};
-
-	// Generate a rotation matrix that rotates around the z-axis
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	FrameUniforms ubo{};
 
 	// Generate a view matrix given a camera eye, a position to look at, and an up vector (z is up in this case)
 	ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
@@ -1887,98 +2909,104 @@ void HelloTriangleApplication::updateUniformBuffer(uint32_t currentImage) {
 	// Need to multiply by -1 because we are in Vulkan, as glm was designed for OpenGL
 	ubo.proj[1][1] *= -1;
 
-	// Now we have defined all the matrices, now we want to mem copy them into our buffer
-	memcpy(uniformBuffersMapped_[currentImage], &ubo, sizeof(ubo));
-}
-
-// In order to tell the shader the uniform information, so we need to
-//	specify descriptor sets
-void HelloTriangleApplication::createDescriptorPool() {
-	// Define a pool size, which needs to know:
-	//	What the pool will be used for
-	//	How many descriptors there are
-	VkDescriptorPoolSize poolSize{};
-	poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	// Now we have defined all the matrices, now we want to mem copy them into the frame's slot.
+	//	The GPU is done with the last frame that used it, so nothing else is reading it
+	char* mapped = static_cast<char*>(uniformBufferMemory_.mapped);
+	memcpy(mapped + frames_[currentFrame].uniformOffset, &ubo, sizeof(ubo));
 
-	// Creation struct for a descriptor pool
-	VkDescriptorPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = 1;
-	poolInfo.pPoolSizes = &poolSize;
+	// Generate a rotation matrix that rotates around the z-axis for each object,
+	//	each one a little faster than the last. Objects take turns with the texture copies,
+	//	and use the first one until theirs has loaded
+	for (uint32_t object = 0; object < OBJECT_COUNT; ++object) {
+		float speed = 1.0f + 0.25f * object;
+		objectConstants_[object].model = glm::rotate(glm::mat4(1.0f), time * speed * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 
-	// What is the maximum number of descriptors that can be allocated
-	poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		uint32_t texture = object % textureCount_;
+		uint32_t index = texture == 0 ? textureIndex_ : extraTextures_[texture - 1].bindlessIndex;
+		objectConstants_[object].textureIndex = index != BindlessHeap::INVALID_INDEX ? index : textureIndex_;
 
-	// Create the pool
-	if (vkCreateDescriptorPool(logicalDevice_, &poolInfo, nullptr, &descriptorPool_) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create descriptor pool!");
+		// Objects without a texture yet skip the sampling altogether
+		objectFeatures_[object] = basePipelineDesc_.features;
+		if (objectConstants_[object].textureIndex == BindlessHeap::INVALID_INDEX)
+			objectFeatures_[object] &= ~SHADER_FEATURE_TEXTURED;
 	}
-}
-
-// Function for creating descriptor sets for uniform buffers
-void HelloTriangleApplication::createDescriptorSets() {
-	std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout_);
-
-	VkDescriptorSetAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-
-	// What pool descriptors will be allocated from
-	allocInfo.descriptorPool = descriptorPool_;
-
-	// How many descriptor sets will be allocated
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-
-	// pointer to the layouts
-	allocInfo.pSetLayouts = layouts.data();
-
-	// Allocate the descriptor sets
-	descriptorSets_.resize(MAX_FRAMES_IN_FLIGHT);
-	if (vkAllocateDescriptorSets(logicalDevice_, &allocInfo, descriptorSets_.data()) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate descriptor sets");
-	}
-
-	// Now that the descriptors have been allocated, they need to be configured
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-		// Specify the uniform buffer info
-		VkDescriptorBufferInfo bufferInfo{};
-
-		// What buffer this descriptor has
-		bufferInfo.buffer = uniformBuffers_[i];
 
-		// Binding offset is zero
-		bufferInfo.offset = 0;
-
-		// Specify a size that will be written to
-		bufferInfo.range = sizeof(UniformBufferObject);
-
-		// Now we need to write the descriptors
-		VkWriteDescriptorSet descriptorWrite{};
-		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.dstSet = descriptorSets_[i];
-		descriptorWrite.dstBinding = 0; // Uniform binding is 0
-		descriptorWrite.dstArrayElement = 0; // No array, so 0
-
-		// Descriptor is means for a uniform buffer
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrite.descriptorCount = 1;
-
-		// used for buffer descriptors
-		descriptorWrite.pBufferInfo = &bufferInfo;
-
-		// used for image descriptors
-		descriptorWrite.pImageInfo = nullptr; // Optional
+	// The culling pass needs the same camera and transforms
+	updateCullUniforms(ubo, currentFrame);
+}
 
-		// used for buffer view descriptors
-		descriptorWrite.pTexelBufferView = nullptr; // Optional
+//*****************************************************************************
+//	Cull Uniforms
+//		The frustum planes come straight out of the rows of proj * view
+//		(Gribb & Hartmann). Vulkan's depth goes from 0 to 1, so the near
+//		plane is just the third row
+//*****************************************************************************
+void HelloTriangleApplication::updateCullUniforms(const FrameUniforms& frameUniforms, uint32_t currentFrame) {
+	CullUniforms cull{};
+
+	glm::mat4 viewProj = frameUniforms.proj * frameUniforms.view;
+	glm::vec4 rows[4];
+	for (int row = 0; row < 4; ++row)
+		rows[row] = glm::vec4(viewProj[0][row], viewProj[1][row], viewProj[2][row], viewProj[3][row]);
+
+	cull.frustumPlanes[0] = rows[3] + rows[0]; // Left
+	cull.frustumPlanes[1] = rows[3] - rows[0]; // Right
+	cull.frustumPlanes[2] = rows[3] + rows[1]; // Bottom
+	cull.frustumPlanes[3] = rows[3] - rows[1]; // Top
+	cull.frustumPlanes[4] = rows[2];           // Near
+	cull.frustumPlanes[5] = rows[3] - rows[2]; // Far
+
+	// Normalize so the distance to a plane is in world units, for comparing against radii
+	for (glm::vec4& plane : cull.frustumPlanes)
+		plane /= glm::length(glm::vec3(plane));
+
+	for (uint32_t object = 0; object < OBJECT_COUNT; ++object)
+		cull.objectModels[object] = objectConstants_[object].model;
+
+	// The camera sits at the origin of view space
+	cull.cameraPosition = glm::inverse(frameUniforms.view) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	for (uint32_t lod = 1; lod < LOD_COUNT; ++lod)
+		cull.lodDistances[lod - 1] = LOD_DISTANCES[lod - 1];
+
+	// Sphere around every vertex of the mesh
+	cull.boundingRadius = meshBoundsRadius_;
+
+	cull.instanceCount = instanceCount();
+	cull.instancesPerObject = instancesPerObject();
+	cull.lodCount = LOD_COUNT;
+
+	char* mapped = static_cast<char*>(uniformBufferMemory_.mapped);
+	memcpy(mapped + frames_[currentFrame].cullUniformOffset, &cull, sizeof(cull));
+}
 
-		// Now update the descriptors
-		vkUpdateDescriptorSets(logicalDevice_, 1, &descriptorWrite, 0, nullptr);
-	}
+// Function for creating the descriptor sets for the uniform buffer and the culling pass.
+//	Neither set ever changes, so both come out of the allocator's cache
+void HelloTriangleApplication::createDescriptorSets() {
+	// The uniform buffer is at binding 0. Its binding offset is zero, the dynamic
+	//	offset is added on top of it, and the range is one frame's worth.
+	//	Only one set, frames pick their uniforms with a dynamic offset
+	descriptorSet_ = descriptors_.getCached(descriptorSetLayout_, {
+		DescriptorResource::makeBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformBuffer_, 0, sizeof(FrameUniforms)),
+	});
+
+	// The culling pass's set. Ranges are one frame's worth, the dynamic offsets pick the frame
+	std::array<VkDescriptorBufferInfo, CULL_BINDING_TYPES.size()> cullBuffers{};
+	cullBuffers[0] = { uniformBuffer_, 0, sizeof(CullUniforms) };
+	cullBuffers[1] = { instanceBuffer_, 0, sizeof(InstanceData) * instanceCount() };
+	cullBuffers[2] = { indirectBuffer_, 0, sizeof(VkDrawIndexedIndirectCommand) * INDIRECT_DRAW_COUNT };
+	cullBuffers[3] = { visibleInstanceBuffer_, 0, sizeof(InstanceData) * instancesPerObject() * INDIRECT_DRAW_COUNT };
+	cullBuffers[4] = { drawCountBuffer_, 0, sizeof(uint32_t) * OBJECT_COUNT };
+
+	std::vector<DescriptorResource> cullResources;
+	for (uint32_t i = 0; i < cullBuffers.size(); ++i) {
+		cullResources.push_back(DescriptorResource::makeBuffer(i, CULL_BINDING_TYPES[i],
+			cullBuffers[i].buffer, cullBuffers[i].offset, cullBuffers[i].range));
+	}
+	cullDescriptorSet_ = descriptors_.getCached(cullSetLayout_, cullResources);
 }
 
 // Function for creating a Vk Image 
-void HelloTriangleApplication::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void HelloTriangleApplication::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory, VkSampleCountFlagBits samples) {
 	// Image creation struct
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1986,13 +3014,13 @@ void HelloTriangleApplication::createImage(uint32_t width, uint32_t height, VkFo
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1; // REMEMBER TO SPECIFY THE DEPTH AS ONE, program will be very unhappy if forgotten
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageInfo.usage = usage;
-	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.samples = samples;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
 	// Actually create the image
@@ -2004,209 +3032,412 @@ void HelloTriangleApplication::createImage(uint32_t width, uint32_t height, VkFo
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(logicalDevice_, image, &memRequirements);
 
-	// Create the allocation info
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	// Perform the actual allocation
-	if (vkAllocateMemory(logicalDevice_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate image memory!");
-	}
+	// Sub-allocate the image memory. Optimal images need to be kept away from
+	//	buffers by bufferImageGranularity, so tell the allocator what kind of resource this is
+	uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+	ResourceKind kind = (tiling == VK_IMAGE_TILING_OPTIMAL) ? ResourceKind::OptimalImage : ResourceKind::Buffer;
+	imageMemory = allocator_.allocate(memRequirements, memoryType, kind);
 
 	// Remember to bind the memory to the image handle
-	vkBindImageMemory(logicalDevice_, image, imageMemory, 0);
+	vkBindImageMemory(logicalDevice_, image, imageMemory.memory, imageMemory.offset);
 }
 
 // Function for creating a texture image
 void HelloTriangleApplication::createTextureImage() {
-	// Load the image using STB Image
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load("data\\textures\\GupPointPlead.png", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	// Prefer a compressed copy of the texture if one was made
+	std::string path = TEXTURE_PATH;
+	std::string stem = path.substr(0, path.find_last_of('.'));
+	for (const char* extension : COMPRESSED_TEXTURE_EXTENSIONS) {
+		if (std::ifstream(stem + extension).good()) {
+			path = stem + extension;
+			break;
+		}
+	}
+
+	// Containers have their mips on disk, so only what fits the budget needs to be resident.
+	//	Decoded images make their mips on the GPU from the first level, so they stay whole
+	if (isTextureContainer(path))
+		streamedTexture_ = textureStreamer_.add(path);
+	else
+		loadTextureAsync(path, textureImage_, textureImageView_, textureImageMemory_);
+
+	// Any more copies are loaded whole, each into its own image. The loads write
+	//	into the elements when they finish, so the vector is never resized after this
+	extraTextures_.assign(textureCount_ - 1, ExtraTexture{});
+	for (ExtraTexture& texture : extraTextures_)
+		loadTextureAsync(path, texture.image, texture.view, texture.memory);
+}
+
+//*****************************************************************************
+//	Bindless Textures
+//		A texture gets an element in the bindless image array once its view
+//		exists. Streamed textures get a new view every time their residency
+//		changes, so they move to a new element, and the old one is handed
+//		back once the frames that might read it have finished. Only elements
+//		no pending frame reads are ever written.
+//*****************************************************************************
+void HelloTriangleApplication::updateBindlessTextures() {
+	std::vector<uint32_t> changed = textureStreamer_.takeChangedTextures();
+	if (!bindless_)
+		return;
 
-	// Calculate the size of the image
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
+	bindlessHeap_.release(graphicsTimeline_.completedValue());
 
-	// Error checking
-	if (!pixels) {
-		throw std::runtime_error("Failed to load texture image!");
+	for (uint32_t texture : changed) {
+		if (texture != streamedTexture_)
+			continue;
+		if (textureIndex_ != BindlessHeap::INVALID_INDEX)
+			bindlessHeap_.removeImage(textureIndex_, graphicsTimeline_.submittedValue());
+		textureIndex_ = bindlessHeap_.addImage(textureStreamer_.view(texture));
 	}
 
-	// Like last time, we will have a staging buffer
-	VkBuffer stagingBuffer;             // The handle to the buffer
-	VkDeviceMemory stagingBufferMemory; // The actual memory of the buffer
+	if (textureImageView_ != VK_NULL_HANDLE && textureIndex_ == BindlessHeap::INVALID_INDEX)
+		textureIndex_ = bindlessHeap_.addImage(textureImageView_);
 
-	// Will be the source of a memory transfer, and buffer needs to be seen by host
-	VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	VkMemoryPropertyFlags memProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	createBuffer(imageSize, bufferUsage, memProps, stagingBuffer, stagingBufferMemory);
+	for (ExtraTexture& texture : extraTextures_) {
+		if (texture.view != VK_NULL_HANDLE && texture.bindlessIndex == BindlessHeap::INVALID_INDEX)
+			texture.bindlessIndex = bindlessHeap_.addImage(texture.view);
+	}
+}
 
-	// Map the memory for writing
-	void* data;
-	vkMapMemory(logicalDevice_, stagingBufferMemory, 0, imageSize, 0, &data);
+// Copy every level of a texture to where its copy reads from in the staging region
+static void writeTextureLevels(const TextureData& texture, const std::vector<VkBufferImageCopy>& levels, const StagingRegion& staging) {
+	for (size_t level = 0; level < levels.size(); ++level) {
+		memcpy(static_cast<char*>(staging.mapped) + levels[level].bufferOffset,
+			texture.bytes.get() + texture.levels[level].offset, static_cast<size_t>(texture.levels[level].size));
+	}
+}
 
-	// Copy the pixels into the memory
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
+//*****************************************************************************
+//	Load Texture Async
+//		The image is decoded on a worker and written straight into the staging
+//		ring. Creating the image and queueing the copy touches Vulkan, so that
+//		part is handed back to the device thread.
+//		KTX2 and DDS files already hold the GPU format and every mip level.
+//		Anything else is decoded to RGBA and the rest of its mips are made on
+//		the GPU.
+//*****************************************************************************
+void HelloTriangleApplication::loadTextureAsync(const std::string& path, VkImage& image, VkImageView& view, Allocation& imageMemory) {
+	jobs_.submit([this, path, &image, &view, &imageMemory]() {
+		try {
+			auto texture = std::make_shared<TextureData>();
+			if (isTextureContainer(path)) {
+				loadTextureFile(path, *texture);
+			}
+			else {
+				// Load the image using STB Image
+				int texWidth, texHeight, texChannels;
+				stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+				// Error checking
+				if (!pixels) {
+					throw std::runtime_error("Failed to load texture image!");
+				}
+
+				texture->format = VK_FORMAT_R8G8B8A8_SRGB;
+				texture->width = static_cast<uint32_t>(texWidth);
+				texture->height = static_cast<uint32_t>(texHeight);
+				texture->levels.push_back({ 0, static_cast<uint64_t>(texWidth) * texHeight * 4, texture->width, texture->height });
+				texture->bytes = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
+				texture->generateMips = true;
+			}
 
-	// Remember to unmap the memory
-	vkUnmapMemory(logicalDevice_, stagingBufferMemory);
+			// Compressed formats are optional, so make sure the device can sample this one.
+			//	Format queries don't go through the device, so they are fine from a worker
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(vkPhysicalDevice_, texture->format, &formatProperties);
+			if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+				throw std::runtime_error("Texture format isn't supported by this device: " + path);
+			}
 
-	// Don't forget to free up the image memory now that we have it in a staging buffer
-	stbi_image_free(pixels);
+			// Mips are made with linear blits. Without them the texture just has one level
+			const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+				VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+			if ((formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures)
+				texture->generateMips = false;
+
+			// Every level goes in one staging region, each on an aligned offset
+			std::vector<VkBufferImageCopy> levels;
+			VkDeviceSize stagingSize = 0;
+			for (uint32_t level = 0; level < texture->levels.size(); ++level) {
+				const TextureLevel& mip = texture->levels[level];
+				stagingSize = (stagingSize + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+				VkBufferImageCopy copy{};
+				copy.bufferOffset = stagingSize;
+				copy.bufferRowLength = 0;
+				copy.bufferImageHeight = 0; // Tightly packed, compressed levels included
+				copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				copy.imageSubresource.mipLevel = level;
+				copy.imageSubresource.baseArrayLayer = 0;
+				copy.imageSubresource.layerCount = 1;
+				copy.imageOffset = { 0, 0, 0 };
+				copy.imageExtent = { mip.width, mip.height, 1 };
+				levels.push_back(copy);
+
+				stagingSize += mip.size;
+			}
 
-	// Now create the image
-	createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage_, textureImageMemory_);
+			// Copy the levels straight into the staging ring if there is room.
+			//	If not, the device thread will have to make room, so hold on to them
+			StagingRegion staging;
+			bool staged = stagingSize <= stagingRing_.capacity() && stagingRing_.tryAllocate(stagingSize, STAGING_ALIGNMENT, staging);
+			if (staged) {
+				writeTextureLevels(*texture, levels, staging);
 
-	// In order for us to copy the staging buffer to a texture image, we need to:
-	//	Transition the texture image to DST_OPTIMAL
-	//	Execute the buffer to image copy operation
-	transitionImageLayout(textureImage_, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	copyBufferToImage(stagingBuffer, textureImage_, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+				// Don't forget to free up the image memory now that we have it in a staging buffer
+				texture->bytes.reset();
+			}
 
-	// One more transition to prepare the image for shader access
-	transitionImageLayout(textureImage_, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			jobs_.postToDevice([this, staging, staged, stagingSize, texture, levels, &image, &view, &imageMemory]() {
+				StagingRegion region = staging;
+				if (!staged) {
+					region = stageUpload(stagingSize);
+					writeTextureLevels(*texture, levels, region);
+				}
 
-	// Remember to destroy the staging buffer
-	vkDestroyBuffer(logicalDevice_, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice_, stagingBufferMemory, nullptr);
+				finishTextureUpload(region, *texture, levels, image, view, imageMemory);
+			});
+		}
+		catch (const std::exception& e) {
+			// Report the error on the device thread, the same as if it was loaded there
+			std::string message = e.what();
+			jobs_.postToDevice([message]() { throw std::runtime_error(message); });
+		}
+	});
 }
 
-VkCommandBuffer HelloTriangleApplication::beginSingleTimeCommands() {
-	// Allocation info for the command buffer
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool_;
-	allocInfo.commandBufferCount = 1;
-
-	// Allocate a command buffer
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(logicalDevice_, &allocInfo, &commandBuffer);
+void HelloTriangleApplication::finishTextureUpload(const StagingRegion& staging, const TextureData& texture, const std::vector<VkBufferImageCopy>& levels, VkImage& image, VkImageView& view, Allocation& imageMemory) {
+	// Decoded images get a full mip chain. Only the first level is copied, the rest are blitted from it
+	uint32_t mipLevels = texture.generateMips ? fullMipLevelCount(texture.width, texture.height) : static_cast<uint32_t>(levels.size());
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (mipLevels > levels.size())
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
-	// Begin the command buffer for a one time use
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	// Now create the image
+	createImage(texture.width, texture.height, mipLevels, texture.format, VK_IMAGE_TILING_OPTIMAL, usage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+
+	// Shaders read the image through a view of every level
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = texture.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	if (vkCreateImageView(logicalDevice_, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create texture image view!");
+	}
 
-	// Return the command buffer after it has begun
-	return commandBuffer;
+	// In order for us to copy the staging buffer to a texture image, we need to:
+	//	Transition the texture image to DST_OPTIMAL
+	//	Execute the buffer to image copy operation
+	//	Transition the image to SHADER_READ_ONLY_OPTIMAL for shader access
+	// The staging ring records both transitions around the copy, batched with all other uploads
+	stagingRing_.copyToImage(staging, image, levels, mipLevels);
+
+	// Blits need a graphics queue, and the copies may be on the transfer queue.
+	//	So the mips get made on the graphics queue right after it takes the image over
+	if (mipLevels > levels.size())
+		pendingMipmaps_.push_back({ image, texture.width, texture.height, mipLevels });
 }
 
-void HelloTriangleApplication::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-	// End the given command buffer
-	vkEndCommandBuffer(commandBuffer);
+//*****************************************************************************
+//	Mipmap Generation
+//		Each level is a linear blit of the one before it. Levels move to
+//		TRANSFER_SRC as they are finished so the next blit can read them,
+//		then every image goes back to SHADER_READ_ONLY together at the end.
+//		Recorded right after the acquire barriers of the copies they follow.
+//*****************************************************************************
+void HelloTriangleApplication::recordMipmapGeneration(VkCommandBuffer commandBuffer) {
+	if (pendingMipmaps_.empty())
+		return;
 
-	// Get ready to submit the command buffer
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	auto levelBarrier = [](VkImage image, uint32_t baseLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = baseLevel;
+		barrier.subresourceRange.levelCount = levelCount;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		return barrier;
+	};
 
-	// Actually submit the command buffer and wait for it to finish
-	vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicsQueue_);
+	// The uploads left every level in SHADER_READ_ONLY for the fragment shader.
+	//	The first level is read by the first blit, the others are about to be overwritten
+	std::vector<VkImageMemoryBarrier> barriers;
+	for (const auto& mips : pendingMipmaps_) {
+		barriers.push_back(levelBarrier(mips.image, 0, 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_READ_BIT));
+		barriers.push_back(levelBarrier(mips.image, 1, mips.mipLevels - 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT));
+	}
 
-	// Remember to free the temporary command buffer
-	vkFreeCommandBuffers(logicalDevice_, commandPool_, 1, &commandBuffer);
-}
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	for (const auto& mips : pendingMipmaps_) {
+		int32_t width = static_cast<int32_t>(mips.width);
+		int32_t height = static_cast<int32_t>(mips.height);
+		for (uint32_t level = 1; level < mips.mipLevels; ++level) {
+			int32_t nextWidth = std::max(width / 2, 1);
+			int32_t nextHeight = std::max(height / 2, 1);
+
+			VkImageBlit blit{};
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = level - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = 1;
+			blit.srcOffsets[0] = { 0, 0, 0 };
+			blit.srcOffsets[1] = { width, height, 1 };
+			blit.dstSubresource = blit.srcSubresource;
+			blit.dstSubresource.mipLevel = level;
+			blit.dstOffsets[0] = { 0, 0, 0 };
+			blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+
+			vkCmdBlitImage(commandBuffer,
+				mips.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				mips.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit, VK_FILTER_LINEAR);
+
+			// The next blit reads the level that was just written
+			VkImageMemoryBarrier barrier = levelBarrier(mips.image, level, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+			vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				1, &barrier);
+
+			width = nextWidth;
+			height = nextHeight;
+		}
+	}
 
-void HelloTriangleApplication::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	// Every level is a transfer source now, hand them all to the fragment shader
+	barriers.clear();
+	for (const auto& mips : pendingMipmaps_) {
+		barriers.push_back(levelBarrier(mips.image, 0, mips.mipLevels, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+	}
 
-	// Set up a memory barrier
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout; // If you don't care about existing contents, can use UNDEFINED
-	barrier.newLayout = newLayout;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
 
-	// We are not transfering queue family ownership, so the source and destination can be ignored
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pendingMipmaps_.clear();
+}
 
-	// Specify the image being affected, and a specific part of the image
-	barrier.image = image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
+//*****************************************************************************
+//	Staging Ring
+//		One persistently mapped buffer that every upload is written into.
+//		Space is handed back as the frames that copied out of it finish, so
+//		uploading assets doesn't create, map, or free anything.
+//*****************************************************************************
+void HelloTriangleApplication::createStagingRing() {
+	// Source of memory transfers, and needs to be seen by the host
+	VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	VkMemoryPropertyFlags memProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	createBuffer(STAGING_RING_SIZE, bufferUsage, memProps, stagingRingBuffer_, stagingRingMemory_);
 
-	// We need to specify what stages of the pipeline are being changed based on what we are transitioning to
-	VkPipelineStageFlags srcStage;
-	VkPipelineStageFlags dstStage;
+	// The allocator keeps the memory mapped, so the ring can write into it for its whole lifetime
+	stagingRing_.init(stagingRingBuffer_, stagingRingMemory_.mapped, STAGING_RING_SIZE);
 
-	// Undefined to transfer dst optimal
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		// Going from undefined to a transfer write
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	// Copies run on the transfer queue, then the graphics queue takes ownership of the results
+	QueueFamilyIndices indices = findQueueFamilies(vkPhysicalDevice_);
+	stagingRing_.setQueueFamilies(indices.transferFamily.value(), indices.graphicsFamily.value());
+}
 
-		// At the top of the pipeline going into a transfer stage
-		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+StagingRegion HelloTriangleApplication::stageUpload(VkDeviceSize size) {
+	StagingRegion region;
+	if (!stagingRing_.tryAllocate(size, STAGING_ALIGNMENT, region)) {
+		// The ring is full of data the GPU hasn't read yet.
+		//	Push everything through so all of the space comes back, then try again.
+		//	Every read of the ring is retired on the graphics timeline, frames included,
+		//	so waiting for its last value covers all of them
+		flushStagingUploads();
+		graphicsTimeline_.wait(graphicsTimeline_.submittedValue());
+		stagingRing_.release(graphicsTimeline_.submittedValue());
+
+		if (!stagingRing_.tryAllocate(size, STAGING_ALIGNMENT, region)) {
+			throw std::runtime_error("Failed to allocate staging memory!");
+		}
 	}
 
-	// transfer dst optimal to shader read only optimal
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		// Going from a transfer write to a shader read
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	return region;
+}
 
-		// Going from a transfer stage to the fragment shader
-		srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
+SetupTicket HelloTriangleApplication::flushStagingUploads() {
+	if (stagingRing_.hasPendingCopies()) {
+		// Record every queued copy into the transfer queue's setup commands
+		stagingRing_.recordPendingCopies(transferSetupCommands_.commandBuffer());
+		SetupTicket copies = transferSetupCommands_.flush();
 
-	// Invalid
-	else {
-		throw std::invalid_argument("Unsupported layout transition!");
+		// The graphics queue waits for the copies' value on the transfer timeline,
+		//	then takes ownership of everything that was copied
+		setupCommands_.waitSemaphore(transferTimeline_.waitFor(copies.value, StagingRing::READ_STAGES));
+		stagingRing_.recordAcquireBarriers(setupCommands_.commandBuffer());
+		recordMipmapGeneration(setupCommands_.commandBuffer());
 	}
 
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		srcStage, dstStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	endSingleTimeCommands(commandBuffer);
+	// One submit for all of the setup work, including anything else recorded
+	//	into the setup commands. The ring space comes back once it has finished
+	SetupTicket ticket = setupCommands_.flush();
+	stagingRing_.retire(ticket.value);
+	return ticket;
 }
 
-void HelloTriangleApplication::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	// Define the region for how we are copying the memory
-	VkBufferImageCopy region{};
-	region.bufferOffset = 0; // Offset into memory
+//*****************************************************************************
+//	Submit Staging Uploads
+//		Records this frame's streamed uploads on the transfer queue. Returns
+//		the transfer timeline value the frame's graphics submission needs to
+//		wait on, or 0 if there was nothing to upload.
+//*****************************************************************************
+uint64_t HelloTriangleApplication::submitStagingUploads(uint32_t frame) {
+	if (!stagingRing_.hasPendingCopies())
+		return 0;
 
-	region.bufferRowLength = 0; 
-	region.bufferImageHeight = 0; // Both zero means the image is tightly packed
+	// The last submission of this command buffer was waited on by this frame's
+	//	graphics work, and that has already been waited on
+	VkCommandBuffer commandBuffer = frames_[frame].transferCommandBuffer;
+	vkResetCommandBuffer(commandBuffer, 0);
 
-	// Define to which part of the image we want to copy pixels to
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording upload command buffer!");
+	}
 
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = { width, height, 1 };
+	uint32_t uploadScope = transferTimestamps_ ? profiler_.beginGpuScope(commandBuffer, "Uploads") : Profiler::INVALID_SCOPE;
+	stagingRing_.recordPendingCopies(commandBuffer);
+	profiler_.endGpuScope(commandBuffer, uploadScope);
 
-	// Queue the copy command
-	vkCmdCopyBufferToImage(
-		commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
-	);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record upload command buffer!");
+	}
 
-	endSingleTimeCommands(commandBuffer);
+	// The copies signal the next transfer timeline value. Nothing waits on it
+	//	from the CPU, the frame's graphics value covers it since it waits on this one
+	return transferTimeline_.submit(&commandBuffer, 1);
 }
 
 VKAPI_ATTR VkBool32 VKAPI_CALL HelloTriangleApplication::debugCallback(
@@ -19,76 +19,87 @@
 #include <vector>
 #include <optional>
 #include <array>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <memory>
 
 #define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-// Struct for handling a mesh vertex
-struct Vertex {
-	glm::vec2 pos;   //!< Position of this vertex
-	glm::vec3 color; //!< Color at this vertex
-
-	// Function for getting how to bind this input
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "SetupCommands.h"
+#include "JobSystem.h"
+#include "ParallelRecorder.h"
+#include "PipelineCache.h"
+#include "PipelineManager.h"
+#include "QueueTimeline.h"
+#include "MeshFile.h"
+#include "TextureFile.h"
+#include "TextureStreamer.h"
+#include "BindlessHeap.h"
+#include "DescriptorAllocator.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "ShaderWatcher.h"
+#include "SceneStore.h"
+#include "RenderTier.h"
+#include "VertexFormats.h"
+
+// Struct for the per-instance data. Every instance of a mesh gets its own
+//	transform and color. The scene store writes these every frame, the culling
+//	pass reads them and the visible ones are pulled from a second vertex buffer
+struct InstanceData {
+	glm::mat4 model; //!< Transform of this instance
+	glm::vec4 color; //!< Tint applied to the mesh's vertex colors
+
+	// Instance data lives in binding 1, and moves forward once per instance instead of per vertex
 	static VkVertexInputBindingDescription getBindingDescription() {
-		// Struct for specifying the description
 		VkVertexInputBindingDescription bindingDescription{};
-
-		// Where the input will bind to
-		bindingDescription.binding = 0;
-
-		// The stride of the input
-		bindingDescription.stride = sizeof(Vertex);
-
-		// Two options for this:
-		//	VERTEX - Move to next data entry after each vertex
-		//	INSTANCE - Move to next data entry after each instance
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		bindingDescription.binding = 1;
+		bindingDescription.stride = sizeof(InstanceData);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
 		return bindingDescription;
 	}
 
-	// Function for getting attribute descriptions
-	static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
-		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
-
-		// Describe the position attribute
-
-		// What binding the per-vertex data comes from
-		attributeDescriptions[0].binding = 0;
-
-		// The location of the attribute in the shader
-		attributeDescriptions[0].location = 0;
+	// A mat4 attribute takes up four locations, one per column
+	static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
 
-		// The data type of the attribute. Common typings are:
-		//	float - VK_FORMAT_R32_SFLOAT
-		//	vec2 - VK_FORMAT_R32G32_SFLOAT
-		//	vec3 - VK_FORMAT_R32G32B32_SFLOAT
-		//	vec4 - VK_FORMAT_R32G32B32A32_SFLOAT
-		// Make sure to also match the typings correctly:
-		//	ivec2 - VK_FORMAT_R32G32_SINT
-		//	uvec4 - VK_FORMAT_R32G32B32A32_UINT
-		//	double - VK_FORMAT_R64_SFLOAT
-		attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+		// Model matrix columns, locations 2 through 5
+		for (uint32_t column = 0; column < 4; ++column) {
+			attributeDescriptions[column].binding = 1;
+			attributeDescriptions[column].location = 2 + column;
+			attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[column].offset = static_cast<uint32_t>(offsetof(InstanceData, model) + sizeof(glm::vec4) * column);
+		}
 
-		// Number of bytes since the start of the per-vertex data
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-		// Describe the color attribute
-		attributeDescriptions[1].binding = 0;
-		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
+		// Color at location 6
+		attributeDescriptions[4].binding = 1;
+		attributeDescriptions[4].location = 6;
+		attributeDescriptions[4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[4].offset = offsetof(InstanceData, color);
 
 		return attributeDescriptions;
 	}
 };
 
+static_assert(sizeof(InstanceData) == SceneStore::INSTANCE_STRIDE && offsetof(InstanceData, color) == SceneStore::COLOR_OFFSET,
+	"The scene store writes InstanceData");
+
 // Struct for Queue Families
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
 
+	// Family used for uploads. A transfer-only family if the device has one,
+	//	otherwise the graphics family is used
+	std::optional<uint32_t> transferFamily;
+
 	bool isComplete() {
 		return graphicsFamily.has_value() && presentFamily.has_value();
 	}
@@ -101,23 +112,152 @@ struct SwapChainSupportDetails {
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
-// Struct for our uniform buffer
+// Uniforms that are the same for everything drawn in a frame
 //	alignas is added to be explicit with how the data is aligned
-struct UniformBufferObject {
-	alignas(16) glm::mat4 model;
+struct FrameUniforms {
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
 };
 
+// Per-object data, handed to the shader as push constants right before the
+//	object's draws. Every device has at least 128 bytes of push constants.
+//	With bindless descriptors the object also says which texture it reads
+struct ObjectConstants {
+	alignas(16) glm::mat4 model;
+	uint32_t textureIndex = BindlessHeap::INVALID_INDEX; //!< Element of the bindless image array
+};
+static_assert(sizeof(ObjectConstants) <= 128, "Object constants have to fit in the guaranteed push constant space");
+
+// Permutations of the scene shaders. Bit i is the bool specialization constant with
+//	constant_id i in BaseShader.vert and BaseShader.frag, see PipelineDesc::features
+const uint32_t SHADER_FEATURE_TEXTURED = 1u << 0;       //!< Sample the object's bindless texture
+const uint32_t SHADER_FEATURE_VERTEX_COLOR = 1u << 1;   //!< Tint by the vertex color
+const uint32_t SHADER_FEATURE_INSTANCE_COLOR = 1u << 2; //!< Tint by the instance color
+const uint32_t SHADER_FEATURE_COUNT = 3;
+static_assert(SHADER_FEATURE_COUNT <= MAX_SHADER_FEATURES, "Shader features have to fit in the feature constant ids");
+
+// How many objects the scene is split into, and how many levels of detail each
+//	one has. The culling pass writes one indirect command per object per level
+const uint32_t OBJECT_COUNT = 4;
+const uint32_t LOD_COUNT = 2;
+static_assert(LOD_COUNT <= 4, "LOD distances are packed in a vec4");
+
+// Instances along each side of the grid the mesh is drawn in, unless setInstanceGridSize picks another
+const uint32_t DEFAULT_INSTANCE_GRID_SIZE = 128;
+
+// What the culling compute shader reads, written every frame next to FrameUniforms.
+//	std140, so the scalars go at the end
+struct CullUniforms {
+	alignas(16) glm::vec4 frustumPlanes[6];           //!< World space, xyz is the inward normal and w the distance
+	alignas(16) glm::mat4 objectModels[OBJECT_COUNT]; //!< Each object's transform, the same as its push constants
+	alignas(16) glm::vec4 cameraPosition;             //!< World space position of the camera, w unused
+	alignas(16) glm::vec4 lodDistances;               //!< Distance from the camera where LOD i + 1 starts
+	float boundingRadius;                             //!< Radius of a sphere around the mesh, in model space
+	uint32_t instanceCount;                           //!< How many instances to test
+	uint32_t instancesPerObject;                      //!< Instances are split evenly over the objects, in order
+	uint32_t lodCount;                                //!< How many levels of detail each object has
+};
+
+// Everything one frame in flight owns. Kept together so a frame's
+//	resources sit next to each other, and so the number of frames
+//	in flight can be picked at runtime
+struct FrameContext {
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;         //!< Primary command buffer the frame is recorded into
+	VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE; //!< Command buffer for uploads streamed in this frame
+
+	VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE; //!< Semaphore for checking if image is available
+	VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE; //!< Semaphore for checking if rendering has finished
+	uint64_t timelineValue = 0;                           //!< Graphics timeline value of the frame's last submit
+
+	uint32_t uniformOffset = 0;     //!< Dynamic offset of the frame's FrameUniforms in the shared uniform buffer
+	uint32_t cullUniformOffset = 0; //!< Dynamic offset of the frame's CullUniforms in the shared uniform buffer
+
+	uint32_t instancesOffset = 0;        //!< Where the frame's instances start, written by the scene store
+	uint32_t drawCommandsOffset = 0;     //!< Where the frame's culled indirect commands start
+	uint32_t visibleInstancesOffset = 0; //!< Where the frame's visible instances start
+	uint32_t drawCountsOffset = 0;       //!< Where the frame's per object draw counts start
+};
+
+// What a physical device can do, worked out while picking one
+struct DeviceCapabilities {
+	std::string name;
+	VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+	bool suitable = false;              //!< Has everything the renderer can't run without
+	bool multiDrawIndirect = false;
+	bool drawIndirectCount = false;
+	bool bindless = false;              //!< Every descriptor indexing feature BindlessHeap uses
+	bool memoryBudget = false;          //!< VK_EXT_memory_budget
+	VkDeviceSize deviceLocalMemory = 0; //!< Size of the biggest device local heap
+	RenderTier tier = RenderTier::Baseline; //!< Highest tier the features allow
+};
+
+// How frames are presented and paced, see setPresentPolicy
+struct PresentPolicy {
+	VkPresentModeKHR mode = VK_PRESENT_MODE_MAILBOX_KHR; //!< Falls back to FIFO, which every surface has
+	uint32_t imageCount = 0;   //!< Swap chain images, 0 for one more than the minimum. Never below the minimum
+	double maxFrameRate = 0.0; //!< Frames per second the limiter caps at, 0 for no cap
+	bool lowLatency = false;   //!< Wait for the GPU to go idle before reading input, so frames never queue up
+	bool presentWait = false;  //!< Also wait for the last image to be displayed, with VK_KHR_present_wait when the device has it
+};
+
+// What a headless run measured, for the benchmark to work its statistics out of
+struct RunStats {
+	std::string deviceName;
+	RenderTier renderTier = RenderTier::Baseline;
+	std::vector<FrameTiming> frames; //!< Every frame drawn, oldest first
+	double seconds = 0.0;            //!< Wall time of the frames after the warm up
+	uint64_t uploadedBytes = 0;      //!< Bytes copied out of the staging ring over the same frames
+	VkDeviceSize memoryUsed = 0;     //!< Device local bytes handed out to resources at the end
+	VkDeviceSize memoryReserved = 0; //!< Device local bytes of memory blocks at the end
+};
+
 class HelloTriangleApplication {
 public:
 
 	// Member functions
 	void run();
+
+	// How many frames can be in flight, 2 or 3. Has to be set before run
+	void setFramesInFlight(uint32_t count);
+
+	// Profile every frame and write a Chrome trace to path on exit. Has to be set before run
+	void setProfileOutput(const std::string& path) { profileOutput_ = path; }
+
+	// How frames are presented and paced. Can be changed while running, the swap chain
+	//	is remade on the next frame
+	void setPresentPolicy(const PresentPolicy& policy);
+
+	// Use the device at this index, or whose name contains this (ignoring case), instead of
+	//	the best one. Fails if that device can't run the renderer. Has to be set before run
+	void setDeviceOverride(const std::string& nameOrIndex) { deviceOverride_ = nameOrIndex; }
+
+	// Never go above this tier, even when the device can. Has to be set before run
+	void setMaxRenderTier(RenderTier tier) { maxRenderTier_ = tier; }
+
+	// Render frameCount frames into offscreen images, with no window, surface or swap chain,
+	//	then return from run. Time steps are fixed so every run draws the same frames.
+	//	The run's time and uploads leave out the first warmupFrames. Has to be set before run
+	void setHeadless(uint32_t frameCount, uint32_t warmupFrames = 0);
+
+	// Size of the scene, set before run. The grid is gridSize x gridSize instances,
+	//	and every object needs the same number of them. Textures past the first
+	//	are more copies of it, each its own image
+	void setInstanceGridSize(uint32_t gridSize);
+	void setTextureCount(uint32_t count);
+
+	// Watch the compiled shaders, and rebuild the pipelines made from any that change.
+	//	Has to be set before run
+	void setShaderHotReload(bool enabled) { shaderHotReload_ = enabled; }
+
+	// What the last headless run measured, filled in when run returns
+	const RunStats& runStats() const { return runStats_; }
 	
 	// Set flag for window being resized
 	void windowResized() { framebufferResized_ = true; }
 
+	// The window wants to be drawn again, which is the only way to draw during a resize on Windows
+	void windowRefreshed();
+
 private:
 
 	// Helper functions
@@ -128,12 +268,17 @@ private:
 	std::vector<const char*> getRequiredExtensions();
 	void setupDebugMessenger();
 	void mainloop();
+	void runHeadless();
+	void paceFrame();
+	void pollPresents();
 	void cleanup();
 	void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 	bool isDeviceSuitable(VkPhysicalDevice device);
+	std::vector<const char*> requiredDeviceExtensions() const;
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 	void pickPhysicalDevice();
-	int rateDeviceSuitability(VkPhysicalDevice device);
+	DeviceCapabilities queryDeviceCapabilities(VkPhysicalDevice device);
+	int rateDeviceSuitability(const DeviceCapabilities& capabilities);
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 	void createLogicalDevice();
 	void createSurface();
@@ -141,35 +286,59 @@ private:
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
-	void createSwapChain();
+	void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+	void createOffscreenImages();
 	void createImageViews();
+	void chooseAttachmentFormats();
+	void buildRenderGraph();
 	void createGraphicsPipeline();
-	VkShaderModule createShaderModule(const std::vector<char>& code);
+	std::array<std::string, 2> sceneShaders() const;
+	void reloadChangedShaders();
 	void createRenderPass();
 	void createFramebuffers();
 	void createCommandPool();
 	void createCommandBuffers();
+	void createSetupCommands();
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void recordDrawReset(VkCommandBuffer commandBuffer);
+	void recordCulling(VkCommandBuffer commandBuffer);
+	void recordDrawCompaction(VkCommandBuffer commandBuffer);
+	void bindCulling(VkCommandBuffer commandBuffer);
+	void recordScene(VkCommandBuffer commandBuffer);
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count);
 	void drawFrame();
 	void createSyncObjects();
 	void recreateSwapChain();
 	void cleanupSwapChain();
-	void createVertexBuffer();
-	void createIndexBuffer();
+	void releaseRetiredSwapChains();
+	bool windowMinimized() const;
+	void loadMesh();
+	void stageBufferData(const void* data, VkDeviceSize size, VkBuffer dst);
+	void createVertexBuffer(const MeshFile& mesh);
+	void createIndexBuffer(const MeshFile& mesh);
+	void createInstanceBuffer();
+	void updateInstances(uint32_t currentFrame);
+	void createIndirectBuffers();
+	void createCullPipeline();
+	void updateCullUniforms(const FrameUniforms& frameUniforms, uint32_t currentFrame);
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+	uint32_t instanceCount() const { return instanceGridSize_ * instanceGridSize_; }
+	uint32_t instancesPerObject() const { return instanceCount() / OBJECT_COUNT; }
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory);
 	void createDescriptorSetLayout();
 	void createUniformBuffers();
-	void updateUniformBuffer(uint32_t currentImage);
-	void createDescriptorPool();
+	void updateUniformBuffer(uint32_t currentFrame);
 	void createDescriptorSets();
-	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
 	void createTextureImage();
-	VkCommandBuffer beginSingleTimeCommands();
-	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+	void loadTextureAsync(const std::string& path, VkImage& image, VkImageView& view, Allocation& imageMemory);
+	void finishTextureUpload(const StagingRegion& staging, const TextureData& texture, const std::vector<VkBufferImageCopy>& levels, VkImage& image, VkImageView& view, Allocation& imageMemory);
+	void updateBindlessTextures();
+	void recordMipmapGeneration(VkCommandBuffer commandBuffer);
+	void createStagingRing();
+	StagingRegion stageUpload(VkDeviceSize size);
+	SetupTicket flushStagingUploads();
+	uint64_t submitStagingUploads(uint32_t frame);
 
 	// Debug callback function
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
@@ -190,10 +359,36 @@ private:
 
 	VkDevice logicalDevice_; //!< The logical device for Vulkan
 
+	MemoryAllocator allocator_; //!< Sub-allocates all buffer and image memory
+
 	VkQueue graphicsQueue_; //!< The queue for graphics commands
 	VkQueue presentQueue_;  //!< Presentation queue
+	VkQueue transferQueue_; //!< Queue that all uploads are copied on
 
-	VkSwapchainKHR swapChain_; //!< Member variable for the swap chain
+	QueueTimeline graphicsTimeline_; //!< Counter every graphics queue submit signals
+	QueueTimeline transferTimeline_; //!< Counter every transfer queue submit signals
+
+	VkSwapchainKHR swapChain_ = VK_NULL_HANDLE; //!< Member variable for the swap chain
+
+	PresentPolicy presentPolicy_; //!< Present mode, image count and pacing
+	bool presentWait_ = false;    //!< VK_KHR_present_id and VK_KHR_present_wait are enabled
+
+	std::string deviceOverride_;                     //!< Device picked by name or index, empty for the best one
+	RenderTier maxRenderTier_ = RenderTier::High;    //!< Cap on the tier picked
+	RenderTier renderTier_ = RenderTier::Baseline;   //!< Tier the device runs at, which features are turned on
+	DeviceCapabilities deviceCapabilities_;          //!< What the picked device can do
+	PFN_vkWaitForPresentKHR waitForPresent_ = nullptr;
+	uint64_t nextPresentId_ = 1;  //!< Ids only ever go up, and 0 means no id
+
+	// A present whose frame hasn't been seen on screen yet
+	struct PendingPresent {
+		uint64_t presentId;
+		uint64_t timelineValue; //!< The frame's graphics submit, for when there is no present wait
+		uint64_t frame;         //!< Profiler frame number
+	};
+	std::deque<PendingPresent> pendingPresents_; //!< Oldest first
+
+	std::chrono::steady_clock::time_point nextFrameTime_; //!< When the frame limiter lets the next frame start
 
 	std::vector<VkImage> swapChainImages_;         //!< Vector of the swap chain images
 	std::vector<VkImageView> swapChainImageViews_; //!< Vector of the swap chain image views
@@ -203,38 +398,149 @@ private:
 
 	VkRenderPass renderPass_; //!< The render pass
 	VkDescriptorSetLayout descriptorSetLayout_; //!< Layout for uniform variables
+	std::vector<VkDescriptorSetLayoutBinding> descriptorSetBindings_; //!< What descriptorSetLayout_ was made of, reflected from the scene shaders
 	VkPipelineLayout pipelineLayout_; //!< The pipeline layout (uniform variables)
 
 	VkPipeline gfxPipeline_; //!< The actual rendering pipeline
 
+	VkDescriptorSetLayout cullSetLayout_; //!< Layout of the culling pass's buffers
+	std::vector<VkDescriptorSetLayoutBinding> cullSetBindings_; //!< What cullSetLayout_ was made of
+	VkPipelineLayout cullPipelineLayout_; //!< Layout of the culling pipeline
+	VkPipeline cullPipeline_;             //!< Compute pipeline that culls instances and picks their LOD
+	VkDescriptorSet cullDescriptorSet_;   //!< The culling pass's buffers, frames pick theirs with dynamic offsets
+
+	PipelineCache pipelineCache_; //!< Compiled pipelines saved between launches
+	PipelineManager pipelines_; //!< Owns every pipeline, looked up by description
+	PipelineDesc basePipelineDesc_; //!< Description of gfxPipeline_, which is also the fallback
+	std::array<PipelineDesc, 1u << SHADER_FEATURE_COUNT> permutationDescs_; //!< basePipelineDesc_ with each combination of features
+
+	bool shaderHotReload_ = false; //!< Rebuild pipelines when their shaders change on disk
+	ShaderWatcher shaderWatcher_;  //!< Watches every shader the pipelines were made from
+
 	std::vector<VkFramebuffer> swapChainFramebuffers_; //!< The Frame buffers in the swap chain
 
+	VkSampleCountFlagBits msaaSamples_ = VK_SAMPLE_COUNT_1_BIT; //!< Samples of the color and depth attachments
+	VkFormat depthFormat_ = VK_FORMAT_UNDEFINED;                //!< Format of the depth attachment
+
+	// The frame's passes, built for the swap chain's size. It owns the multisampled color
+	//	and the depth, which are transient images resolved away by the end of the frame
+	std::unique_ptr<RenderGraph> renderGraph_;
+	RenderGraph::Resource backbuffer_ = RenderGraph::INVALID_RESOURCE; //!< The swap chain (or offscreen) image being drawn to
+	RenderGraph::Resource sceneColor_ = RenderGraph::INVALID_RESOURCE; //!< Multisampled color, resolved into the backbuffer
+	RenderGraph::Resource sceneDepth_ = RenderGraph::INVALID_RESOURCE; //!< Depth of the multisampled color
+	uint32_t curImage_ = 0; //!< Swap chain image the frame being recorded draws into
+
+	// A swap chain that was replaced, kept until the frames that used it have finished
+	struct RetiredSwapChain {
+		VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+		std::vector<VkImageView> imageViews;
+		std::vector<VkFramebuffer> framebuffers;
+		std::unique_ptr<RenderGraph> renderGraph; //!< Its transient images are sized for it
+		uint64_t timelineValue = 0; //!< Last graphics submit that could have used it
+	};
+	std::deque<RetiredSwapChain> retiredSwapChains_; //!< Oldest first
+	void destroyRetiredSwapChain(RetiredSwapChain& retired);
+
+	bool headless_ = false;             //!< Rendering offscreen, swapChainImages_ are ours instead of a swap chain's
+	uint32_t headlessFrames_ = 0;       //!< How many frames a headless run draws
+	uint32_t headlessWarmupFrames_ = 0; //!< Frames drawn before a headless run starts measuring
+	std::vector<Allocation> offscreenMemory_; //!< Memory of each offscreen image, when headless
+	uint64_t framesDrawn_ = 0;          //!< Frames drawFrame has recorded, headless time steps go by it
+	RunStats runStats_;                 //!< Filled in at the end of a headless run
+
 	VkCommandPool commandPool_; //!< Pool for managing buffers and command buffers
+	VkCommandPool transferCommandPool_; //!< Pool for command buffers submitted to the transfer queue
 
-	std::vector<VkCommandBuffer> commandBuffers_; //!< Command buffer for the command pool
+	ParallelRecorder recorder_; //!< Records the draws into secondary command buffers on several threads
 
-	std::vector<VkSemaphore> imageAvailableSemaphores_; //!< Semaphore for checking if image is available
-	std::vector<VkSemaphore> renderFinishedSemaphores_; //!< Semaphore for checking if rendering has finished
+	SetupCommands setupCommands_;         //!< Batches setup work on the graphics queue
+	SetupCommands transferSetupCommands_; //!< Batches setup work on the transfer queue
 
-	std::vector<VkFence> inFlightFences_; //!< An image is currently being rendered
+	std::vector<FrameContext> frames_; //!< Everything each frame in flight owns
+	uint32_t framesInFlight_ = 2;      //!< How many frames can be in flight at once
 
 	bool framebufferResized_ = false; //!< For handling window resize explicitly
 
 	uint32_t curFrame_ = 0; //!< The current frame to render
 
+	uint32_t instanceGridSize_ = DEFAULT_INSTANCE_GRID_SIZE; //!< Instances along each side of the grid
+	uint32_t textureCount_ = 1; //!< Copies of the texture loaded, the first is textureImage_
+
 	VkBuffer vertexBuffer_; //!< Vertex buffer for triangle mesh
-	VkDeviceMemory vertexBufferMemory_; //!< Memory for our vertex buffer
+	Allocation vertexBufferMemory_; //!< Memory for our vertex buffer
 
 	VkBuffer indexBuffer_; //!< Index buffer for indexed rendering
-	VkDeviceMemory indexBufferMemory_; //!< The buffer memory for the index buffer
+	Allocation indexBufferMemory_; //!< The buffer memory for the index buffer
+	VkIndexType indexType_ = VK_INDEX_TYPE_UINT16; //!< 16 or 32 bit, whichever the mesh file has
+
+	std::vector<MeshFileLod> meshLods_; //!< Index ranges of the mesh's levels of detail
+	float meshBoundsRadius_ = 0.0f;     //!< Radius of a sphere around the mesh, for culling
+
+	VkBuffer instanceBuffer_; //!< Per-instance transforms and colors, one slice per frame
+	Allocation instanceBufferMemory_; //!< The memory of the instance buffer, kept mapped
+	SceneStore scene_;                //!< Every instance's transform, written into the frame's slice each frame
+	std::chrono::steady_clock::time_point lastSceneUpdate_{}; //!< When the instances were last moved forward
+
+	VkBuffer drawTemplateBuffer_; //!< Indirect commands with no instances, copied over each frame's before culling
+	Allocation drawTemplateBufferMemory_; //!< The memory of the draw template buffer
+	VkBuffer indirectBuffer_; //!< VkDrawIndexedIndirectCommands the culling pass writes, one slice per frame
+	Allocation indirectBufferMemory_; //!< The memory of the indirect buffer
+	VkBuffer visibleInstanceBuffer_; //!< Instances that passed culling, grouped by command, one slice per frame
+	Allocation visibleInstanceBufferMemory_; //!< The memory of the visible instance buffer
+	VkBuffer drawCountBuffer_; //!< How many of each object's commands got instances, written by culling, one slice per frame
+	Allocation drawCountBufferMemory_; //!< The memory of the draw count buffer
+
+	bool multiDrawIndirect_ = false; //!< Device can draw more than one indirect command per call
+	bool drawIndirectCount_ = false; //!< Device can read the draw count from a buffer
+	bool memoryBudget_ = false;      //!< VK_EXT_memory_budget is enabled, heap budgets can be queried
+	bool bindless_ = false;          //!< Descriptor indexing is enabled, textures are read through bindlessHeap_
+	bool hostQueryReset_ = false;    //!< Queries can be reset from the CPU, which GPU profiling needs
+	bool pipelineStatistics_ = false; //!< Pipeline statistics queries can be used, and inherited by secondaries
+	bool transferTimestamps_ = false; //!< The transfer queue can write timestamps
+
+	Profiler profiler_;         //!< CPU and GPU scope timings, only recording with a profile output
+	std::string profileOutput_; //!< Where the Chrome trace goes, empty to not profile
 	
-	std::vector<VkBuffer> uniformBuffers_; //!< Handles to uniform buffers
-	std::vector<VkDeviceMemory> uniformBuffersMemory_; //!< The memory of the uniform buffers
-	std::vector<void*> uniformBuffersMapped_; //!< The uniform buffers mapped for writing
-
-	VkDescriptorPool descriptorPool_; //!< Pool for allocating descriptors
-	std::vector<VkDescriptorSet> descriptorSets_; //!< The descriptor sets
-
-	VkImage textureImage_; //!< The texture image
-	VkDeviceMemory textureImageMemory_; //!< The memory of the texture
+	DescriptorAllocator descriptors_; //!< Every descriptor set is allocated through this
+	VkDescriptorSet descriptorSet_;   //!< The one descriptor set, each frame picks its uniforms with a dynamic offset
+
+	VkBuffer uniformBuffer_; //!< Every frame's uniforms, each at an offset aligned to minUniformBufferOffsetAlignment
+	Allocation uniformBufferMemory_; //!< The memory of the uniform buffer, kept mapped
+
+	std::vector<ObjectConstants> objectConstants_; //!< Each object's push constants for the frame being recorded
+	std::vector<uint32_t> objectFeatures_;         //!< Shader features each object is drawn with this frame
+
+	VkImage textureImage_ = VK_NULL_HANDLE; //!< The texture image (null until it has been loaded)
+	VkImageView textureImageView_ = VK_NULL_HANDLE; //!< View of the whole texture image
+	Allocation textureImageMemory_; //!< The memory of the texture
+
+	TextureStreamer textureStreamer_; //!< Streams the mips of KTX2 and DDS textures under a memory budget
+	uint32_t streamedTexture_ = UINT32_MAX; //!< The texture in the streamer, if it was a container
+
+	BindlessHeap bindlessHeap_; //!< Every texture and storage buffer in one descriptor set, only made when bindless_
+	uint32_t textureIndex_ = BindlessHeap::INVALID_INDEX; //!< Where the texture is in the bindless image array
+
+	// A copy of the texture past the first, loaded the same way
+	struct ExtraTexture {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		Allocation memory;
+		uint32_t bindlessIndex = BindlessHeap::INVALID_INDEX;
+	};
+	std::vector<ExtraTexture> extraTextures_; //!< Sized once before loading, the loads hold references into it
+
+	// An uploaded image whose levels after the first still have to be blitted
+	struct PendingMipmaps {
+		VkImage image;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+	};
+	std::vector<PendingMipmaps> pendingMipmaps_; //!< Generated on the graphics queue once their copies are recorded
+
+	VkBuffer stagingRingBuffer_; //!< Persistently mapped buffer all uploads are staged in
+	Allocation stagingRingMemory_; //!< Memory of the staging ring
+	StagingRing stagingRing_; //!< Hands out space in the staging buffer and batches the copies
+
+	JobSystem jobs_; //!< Worker threads for loading assets
 };
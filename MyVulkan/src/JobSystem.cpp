@@ -0,0 +1,106 @@
+/**************************************************************************//**
+*	@file   JobSystem.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the worker thread pool
+******************************************************************************/
+
+#include "JobSystem.h"
+
+#include <algorithm>
+
+void JobSystem::init(uint32_t threadCount) {
+	// Leave one hardware thread for the device thread
+	if (threadCount == 0) {
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = std::max(hardwareThreads, 2u) - 1;
+	}
+
+	stopping_ = false;
+	for (uint32_t i = 0; i < threadCount; ++i) {
+		workers_.emplace_back(&JobSystem::workerLoop, this);
+	}
+}
+
+void JobSystem::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(jobMutex_);
+		stopping_ = true;
+		jobs_.clear();
+	}
+	jobAvailable_.notify_all();
+
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+	workers_.clear();
+
+	// Nobody is going to run these anymore
+	std::lock_guard<std::mutex> lock(callbackMutex_);
+	callbacks_.clear();
+}
+
+void JobSystem::submit(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(jobMutex_);
+		jobs_.push_back(std::move(job));
+	}
+	jobAvailable_.notify_one();
+}
+
+void JobSystem::postToDevice(std::function<void()> callback) {
+	std::lock_guard<std::mutex> lock(callbackMutex_);
+	callbacks_.push_back(std::move(callback));
+}
+
+size_t JobSystem::runDeviceCallbacks() {
+	// Take the callbacks out first so workers can keep posting while these run
+	std::vector<std::function<void()>> callbacks;
+	{
+		std::lock_guard<std::mutex> lock(callbackMutex_);
+		callbacks.swap(callbacks_);
+	}
+
+	for (auto& callback : callbacks) {
+		callback();
+	}
+
+	return callbacks.size();
+}
+
+void JobSystem::waitIdle() {
+	std::unique_lock<std::mutex> lock(jobMutex_);
+	jobsFinished_.wait(lock, [this]() { return jobs_.empty() && activeJobs_ == 0; });
+}
+
+//*****************************************************************************
+//	Worker Loop
+//		Each worker sleeps until there is a job, runs it, and goes back to
+//		sleep. Jobs are run in the order they were submitted.
+//*****************************************************************************
+void JobSystem::workerLoop() {
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobMutex_);
+			jobAvailable_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+
+			if (stopping_)
+				return;
+
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+			++activeJobs_;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(jobMutex_);
+			--activeJobs_;
+			if (jobs_.empty() && activeJobs_ == 0)
+				jobsFinished_.notify_all();
+		}
+	}
+}
@@ -0,0 +1,73 @@
+/**************************************************************************//**
+*	@file   JobSystem.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Worker thread pool for running jobs (file reads, image decoding, ...)
+*		off of the main thread. Anything that has to touch Vulkan objects is
+*		posted back to the device thread and run when it pumps its callbacks.
+******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+class JobSystem {
+public:
+
+	// threadCount of 0 uses one worker per hardware thread, minus the device thread
+	void init(uint32_t threadCount = 0);
+
+	// Finishes the jobs that are running, drops the rest, and joins the workers
+	void shutdown();
+
+	// Run a job on one of the workers
+	void submit(std::function<void()> job);
+
+	// Run a job on one of the workers and get its result through a future
+	template<typename Func>
+	auto async(Func&& func) -> std::future<decltype(func())> {
+		using Result = decltype(func());
+
+		// std::function needs to be copyable, so the task lives in a shared_ptr
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+		std::future<Result> result = task->get_future();
+		submit([task]() { (*task)(); });
+		return result;
+	}
+
+	// Hand work back to the device thread. Called from the workers
+	void postToDevice(std::function<void()> callback);
+
+	// Run everything the workers have handed back. Only call from the device thread.
+	//	Returns how many callbacks ran
+	size_t runDeviceCallbacks();
+
+	// Block until every submitted job has finished
+	void waitIdle();
+
+	uint32_t threadCount() const { return static_cast<uint32_t>(workers_.size()); }
+
+private:
+
+	void workerLoop();
+
+	std::vector<std::thread> workers_; //!< The worker threads
+
+	std::mutex jobMutex_;                     //!< Guards the job queue and counters
+	std::condition_variable jobAvailable_;    //!< Wakes a worker when a job is queued
+	std::condition_variable jobsFinished_;    //!< Wakes waitIdle when the workers run out of work
+	std::deque<std::function<void()>> jobs_;  //!< Jobs waiting for a worker
+	uint32_t activeJobs_ = 0;                 //!< Jobs a worker is currently running
+	bool stopping_ = false;                   //!< Tells the workers to exit
+
+	std::mutex callbackMutex_;                       //!< Guards the device callbacks
+	std::vector<std::function<void()>> callbacks_;   //!< Work handed back to the device thread
+};
@@ -0,0 +1,354 @@
+/**************************************************************************//**
+*	@file   MemoryAllocator.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the sub-allocating device memory allocator
+******************************************************************************/
+
+#include "MemoryAllocator.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+
+// Round a value up to a multiple of alignment (alignments are powers of two in Vulkan)
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Check if the last byte of range A sits on the same granularity page as the first byte at B
+static bool onSamePage(VkDeviceSize aOffset, VkDeviceSize aSize, VkDeviceSize bOffset, VkDeviceSize pageSize) {
+	VkDeviceSize aEndPage = (aOffset + aSize - 1) & ~(pageSize - 1);
+	VkDeviceSize bStartPage = bOffset & ~(pageSize - 1);
+	return aEndPage == bStartPage;
+}
+
+//*****************************************************************************
+//	Memory Block
+//		One vkAllocateMemory call. Ranges in the block are tracked as a sorted
+//		list of chunks that cover the whole block (free-list), or as a bump
+//		pointer (linear).
+//*****************************************************************************
+struct MemoryBlock {
+	struct Chunk {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		bool free;
+		ResourceKind kind;
+	};
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	uint32_t memoryType = 0;
+	AllocationStrategy strategy = AllocationStrategy::FreeList;
+	bool dedicated = false;  //!< Block was made for one large resource
+	void* mapped = nullptr;  //!< Persistent mapping if the memory is host visible
+
+	VkDeviceSize used = 0;   //!< Bytes handed out
+	uint32_t liveCount = 0;  //!< Ranges handed out
+
+	// Free-list state
+	std::vector<Chunk> chunks;
+
+	// Linear state
+	VkDeviceSize head = 0;
+	ResourceKind lastKind = ResourceKind::Buffer;
+
+	bool tryAllocate(const VkMemoryRequirements& req, ResourceKind kind, VkDeviceSize granularity, VkDeviceSize& outOffset);
+	void release(VkDeviceSize offset, VkDeviceSize rangeSize);
+};
+
+bool MemoryBlock::tryAllocate(const VkMemoryRequirements& req, ResourceKind kind, VkDeviceSize granularity, VkDeviceSize& outOffset) {
+	VkDeviceSize alignment = std::max<VkDeviceSize>(req.alignment, 1);
+
+	if (strategy == AllocationStrategy::Linear) {
+		VkDeviceSize offset = alignUp(head, alignment);
+
+		// A different kind of resource was placed right before us, so step onto a new page
+		if (liveCount > 0 && lastKind != kind && onSamePage(0, head, offset, granularity)) {
+			offset = alignUp(offset, granularity);
+		}
+
+		if (offset + req.size > size)
+			return false;
+
+		head = offset + req.size;
+		lastKind = kind;
+		outOffset = offset;
+		return true;
+	}
+
+	// Best fit search over the free chunks
+	size_t bestIndex = chunks.size();
+	VkDeviceSize bestOffset = 0;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		const Chunk& chunk = chunks[i];
+		if (!chunk.free || chunk.size < req.size)
+			continue;
+
+		VkDeviceSize offset = alignUp(chunk.offset, alignment);
+
+		// Look back at anything that shares our first page. If it is a different kind, move to the next page
+		for (size_t j = i; j-- > 0;) {
+			const Chunk& prev = chunks[j];
+			if (!onSamePage(prev.offset, prev.size, offset, granularity))
+				break;
+			if (!prev.free && prev.kind != kind) {
+				offset = alignUp(offset, granularity);
+				break;
+			}
+		}
+
+		if (offset + req.size > chunk.offset + chunk.size)
+			continue;
+
+		// Look ahead at anything that shares our last page. If it is a different kind, this chunk won't work
+		bool conflict = false;
+		for (size_t j = i + 1; j < chunks.size(); ++j) {
+			const Chunk& next = chunks[j];
+			if (!onSamePage(offset, req.size, next.offset, granularity))
+				break;
+			if (!next.free && next.kind != kind) {
+				conflict = true;
+				break;
+			}
+		}
+		if (conflict)
+			continue;
+
+		if (bestIndex == chunks.size() || chunk.size < chunks[bestIndex].size) {
+			bestIndex = i;
+			bestOffset = offset;
+		}
+	}
+
+	if (bestIndex == chunks.size())
+		return false;
+
+	// Split the chosen chunk into [padding][used][remainder]
+	Chunk chosen = chunks[bestIndex];
+	std::vector<Chunk> pieces;
+	if (bestOffset > chosen.offset) {
+		pieces.push_back({ chosen.offset, bestOffset - chosen.offset, true, kind });
+	}
+	pieces.push_back({ bestOffset, req.size, false, kind });
+	VkDeviceSize end = bestOffset + req.size;
+	if (end < chosen.offset + chosen.size) {
+		pieces.push_back({ end, chosen.offset + chosen.size - end, true, kind });
+	}
+
+	chunks.erase(chunks.begin() + bestIndex);
+	chunks.insert(chunks.begin() + bestIndex, pieces.begin(), pieces.end());
+
+	outOffset = bestOffset;
+	return true;
+}
+
+void MemoryBlock::release(VkDeviceSize offset, VkDeviceSize rangeSize) {
+	used -= rangeSize;
+	--liveCount;
+
+	if (strategy == AllocationStrategy::Linear) {
+		// Linear blocks only get their space back once they are completely empty
+		if (liveCount == 0)
+			head = 0;
+		return;
+	}
+
+	// Find the chunk that starts at this offset
+	auto it = std::lower_bound(chunks.begin(), chunks.end(), offset,
+		[](const Chunk& chunk, VkDeviceSize value) { return chunk.offset < value; });
+
+	if (it == chunks.end() || it->offset != offset || it->free) {
+		throw std::runtime_error("Freeing memory that was not allocated from this block!");
+	}
+
+	it->free = true;
+
+	// Merge with the next chunk
+	auto next = it + 1;
+	if (next != chunks.end() && next->free) {
+		it->size += next->size;
+		chunks.erase(next);
+	}
+
+	// Merge with the previous chunk
+	if (it != chunks.begin()) {
+		auto prev = it - 1;
+		if (prev->free) {
+			prev->size += it->size;
+			chunks.erase(it);
+		}
+	}
+}
+
+//*****************************************************************************
+//	Memory Allocator
+//*****************************************************************************
+// Defined here since MemoryBlock is only complete in this file
+MemoryAllocator::MemoryAllocator() = default;
+MemoryAllocator::~MemoryAllocator() = default;
+
+void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize) {
+	device_ = device;
+	blockSize_ = blockSize;
+
+	// Memory types and heaps don't change, so only query them once
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties_);
+
+	// Buffers and optimal images next to each other must be this far apart
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	granularity_ = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+}
+
+void MemoryAllocator::cleanup() {
+	for (auto& block : blocks_) {
+		if (block->liveCount > 0) {
+			std::cerr << "Memory allocator: " << block->liveCount << " allocations leaked in memory type " << block->memoryType << std::endl;
+		}
+
+		if (block->mapped)
+			vkUnmapMemory(device_, block->memory);
+		vkFreeMemory(device_, block->memory, nullptr);
+	}
+	blocks_.clear();
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, ResourceKind kind, AllocationStrategy strategy) {
+	MemoryBlock* block = nullptr;
+	VkDeviceSize offset = 0;
+
+	// Large resources get a block of their own so they don't eat a regular block
+	if (requirements.size > blockSize_ / 2) {
+		block = createBlock(memoryType, requirements.size, strategy, true);
+		block->tryAllocate(requirements, kind, granularity_, offset);
+	}
+	else {
+		// Try every existing block of this memory type first
+		for (auto& candidate : blocks_) {
+			if (candidate->memoryType != memoryType || candidate->strategy != strategy || candidate->dedicated)
+				continue;
+
+			if (candidate->tryAllocate(requirements, kind, granularity_, offset)) {
+				block = candidate.get();
+				break;
+			}
+		}
+
+		// Nothing had room, so we need a new block
+		if (!block) {
+			block = createBlock(memoryType, blockSize_, strategy, false);
+			if (!block->tryAllocate(requirements, kind, granularity_, offset)) {
+				throw std::runtime_error("Failed to sub-allocate from a new memory block!");
+			}
+		}
+	}
+
+	block->used += requirements.size;
+	++block->liveCount;
+
+	Allocation allocation{};
+	allocation.memory = block->memory;
+	allocation.offset = offset;
+	allocation.size = requirements.size;
+	allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+	allocation.memoryType = memoryType;
+	allocation.block = block;
+	return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation) {
+	if (!allocation.block)
+		return;
+
+	MemoryBlock* block = allocation.block;
+	block->release(allocation.offset, allocation.size);
+
+	// Dedicated blocks are only for one resource, so give them back to the driver
+	if (block->dedicated && block->liveCount == 0) {
+		destroyBlock(block);
+	}
+
+	allocation = Allocation{};
+}
+
+MemoryBlock* MemoryAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, AllocationStrategy strategy, bool dedicated) {
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	VkDeviceMemory memory;
+	VkResult result = vkAllocateMemory(device_, &allocInfo, nullptr, &memory);
+
+	// Small heaps may not fit a whole block, so keep halving until it fits
+	while (result != VK_SUCCESS && !dedicated && allocInfo.allocationSize > 1024 * 1024) {
+		allocInfo.allocationSize /= 2;
+		result = vkAllocateMemory(device_, &allocInfo, nullptr, &memory);
+	}
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate memory block!");
+	}
+
+	auto block = std::make_unique<MemoryBlock>();
+	block->memory = memory;
+	block->size = allocInfo.allocationSize;
+	block->memoryType = memoryType;
+	block->strategy = strategy;
+	block->dedicated = dedicated;
+	block->chunks.push_back({ 0, block->size, true, ResourceKind::Buffer });
+
+	// Host visible memory stays mapped for the lifetime of the block.
+	//	Memory can only be mapped once, so ranges can't map themselves
+	if (memProperties_.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+			vkFreeMemory(device_, memory, nullptr);
+			throw std::runtime_error("Failed to map memory block!");
+		}
+	}
+
+	blocks_.push_back(std::move(block));
+	return blocks_.back().get();
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock* block) {
+	if (block->mapped)
+		vkUnmapMemory(device_, block->memory);
+	vkFreeMemory(device_, block->memory, nullptr);
+
+	blocks_.erase(std::remove_if(blocks_.begin(), blocks_.end(),
+		[block](const std::unique_ptr<MemoryBlock>& candidate) { return candidate.get() == block; }), blocks_.end());
+}
+
+std::vector<HeapStats> MemoryAllocator::getHeapStats() const {
+	std::vector<HeapStats> stats(memProperties_.memoryHeapCount);
+	for (uint32_t i = 0; i < memProperties_.memoryHeapCount; ++i) {
+		stats[i].heapSize = memProperties_.memoryHeaps[i].size;
+	}
+
+	for (const auto& block : blocks_) {
+		HeapStats& heap = stats[memProperties_.memoryTypes[block->memoryType].heapIndex];
+		heap.bytesReserved += block->size;
+		heap.bytesUsed += block->used;
+		heap.blockCount += 1;
+		heap.allocationCount += block->liveCount;
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::printStats(std::ostream& os) const {
+	const double MB = 1024.0 * 1024.0;
+
+	std::vector<HeapStats> stats = getHeapStats();
+	for (size_t i = 0; i < stats.size(); ++i) {
+		const HeapStats& heap = stats[i];
+		os << "Memory Heap " << i << ": "
+			<< heap.bytesUsed / MB << " MB used / " << heap.bytesReserved / MB << " MB reserved in "
+			<< heap.blockCount << " blocks (" << heap.allocationCount << " allocations), heap size "
+			<< heap.heapSize / MB << " MB" << std::endl;
+	}
+}
@@ -0,0 +1,94 @@
+/**************************************************************************//**
+*	@file   MemoryAllocator.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Sub-allocating device memory allocator. Large blocks of VkDeviceMemory
+*		are allocated once per memory type, then buffers and images are
+*		handed aligned ranges out of those blocks.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <memory>
+#include <ostream>
+
+// How a block hands out its memory
+//	FreeList - Ranges can be freed in any order and are merged back together
+//	Linear - Ranges are bumped off the end of the block, the block only gets
+//		its space back once every range in it has been freed
+enum class AllocationStrategy {
+	FreeList,
+	Linear
+};
+
+// What kind of resource is being bound to the memory.
+//	Linear and optimal resources sitting next to each other in the same block
+//	need to be bufferImageGranularity apart, so the allocator needs to know
+enum class ResourceKind {
+	Buffer,       //!< Buffers and LINEAR tiled images
+	OptimalImage  //!< OPTIMAL tiled images
+};
+
+struct MemoryBlock;
+
+// A range of device memory handed out by the allocator
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE; //!< The block of memory this range lives in
+	VkDeviceSize offset = 0;                //!< Offset of the range in the block (bind with this)
+	VkDeviceSize size = 0;                  //!< Size of the range
+	void* mapped = nullptr;                 //!< CPU pointer to the range if the block is host visible
+	uint32_t memoryType = 0;                //!< Memory type index of the block
+	MemoryBlock* block = nullptr;           //!< Block that owns this range (internal use)
+};
+
+// Usage of a single memory heap
+struct HeapStats {
+	VkDeviceSize heapSize = 0;       //!< Size of the heap reported by the device
+	VkDeviceSize bytesReserved = 0;  //!< Bytes of vkAllocateMemory blocks on this heap
+	VkDeviceSize bytesUsed = 0;      //!< Bytes actually handed out to resources
+	uint32_t blockCount = 0;         //!< Number of vkAllocateMemory calls alive on this heap
+	uint32_t allocationCount = 0;    //!< Number of resources living on this heap
+};
+
+class MemoryAllocator {
+public:
+
+	// Default size of each block. Anything bigger than half a block gets its own block
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+	MemoryAllocator();
+	~MemoryAllocator();
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+	void cleanup();
+
+	// Grab a range of memory that satisfies the requirements from the given memory type
+	Allocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, ResourceKind kind,
+		AllocationStrategy strategy = AllocationStrategy::FreeList);
+
+	// Give a range back to its block
+	void free(Allocation& allocation);
+
+	// Per-heap usage, indexed by heap index
+	std::vector<HeapStats> getHeapStats() const;
+	void printStats(std::ostream& os) const;
+
+private:
+
+	MemoryBlock* createBlock(uint32_t memoryType, VkDeviceSize size, AllocationStrategy strategy, bool dedicated);
+	void destroyBlock(MemoryBlock* block);
+
+	VkDevice device_ = VK_NULL_HANDLE; //!< Logical device the memory is allocated from
+
+	VkPhysicalDeviceMemoryProperties memProperties_{}; //!< Memory types and heaps of the device
+
+	VkDeviceSize blockSize_ = DEFAULT_BLOCK_SIZE; //!< Size of each regular block
+	VkDeviceSize granularity_ = 1;                //!< bufferImageGranularity of the device
+
+	std::vector<std::unique_ptr<MemoryBlock>> blocks_; //!< Every block that is currently allocated
+};
@@ -0,0 +1,194 @@
+/**************************************************************************//**
+*	@file   MeshConverter.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the OBJ to mesh file converter
+******************************************************************************/
+
+#include "MeshConverter.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "VertexFormats.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace {
+
+	// Full precision vertex, packed into the Vertex layout once the whole file is read.
+	//	OBJ keeps normals apart from positions, so each vertex takes the normal of the
+	//	last face corner that used it
+	struct ObjVertex {
+		glm::vec2 position;
+		glm::vec3 color;
+		glm::vec3 normal;
+	};
+
+	// "7", "7/2", "7//3" or "7/2/3". The normal is left empty when there isn't one
+	void splitCorner(const std::string& corner, std::string& position, std::string& normal) {
+		size_t first = corner.find('/');
+		position = corner.substr(0, first);
+		normal.clear();
+		if (first != std::string::npos) {
+			size_t second = corner.find('/', first + 1);
+			if (second != std::string::npos)
+				normal = corner.substr(second + 1);
+		}
+	}
+
+	// OBJ counts from 1, negative counts back from the last one
+	uint32_t parseIndex(const std::string& text, size_t count, uint32_t line) {
+		long index = strtol(text.c_str(), nullptr, 10);
+		if (index < 0)
+			index += static_cast<long>(count) + 1;
+
+		if (index < 1 || static_cast<size_t>(index) > count) {
+			throw std::runtime_error("Face uses a vertex that doesn't exist on line " + std::to_string(line));
+		}
+
+		return static_cast<uint32_t>(index - 1);
+	}
+}
+
+void convertObjToMesh(const std::string& objPath, const std::string& meshPath, const MeshConvertOptions& options) {
+	std::ifstream obj(objPath);
+	if (!obj.is_open()) {
+		throw std::runtime_error("Failed to open OBJ: " + objPath);
+	}
+
+	std::vector<ObjVertex> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<uint32_t> indices;
+
+	std::string text;
+	uint32_t lineNumber = 0;
+	std::vector<uint32_t> face;
+	while (std::getline(obj, text)) {
+		++lineNumber;
+
+		std::istringstream line(text);
+		std::string type;
+		line >> type;
+
+		if (type == "v") {
+			float position[3] = {};
+			float color[3] = { 1.0f, 1.0f, 1.0f };
+			line >> position[0] >> position[1] >> position[2];
+			if (!line) {
+				throw std::runtime_error("Bad vertex on line " + std::to_string(lineNumber));
+			}
+
+			// Vertex colors are an extension, so they may not be there
+			float r, g, b;
+			if (line >> r >> g >> b) {
+				color[0] = r;
+				color[1] = g;
+				color[2] = b;
+			}
+
+			ObjVertex vertex{};
+			vertex.position = glm::vec2(position[0], position[1]);
+			vertex.color = glm::vec3(color[0], color[1], color[2]);
+			vertex.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+			vertices.push_back(vertex);
+		}
+		else if (type == "vn") {
+			float x = 0.0f, y = 0.0f, z = 1.0f;
+			line >> x >> y >> z;
+			normals.push_back(glm::vec3(x, y, z));
+		}
+		else if (type == "f") {
+			face.clear();
+			std::string corner, position, normal;
+			while (line >> corner) {
+				splitCorner(corner, position, normal);
+				uint32_t index = parseIndex(position, vertices.size(), lineNumber);
+				if (!normal.empty())
+					vertices[index].normal = normals[parseIndex(normal, normals.size(), lineNumber)];
+
+				face.push_back(index);
+			}
+
+			if (face.size() < 3) {
+				throw std::runtime_error("Face with fewer than three corners on line " + std::to_string(lineNumber));
+			}
+
+			// Fan out from the first corner
+			for (size_t i = 1; i + 1 < face.size(); ++i) {
+				indices.push_back(face[0]);
+				indices.push_back(face[i]);
+				indices.push_back(face[i + 1]);
+			}
+		}
+
+		// Texture coordinates, groups and materials aren't used yet
+	}
+
+	if (vertices.empty() || indices.empty()) {
+		throw std::runtime_error("OBJ has no faces: " + objPath);
+	}
+
+	// Reorder while the positions are still full precision. Meshlets are cut last
+	//	so they follow the final triangle order, the fetch remap only renames vertices
+	std::vector<glm::vec3> positions(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i)
+		positions[i] = glm::vec3(vertices[i].position, 0.0f);
+
+	optimizeVertexCache(indices, vertices.size());
+	optimizeOverdraw(indices, positions);
+
+	MeshFileContents contents;
+	if (options.meshlets)
+		contents.meshlets = buildMeshlets(indices, positions);
+
+	size_t vertexCount = vertices.size();
+	std::vector<uint32_t> remap = optimizeVertexFetch(indices, vertexCount);
+
+	std::vector<ObjVertex> fetchOrder(vertexCount);
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		if (remap[i] != UINT32_MAX)
+			fetchOrder[remap[i]] = vertices[i];
+	}
+	vertices.swap(fetchOrder);
+
+	// Pack every vertex into the layout the renderer uses
+	std::vector<Vertex> packed(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		packed[i].position.set(vertices[i].position);
+		packed[i].color.set(vertices[i].color);
+		packed[i].setNormal(vertices[i].normal);
+	}
+
+	contents.vertexFormat = Vertex::FORMAT_ID;
+	contents.vertexStride = sizeof(Vertex);
+	contents.vertexCount = static_cast<uint32_t>(packed.size());
+	contents.vertices = packed.data();
+	contents.indexCount = static_cast<uint32_t>(indices.size());
+
+	// Bounds from the full precision positions, grown a little in case packing rounded outwards
+	for (const ObjVertex& vertex : vertices) {
+		float length = std::sqrt(vertex.position.x * vertex.position.x + vertex.position.y * vertex.position.y);
+		contents.boundsRadius = std::max(contents.boundsRadius, length * 1.001f);
+	}
+
+	// Half the index memory when every vertex can be reached with 16 bits
+	std::vector<uint16_t> shortIndices;
+	if (vertices.size() <= UINT16_MAX) {
+		shortIndices.assign(indices.begin(), indices.end());
+		contents.indexSize = sizeof(uint16_t);
+		contents.indices = shortIndices.data();
+	}
+	else {
+		contents.indexSize = sizeof(uint32_t);
+		contents.indices = indices.data();
+	}
+
+	writeMeshFile(meshPath, contents);
+}
@@ -0,0 +1,25 @@
+/**************************************************************************//**
+*	@file   MeshConverter.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Offline conversion from OBJ into the binary mesh format. Run with
+*		--convert-mesh, never at load time.
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+
+// Optional parts of a conversion
+struct MeshConvertOptions {
+	bool meshlets = false; //!< Build meshlets with culling bounds and store them in the file
+};
+
+// Read an OBJ and write it out as a mesh file, throws if either fails.
+//	Vertices are packed into the Vertex layout. Positions keep x and y, "v x y z r g b"
+//	vertex colors are kept (white otherwise) and "vn" normals are used when the layout
+//	has normals. Faces are triangulated as fans. 16 bit indices are used when they fit.
+//	Triangles and vertices are reordered for the vertex cache, overdraw and vertex fetch
+//	on the way out, and vertices no face uses are dropped
+void convertObjToMesh(const std::string& objPath, const std::string& meshPath, const MeshConvertOptions& options = {});
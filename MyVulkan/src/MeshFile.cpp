@@ -0,0 +1,215 @@
+/**************************************************************************//**
+*	@file   MeshFile.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the binary mesh format
+******************************************************************************/
+
+#include "MeshFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+
+namespace {
+
+	uint64_t alignUp(uint64_t value, uint64_t alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Pad the file out to offset with zeros. The gap can be longer than the alignment
+	//	(the header's space is padding too), so it goes out a block at a time
+	void writePadding(std::ofstream& file, uint64_t offset) {
+		static const char zeros[MESH_FILE_ALIGNMENT] = {};
+		uint64_t position = static_cast<uint64_t>(file.tellp());
+		while (offset > position) {
+			uint64_t count = std::min<uint64_t>(offset - position, sizeof(zeros));
+			file.write(zeros, static_cast<std::streamsize>(count));
+			position += count;
+		}
+	}
+}
+
+//*****************************************************************************
+//	Writing
+//		Header, LOD table, meshlets, vertices, indices. The header is written last so
+//		a file cut short by a crash never looks valid
+//*****************************************************************************
+void writeMeshFile(const std::string& path, const MeshFileContents& contents) {
+	if (contents.indexSize != 2 && contents.indexSize != 4) {
+		throw std::runtime_error("Mesh indices have to be 16 or 32 bit!");
+	}
+
+	std::vector<MeshFileLod> lods = contents.lods;
+	if (lods.empty())
+		lods.push_back({ 0, contents.indexCount });
+
+	MeshFileHeader header{};
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.vertexFormat = contents.vertexFormat;
+	header.vertexStride = contents.vertexStride;
+	header.vertexCount = contents.vertexCount;
+	header.indexSize = contents.indexSize;
+	header.indexCount = contents.indexCount;
+	header.lodCount = static_cast<uint32_t>(lods.size());
+	header.boundsRadius = contents.boundsRadius;
+	header.meshletCount = static_cast<uint32_t>(contents.meshlets.size());
+
+	uint64_t vertexSize = static_cast<uint64_t>(contents.vertexStride) * contents.vertexCount;
+	header.lodOffset = alignUp(sizeof(MeshFileHeader), MESH_FILE_ALIGNMENT);
+	header.meshletOffset = alignUp(header.lodOffset + sizeof(MeshFileLod) * lods.size(), MESH_FILE_ALIGNMENT);
+	header.vertexOffset = alignUp(header.meshletOffset + sizeof(MeshFileMeshlet) * contents.meshlets.size(), MESH_FILE_ALIGNMENT);
+	header.indexOffset = alignUp(header.vertexOffset + vertexSize, MESH_FILE_ALIGNMENT);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open mesh file for writing: " + path);
+	}
+
+	// Space for the header, filled in at the end
+	writePadding(file, header.lodOffset);
+
+	file.write(reinterpret_cast<const char*>(lods.data()), static_cast<std::streamsize>(sizeof(MeshFileLod) * lods.size()));
+
+	writePadding(file, header.meshletOffset);
+	file.write(reinterpret_cast<const char*>(contents.meshlets.data()), static_cast<std::streamsize>(sizeof(MeshFileMeshlet) * contents.meshlets.size()));
+
+	writePadding(file, header.vertexOffset);
+	file.write(static_cast<const char*>(contents.vertices), static_cast<std::streamsize>(vertexSize));
+
+	writePadding(file, header.indexOffset);
+	file.write(static_cast<const char*>(contents.indices), static_cast<std::streamsize>(contents.indexSize) * contents.indexCount);
+
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	if (!file) {
+		throw std::runtime_error("Failed to write mesh file: " + path);
+	}
+}
+
+//*****************************************************************************
+//	Mapping
+//		The OS pages the file in as the blobs are copied out, so only the
+//		part being copied has to be in memory at once
+//*****************************************************************************
+void MeshFile::open(const std::string& path) {
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open mesh file: " + path);
+	}
+	file_ = file;
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	size_ = static_cast<uint64_t>(size.QuadPart);
+
+	if (size_ >= sizeof(MeshFileHeader)) {
+		mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping_ != nullptr)
+			data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		throw std::runtime_error("Failed to open mesh file: " + path);
+	}
+
+	struct stat info;
+	if (fstat(file, &info) == 0)
+		size_ = static_cast<uint64_t>(info.st_size);
+
+	if (size_ >= sizeof(MeshFileHeader)) {
+		void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapped != MAP_FAILED) {
+			data_ = static_cast<const unsigned char*>(mapped);
+			madvise(mapped, size_, MADV_SEQUENTIAL);
+		}
+	}
+
+	// The mapping keeps its own reference to the file
+	::close(file);
+#endif
+
+	if (data_ == nullptr) {
+		close();
+		throw std::runtime_error("Failed to map mesh file: " + path);
+	}
+
+	// Check everything the pointers will be made from before trusting them
+	header_ = reinterpret_cast<const MeshFileHeader*>(data_);
+	const MeshFileHeader& header = *header_;
+
+	bool valid = header.magic == MESH_FILE_MAGIC && header.version == MESH_FILE_VERSION &&
+		(header.indexSize == 2 || header.indexSize == 4) && header.lodCount > 0 &&
+		header.lodOffset % MESH_FILE_ALIGNMENT == 0 && header.meshletOffset % MESH_FILE_ALIGNMENT == 0 &&
+		header.vertexOffset % MESH_FILE_ALIGNMENT == 0 && header.indexOffset % MESH_FILE_ALIGNMENT == 0 &&
+		header.lodOffset + sizeof(MeshFileLod) * header.lodCount <= size_ &&
+		header.meshletOffset + sizeof(MeshFileMeshlet) * header.meshletCount <= size_ &&
+		header.vertexOffset + vertexDataSize() <= size_ &&
+		header.indexOffset + indexDataSize() <= size_;
+
+	if (valid) {
+		lods_ = reinterpret_cast<const MeshFileLod*>(data_ + header.lodOffset);
+		for (uint32_t i = 0; i < header.lodCount; ++i) {
+			if (static_cast<uint64_t>(lods_[i].firstIndex) + lods_[i].indexCount > header.indexCount)
+				valid = false;
+		}
+
+		if (header.meshletCount > 0)
+			meshlets_ = reinterpret_cast<const MeshFileMeshlet*>(data_ + header.meshletOffset);
+		for (uint32_t i = 0; i < header.meshletCount; ++i) {
+			if (static_cast<uint64_t>(meshlets_[i].firstIndex) + meshlets_[i].indexCount > header.indexCount)
+				valid = false;
+		}
+	}
+
+	if (!valid) {
+		close();
+		throw std::runtime_error("Not a mesh file this version can read: " + path);
+	}
+
+	vertices_ = data_ + header.vertexOffset;
+	indices_ = data_ + header.indexOffset;
+}
+
+void MeshFile::close() {
+#ifdef _WIN32
+	if (data_ != nullptr)
+		UnmapViewOfFile(data_);
+	if (mapping_ != nullptr)
+		CloseHandle(mapping_);
+	if (file_ != nullptr)
+		CloseHandle(file_);
+	mapping_ = nullptr;
+	file_ = nullptr;
+#else
+	if (data_ != nullptr)
+		munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+
+	data_ = nullptr;
+	size_ = 0;
+	header_ = nullptr;
+	lods_ = nullptr;
+	meshlets_ = nullptr;
+	vertices_ = nullptr;
+	indices_ = nullptr;
+}
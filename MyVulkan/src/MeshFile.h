@@ -0,0 +1,127 @@
+/**************************************************************************//**
+*	@file   MeshFile.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Binary mesh format. A small header, a table of LODs, an optional
+*		table of meshlets, then the vertex and index data exactly as the GPU
+*		wants them, each on an aligned offset. Files are memory mapped, so loading is pointing at the blobs
+*		and copying them into the staging ring. Nothing gets parsed.
+******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// "LMSH" when read as little endian bytes
+const uint32_t MESH_FILE_MAGIC = 0x48534D4C;
+
+// Bumped whenever the layout changes, old files have to be converted again
+const uint32_t MESH_FILE_VERSION = 2;
+
+// Every blob starts on a multiple of this. Covers every vertex attribute and index type
+const uint64_t MESH_FILE_ALIGNMENT = 16;
+
+// First thing in the file. Offsets are from the start of the file
+struct MeshFileHeader {
+	uint32_t magic;        //!< MESH_FILE_MAGIC
+	uint32_t version;      //!< MESH_FILE_VERSION
+	uint32_t vertexFormat; //!< VertexLayout::FORMAT_ID of the layout the vertices were written with
+	uint32_t vertexStride; //!< Bytes between vertices
+	uint32_t vertexCount;  //!< How many vertices
+	uint32_t indexSize;    //!< Bytes per index, 2 or 4
+	uint32_t indexCount;   //!< How many indices, over every LOD
+	uint32_t lodCount;     //!< Entries in the LOD table, most detailed first. At least 1
+
+	float boundsRadius;    //!< Radius of a sphere around every vertex, centered on the origin
+	uint32_t meshletCount; //!< Entries in the meshlet table, 0 if none were built
+
+	uint64_t lodOffset;     //!< Where the LOD table starts
+	uint64_t meshletOffset; //!< Where the meshlet table starts
+	uint64_t vertexOffset;  //!< Where the vertex blob starts
+	uint64_t indexOffset;   //!< Where the index blob starts
+};
+static_assert(sizeof(MeshFileHeader) == 72, "The header is read straight out of the file");
+
+// One level of detail, a range of the index blob
+struct MeshFileLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+static_assert(sizeof(MeshFileLod) == 8, "LODs are read straight out of the file");
+
+// A small cluster of triangles, a range of the index blob, with bounds for culling
+//	it as a whole. Every triangle in it faces away from a camera when
+//	dot(center - camera, coneAxis) >= coneCutoff * length(center - camera) + radius
+struct MeshFileMeshlet {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float center[3];   //!< Bounding sphere around the meshlet's vertices
+	float radius;
+	float coneAxis[3]; //!< Average facing direction of the triangles
+	float coneCutoff;  //!< Sine of the normal cone's half angle, 1 when it can't be backface culled
+};
+static_assert(sizeof(MeshFileMeshlet) == 40, "Meshlets are read straight out of the file");
+
+// Everything needed to write a mesh file. The blobs are written as is
+struct MeshFileContents {
+	uint32_t vertexFormat = 0;
+	uint32_t vertexStride = 0;
+	uint32_t vertexCount = 0;
+	const void* vertices = nullptr;
+
+	uint32_t indexSize = 2;
+	uint32_t indexCount = 0;
+	const void* indices = nullptr;
+
+	std::vector<MeshFileLod> lods;         //!< Empty means one LOD covering every index
+	std::vector<MeshFileMeshlet> meshlets; //!< Optional, ranges of the indices for cluster culling
+	float boundsRadius = 0.0f;
+};
+
+// Write a mesh file, throws if it can't
+void writeMeshFile(const std::string& path, const MeshFileContents& contents);
+
+// A mesh file mapped into memory. The pointers stay valid until close
+class MeshFile {
+public:
+
+	MeshFile() = default;
+	~MeshFile() { close(); }
+
+	// Only one owner of the mapping
+	MeshFile(const MeshFile&) = delete;
+	MeshFile& operator=(const MeshFile&) = delete;
+
+	// Map the file and check the header, throws if it isn't a mesh file this version can read
+	void open(const std::string& path);
+	void close();
+
+	const MeshFileHeader& header() const { return *header_; }
+	const MeshFileLod* lods() const { return lods_; }
+	const MeshFileMeshlet* meshlets() const { return meshlets_; }
+
+	// The blobs, ready to be copied into the staging ring
+	const void* vertexData() const { return vertices_; }
+	uint64_t vertexDataSize() const { return static_cast<uint64_t>(header_->vertexStride) * header_->vertexCount; }
+	const void* indexData() const { return indices_; }
+	uint64_t indexDataSize() const { return static_cast<uint64_t>(header_->indexSize) * header_->indexCount; }
+
+private:
+
+	const unsigned char* data_ = nullptr; //!< Start of the mapping
+	uint64_t size_ = 0;                   //!< Size of the file
+
+	const MeshFileHeader* header_ = nullptr; //!< Header, at the start of the mapping
+	const MeshFileLod* lods_ = nullptr;      //!< LOD table in the mapping
+	const MeshFileMeshlet* meshlets_ = nullptr; //!< Meshlet table in the mapping, null if there is none
+	const void* vertices_ = nullptr;         //!< Vertex blob in the mapping
+	const void* indices_ = nullptr;          //!< Index blob in the mapping
+
+#ifdef _WIN32
+	void* file_ = nullptr;    //!< HANDLE of the open file
+	void* mapping_ = nullptr; //!< HANDLE of the file mapping
+#endif
+};
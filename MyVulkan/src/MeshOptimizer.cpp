@@ -0,0 +1,375 @@
+/**************************************************************************//**
+*	@file   MeshOptimizer.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the mesh optimization passes
+******************************************************************************/
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+	// Tuning from Forsyth's paper. The cache size doesn't have to match the
+	//	hardware, the order ends up good for any cache around this size
+	const uint32_t CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	// Small FIFO cache, used to find where the cache order starts somewhere new
+	const uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+	// How much a vertex wants its triangles drawn next. Vertices of the last
+	//	triangle get a flat score so the next triangle doesn't just reuse one edge,
+	//	and vertices with few triangles left get a boost so they are finished off
+	float vertexScore(int cachePosition, uint32_t remainingTriangles) {
+		if (remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			if (cachePosition < 3)
+				score = LAST_TRIANGLE_SCORE;
+			else
+				score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+
+		return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+	}
+
+	glm::vec3 triangleNormal(const std::vector<uint32_t>& indices, size_t triangle, const std::vector<glm::vec3>& positions) {
+		const glm::vec3& a = positions[indices[triangle * 3 + 0]];
+		const glm::vec3& b = positions[indices[triangle * 3 + 1]];
+		const glm::vec3& c = positions[indices[triangle * 3 + 2]];
+
+		// Length is twice the area
+		return glm::cross(b - a, c - a);
+	}
+
+	// Sphere around the meshlet's vertices and a cone around its triangle normals
+	void computeMeshletBounds(MeshFileMeshlet& meshlet, const std::vector<uint32_t>& indices,
+		const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& meshletVertices) {
+		glm::vec3 center(0.0f);
+		for (uint32_t vertex : meshletVertices)
+			center += positions[vertex];
+		center /= static_cast<float>(meshletVertices.size());
+
+		float radius = 0.0f;
+		for (uint32_t vertex : meshletVertices)
+			radius = std::max(radius, glm::length(positions[vertex] - center));
+
+		// Triangles with no area don't face anywhere, so they are left out of the cone
+		glm::vec3 axis(0.0f);
+		size_t firstTriangle = meshlet.firstIndex / 3;
+		size_t lastTriangle = firstTriangle + meshlet.indexCount / 3;
+		for (size_t triangle = firstTriangle; triangle < lastTriangle; ++triangle) {
+			glm::vec3 normal = triangleNormal(indices, triangle, positions);
+			float area = glm::length(normal);
+			if (area > 0.0f)
+				axis += normal / area;
+		}
+
+		float cutoff = 1.0f;
+		float axisLength = glm::length(axis);
+		if (axisLength > 0.0f) {
+			axis /= axisLength;
+
+			float minDot = 1.0f;
+			for (size_t triangle = firstTriangle; triangle < lastTriangle; ++triangle) {
+				glm::vec3 normal = triangleNormal(indices, triangle, positions);
+				float area = glm::length(normal);
+				if (area > 0.0f)
+					minDot = std::min(minDot, glm::dot(axis, normal / area));
+			}
+
+			// The cone's half angle is acos(minDot). Widening it by 90 degrees on each side
+			//	gives the directions every triangle faces away from, and the sine of the
+			//	half angle is the cosine of that. Past 90 degrees nothing can be culled
+			if (minDot > 0.0f)
+				cutoff = std::sqrt(1.0f - minDot * minDot);
+		}
+		else {
+			axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+
+		meshlet.center[0] = center.x;
+		meshlet.center[1] = center.y;
+		meshlet.center[2] = center.z;
+		meshlet.radius = radius;
+		meshlet.coneAxis[0] = axis.x;
+		meshlet.coneAxis[1] = axis.y;
+		meshlet.coneAxis[2] = axis.z;
+		meshlet.coneCutoff = cutoff;
+	}
+}
+
+//*****************************************************************************
+//	Vertex cache
+//		Greedy, one triangle at a time. The next triangle is the best scoring
+//		one that uses a vertex in the simulated cache, so only those scores
+//		have to be updated. When none are left we move on to the first
+//		triangle that hasn't been drawn yet.
+//*****************************************************************************
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles using each vertex, packed into one array. The first remaining[v]
+	//	entries of a vertex's list are the triangles that haven't been drawn yet
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (uint32_t index : indices)
+		++remaining[index];
+
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		offsets[vertex + 1] = offsets[vertex] + remaining[vertex];
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); ++i)
+		adjacency[filled[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		vertexScores[vertex] = vertexScore(-1, remaining[vertex]);
+
+	std::vector<float> triangleScores(triangleCount);
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+		triangleScores[triangle] = vertexScores[indices[triangle * 3 + 0]] +
+			vertexScores[indices[triangle * 3 + 1]] + vertexScores[indices[triangle * 3 + 2]];
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	std::vector<uint32_t> cache, nextCache;
+	cache.reserve(CACHE_SIZE + 3);
+	nextCache.reserve(CACHE_SIZE + 3);
+
+	size_t cursor = 0;
+	size_t best = SIZE_MAX;
+	for (size_t drawn = 0; drawn < triangleCount; ++drawn) {
+		if (best == SIZE_MAX) {
+			while (emitted[cursor])
+				++cursor;
+			best = cursor;
+		}
+
+		emitted[best] = true;
+		const uint32_t* triangle = &indices[best * 3];
+		result.insert(result.end(), triangle, triangle + 3);
+
+		// Take the triangle out of its vertices' lists
+		for (int corner = 0; corner < 3; ++corner) {
+			uint32_t vertex = triangle[corner];
+			uint32_t* list = &adjacency[offsets[vertex]];
+			uint32_t* last = list + remaining[vertex] - 1;
+			*std::find(list, last + 1, static_cast<uint32_t>(best)) = *last;
+			--remaining[vertex];
+		}
+
+		// The triangle's vertices go to the front, everything else moves back
+		nextCache.clear();
+		for (int corner = 0; corner < 3; ++corner) {
+			if (std::find(nextCache.begin(), nextCache.end(), triangle[corner]) == nextCache.end())
+				nextCache.push_back(triangle[corner]);
+		}
+		for (uint32_t vertex : cache) {
+			if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end())
+				nextCache.push_back(vertex);
+		}
+		cache.swap(nextCache);
+
+		// Rescore everything that was in the cache, including what just fell out of it,
+		//	and pick the best triangle from the ones still in the cache
+		best = SIZE_MAX;
+		float bestScore = -1.0f;
+		for (size_t position = 0; position < cache.size(); ++position) {
+			uint32_t vertex = cache[position];
+			bool inCache = position < CACHE_SIZE;
+			cachePosition[vertex] = inCache ? static_cast<int>(position) : -1;
+
+			float score = vertexScore(cachePosition[vertex], remaining[vertex]);
+			float change = score - vertexScores[vertex];
+			vertexScores[vertex] = score;
+
+			const uint32_t* list = &adjacency[offsets[vertex]];
+			for (uint32_t i = 0; i < remaining[vertex]; ++i) {
+				uint32_t other = list[i];
+				triangleScores[other] += change;
+				if (inCache && triangleScores[other] > bestScore) {
+					bestScore = triangleScores[other];
+					best = other;
+				}
+			}
+		}
+
+		if (cache.size() > CACHE_SIZE)
+			cache.resize(CACHE_SIZE);
+	}
+
+	indices.swap(result);
+}
+
+//*****************************************************************************
+//	Overdraw
+//		Clusters start wherever a triangle misses the cache on all three
+//		vertices, which is where the cache order jumped somewhere new anyway.
+//		Clusters facing out from the middle of the mesh are likely to cover
+//		the rest, so they are drawn first. Flat meshes keep their order.
+//*****************************************************************************
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	// FIFO cache, a vertex is in it if fewer than OVERDRAW_CACHE_SIZE misses happened since it was loaded
+	std::vector<uint32_t> loadedAt(positions.size(), 0);
+	uint32_t misses = OVERDRAW_CACHE_SIZE + 1;
+
+	std::vector<size_t> clusterStarts;
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+		uint32_t triangleMisses = 0;
+		for (int corner = 0; corner < 3; ++corner) {
+			uint32_t vertex = indices[triangle * 3 + corner];
+			if (misses - loadedAt[vertex] > OVERDRAW_CACHE_SIZE) {
+				loadedAt[vertex] = misses++;
+				++triangleMisses;
+			}
+		}
+
+		if (triangle == 0 || triangleMisses == 3)
+			clusterStarts.push_back(triangle);
+	}
+	clusterStarts.push_back(triangleCount);
+
+	size_t clusterCount = clusterStarts.size() - 1;
+	if (clusterCount < 2)
+		return;
+
+	// Area weighted centers and normals of every cluster, and of the whole mesh
+	std::vector<glm::vec3> clusterCenters(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0.0f;
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+		float clusterArea = 0.0f;
+		for (size_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; ++triangle) {
+			glm::vec3 normal = triangleNormal(indices, triangle, positions);
+			float area = glm::length(normal);
+			glm::vec3 center = (positions[indices[triangle * 3 + 0]] + positions[indices[triangle * 3 + 1]] +
+				positions[indices[triangle * 3 + 2]]) / 3.0f;
+
+			clusterCenters[cluster] += center * area;
+			clusterNormals[cluster] += normal;
+			clusterArea += area;
+		}
+
+		meshCenter += clusterCenters[cluster];
+		meshArea += clusterArea;
+		if (clusterArea > 0.0f)
+			clusterCenters[cluster] /= clusterArea;
+	}
+	if (meshArea > 0.0f)
+		meshCenter /= meshArea;
+
+	std::vector<float> facing(clusterCount, 0.0f);
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+		float normalLength = glm::length(clusterNormals[cluster]);
+		if (normalLength > 0.0f)
+			facing[cluster] = glm::dot(clusterCenters[cluster] - meshCenter, clusterNormals[cluster] / normalLength);
+	}
+
+	// Stable, so clusters that face the same way keep their cache order
+	std::vector<size_t> order(clusterCount);
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+		order[cluster] = cluster;
+	std::stable_sort(order.begin(), order.end(), [&facing](size_t a, size_t b) { return facing[a] > facing[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (size_t cluster : order) {
+		result.insert(result.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+	}
+
+	indices.swap(result);
+}
+
+//*****************************************************************************
+//	Vertex fetch
+//*****************************************************************************
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, size_t& vertexCount) {
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	uint32_t next = 0;
+	for (uint32_t& index : indices) {
+		if (remap[index] == UINT32_MAX)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	vertexCount = next;
+	return remap;
+}
+
+//*****************************************************************************
+//	Meshlets
+//		Triangles are added in order until the next one would go over either
+//		limit. The cache order keeps neighbouring triangles together, so the
+//		meshlets come out reasonably tight without searching.
+//*****************************************************************************
+std::vector<MeshFileMeshlet> buildMeshlets(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+	uint32_t maxVertices, uint32_t maxTriangles) {
+	std::vector<MeshFileMeshlet> meshlets;
+
+	// Which meshlet each vertex was last added to, so checking for it is one lookup
+	std::vector<uint32_t> usedBy(positions.size(), UINT32_MAX);
+	std::vector<uint32_t> meshletVertices;
+
+	MeshFileMeshlet meshlet{};
+	size_t triangleCount = indices.size() / 3;
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+		uint32_t meshletIndex = static_cast<uint32_t>(meshlets.size());
+		const uint32_t* corners = &indices[triangle * 3];
+
+		uint32_t newVertices = 0;
+		for (int corner = 0; corner < 3; ++corner) {
+			bool repeated = (corner > 0 && corners[corner] == corners[0]) || (corner > 1 && corners[corner] == corners[1]);
+			if (usedBy[corners[corner]] != meshletIndex && !repeated)
+				++newVertices;
+		}
+
+		// Full, start the next one with this triangle
+		if (meshletVertices.size() + newVertices > maxVertices || meshlet.indexCount / 3 == maxTriangles) {
+			computeMeshletBounds(meshlet, indices, positions, meshletVertices);
+			meshlets.push_back(meshlet);
+
+			meshlet = {};
+			meshlet.firstIndex = static_cast<uint32_t>(triangle * 3);
+			meshletVertices.clear();
+			++meshletIndex;
+		}
+
+		for (int corner = 0; corner < 3; ++corner) {
+			if (usedBy[corners[corner]] != meshletIndex) {
+				usedBy[corners[corner]] = meshletIndex;
+				meshletVertices.push_back(corners[corner]);
+			}
+		}
+		meshlet.indexCount += 3;
+	}
+
+	if (meshlet.indexCount > 0) {
+		computeMeshletBounds(meshlet, indices, positions, meshletVertices);
+		meshlets.push_back(meshlet);
+	}
+
+	return meshlets;
+}
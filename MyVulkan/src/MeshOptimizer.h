@@ -0,0 +1,47 @@
+/**************************************************************************//**
+*	@file   MeshOptimizer.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Index and vertex reordering, run when a mesh is converted so drawing
+*		it costs nothing extra. The triangles are put in an order that reuses
+*		the post-transform vertex cache, then clusters of them are sorted so
+*		the ones most likely to cover others go first, then the vertices are
+*		put in the order they are first fetched. Meshlets (small bounded
+*		clusters for culling) can be built from the result as well.
+******************************************************************************/
+
+#pragma once
+
+#include "MeshFile.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// Limits for a meshlet. The defaults are the common mesh shader limits,
+//	so the same meshlets would work there too
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Reorder triangles for the post-transform vertex cache (Tom Forsyth's
+//	linear speed vertex cache optimization). Works with any cache size
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// Reorder clusters of cache optimized triangles so outward facing ones draw
+//	first (Sander et al., "Fast Triangle Reordering for Vertex Locality and
+//	Reduced Overdraw"). Clusters are only broken where the cache would be
+//	cold anyway, so the cache order is kept
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions);
+
+// Renumber the vertices in the order the indices first use them, so fetching
+//	them walks through memory. Returns where each old vertex went (or UINT32_MAX if
+//	no triangle uses it), and how many vertices are left through vertexCount
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, size_t& vertexCount);
+
+// Split the triangles into meshlets of at most maxVertices unique vertices and
+//	maxTriangles triangles. Meshlets are cut from the triangles in order, so every
+//	meshlet is a range of the indices and can still be drawn with vkCmdDrawIndexed
+std::vector<MeshFileMeshlet> buildMeshlets(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+	uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
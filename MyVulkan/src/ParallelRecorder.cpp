@@ -0,0 +1,147 @@
+/**************************************************************************//**
+*	@file   ParallelRecorder.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the multi-threaded secondary command buffer recorder
+******************************************************************************/
+
+#include "ParallelRecorder.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <future>
+#include <exception>
+
+void ParallelRecorder::init(VkDevice device, uint32_t queueFamily, uint32_t threadCount, uint32_t frameCount, uint32_t minDrawsPerThread) {
+	device_ = device;
+	threadCount_ = std::max(threadCount, 1u);
+	frameCount_ = frameCount;
+	minDrawsPerThread_ = std::max(minDrawsPerThread, 1u);
+
+	// Pools are reset all at once every frame, and their buffers are rerecorded every frame
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamily;
+
+	pools_.resize(static_cast<size_t>(frameCount_) * threadCount_);
+	for (auto& pool : pools_) {
+		if (vkCreateCommandPool(device_, &poolInfo, nullptr, &pool.pool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create recording command pool!");
+		}
+	}
+
+	// The device thread is one of the recording threads
+	if (threadCount_ > 1)
+		workers_.init(threadCount_ - 1);
+}
+
+void ParallelRecorder::cleanup() {
+	workers_.shutdown();
+
+	// Destroying the pools frees their command buffers
+	for (auto& pool : pools_) {
+		vkDestroyCommandPool(device_, pool.pool, nullptr);
+	}
+	pools_.clear();
+}
+
+void ParallelRecorder::beginFrame(uint32_t frame) {
+	// One reset per pool is much cheaper than resetting every command buffer
+	for (uint32_t thread = 0; thread < threadCount_; ++thread) {
+		ThreadPool& pool = threadPool(frame, thread);
+		vkResetCommandPool(device_, pool.pool, 0);
+		pool.used = 0;
+	}
+}
+
+VkCommandBuffer ParallelRecorder::nextCommandBuffer(ThreadPool& pool) {
+	// Allocate a new one the first time this many are needed, after that they get reused
+	if (pool.used == pool.commandBuffers.size()) {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = pool.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate secondary command buffer!");
+		}
+		pool.commandBuffers.push_back(commandBuffer);
+	}
+
+	return pool.commandBuffers[pool.used++];
+}
+
+//*****************************************************************************
+//	Record
+//		Each batch of draws goes to its own thread, and each thread only
+//		touches its own pool, so no locking is needed while recording.
+//*****************************************************************************
+std::vector<VkCommandBuffer> ParallelRecorder::record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance,
+	uint32_t drawCount, const RecordFunc& recordFunc) {
+	// Don't bother other threads with tiny batches
+	uint32_t batchCount = (drawCount + minDrawsPerThread_ - 1) / minDrawsPerThread_;
+	batchCount = std::max(1u, std::min(batchCount, threadCount_));
+	uint32_t drawsPerBatch = (drawCount + batchCount - 1) / batchCount;
+
+	// Grab the command buffers up front on this thread, the pools' vectors aren't thread safe
+	std::vector<VkCommandBuffer> commandBuffers(batchCount);
+	for (uint32_t batch = 0; batch < batchCount; ++batch) {
+		commandBuffers[batch] = nextCommandBuffer(threadPool(frame, batch));
+	}
+
+	// Records one batch. Secondaries run entirely inside the render pass
+	auto recordBatch = [&](uint32_t batch) {
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &inheritance;
+
+		VkCommandBuffer commandBuffer = commandBuffers[batch];
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin recording secondary command buffer!");
+		}
+
+		uint32_t first = batch * drawsPerBatch;
+		uint32_t count = std::min(drawsPerBatch, drawCount - std::min(first, drawCount));
+		recordFunc(commandBuffer, first, count);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record secondary command buffer!");
+		}
+	};
+
+	// Hand every batch but the first to the workers, and record the first one here
+	std::vector<std::future<void>> recordings;
+	for (uint32_t batch = 1; batch < batchCount; ++batch) {
+		recordings.push_back(workers_.async([&recordBatch, batch]() { recordBatch(batch); }));
+	}
+
+	// The workers reference this stack frame, so every batch has to finish before anything is thrown
+	std::exception_ptr error;
+	try {
+		recordBatch(0);
+	}
+	catch (...) {
+		error = std::current_exception();
+	}
+
+	// get() rethrows anything that went wrong on a worker
+	for (auto& recording : recordings) {
+		try {
+			recording.get();
+		}
+		catch (...) {
+			if (!error)
+				error = std::current_exception();
+		}
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+
+	return commandBuffers;
+}
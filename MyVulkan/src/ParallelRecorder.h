@@ -0,0 +1,66 @@
+/**************************************************************************//**
+*	@file   ParallelRecorder.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Records secondary command buffers on several threads at once. Every
+*		recording thread gets its own command pool for every frame in flight,
+*		since command pools can't be used from two threads at the same time
+*		and can only be reset once the frame using them has finished.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "JobSystem.h"
+
+#include <vector>
+#include <functional>
+
+class ParallelRecorder {
+public:
+
+	// Records draws [first, first + count) into a secondary command buffer
+	//	that has already begun inside of the render pass
+	using RecordFunc = std::function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)>;
+
+	// threadCount is the number of recording slots, including the device thread.
+	//	minDrawsPerThread is the fewest draws worth handing to another thread, which
+	//	depends on how much recording a draw is
+	void init(VkDevice device, uint32_t queueFamily, uint32_t threadCount, uint32_t frameCount, uint32_t minDrawsPerThread);
+	void cleanup();
+
+	// Reset every pool for the frame. Only call once the frame's last submit has finished
+	void beginFrame(uint32_t frame);
+
+	// Split the draws over the recording threads and record them. The device thread
+	//	records the first batch itself. Returns the secondary command buffers in draw
+	//	order, ready for vkCmdExecuteCommands
+	std::vector<VkCommandBuffer> record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance,
+		uint32_t drawCount, const RecordFunc& recordFunc);
+
+	uint32_t threadCount() const { return threadCount_; }
+
+private:
+
+	// One command pool and the secondary command buffers allocated from it
+	struct ThreadPool {
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> commandBuffers; //!< Allocated secondaries, reused every frame
+		uint32_t used = 0;                           //!< How many have been handed out this frame
+	};
+
+	ThreadPool& threadPool(uint32_t frame, uint32_t thread) { return pools_[frame * threadCount_ + thread]; }
+	VkCommandBuffer nextCommandBuffer(ThreadPool& pool);
+
+	VkDevice device_ = VK_NULL_HANDLE; //!< Logical device the pools belong to
+	uint32_t threadCount_ = 0;         //!< Recording slots per frame
+	uint32_t frameCount_ = 0;          //!< Frames in flight
+	uint32_t minDrawsPerThread_ = 1;   //!< Smallest batch another thread is given
+
+	std::vector<ThreadPool> pools_; //!< frameCount_ * threadCount_ pools
+
+	JobSystem workers_; //!< Recording threads, separate from asset loading so frames don't wait on it
+};
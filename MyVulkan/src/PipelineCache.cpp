@@ -0,0 +1,149 @@
+/**************************************************************************//**
+*	@file   PipelineCache.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the on-disk pipeline cache
+******************************************************************************/
+
+#include "PipelineCache.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+namespace {
+
+	// Written in front of the driver's data, so we can reject files from other devices
+	//	or driver versions (or older versions of this format) before the driver sees them
+	struct CacheFileHeader {
+		uint32_t magic;         //!< CACHE_MAGIC
+		uint32_t version;       //!< CACHE_VERSION
+		uint32_t vendorID;      //!< VkPhysicalDeviceProperties::vendorID
+		uint32_t deviceID;      //!< VkPhysicalDeviceProperties::deviceID
+		uint32_t driverVersion; //!< VkPhysicalDeviceProperties::driverVersion
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE]; //!< VkPhysicalDeviceProperties::pipelineCacheUUID
+		uint64_t dataSize;      //!< Bytes of cache data after the header
+	};
+
+	const uint32_t CACHE_MAGIC = 0x4350594D; // "MYPC"
+	const uint32_t CACHE_VERSION = 1;
+
+	// The header Vulkan puts at the start of the cache data itself
+	struct VulkanCacheHeader {
+		uint32_t headerSize;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	};
+
+	bool matchesDevice(const CacheFileHeader& header, const VkPhysicalDeviceProperties& properties) {
+		return header.magic == CACHE_MAGIC &&
+			header.version == CACHE_VERSION &&
+			header.vendorID == properties.vendorID &&
+			header.deviceID == properties.deviceID &&
+			header.driverVersion == properties.driverVersion &&
+			memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	// The driver checks this too, but a broken file can crash some drivers, so check first
+	bool matchesDevice(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties) {
+		if (data.size() < sizeof(VulkanCacheHeader))
+			return false;
+
+		VulkanCacheHeader header;
+		memcpy(&header, data.data(), sizeof(header));
+		return header.headerSize >= sizeof(VulkanCacheHeader) &&
+			header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header.vendorID == properties.vendorID &&
+			header.deviceID == properties.deviceID &&
+			memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+}
+
+void PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path) {
+	device_ = device;
+	path_ = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties_);
+
+	// Try to read the file. Any problem just means we start with an empty cache
+	std::vector<char> data;
+	std::ifstream file(path_, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+		file.seekg(0);
+
+		CacheFileHeader header{};
+		if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) && matchesDevice(header, deviceProperties_) &&
+			header.dataSize <= fileSize - sizeof(header)) {
+			data.resize(static_cast<size_t>(header.dataSize));
+			if (!file.read(data.data(), data.size()) || !matchesDevice(data, deviceProperties_))
+				data.clear();
+		}
+	}
+
+	loadedFromDisk_ = !data.empty();
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device_, &createInfo, nullptr, &cache_) != VK_SUCCESS) {
+		// The driver didn't like the data after all, start from nothing
+		loadedFromDisk_ = false;
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		if (vkCreatePipelineCache(device_, &createInfo, nullptr, &cache_) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline cache!");
+		}
+	}
+}
+
+void PipelineCache::cleanup() {
+	// Losing the cache only costs us compile time next launch, so don't throw
+	save();
+
+	vkDestroyPipelineCache(device_, cache_, nullptr);
+	cache_ = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::save() const {
+	// Ask for the size first, then the data
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device_, cache_, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+		return false;
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device_, cache_, &dataSize, data.data()) != VK_SUCCESS)
+		return false;
+
+	CacheFileHeader header{};
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.vendorID = deviceProperties_.vendorID;
+	header.deviceID = deviceProperties_.deviceID;
+	header.driverVersion = deviceProperties_.driverVersion;
+	memcpy(header.pipelineCacheUUID, deviceProperties_.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = dataSize;
+
+	// Write to a temporary file first so a crash while saving can't leave half a cache behind
+	std::string tempPath = path_ + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), dataSize);
+		if (!file)
+			return false;
+	}
+
+	std::remove(path_.c_str());
+	return std::rename(tempPath.c_str(), path_.c_str()) == 0;
+}
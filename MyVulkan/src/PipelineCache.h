@@ -0,0 +1,41 @@
+/**************************************************************************//**
+*	@file   PipelineCache.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		VkPipelineCache that is saved to disk and loaded on the next launch,
+*		so the driver doesn't have to compile the same shaders every time.
+*		The file is thrown away if it came from a different device or driver.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+
+class PipelineCache {
+public:
+
+	// Creates the cache, seeded with the file at path if it is valid for this device
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+
+	// Writes the cache back to the file and destroys it
+	void cleanup();
+
+	VkPipelineCache handle() const { return cache_; }
+
+	// True if the file was accepted when the cache was created
+	bool loadedFromDisk() const { return loadedFromDisk_; }
+
+private:
+
+	bool save() const;
+
+	VkDevice device_ = VK_NULL_HANDLE;      //!< Logical device the cache belongs to
+	VkPipelineCache cache_ = VK_NULL_HANDLE; //!< The cache handed to vkCreateGraphicsPipelines
+	VkPhysicalDeviceProperties deviceProperties_{}; //!< Identifies the device and driver the data is for
+	std::string path_;                       //!< Where the cache is saved
+	bool loadedFromDisk_ = false;            //!< The file was valid and used
+};
@@ -0,0 +1,560 @@
+/**************************************************************************//**
+*	@file   PipelineManager.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the pipeline manager
+******************************************************************************/
+
+#include "PipelineManager.h"
+#include "ShaderReflection.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+	// FNV-1a, run over each field one at a time so struct padding never gets hashed
+	class Hasher {
+	public:
+		template<typename T>
+		void add(const T& value) {
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+			for (size_t i = 0; i < sizeof(T); ++i) {
+				hash_ ^= bytes[i];
+				hash_ *= 1099511628211ull;
+			}
+		}
+
+		void add(const std::string& value) {
+			add(value.size());
+			for (char c : value)
+				add(c);
+		}
+
+		uint64_t hash() const { return hash_; }
+
+	private:
+		uint64_t hash_ = 14695981039346656037ull;
+	};
+
+	std::vector<char> readShaderFile(const std::string& path) {
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open shader file " + path + "!");
+		}
+
+		size_t fileSize = (size_t)file.tellg();
+		std::vector<char> buffer(fileSize);
+		file.seekg(0);
+		file.read(buffer.data(), fileSize);
+		return buffer;
+	}
+}
+
+uint64_t PipelineDesc::hash() const {
+	Hasher hasher;
+	hasher.add(vertexShader);
+	hasher.add(fragmentShader);
+
+	hasher.add(features);
+	hasher.add(specialization.size());
+	for (const auto& constant : specialization) {
+		hasher.add(constant.id);
+		hasher.add(constant.value);
+	}
+
+	hasher.add(bindings.size());
+	for (const auto& binding : bindings) {
+		hasher.add(binding.binding);
+		hasher.add(binding.stride);
+		hasher.add(binding.inputRate);
+	}
+
+	hasher.add(attributes.size());
+	for (const auto& attribute : attributes) {
+		hasher.add(attribute.location);
+		hasher.add(attribute.binding);
+		hasher.add(attribute.format);
+		hasher.add(attribute.offset);
+	}
+
+	hasher.add(topology);
+	hasher.add(polygonMode);
+	hasher.add(cullMode);
+	hasher.add(frontFace);
+	hasher.add(samples);
+
+	hasher.add(depthTestEnable);
+	hasher.add(depthWriteEnable);
+	hasher.add(depthCompareOp);
+
+	hasher.add(blendEnable);
+	hasher.add(srcColorBlendFactor);
+	hasher.add(dstColorBlendFactor);
+	hasher.add(colorBlendOp);
+	hasher.add(srcAlphaBlendFactor);
+	hasher.add(dstAlphaBlendFactor);
+	hasher.add(alphaBlendOp);
+	hasher.add(colorWriteMask);
+
+	hasher.add(layout);
+	hasher.add(renderPass);
+	hasher.add(subpass);
+	return hasher.hash();
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const {
+	auto sameBindings = [](const VkVertexInputBindingDescription& a, const VkVertexInputBindingDescription& b) {
+		return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+	};
+	auto sameConstants = [](const SpecializationConstant& a, const SpecializationConstant& b) {
+		return a.id == b.id && a.value == b.value;
+	};
+	auto sameAttributes = [](const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b) {
+		return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+	};
+
+	return vertexShader == other.vertexShader &&
+		fragmentShader == other.fragmentShader &&
+		features == other.features &&
+		std::equal(specialization.begin(), specialization.end(), other.specialization.begin(), other.specialization.end(), sameConstants) &&
+		std::equal(bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(), sameBindings) &&
+		std::equal(attributes.begin(), attributes.end(), other.attributes.begin(), other.attributes.end(), sameAttributes) &&
+		topology == other.topology &&
+		polygonMode == other.polygonMode &&
+		cullMode == other.cullMode &&
+		frontFace == other.frontFace &&
+		samples == other.samples &&
+		depthTestEnable == other.depthTestEnable &&
+		depthWriteEnable == other.depthWriteEnable &&
+		depthCompareOp == other.depthCompareOp &&
+		blendEnable == other.blendEnable &&
+		srcColorBlendFactor == other.srcColorBlendFactor &&
+		dstColorBlendFactor == other.dstColorBlendFactor &&
+		colorBlendOp == other.colorBlendOp &&
+		srcAlphaBlendFactor == other.srcAlphaBlendFactor &&
+		dstAlphaBlendFactor == other.dstAlphaBlendFactor &&
+		alphaBlendOp == other.alphaBlendOp &&
+		colorWriteMask == other.colorWriteMask &&
+		layout == other.layout &&
+		renderPass == other.renderPass &&
+		subpass == other.subpass;
+}
+
+void PipelineManager::init(VkDevice device, VkPipelineCache cache, JobSystem& jobs) {
+	device_ = device;
+	cache_ = cache;
+	jobs_ = &jobs;
+}
+
+void PipelineManager::cleanup() {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (auto& pair : entries_) {
+		Entry& entry = *pair.second;
+
+		// A compile that was dropped when the workers shut down still counts as finished
+		if (entry.compile.valid())
+			entry.compile.wait();
+
+		vkDestroyPipeline(device_, entry.pipeline.load(), nullptr);
+	}
+	entries_.clear();
+
+	for (auto& pair : computePipelines_)
+		vkDestroyPipeline(device_, pair.second, nullptr);
+	computePipelines_.clear();
+
+	for (const RetiredPipeline& retired : retired_)
+		vkDestroyPipeline(device_, retired.pipeline, nullptr);
+	retired_.clear();
+}
+
+PipelineManager::Entry& PipelineManager::findEntry(const PipelineDesc& desc, bool& created) {
+	auto it = entries_.find(desc);
+	created = (it == entries_.end());
+	if (created)
+		it = entries_.emplace(desc, std::make_unique<Entry>()).first;
+
+	return *it->second;
+}
+
+VkPipeline PipelineManager::get(const PipelineDesc& desc) {
+	Entry* entry;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		bool created;
+		entry = &findEntry(desc, created);
+
+		// Nobody has started this one, so compile it right here. Holding the lock
+		//	stops another thread from starting the same compile
+		if (created) {
+			try {
+				entry->pipeline = compile(desc);
+			}
+			catch (...) {
+				entries_.erase(desc);
+				throw;
+			}
+			return entry->pipeline;
+		}
+	}
+
+	// Already compiling on a worker, wait for it. get() rethrows if it failed
+	if (entry->pipeline.load() == VK_NULL_HANDLE && entry->compile.valid())
+		entry->compile.get();
+
+	if (entry->failed)
+		throw std::runtime_error("Failed to create Graphics Pipeline!");
+
+	return entry->pipeline;
+}
+
+VkPipeline PipelineManager::request(const PipelineDesc& desc, VkPipeline fallback) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	bool created;
+	Entry& entry = findEntry(desc, created);
+	if (created)
+		startCompile(desc, entry);
+
+	VkPipeline pipeline = entry.pipeline;
+	return pipeline != VK_NULL_HANDLE ? pipeline : fallback;
+}
+
+void PipelineManager::precompile(const PipelineDesc& desc) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	bool created;
+	Entry& entry = findEntry(desc, created);
+	if (created)
+		startCompile(desc, entry);
+}
+
+//*****************************************************************************
+//	Compute
+//		A compute pipeline is just the shader stage and a layout, there is
+//		no fixed function state to describe. Only used at load time, so it
+//		always compiles on the calling thread
+//*****************************************************************************
+VkPipeline PipelineManager::getCompute(const std::string& shader, VkPipelineLayout layout) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto key = std::make_pair(shader, layout);
+	auto found = computePipelines_.find(key);
+	if (found != computePipelines_.end())
+		return found->second;
+
+	VkPipeline pipeline = compileCompute(shader, layout);
+	computePipelines_[key] = pipeline;
+	return pipeline;
+}
+
+VkPipeline PipelineManager::compileCompute(const std::string& shader, VkPipelineLayout layout) const {
+	VkShaderModule module = createShaderModule(readShaderFile(shader));
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = module;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = layout;
+
+	VkPipeline pipeline;
+	VkResult result = vkCreateComputePipelines(device_, cache_, 1, &pipelineInfo, nullptr, &pipeline);
+
+	// The module is only needed while creating the pipeline
+	vkDestroyShaderModule(device_, module, nullptr);
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create Compute Pipeline!");
+	}
+
+	return pipeline;
+}
+
+//*****************************************************************************
+//	Reload
+//		Swaps in freshly compiled pipelines for every one made from a shader
+//		that changed on disk. Their descriptions don't change, so the
+//		entries are kept and only the handle inside is replaced. Command
+//		buffers still in flight may use the old pipelines, so those are
+//		held until the GPU is past the frame they were last used in.
+//*****************************************************************************
+size_t PipelineManager::reload(const std::string& shader, uint64_t retireValue) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	size_t reloaded = 0;
+	auto swap = [&](std::atomic<VkPipeline>& target, VkPipeline pipeline) {
+		VkPipeline old = target.exchange(pipeline);
+		if (old != VK_NULL_HANDLE)
+			retired_.push_back({ old, retireValue });
+		++reloaded;
+	};
+
+	for (auto& pair : entries_) {
+		const PipelineDesc& desc = pair.first;
+		Entry& entry = *pair.second;
+		if (desc.vertexShader != shader && desc.fragmentShader != shader)
+			continue;
+
+		// Don't race a worker still compiling the old version
+		if (entry.compile.valid())
+			entry.compile.wait();
+
+		try {
+			swap(entry.pipeline, compile(desc));
+			entry.failed = false;
+		}
+		catch (const std::exception& e) {
+			// Keep drawing with what was there, the shader can be fixed and saved again
+			std::cerr << "Pipeline reload failed (" << desc.vertexShader << ", " << desc.fragmentShader << "): " << e.what() << std::endl;
+		}
+	}
+
+	for (auto& pair : computePipelines_) {
+		if (pair.first.first != shader)
+			continue;
+
+		try {
+			VkPipeline old = pair.second;
+			pair.second = compileCompute(shader, pair.first.second);
+			retired_.push_back({ old, retireValue });
+			++reloaded;
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Compute pipeline reload failed (" << shader << "): " << e.what() << std::endl;
+		}
+	}
+
+	return reloaded;
+}
+
+void PipelineManager::releaseRetired(uint64_t completedValue) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto done = std::remove_if(retired_.begin(), retired_.end(), [&](const RetiredPipeline& retired) {
+		if (retired.retireValue > completedValue)
+			return false;
+		vkDestroyPipeline(device_, retired.pipeline, nullptr);
+		return true;
+	});
+	retired_.erase(done, retired_.end());
+}
+
+size_t PipelineManager::pipelineCount() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return entries_.size() + computePipelines_.size();
+}
+
+void PipelineManager::startCompile(const PipelineDesc& desc, Entry& entry) {
+	// Entries are never removed while the manager is alive, so the worker can hold on to it
+	Entry* target = &entry;
+	entry.compile = jobs_->async([this, desc, target]() {
+		try {
+			target->pipeline = compile(desc);
+		}
+		catch (const std::exception& e) {
+			// The fallback keeps getting used, but say why
+			std::cerr << "Pipeline compile failed (" << desc.vertexShader << ", " << desc.fragmentShader << "): " << e.what() << std::endl;
+			target->failed = true;
+			throw;
+		}
+	}).share();
+}
+
+VkShaderModule PipelineManager::createShaderModule(const std::vector<char>& code) const {
+	// Start the creation information of the shader module
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size();
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	// Create the shader module
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(device_, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create shader module!");
+	}
+
+	return shaderModule;
+}
+
+//*****************************************************************************
+//	Compile
+//		Builds all of the fixed function state out of the description and
+//		creates the pipeline. Runs on whichever thread asked for it, since
+//		pipeline creation and the pipeline cache are both thread safe.
+//*****************************************************************************
+VkPipeline PipelineManager::compile(const PipelineDesc& desc) const {
+	// The low ids belong to the feature bits
+	for (const SpecializationConstant& constant : desc.specialization) {
+		if (constant.id < MAX_SHADER_FEATURES) {
+			throw std::runtime_error("Specialization constant " + std::to_string(constant.id) + " is a shader feature id!");
+		}
+	}
+
+	std::vector<char> vertCode = readShaderFile(desc.vertexShader);
+	std::vector<char> fragCode = readShaderFile(desc.fragmentShader);
+
+	// Every input the vertex shader reads needs an attribute feeding it. Vulkan leaves a
+	//	missing one undefined instead of failing, so catch it here. The formats aren't
+	//	compared, attributes are packed smaller than the shader's 32 bit types
+	ShaderReflection vertReflection = reflectShader(reinterpret_cast<const uint32_t*>(vertCode.data()), vertCode.size() / sizeof(uint32_t));
+	for (const ShaderInput& input : vertReflection.inputs) {
+		auto fed = std::find_if(desc.attributes.begin(), desc.attributes.end(),
+			[&](const VkVertexInputAttributeDescription& attribute) { return attribute.location == input.location; });
+		if (fed == desc.attributes.end()) {
+			throw std::runtime_error(desc.vertexShader + " reads vertex input location " + std::to_string(input.location) + " which has no attribute!");
+		}
+	}
+
+	// Create the shader modules. They are only needed until the pipeline is created
+	VkShaderModule vertShaderModule = createShaderModule(vertCode);
+	VkShaderModule fragShaderModule;
+	try {
+		fragShaderModule = createShaderModule(fragCode);
+	}
+	catch (...) {
+		vkDestroyShaderModule(device_, vertShaderModule, nullptr);
+		throw;
+	}
+
+	// Specialization constants are baked in when the pipeline compiles, so the driver
+	//	folds them like any other constant. Every feature bit gets an entry, a false one
+	//	has to be given too in case the shader defaults it to true. Both stages share the data
+	std::vector<VkSpecializationMapEntry> mapEntries;
+	std::vector<uint32_t> specializationData;
+	for (uint32_t feature = 0; feature < MAX_SHADER_FEATURES; ++feature) {
+		mapEntries.push_back({ feature, static_cast<uint32_t>(specializationData.size() * sizeof(uint32_t)), sizeof(VkBool32) });
+		specializationData.push_back((desc.features >> feature) & 1 ? VK_TRUE : VK_FALSE);
+	}
+	for (const SpecializationConstant& constant : desc.specialization) {
+		mapEntries.push_back({ constant.id, static_cast<uint32_t>(specializationData.size() * sizeof(uint32_t)), sizeof(uint32_t) });
+		specializationData.push_back(constant.value);
+	}
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+	specializationInfo.pMapEntries = mapEntries.data();
+	specializationInfo.dataSize = specializationData.size() * sizeof(uint32_t);
+	specializationInfo.pData = specializationData.data();
+
+	// Creation info for the shader stages
+	VkPipelineShaderStageCreateInfo shaderStages[2]{};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = vertShaderModule;
+	shaderStages[0].pName = "main"; // Entrypoint of the shader
+	shaderStages[0].pSpecializationInfo = &specializationInfo;
+
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = fragShaderModule;
+	shaderStages[1].pName = "main";
+	shaderStages[1].pSpecializationInfo = &specializationInfo;
+
+	// Viewport and scissor are set while recording
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	// Vertex layout
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.bindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = desc.bindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.attributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = desc.attributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = desc.topology;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// Only the counts matter since both are dynamic
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = desc.polygonMode;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode;
+	rasterizer.frontFace = desc.frontFace;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = desc.samples;
+	multisampling.minSampleShading = 1.0f;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTestEnable;
+	depthStencil.depthWriteEnable = desc.depthWriteEnable;
+	depthStencil.depthCompareOp = desc.depthCompareOp;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = desc.colorWriteMask;
+	colorBlendAttachment.blendEnable = desc.blendEnable;
+	colorBlendAttachment.srcColorBlendFactor = desc.srcColorBlendFactor;
+	colorBlendAttachment.dstColorBlendFactor = desc.dstColorBlendFactor;
+	colorBlendAttachment.colorBlendOp = desc.colorBlendOp;
+	colorBlendAttachment.srcAlphaBlendFactor = desc.srcAlphaBlendFactor;
+	colorBlendAttachment.dstAlphaBlendFactor = desc.dstAlphaBlendFactor;
+	colorBlendAttachment.alphaBlendOp = desc.alphaBlendOp;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = desc.renderPass;
+	pipelineInfo.subpass = desc.subpass;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	// The pipeline cache lets the driver skip compiling if it has seen this pipeline before
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(device_, cache_, 1, &pipelineInfo, nullptr, &pipeline);
+
+	// Don't forget to destroy the shader modules
+	vkDestroyShaderModule(device_, fragShaderModule, nullptr);
+	vkDestroyShaderModule(device_, vertShaderModule, nullptr);
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create Graphics Pipeline!");
+	}
+
+	return pipeline;
+}
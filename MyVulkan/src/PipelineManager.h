@@ -0,0 +1,161 @@
+/**************************************************************************//**
+*	@file   PipelineManager.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Owns every graphics pipeline. Pipelines are looked up by a hash of
+*		their full description, so the same description always gives back
+*		the same pipeline. Missing pipelines can be compiled on the workers
+*		while a fallback pipeline is drawn with. Compute pipelines only have
+*		a shader and a layout, so they are looked up by those. Pipelines
+*		can be rebuilt from shaders that changed on disk while running.
+*		Shader permutations are specialization constants in the description,
+*		so every feature combination of one shader is its own pipeline.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "JobSystem.h"
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <map>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <future>
+
+// Specialization constant ids below this are shader features, one bool per bit of
+//	PipelineDesc::features. Other constants take ids from here up
+const uint32_t MAX_SHADER_FEATURES = 16;
+
+// A 32 bit specialization constant, by the constant_id the shader declared it with
+struct SpecializationConstant {
+	uint32_t id;
+	uint32_t value;
+};
+
+// Everything that goes into a graphics pipeline.
+//	Viewport and scissor are always dynamic, so they aren't part of it
+struct PipelineDesc {
+	// Shaders (paths to the SPIR-V)
+	std::string vertexShader;
+	std::string fragmentShader;
+
+	// Specialization, given to both stages. Bit i of features sets the bool constant
+	//	with constant_id i, so branches on it are compiled out. Ids a stage doesn't
+	//	declare are ignored by it
+	uint32_t features = 0;
+	std::vector<SpecializationConstant> specialization;
+
+	// Vertex input
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	// Rasterizer
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Depth
+	VkBool32 depthTestEnable = VK_FALSE;
+	VkBool32 depthWriteEnable = VK_FALSE;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+	// Blending, for the single color attachment
+	VkBool32 blendEnable = VK_FALSE;
+	VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+	VkBlendFactor srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp alphaBlendOp = VK_BLEND_OP_ADD;
+	VkColorComponentFlags colorWriteMask =
+		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	// Where the pipeline is used
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+
+	// Hash of every field above. Equal descriptions always have equal hashes
+	uint64_t hash() const;
+	bool operator==(const PipelineDesc& other) const;
+};
+
+struct PipelineDescHash {
+	size_t operator()(const PipelineDesc& desc) const { return static_cast<size_t>(desc.hash()); }
+};
+
+class PipelineManager {
+public:
+
+	void init(VkDevice device, VkPipelineCache cache, JobSystem& jobs);
+
+	// Waits for any compiles still running and destroys every pipeline
+	void cleanup();
+
+	// Get the pipeline, compiling it on this thread if it doesn't exist yet. Use this
+	//	at load time, or for the fallback pipeline
+	VkPipeline get(const PipelineDesc& desc);
+
+	// Get the pipeline if it is ready. If it isn't, its compile is started on the
+	//	workers and fallback is returned instead, so the frame doesn't stall.
+	//	Safe to call from the recording threads
+	VkPipeline request(const PipelineDesc& desc, VkPipeline fallback);
+
+	// Start compiling a pipeline on the workers before it is needed
+	void precompile(const PipelineDesc& desc);
+
+	// Get a compute pipeline, compiling it on this thread if it doesn't exist yet
+	VkPipeline getCompute(const std::string& shader, VkPipelineLayout layout);
+
+	// Recompile every pipeline made from shader and swap it in. The old pipelines are destroyed
+	//	by releaseRetired once the GPU reaches retireValue. A pipeline that fails to compile
+	//	keeps its old version. Returns how many were replaced
+	size_t reload(const std::string& shader, uint64_t retireValue);
+
+	// Destroy the pipelines replaced by reload that the GPU is done with
+	void releaseRetired(uint64_t completedValue);
+
+	size_t pipelineCount() const;
+
+private:
+
+	// One pipeline, which may still be compiling
+	struct Entry {
+		std::atomic<VkPipeline> pipeline{ VK_NULL_HANDLE }; //!< Null until compiled
+		std::atomic<bool> failed{ false };                  //!< Compiling threw, keep using the fallback
+		std::shared_future<void> compile;                   //!< Valid while (or after) compiling on a worker
+	};
+
+	// Find or add the entry for a description. Needs mutex_ held
+	Entry& findEntry(const PipelineDesc& desc, bool& created);
+
+	// A pipeline replaced by reload, which command buffers in flight may still use
+	struct RetiredPipeline {
+		VkPipeline pipeline;
+		uint64_t retireValue; //!< Graphics timeline value of the last frame that used it
+	};
+
+	void startCompile(const PipelineDesc& desc, Entry& entry);
+	VkPipeline compile(const PipelineDesc& desc) const;
+	VkPipeline compileCompute(const std::string& shader, VkPipelineLayout layout) const;
+	VkShaderModule createShaderModule(const std::vector<char>& code) const;
+
+	VkDevice device_ = VK_NULL_HANDLE;       //!< Logical device the pipelines are created on
+	VkPipelineCache cache_ = VK_NULL_HANDLE; //!< Cache every pipeline is compiled through
+	JobSystem* jobs_ = nullptr;              //!< Workers for background compiles
+
+	mutable std::mutex mutex_; //!< Guards entries_ and retired_, pipelines are looked up from several threads
+	std::unordered_map<PipelineDesc, std::unique_ptr<Entry>, PipelineDescHash> entries_; //!< Every pipeline by description
+	std::map<std::pair<std::string, VkPipelineLayout>, VkPipeline> computePipelines_;    //!< Compute pipelines by shader and layout
+	std::vector<RetiredPipeline> retired_;                                               //!< Replaced by reload, waiting on the GPU
+};
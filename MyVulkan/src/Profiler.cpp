@@ -0,0 +1,356 @@
+/**************************************************************************//**
+*	@file   Profiler.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the CPU and GPU scope profiler
+******************************************************************************/
+
+#include "Profiler.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+
+namespace {
+
+	// Counted in every statistics scope, in the order the results come back in
+	const VkQueryPipelineStatisticFlags STATISTICS_FLAGS =
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+	const char* const STATISTICS_NAMES[Profiler::STATISTICS_COUNT] = {
+		"inputAssemblyVertices",
+		"inputAssemblyPrimitives",
+		"vertexShaderInvocations",
+		"clippingInvocations",
+		"clippingPrimitives",
+		"fragmentShaderInvocations",
+		"computeShaderInvocations",
+	};
+
+	// Names go straight into the JSON, so quotes and backslashes need escaping
+	std::string escapeJson(const char* text) {
+		std::string escaped;
+		for (const char* c = text; *c; ++c) {
+			if (*c == '"' || *c == '\\')
+				escaped += '\\';
+			escaped += *c;
+		}
+		return escaped;
+	}
+}
+
+void Profiler::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t frameCount, bool hostQueryReset, bool pipelineStatistics) {
+	device_ = device;
+	start_ = std::chrono::steady_clock::now();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	timestampPeriod_ = properties.limits.timestampPeriod;
+
+	// timestampComputeAndGraphics says every graphics and compute queue can write timestamps
+	gpuScopes_ = hostQueryReset && properties.limits.timestampComputeAndGraphics;
+	statistics_ = gpuScopes_ && pipelineStatistics;
+
+	frames_.assign(frameCount, FrameQueries{});
+	if (!gpuScopes_)
+		return;
+
+	for (FrameQueries& queries : frames_) {
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = MAX_GPU_SCOPES * 2;
+		if (vkCreateQueryPool(device_, &poolInfo, nullptr, &queries.timestamps) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timestamp query pool!");
+		}
+		vkResetQueryPool(device_, queries.timestamps, 0, poolInfo.queryCount);
+
+		if (statistics_) {
+			poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			poolInfo.queryCount = MAX_STATISTICS_SCOPES;
+			poolInfo.pipelineStatistics = STATISTICS_FLAGS;
+			if (vkCreateQueryPool(device_, &poolInfo, nullptr, &queries.statistics) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create pipeline statistics query pool!");
+			}
+			vkResetQueryPool(device_, queries.statistics, 0, poolInfo.queryCount);
+		}
+	}
+}
+
+void Profiler::cleanup() {
+	for (FrameQueries& queries : frames_) {
+		vkDestroyQueryPool(device_, queries.timestamps, nullptr);
+		vkDestroyQueryPool(device_, queries.statistics, nullptr);
+	}
+	frames_.clear();
+}
+
+double Profiler::nowUs() const {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_).count();
+}
+
+void Profiler::beginFrame(uint32_t frame) {
+	double now = nowUs();
+	endFrame(now);
+	lastFrameStartUs_ = now;
+
+	// The frame's last submit has finished, so every query it wrote is ready
+	FrameQueries& queries = frames_[frame];
+	readBack(queries);
+
+	// Timings are filled in as they come, the CPU time once the frame ends and the rest later
+	if (enabled_) {
+		FrameTiming timing;
+		timing.frame = frameNumber_;
+		frameTimings_.push_back(timing);
+		if (frameTimings_.size() > MAX_TRACE_EVENTS)
+			frameTimings_.pop_front();
+
+		// Latency is measured from the input the frame was made from
+		if (inputUs_ >= 0.0)
+			inputs_.push_back({ frameNumber_, inputUs_ });
+	}
+	inputUs_ = -1.0;
+
+	queries.frame = frameNumber_++;
+	queries.startUs = now;
+	currentFrame_ = frame;
+}
+
+void Profiler::markInput() {
+	if (enabled_)
+		inputUs_ = nowUs();
+}
+
+//*****************************************************************************
+//	Latency
+//		From the frame's input being read to it being displayed. Frames
+//		before it that never got a time were replaced before they were
+//		shown (mailbox drops them), so they are dropped here too.
+//*****************************************************************************
+void Profiler::markDisplayed(uint64_t frame) {
+	while (!inputs_.empty() && inputs_.front().frame < frame)
+		inputs_.pop_front();
+	if (inputs_.empty() || inputs_.front().frame != frame)
+		return;
+
+	double now = nowUs();
+	double inputUs = inputs_.front().startUs;
+	inputs_.pop_front();
+	addEvent({ "Input to display", inputUs, now - inputUs, LATENCY_TRACK, frame, false, {} });
+
+	FrameTiming* timing = findTiming(frame);
+	if (timing)
+		timing->latencyMs = (now - inputUs) / 1000.0;
+}
+
+// Newest frames are at the back, and the ones being looked for are recent
+FrameTiming* Profiler::findTiming(uint64_t frame) {
+	for (auto it = frameTimings_.rbegin(); it != frameTimings_.rend(); ++it) {
+		if (it->frame == frame)
+			return &*it;
+		if (it->frame < frame)
+			break;
+	}
+	return nullptr;
+}
+
+void Profiler::flush() {
+	endFrame(nowUs());
+	for (FrameQueries& queries : frames_)
+		readBack(queries);
+
+	// The last frame is finished, so the next beginFrame has nothing to close
+	lastFrameStartUs_ = -1.0;
+}
+
+// The frame that started at lastFrameStartUs_ ends at now
+void Profiler::endFrame(double now) {
+	if (!enabled_ || frameNumber_ == 0 || lastFrameStartUs_ < 0.0)
+		return;
+
+	uint64_t frame = frameNumber_ - 1;
+	FrameTiming* timing = findTiming(frame);
+	if (timing)
+		timing->cpuMs = (now - lastFrameStartUs_) / 1000.0;
+	addEvent({ "Frame", lastFrameStartUs_, now - lastFrameStartUs_, CPU_TRACK, frame, false, {} });
+}
+
+//*****************************************************************************
+//	Read Back
+//		Results come back with an availability value after each one, and
+//		only available results are used. A scope whose command buffer never
+//		got submitted (the swap chain went out of date) is just skipped.
+//		The queries are reset from the host once they are read.
+//*****************************************************************************
+void Profiler::readBack(FrameQueries& queries) {
+	uint32_t scopeCount = static_cast<uint32_t>(queries.scopes.size());
+	if (scopeCount == 0 || !gpuScopes_) {
+		queries.scopes.clear();
+		return;
+	}
+
+	std::vector<uint64_t> timestamps(scopeCount * 2 * 2);
+	vkGetQueryPoolResults(device_, queries.timestamps, 0, scopeCount * 2, timestamps.size() * sizeof(uint64_t), timestamps.data(),
+		2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	std::vector<uint64_t> statistics;
+	if (queries.statisticsUsed > 0) {
+		const uint32_t stride = STATISTICS_COUNT + 1;
+		statistics.resize(queries.statisticsUsed * stride);
+		vkGetQueryPoolResults(device_, queries.statistics, 0, queries.statisticsUsed, statistics.size() * sizeof(uint64_t), statistics.data(),
+			stride * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	}
+
+	double gpuStart = 0.0;
+	double gpuEnd = 0.0;
+	bool anyScope = false;
+	for (uint32_t i = 0; i < scopeCount; ++i) {
+		const GpuScope& scope = queries.scopes[i];
+		const uint64_t* begin = &timestamps[i * 4];
+		const uint64_t* end = &timestamps[i * 4 + 2];
+		if (begin[1] == 0 || end[1] == 0 || end[0] < begin[0])
+			continue;
+
+		double beginUs = static_cast<double>(begin[0]) * timestampPeriod_ / 1000.0;
+		double durationUs = static_cast<double>(end[0] - begin[0]) * timestampPeriod_ / 1000.0;
+
+		// Move the GPU clock so this scope starts no earlier than when it was recorded
+		double shift = scope.recordedUs - beginUs;
+		if (!gpuOffsetFound_ || shift > gpuToCpuUs_) {
+			gpuToCpuUs_ = shift;
+			gpuOffsetFound_ = true;
+		}
+
+		TraceEvent event{ scope.name, beginUs, durationUs, GPU_TRACK, queries.frame, false, {} };
+		if (scope.statisticsQuery != INVALID_SCOPE) {
+			const uint64_t* counters = &statistics[scope.statisticsQuery * (STATISTICS_COUNT + 1)];
+			if (counters[STATISTICS_COUNT] != 0) {
+				event.hasStatistics = true;
+				std::copy(counters, counters + STATISTICS_COUNT, event.statistics.begin());
+			}
+		}
+
+		if (!anyScope || beginUs < gpuStart)
+			gpuStart = beginUs;
+		gpuEnd = std::max(gpuEnd, beginUs + durationUs);
+		anyScope = true;
+
+		// Stored on the GPU clock for now, shifted when written out
+		addEvent(event);
+	}
+
+	if (anyScope) {
+		FrameTiming* timing = findTiming(queries.frame);
+		if (timing)
+			timing->gpuMs = (gpuEnd - gpuStart) / 1000.0;
+	}
+
+	vkResetQueryPool(device_, queries.timestamps, 0, scopeCount * 2);
+	if (queries.statisticsUsed > 0)
+		vkResetQueryPool(device_, queries.statistics, 0, queries.statisticsUsed);
+	queries.scopes.clear();
+	queries.statisticsUsed = 0;
+}
+
+void Profiler::addEvent(const TraceEvent& event) {
+	events_.push_back(event);
+	if (events_.size() > MAX_TRACE_EVENTS)
+		events_.pop_front();
+}
+
+uint32_t Profiler::beginCpuScope(const char* name) {
+	if (!enabled_)
+		return INVALID_SCOPE;
+
+	cpuScopes_.push_back({ name, nowUs() });
+	return static_cast<uint32_t>(cpuScopes_.size() - 1);
+}
+
+void Profiler::endCpuScope(uint32_t scope) {
+	if (scope == INVALID_SCOPE || scope >= cpuScopes_.size())
+		return;
+
+	const OpenScope& open = cpuScopes_[scope];
+	addEvent({ open.name, open.startUs, nowUs() - open.startUs, CPU_TRACK, frameNumber_ > 0 ? frameNumber_ - 1 : 0, false, {} });
+
+	// Scopes nest, so once the outermost one ends they are all done
+	if (scope == 0)
+		cpuScopes_.clear();
+}
+
+uint32_t Profiler::beginGpuScope(VkCommandBuffer commandBuffer, const char* name, bool statistics) {
+	if (!enabled_ || !gpuScopes_)
+		return INVALID_SCOPE;
+
+	FrameQueries& queries = frames_[currentFrame_];
+	if (queries.scopes.size() == MAX_GPU_SCOPES)
+		return INVALID_SCOPE;
+
+	uint32_t scope = static_cast<uint32_t>(queries.scopes.size());
+	GpuScope gpuScope{ name, INVALID_SCOPE, nowUs() };
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.timestamps, scope * 2);
+
+	if (statistics && statistics_ && queries.statisticsUsed < MAX_STATISTICS_SCOPES) {
+		gpuScope.statisticsQuery = queries.statisticsUsed++;
+		vkCmdBeginQuery(commandBuffer, queries.statistics, gpuScope.statisticsQuery, 0);
+	}
+
+	queries.scopes.push_back(gpuScope);
+	return scope;
+}
+
+void Profiler::endGpuScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+	if (scope == INVALID_SCOPE)
+		return;
+
+	FrameQueries& queries = frames_[currentFrame_];
+	const GpuScope& gpuScope = queries.scopes[scope];
+	if (gpuScope.statisticsQuery != INVALID_SCOPE)
+		vkCmdEndQuery(commandBuffer, queries.statistics, gpuScope.statisticsQuery);
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries.timestamps, scope * 2 + 1);
+}
+
+VkQueryPipelineStatisticFlags Profiler::statisticsFlags() const {
+	return (enabled_ && statistics_) ? STATISTICS_FLAGS : 0;
+}
+
+//*****************************************************************************
+//	Chrome Trace
+//		Complete ("X") events with microsecond times, one process with a CPU
+//		thread, a GPU thread and a latency thread. Frame numbers and pipeline statistics go in
+//		each event's args.
+//*****************************************************************************
+void Profiler::writeChromeTrace(const std::string& path) const {
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open trace file: " + path);
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"Latency\"}}";
+
+	for (const TraceEvent& event : events_) {
+		double start = event.track == GPU_TRACK ? event.startUs + gpuToCpuUs_ : event.startUs;
+		file << ",\n{\"name\":\"" << escapeJson(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+			<< ",\"ts\":" << start << ",\"dur\":" << event.durationUs << ",\"args\":{\"frame\":" << event.frame;
+		if (event.hasStatistics) {
+			for (uint32_t i = 0; i < STATISTICS_COUNT; ++i)
+				file << ",\"" << STATISTICS_NAMES[i] << "\":" << event.statistics[i];
+		}
+		file << "}}";
+	}
+
+	file << "\n]}\n";
+}
@@ -0,0 +1,170 @@
+/**************************************************************************//**
+*	@file   Profiler.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		CPU and GPU timing in named scopes. GPU scopes write a timestamp at
+*		each end, and can count pipeline statistics over the commands in
+*		between. Every frame in flight has its own query pools, and their
+*		results are read the next time that frame comes around, after its
+*		timeline wait, so reading them never stalls. Everything recorded can
+*		be written out as a Chrome trace (chrome://tracing or Perfetto).
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <deque>
+#include <array>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// How long a frame took, read back frames in flight later
+struct FrameTiming {
+	uint64_t frame = 0;
+	double cpuMs = 0.0; //!< From this frame's beginFrame to the next one's
+	double gpuMs = 0.0; //!< From the first GPU scope's start to the last one's end, 0 without any
+	double latencyMs = 0.0; //!< From markInput to markDisplayed, 0 if either never happened
+};
+
+class Profiler {
+public:
+
+	// Queries each frame can use. Scopes past these are dropped
+	static constexpr uint32_t MAX_GPU_SCOPES = 32;
+	static constexpr uint32_t MAX_STATISTICS_SCOPES = 8;
+
+	// Oldest events are dropped past this many, so a long run doesn't grow forever
+	static constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+
+	// A scope that wasn't opened, ending it does nothing
+	static constexpr uint32_t INVALID_SCOPE = UINT32_MAX;
+
+	// Counters in each pipeline statistics scope
+	static constexpr uint32_t STATISTICS_COUNT = 7;
+
+	// GPU scopes need the hostQueryReset feature (core in Vulkan 1.2), since queries
+	//	are reset from the CPU before the frame records. Statistics need pipelineStatisticsQuery.
+	//	Without them the profiler only times the CPU
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t frameCount, bool hostQueryReset, bool pipelineStatistics);
+	void cleanup();
+
+	// Nothing is recorded until this is turned on
+	void setEnabled(bool enabled) { enabled_ = enabled; }
+	bool enabled() const { return enabled_; }
+
+	// Once a frame, after waiting for the frame's last submit. Reads that frame's last
+	//	results back and resets its queries for this frame
+	void beginFrame(uint32_t frame);
+
+	// Finish the last frame and read back every frame still in flight. Only once the device is idle
+	void flush();
+
+	// The input the next frame is made from was just read
+	void markInput();
+
+	// The frame is on screen, which ends its input latency. Frames are numbered by beginFrame
+	void markDisplayed(uint64_t frame);
+
+	// Number of the frame beginFrame started last
+	uint64_t currentFrame() const { return frameNumber_ > 0 ? frameNumber_ - 1 : 0; }
+
+	// CPU scopes on the device thread. Names have to outlive the profiler, string literals are the idea
+	uint32_t beginCpuScope(const char* name);
+	void endCpuScope(uint32_t scope);
+
+	// GPU scopes around commands in a command buffer of the current frame. Only on queues
+	//	with timestampValidBits, and outside of render passes when the commands
+	//	are in secondary command buffers. Statistics scopes can't nest
+	uint32_t beginGpuScope(VkCommandBuffer commandBuffer, const char* name, bool statistics = false);
+	void endGpuScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	// What secondary command buffers executed inside of a statistics scope have to inherit.
+	//	0 when statistics are off
+	VkQueryPipelineStatisticFlags statisticsFlags() const;
+
+	// Every frame read back so far, oldest first
+	const std::deque<FrameTiming>& frameTimings() const { return frameTimings_; }
+
+	// Write every recorded event as Chrome's trace event JSON. CPU scopes on one track, GPU on another
+	void writeChromeTrace(const std::string& path) const;
+
+private:
+
+	// Thread each event shows up on in the trace
+	static constexpr uint32_t CPU_TRACK = 1;
+	static constexpr uint32_t GPU_TRACK = 2;
+	static constexpr uint32_t LATENCY_TRACK = 3;
+
+	struct TraceEvent {
+		const char* name;
+		double startUs;
+		double durationUs;
+		uint32_t track;
+		uint64_t frame;
+		bool hasStatistics;
+		std::array<uint64_t, STATISTICS_COUNT> statistics;
+	};
+
+	struct GpuScope {
+		const char* name;
+		uint32_t statisticsQuery; //!< INVALID_SCOPE when it has none
+		double recordedUs;        //!< When begin was recorded, the GPU can't have started before it
+	};
+
+	// Queries of one frame in flight
+	struct FrameQueries {
+		VkQueryPool timestamps = VK_NULL_HANDLE;
+		VkQueryPool statistics = VK_NULL_HANDLE;
+		std::vector<GpuScope> scopes; //!< Scope i uses timestamps 2i and 2i + 1
+		uint32_t statisticsUsed = 0;
+		uint64_t frame = 0;           //!< Frame number that last used these
+		double startUs = 0.0;         //!< CPU time of that frame's beginFrame
+	};
+
+	struct OpenScope {
+		const char* name;
+		double startUs;
+	};
+
+	// A frame whose input has been read, waiting to be displayed
+	struct PendingInput {
+		uint64_t frame;
+		double startUs;
+	};
+
+	double nowUs() const;
+	void endFrame(double now);
+	FrameTiming* findTiming(uint64_t frame);
+	void readBack(FrameQueries& queries);
+	void addEvent(const TraceEvent& event);
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	bool enabled_ = false;
+	bool gpuScopes_ = false;  //!< Timestamps can be written and reset from the host
+	bool statistics_ = false; //!< Pipeline statistics queries can be used
+	double timestampPeriod_ = 1.0; //!< Nanoseconds per timestamp tick
+
+	// GPU timestamps are on their own clock. They are moved onto the CPU's by the smallest
+	//	shift that keeps every GPU scope from starting before it was recorded
+	double gpuToCpuUs_ = 0.0;
+	bool gpuOffsetFound_ = false;
+
+	std::chrono::steady_clock::time_point start_; //!< CPU time zero
+
+	std::vector<FrameQueries> frames_;
+	uint32_t currentFrame_ = 0;
+	uint64_t frameNumber_ = 0;
+	double lastFrameStartUs_ = 0.0;
+
+	double inputUs_ = -1.0;        //!< When the next frame's input was read, negative if it wasn't
+	std::deque<PendingInput> inputs_; //!< Input times of frames that aren't displayed yet, by frame number
+
+	std::vector<OpenScope> cpuScopes_; //!< Scopes that have begun, ended ones are left in place
+	std::deque<TraceEvent> events_;
+	std::deque<FrameTiming> frameTimings_;
+};
@@ -0,0 +1,126 @@
+/**************************************************************************//**
+*	@file   QueueTimeline.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the per queue timeline semaphore
+******************************************************************************/
+
+#include "QueueTimeline.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+void QueueTimeline::init(VkDevice device, VkQueue queue) {
+	device_ = device;
+	queue_ = queue;
+	submittedValue_ = 0;
+	completedValue_ = 0;
+
+	// A timeline semaphore holds a counter instead of signaled/unsignaled
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &semaphore_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create timeline semaphore!");
+	}
+}
+
+void QueueTimeline::cleanup() {
+	// Nothing on the queue can still be signaling it
+	wait(submittedValue_);
+
+	vkDestroySemaphore(device_, semaphore_, nullptr);
+	semaphore_ = VK_NULL_HANDLE;
+}
+
+//*****************************************************************************
+//	Submit
+//		Binary and timeline semaphores can be mixed in the same submit, the
+//		values are just ignored for the binary ones. The swap chain still
+//		needs binary semaphores, so those get passed through.
+//*****************************************************************************
+uint64_t QueueTimeline::submit(const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount,
+	const std::vector<SemaphoreWait>& waits, const std::vector<VkSemaphore>& binarySignals) {
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<uint64_t> waitValues;
+	std::vector<VkPipelineStageFlags> waitStages;
+	for (const auto& wait : waits) {
+		waitSemaphores.push_back(wait.semaphore);
+		waitValues.push_back(wait.value);
+		waitStages.push_back(wait.stages);
+	}
+
+	// This timeline's next value goes last
+	uint64_t value = submittedValue_ + 1;
+	std::vector<VkSemaphore> signalSemaphores(binarySignals);
+	std::vector<uint64_t> signalValues(binarySignals.size(), 0);
+	signalSemaphores.push_back(semaphore_);
+	signalValues.push_back(value);
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	timelineInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
+	submitInfo.commandBufferCount = commandBufferCount;
+	submitInfo.pCommandBuffers = commandBuffers;
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+	submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+	// No fence, the timeline value is how anyone finds out the work is done
+	if (vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit to queue!");
+	}
+
+	submittedValue_ = value;
+	return value;
+}
+
+uint64_t QueueTimeline::completedValue() {
+	uint64_t value = 0;
+	if (vkGetSemaphoreCounterValue(device_, semaphore_, &value) == VK_SUCCESS)
+		completedValue_ = value;
+
+	return completedValue_;
+}
+
+bool QueueTimeline::isComplete(uint64_t value) {
+	// Don't ask the driver if we already know
+	return value <= completedValue_ || value <= completedValue();
+}
+
+void QueueTimeline::wait(uint64_t value) {
+	if (value > submittedValue_) {
+		throw std::runtime_error("Waiting on a timeline value that was never submitted!");
+	}
+
+	if (isComplete(value))
+		return;
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore_;
+	waitInfo.pValues = &value;
+
+	if (vkWaitSemaphores(device_, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to wait on timeline semaphore!");
+	}
+
+	completedValue_ = std::max(completedValue_, value);
+}
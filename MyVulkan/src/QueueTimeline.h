@@ -0,0 +1,68 @@
+/**************************************************************************//**
+*	@file   QueueTimeline.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		One timeline semaphore per queue. Every submit to the queue signals
+*		the next value on the counter, so "has this work finished" is just
+*		a comparison against the counter. The CPU waits on values, other
+*		queues wait on values, and resources are retired by value, all
+*		without a fence per submission.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <cstdint>
+
+// A semaphore for a submit to wait on. value is ignored for binary semaphores
+struct SemaphoreWait {
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t value = 0;
+	VkPipelineStageFlags stages = 0;
+};
+
+class QueueTimeline {
+public:
+
+	// Needs the timelineSemaphore feature (core in Vulkan 1.2) enabled on the device
+	void init(VkDevice device, VkQueue queue);
+
+	// Waits for everything submitted and destroys the semaphore
+	void cleanup();
+
+	// Submit command buffers to the queue. The submit signals the next value on this
+	//	timeline (along with any binary semaphores) and that value is returned
+	uint64_t submit(const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount,
+		const std::vector<SemaphoreWait>& waits = {}, const std::vector<VkSemaphore>& binarySignals = {});
+
+	// Have another submit wait for value to be reached on this timeline
+	SemaphoreWait waitFor(uint64_t value, VkPipelineStageFlags stages) const { return { semaphore_, value, stages }; }
+
+	// Has the GPU reached value? 0 is always reached
+	bool isComplete(uint64_t value);
+
+	// Block the CPU until the GPU reaches value
+	void wait(uint64_t value);
+
+	// Highest value the GPU has reached
+	uint64_t completedValue();
+
+	// Value of the last submit
+	uint64_t submittedValue() const { return submittedValue_; }
+
+	VkSemaphore semaphore() const { return semaphore_; }
+	VkQueue queue() const { return queue_; }
+
+private:
+
+	VkDevice device_ = VK_NULL_HANDLE;       //!< Logical device the semaphore belongs to
+	VkQueue queue_ = VK_NULL_HANDLE;         //!< Queue every submit goes to
+	VkSemaphore semaphore_ = VK_NULL_HANDLE; //!< The timeline semaphore
+
+	uint64_t submittedValue_ = 0; //!< Value signaled by the last submit
+	uint64_t completedValue_ = 0; //!< Last value read back from the GPU
+};
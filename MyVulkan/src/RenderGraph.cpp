@@ -0,0 +1,561 @@
+/**************************************************************************//**
+*	@file   RenderGraph.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the render graph
+******************************************************************************/
+
+#include "RenderGraph.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace {
+
+	// Usages that TRANSIENT_ATTACHMENT images are allowed to have
+	const VkImageUsageFlags ATTACHMENT_USAGES = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+}
+
+RenderGraph::UsageState RenderGraph::usageState(ResourceUsage usage) {
+	switch (usage) {
+	case ResourceUsage::TransferRead:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, true };
+	case ResourceUsage::TransferWrite:
+		return { VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, false };
+	case ResourceUsage::ComputeRead:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true };
+	case ResourceUsage::ComputeWrite:
+		return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true };
+	case ResourceUsage::IndirectRead:
+		return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, true };
+	case ResourceUsage::VertexRead:
+		return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, true };
+	case ResourceUsage::FragmentSampled:
+		return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true };
+	case ResourceUsage::ColorAttachment:
+		return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, false };
+	case ResourceUsage::DepthAttachment:
+		return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, false };
+	case ResourceUsage::Present:
+		return { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, true };
+	case ResourceUsage::None:
+	default:
+		return { 0, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, false };
+	}
+}
+
+void RenderGraph::init(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator) {
+	device_ = device;
+	allocator_ = &allocator;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties_);
+}
+
+void RenderGraph::cleanup() {
+	for (ResourceInfo& resource : resources_) {
+		if (resource.imported)
+			continue;
+		if (resource.view != VK_NULL_HANDLE)
+			vkDestroyImageView(device_, resource.view, nullptr);
+		if (resource.image != VK_NULL_HANDLE)
+			vkDestroyImage(device_, resource.image, nullptr);
+	}
+
+	for (MemorySlot& slot : slots_) {
+		if (slot.memory.memory != VK_NULL_HANDLE)
+			allocator_->free(slot.memory);
+	}
+
+	resources_.clear();
+	passes_.clear();
+	slots_.clear();
+	finalBarriers_ = BarrierBatch{};
+	compiled_ = false;
+}
+
+RenderGraph::Resource RenderGraph::importImage(const std::string& name, VkImageAspectFlags aspect, ResourceUsage before, ResourceUsage after, bool preserve) {
+	ResourceInfo resource;
+	resource.name = name;
+	resource.isImage = true;
+	resource.imported = true;
+	resource.output = (after != ResourceUsage::None);
+	resource.aspect = aspect;
+	resource.before = before;
+	resource.after = after;
+	resource.preserve = preserve;
+	resources_.push_back(resource);
+	return static_cast<Resource>(resources_.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importBuffer(const std::string& name, ResourceUsage before) {
+	ResourceInfo resource;
+	resource.name = name;
+	resource.imported = true;
+	resource.before = before;
+	resource.preserve = true;
+	resources_.push_back(resource);
+	return static_cast<Resource>(resources_.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::createImage(const std::string& name, const RenderGraphImageDesc& desc) {
+	ResourceInfo resource;
+	resource.name = name;
+	resource.isImage = true;
+	resource.aspect = desc.aspect;
+	resource.desc = desc;
+	resources_.push_back(resource);
+	return static_cast<Resource>(resources_.size() - 1);
+}
+
+uint32_t RenderGraph::addPass(const std::string& name, PassCallback callback) {
+	if (compiled_) {
+		throw std::runtime_error("Render graph passes can't be added after compiling!");
+	}
+
+	Pass pass;
+	pass.name = name;
+	pass.callback = std::move(callback);
+	passes_.push_back(std::move(pass));
+	return static_cast<uint32_t>(passes_.size() - 1);
+}
+
+void RenderGraph::use(uint32_t pass, Resource resource, ResourceUsage usage) {
+	UsageState state = usageState(usage);
+	std::vector<PassUse>& uses = passes_.at(pass).uses;
+
+	// A pass reading a buffer at several stages waits for all of them at once
+	for (PassUse& existing : uses) {
+		if (existing.resource != resource)
+			continue;
+
+		if (resources_[resource].isImage && existing.state.layout != state.layout) {
+			throw std::runtime_error("Render graph pass " + passes_[pass].name + " uses " +
+				resources_[resource].name + " in two layouts!");
+		}
+		existing.state.stages |= state.stages;
+		existing.state.readAccess |= state.readAccess;
+		existing.state.writeAccess |= state.writeAccess;
+		existing.state.readsContents = existing.state.readsContents || state.readsContents;
+		return;
+	}
+
+	uses.push_back({ resource, state });
+}
+
+void RenderGraph::setSideEffects(uint32_t pass) {
+	passes_.at(pass).sideEffects = true;
+}
+
+void RenderGraph::markOutput(Resource resource) {
+	resources_.at(resource).output = true;
+}
+
+void RenderGraph::compile() {
+	cullPasses();
+	computeLifetimes();
+	createTransients();
+	computeBarriers();
+	compiled_ = true;
+}
+
+//*****************************************************************************
+//	Culling
+//		Walk the passes backwards keeping track of which resources something
+//		later still needs. A pass is kept if it writes one of them, then
+//		what it reads is needed too, and what it overwrites without reading
+//		isn't needed from anything before it
+//*****************************************************************************
+void RenderGraph::cullPasses() {
+	std::vector<bool> needed(resources_.size(), false);
+	for (size_t i = 0; i < resources_.size(); ++i)
+		needed[i] = resources_[i].output;
+
+	for (auto pass = passes_.rbegin(); pass != passes_.rend(); ++pass) {
+		bool keep = pass->sideEffects;
+		for (const PassUse& use : pass->uses) {
+			if (use.state.writeAccess != 0 && needed[use.resource])
+				keep = true;
+		}
+
+		pass->culled = !keep;
+		if (!keep)
+			continue;
+
+		for (const PassUse& use : pass->uses) {
+			if (use.state.writeAccess != 0 && !use.state.readsContents)
+				needed[use.resource] = false;
+		}
+		for (const PassUse& use : pass->uses) {
+			if (use.state.readsContents)
+				needed[use.resource] = true;
+		}
+	}
+}
+
+void RenderGraph::computeLifetimes() {
+	for (uint32_t i = 0; i < passes_.size(); ++i) {
+		if (passes_[i].culled)
+			continue;
+
+		for (const PassUse& use : passes_[i].uses) {
+			ResourceInfo& resource = resources_[use.resource];
+			if (resource.firstPass == UINT32_MAX) {
+				resource.firstPass = i;
+				resource.firstUse = use.state;
+			}
+			resource.lastPass = i;
+			resource.lastUse = use.state;
+		}
+	}
+}
+
+//*****************************************************************************
+//	Transient Images
+//		Every image is created first to learn its memory requirements. Then
+//		in the order they start being used, each goes into the first slot
+//		whose images have all stopped being used by then and shares a memory
+//		type with it. Each slot is one allocation, as big as its biggest image
+//*****************************************************************************
+void RenderGraph::createTransients() {
+	std::vector<Resource> transients;
+	std::vector<VkMemoryRequirements> requirements(resources_.size());
+	for (Resource i = 0; i < resources_.size(); ++i) {
+		ResourceInfo& resource = resources_[i];
+		if (resource.imported || !resource.isImage || resource.firstPass == UINT32_MAX)
+			continue;
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = resource.desc.format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = resource.desc.usage;
+		imageInfo.samples = resource.desc.samples;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		// Nothing outside of a render pass ever touches attachment only images
+		if ((resource.desc.usage & ~ATTACHMENT_USAGES) == 0)
+			imageInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+		if (vkCreateImage(device_, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create render graph image " + resource.name + "!");
+		}
+		vkGetImageMemoryRequirements(device_, resource.image, &requirements[i]);
+		transients.push_back(i);
+	}
+
+	std::sort(transients.begin(), transients.end(),
+		[this](Resource a, Resource b) { return resources_[a].firstPass < resources_[b].firstPass; });
+
+	for (Resource i : transients) {
+		ResourceInfo& resource = resources_[i];
+		const VkMemoryRequirements& imageRequirements = requirements[i];
+		bool transient = (resource.desc.usage & ~ATTACHMENT_USAGES) == 0;
+
+		uint32_t slotIndex = UINT32_MAX;
+		for (uint32_t s = 0; s < slots_.size(); ++s) {
+			const MemorySlot& slot = slots_[s];
+			if (resources_[slot.images.back()].lastPass < resource.firstPass &&
+				(slot.requirements.memoryTypeBits & imageRequirements.memoryTypeBits) != 0) {
+				slotIndex = s;
+				break;
+			}
+		}
+
+		if (slotIndex == UINT32_MAX) {
+			slots_.push_back(MemorySlot{});
+			slots_.back().requirements.memoryTypeBits = imageRequirements.memoryTypeBits;
+			slotIndex = static_cast<uint32_t>(slots_.size() - 1);
+		}
+
+		MemorySlot& slot = slots_[slotIndex];
+		slot.images.push_back(i);
+		slot.requirements.size = std::max(slot.requirements.size, imageRequirements.size);
+		slot.requirements.alignment = std::max(slot.requirements.alignment, imageRequirements.alignment);
+		slot.requirements.memoryTypeBits &= imageRequirements.memoryTypeBits;
+		slot.lazy = slot.lazy && transient;
+		resource.slot = slotIndex;
+	}
+
+	// Lazily allocated memory is only backed if the images ever need to leave tile memory
+	for (MemorySlot& slot : slots_) {
+		uint32_t memoryType = UINT32_MAX;
+		if (slot.lazy)
+			memoryType = findMemoryType(slot.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+		if (memoryType == UINT32_MAX)
+			memoryType = findMemoryType(slot.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (memoryType == UINT32_MAX) {
+			throw std::runtime_error("Failed to find memory for render graph images!");
+		}
+
+		slot.memory = allocator_->allocate(slot.requirements, memoryType, ResourceKind::OptimalImage);
+		for (Resource i : slot.images)
+			vkBindImageMemory(device_, resources_[i].image, slot.memory.memory, slot.memory.offset);
+	}
+
+	for (Resource i : transients) {
+		ResourceInfo& resource = resources_[i];
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = resource.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = resource.desc.format;
+		viewInfo.subresourceRange.aspectMask = resource.aspect;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device_, &viewInfo, nullptr, &resource.view) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create render graph image view " + resource.name + "!");
+		}
+	}
+}
+
+//*****************************************************************************
+//	Barriers
+//		Every execution starts from the same states, so the barriers are all
+//		worked out once. Imported resources start from how they were used
+//		before the graph. A transient image starts from the last use of the
+//		image before it in its memory slot: the previous image aliasing the
+//		memory, or the last execution's use of the first image
+//*****************************************************************************
+void RenderGraph::computeBarriers() {
+	std::vector<SyncState> states(resources_.size());
+	for (Resource i = 0; i < resources_.size(); ++i) {
+		const ResourceInfo& resource = resources_[i];
+		SyncState& state = states[i];
+
+		UsageState previous{};
+		if (resource.imported) {
+			previous = usageState(resource.before);
+		}
+		else if (resource.slot != UINT32_MAX) {
+			const std::vector<Resource>& images = slots_[resource.slot].images;
+			size_t position = std::find(images.begin(), images.end(), i) - images.begin();
+			Resource before = images[(position + images.size() - 1) % images.size()];
+			previous = resources_[before].lastUse;
+		}
+
+		if (previous.writeAccess != 0) {
+			state.writeStages = previous.stages;
+			state.writeAccess = previous.writeAccess;
+		}
+		else {
+			state.readStages = previous.stages;
+		}
+
+		if (resource.imported && resource.preserve)
+			state.layout = previous.layout;
+	}
+
+	for (Pass& pass : passes_) {
+		if (pass.culled)
+			continue;
+		for (const PassUse& use : pass.uses)
+			addBarrier(pass.barriers, use.resource, states[use.resource], use.state);
+	}
+
+	// Only the layout matters at the end, whatever uses them next syncs with the graph's submit
+	for (Resource i = 0; i < resources_.size(); ++i) {
+		const ResourceInfo& resource = resources_[i];
+		if (!resource.imported || !resource.isImage || resource.after == ResourceUsage::None)
+			continue;
+
+		UsageState after = usageState(resource.after);
+		if (after.layout != states[i].layout)
+			addBarrier(finalBarriers_, i, states[i], after);
+	}
+}
+
+//*****************************************************************************
+//	Add Barrier
+//		Reads only wait on the last write, and only if it wasn't already made
+//		visible to them. Writes wait on the last write and on every read since
+//		it, though reads only need an execution dependency. Layout changes
+//		always need an image barrier
+//*****************************************************************************
+void RenderGraph::addBarrier(BarrierBatch& batch, Resource resource, SyncState& state, const UsageState& use) const {
+	const ResourceInfo& info = resources_[resource];
+	bool layoutChange = info.isImage && state.layout != use.layout;
+
+	VkPipelineStageFlags srcStages = 0;
+	VkAccessFlags srcAccess = 0;
+	VkAccessFlags dstAccess = 0;
+	bool madeVisible = false;
+
+	if (use.writeAccess != 0) {
+		if (state.writeStages != 0) {
+			srcStages |= state.writeStages;
+			srcAccess |= state.writeAccess;
+			dstAccess |= use.readAccess | use.writeAccess;
+		}
+		srcStages |= state.readStages;
+	}
+	else if (state.writeStages != 0) {
+		bool visible = (use.readAccess & ~state.visibleAccess) == 0 && (use.stages & ~state.visibleStages) == 0;
+		if (!visible) {
+			srcStages |= state.writeStages;
+			srcAccess |= state.writeAccess;
+			dstAccess |= use.readAccess;
+			madeVisible = true;
+		}
+	}
+
+	if (layoutChange) {
+		// The transition itself has to be made visible to the new use
+		batch.images.push_back({ resource, srcAccess, use.readAccess | use.writeAccess, state.layout, use.layout });
+	}
+	else if (info.isImage && srcStages != 0) {
+		batch.images.push_back({ resource, srcAccess, dstAccess, state.layout, use.layout });
+	}
+	else {
+		batch.memorySrcAccess |= srcAccess;
+		batch.memoryDstAccess |= dstAccess;
+	}
+
+	if (srcStages != 0 || layoutChange) {
+		batch.srcStages |= srcStages;
+		batch.dstStages |= use.stages;
+	}
+
+	// Move the resource on to its new state
+	if (use.writeAccess != 0) {
+		state.writeStages = use.stages;
+		state.writeAccess = use.writeAccess;
+		state.readStages = 0;
+		state.visibleStages = 0;
+		state.visibleAccess = 0;
+	}
+	else if (layoutChange) {
+		// Later reads at other stages have to wait for the transition like they would a write
+		state.writeStages = use.stages;
+		state.writeAccess = 0;
+		state.readStages = use.stages;
+		state.visibleStages = use.stages;
+		state.visibleAccess = use.readAccess;
+	}
+	else {
+		state.readStages |= use.stages;
+		if (madeVisible) {
+			state.visibleStages |= use.stages;
+			state.visibleAccess |= use.readAccess;
+		}
+	}
+	state.layout = use.layout;
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) const {
+	if (batch.dstStages == 0)
+		return;
+
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = batch.memorySrcAccess;
+	memoryBarrier.dstAccessMask = batch.memoryDstAccess;
+	uint32_t memoryBarrierCount = (batch.memorySrcAccess != 0) ? 1 : 0;
+
+	std::vector<VkImageMemoryBarrier> imageBarriers(batch.images.size());
+	for (size_t i = 0; i < batch.images.size(); ++i) {
+		const ImageBarrier& image = batch.images[i];
+		VkImageMemoryBarrier& barrier = imageBarriers[i];
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = image.srcAccess;
+		barrier.dstAccessMask = image.dstAccess;
+		barrier.oldLayout = image.oldLayout;
+		barrier.newLayout = image.newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = resources_[image.resource].image;
+		barrier.subresourceRange.aspectMask = resources_[image.resource].aspect;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+	}
+
+	// Nothing before it to wait on, only a layout to change
+	VkPipelineStageFlags srcStages = batch.srcStages != 0 ? batch.srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStages, batch.dstStages, 0,
+		memoryBarrierCount, &memoryBarrier, 0, nullptr,
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void RenderGraph::setImage(Resource resource, VkImage image) {
+	ResourceInfo& info = resources_.at(resource);
+	if (!info.imported || !info.isImage) {
+		throw std::runtime_error("Only imported images can be set: " + info.name);
+	}
+	info.image = image;
+}
+
+VkImage RenderGraph::image(Resource resource) const {
+	return resources_.at(resource).image;
+}
+
+VkImageView RenderGraph::view(Resource resource) const {
+	return resources_.at(resource).view;
+}
+
+VkPipelineStageFlags RenderGraph::firstStages(Resource resource) const {
+	return resources_.at(resource).firstUse.stages;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) const {
+	for (const Pass& pass : passes_) {
+		if (pass.culled)
+			continue;
+		recordBarriers(commandBuffer, pass.barriers);
+		pass.callback(commandBuffer);
+	}
+	recordBarriers(commandBuffer, finalBarriers_);
+}
+
+uint32_t RenderGraph::culledPassCount() const {
+	uint32_t culled = 0;
+	for (const Pass& pass : passes_) {
+		if (pass.culled)
+			++culled;
+	}
+	return culled;
+}
+
+VkDeviceSize RenderGraph::transientMemorySize() const {
+	VkDeviceSize size = 0;
+	for (const MemorySlot& slot : slots_)
+		size += slot.requirements.size;
+	return size;
+}
+
+void RenderGraph::printStats(std::ostream& os) const {
+	uint32_t transientCount = 0;
+	for (const MemorySlot& slot : slots_)
+		transientCount += static_cast<uint32_t>(slot.images.size());
+
+	os << "Render graph: " << passCount() << " passes (" << culledPassCount() << " culled), "
+		<< transientCount << " transient images in " << slots_.size() << " allocations ("
+		<< transientMemorySize() / 1024 << " KiB)" << std::endl;
+	for (const Pass& pass : passes_) {
+		os << "  " << pass.name << (pass.culled ? " [culled]" : "") << ": "
+			<< pass.barriers.images.size() << " image barriers"
+			<< (pass.barriers.memorySrcAccess != 0 ? ", memory barrier" : "") << std::endl;
+	}
+}
+
+uint32_t RenderGraph::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+	for (uint32_t i = 0; i < memProperties_.memoryTypeCount; ++i) {
+		if ((typeFilter & (1 << i)) && (memProperties_.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	}
+	return UINT32_MAX;
+}
@@ -0,0 +1,214 @@
+/**************************************************************************//**
+*	@file   RenderGraph.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Frame graph of passes over images and buffers. Each pass declares
+*		how it uses every resource it touches, and compile works out one
+*		batched barrier in front of each pass from that, culls passes
+*		nothing needs, and creates the transient images. Transient images
+*		whose lifetimes don't overlap share the same memory. The graph is
+*		compiled once and executed every frame, imported images can be
+*		swapped out between executions (like the swap chain image).
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "MemoryAllocator.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <ostream>
+#include <cstdint>
+
+// How a pass uses a resource. Each one is a stage, access and (for images) layout
+//	ColorAttachment and DepthAttachment are drawn into without their earlier
+//	contents, so a pass that only draws into an image doesn't need the pass before it
+enum class ResourceUsage {
+	None,            //!< Not used yet, nothing to wait on
+	TransferRead,
+	TransferWrite,
+	ComputeRead,     //!< Storage buffers or sampled images read in a compute shader
+	ComputeWrite,    //!< Storage buffers or images written (and read) in a compute shader
+	IndirectRead,    //!< Indirect draw commands and counts
+	VertexRead,      //!< Vertex and instance buffers
+	FragmentSampled, //!< Images sampled in a fragment shader
+	ColorAttachment, //!< Color or resolve attachment of a render pass
+	DepthAttachment,
+	Present          //!< Handed to the presentation engine
+};
+
+// What a transient image is created as. Images only used as attachments are made
+//	TRANSIENT and get lazily allocated memory where the device has it
+struct RenderGraphImageDesc {
+	VkExtent2D extent{};
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkImageUsageFlags usage = 0;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+class RenderGraph {
+public:
+
+	using Resource = uint32_t;
+	using PassCallback = std::function<void(VkCommandBuffer)>;
+
+	// Handle of a resource that wasn't declared
+	static constexpr Resource INVALID_RESOURCE = UINT32_MAX;
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator);
+
+	// Destroys the transient images and frees their memory. Only once the GPU is done with them
+	void cleanup();
+
+	// An image the graph doesn't own. before is how it was last used ahead of the graph,
+	//	which the first barrier waits on, and after is what it is left as at the end.
+	//	Without preserve, its contents going in are thrown away
+	Resource importImage(const std::string& name, VkImageAspectFlags aspect, ResourceUsage before, ResourceUsage after,
+		bool preserve = false);
+
+	// A buffer the graph doesn't own. Buffer hazards are covered with global memory barriers,
+	//	so the handle itself isn't needed
+	Resource importBuffer(const std::string& name, ResourceUsage before = ResourceUsage::None);
+
+	// An image the graph creates at compile, and only exists while the graph runs
+	Resource createImage(const std::string& name, const RenderGraphImageDesc& desc);
+
+	// Passes run in the order they are added. Returns the pass index
+	uint32_t addPass(const std::string& name, PassCallback callback);
+
+	// Declare a use of a resource. Uses of the same resource in a pass are combined
+	void use(uint32_t pass, Resource resource, ResourceUsage usage);
+
+	// The pass does something outside of the graph (uploads, queries), so it is never culled
+	void setSideEffects(uint32_t pass);
+
+	// The resource's contents are needed after the graph. Imported images with a layout
+	//	they are left in are outputs already
+	void markOutput(Resource resource);
+
+	// Cull passes, create the transient images and work out every pass's barriers.
+	//	Nothing can be declared after this
+	void compile();
+
+	// Swap out an imported image before executing, like the acquired swap chain image
+	void setImage(Resource resource, VkImage image);
+
+	VkImage image(Resource resource) const;
+	VkImageView view(Resource resource) const;
+
+	// Stages the resource is first used at, for semaphore waits in front of the graph
+	VkPipelineStageFlags firstStages(Resource resource) const;
+
+	// Record every pass that wasn't culled, each behind its barrier
+	void execute(VkCommandBuffer commandBuffer) const;
+
+	uint32_t passCount() const { return static_cast<uint32_t>(passes_.size()); }
+	uint32_t culledPassCount() const;
+	VkDeviceSize transientMemorySize() const;
+	void printStats(std::ostream& os) const;
+
+private:
+
+	// Stage, access and layout a usage stands for
+	struct UsageState {
+		VkPipelineStageFlags stages;
+		VkAccessFlags readAccess;
+		VkAccessFlags writeAccess;
+		VkImageLayout layout;
+		bool readsContents; //!< Needs what earlier passes wrote
+	};
+	static UsageState usageState(ResourceUsage usage);
+
+	// Where a resource stands while compile walks the passes
+	struct SyncState {
+		VkPipelineStageFlags writeStages = 0;       //!< Stages of the last write, 0 if none
+		VkAccessFlags writeAccess = 0;
+		VkPipelineStageFlags readStages = 0;        //!< Stages that read since the last write
+		VkAccessFlags visibleAccess = 0;            //!< Reads the last write has been made visible to
+		VkPipelineStageFlags visibleStages = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	struct ResourceInfo {
+		std::string name;
+		bool isImage = false;
+		bool imported = false;
+		bool output = false;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		ResourceUsage before = ResourceUsage::None;
+		ResourceUsage after = ResourceUsage::None;
+		bool preserve = false;
+		RenderGraphImageDesc desc{};
+
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		uint32_t slot = UINT32_MAX;      //!< Memory slot of a transient image
+		uint32_t firstPass = UINT32_MAX; //!< Lifetime over the passes that were kept
+		uint32_t lastPass = 0;
+		UsageState firstUse{};
+		UsageState lastUse{};
+	};
+
+	struct PassUse {
+		Resource resource;
+		UsageState state;
+	};
+
+	struct ImageBarrier {
+		Resource resource;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+	};
+
+	// Everything waited on in front of a pass, recorded as one vkCmdPipelineBarrier
+	struct BarrierBatch {
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		VkAccessFlags memorySrcAccess = 0; //!< Buffer hazards, as one global memory barrier
+		VkAccessFlags memoryDstAccess = 0;
+		std::vector<ImageBarrier> images;
+	};
+
+	struct Pass {
+		std::string name;
+		PassCallback callback;
+		std::vector<PassUse> uses;
+		bool sideEffects = false;
+		bool culled = false;
+		BarrierBatch barriers;
+	};
+
+	// Transient images with lifetimes that don't overlap, bound to the same memory
+	struct MemorySlot {
+		std::vector<Resource> images; //!< In the order they are used
+		VkMemoryRequirements requirements{};
+		bool lazy = true;             //!< Every image in it is a TRANSIENT attachment
+		Allocation memory;
+	};
+
+	void cullPasses();
+	void computeLifetimes();
+	void createTransients();
+	void computeBarriers();
+	void addBarrier(BarrierBatch& batch, Resource resource, SyncState& state, const UsageState& use) const;
+	void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) const;
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	MemoryAllocator* allocator_ = nullptr;
+	VkPhysicalDeviceMemoryProperties memProperties_{};
+	bool compiled_ = false;
+
+	std::vector<ResourceInfo> resources_;
+	std::vector<Pass> passes_;
+	std::vector<MemorySlot> slots_;
+	BarrierBatch finalBarriers_; //!< Imported images into the layouts they are left in
+};
@@ -0,0 +1,27 @@
+/**************************************************************************//**
+*	@file   RenderTier.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		The tiers the renderer runs at. Devices are rated by what they can
+*		do, and the tier they land on decides which optional rendering
+*		paths get turned on, so one build runs at its best on any device.
+******************************************************************************/
+
+#pragma once
+
+// Each tier has everything the one before it has
+enum class RenderTier {
+	Baseline, //!< Only what the renderer needs: one indirect command per draw call, one texture set
+	Standard, //!< Multi draw indirect, and GPU written draw counts where the device has them
+	High      //!< Bindless textures as well
+};
+
+inline const char* renderTierName(RenderTier tier) {
+	switch (tier) {
+	case RenderTier::Baseline: return "baseline";
+	case RenderTier::Standard: return "standard";
+	case RenderTier::High: return "high";
+	}
+	return "unknown";
+}
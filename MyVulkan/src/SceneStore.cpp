@@ -0,0 +1,231 @@
+/**************************************************************************//**
+*	@file   SceneStore.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the structure of arrays instance transforms
+******************************************************************************/
+
+#include "SceneStore.h"
+
+#include <algorithm>
+#include <future>
+#include <cmath>
+#include <cstring>
+
+// SSE2 is always there on x64, and 32 bit builds say when they target it
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_STORE_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+	// Fewest instances worth handing to a worker, a multiple of the SSE width
+	const uint32_t MIN_INSTANCES_PER_JOB = 4096;
+}
+
+void SceneStore::init(uint32_t threadCount) {
+	// The device thread is one of the updating threads
+	if (threadCount > 1)
+		workers_.init(threadCount - 1);
+}
+
+void SceneStore::cleanup() {
+	workers_.shutdown();
+}
+
+uint32_t SceneStore::add(const glm::vec3& position, const glm::quat& rotation, float scale, const glm::vec4& color) {
+	uint32_t index = size();
+
+	positionX_.push_back(position.x);
+	positionY_.push_back(position.y);
+	positionZ_.push_back(position.z);
+	rotationX_.push_back(rotation.x);
+	rotationY_.push_back(rotation.y);
+	rotationZ_.push_back(rotation.z);
+	rotationW_.push_back(rotation.w);
+	scales_.push_back(scale);
+	velocityX_.push_back(0.0f);
+	velocityY_.push_back(0.0f);
+	velocityZ_.push_back(0.0f);
+	angularX_.push_back(0.0f);
+	angularY_.push_back(0.0f);
+	angularZ_.push_back(0.0f);
+	colors_.push_back(color);
+
+	return index;
+}
+
+void SceneStore::setVelocity(uint32_t instance, const glm::vec3& velocity) {
+	velocityX_[instance] = velocity.x;
+	velocityY_[instance] = velocity.y;
+	velocityZ_[instance] = velocity.z;
+}
+
+void SceneStore::setAngularVelocity(uint32_t instance, const glm::vec3& angularVelocity) {
+	angularX_[instance] = angularVelocity.x;
+	angularY_[instance] = angularVelocity.y;
+	angularZ_[instance] = angularVelocity.z;
+}
+
+//*****************************************************************************
+//	Update
+//		Each job gets its own range, so nothing is shared but the read only
+//		dt. The device thread takes the first range itself instead of only
+//		waiting on the others
+//*****************************************************************************
+void SceneStore::update(float dt, void* instances) {
+	float* out = static_cast<float*>(instances);
+	uint32_t count = size();
+
+	uint32_t jobCount = std::min(workers_.threadCount() + 1, (count + MIN_INSTANCES_PER_JOB - 1) / MIN_INSTANCES_PER_JOB);
+	jobCount = std::max(jobCount, 1u);
+
+	// Ranges start on a multiple of four, so only the last one has a tail
+	uint32_t perJob = (count + jobCount - 1) / jobCount;
+	perJob = (perJob + 3) & ~3u;
+
+	std::vector<std::future<void>> jobs;
+	for (uint32_t job = 1; job < jobCount; ++job) {
+		uint32_t first = job * perJob;
+		if (first >= count)
+			break;
+		uint32_t rangeCount = std::min(perJob, count - first);
+		jobs.push_back(workers_.async([this, first, rangeCount, dt, out]() { updateRange(first, rangeCount, dt, out); }));
+	}
+
+	updateRange(0, std::min(perJob, count), dt, out);
+
+	for (auto& job : jobs)
+		job.get();
+}
+
+void SceneStore::updateRange(uint32_t first, uint32_t count, float dt, float* out) {
+	const uint32_t floatsPerInstance = static_cast<uint32_t>(INSTANCE_STRIDE / sizeof(float));
+	uint32_t i = first;
+	uint32_t end = first + count;
+
+#ifdef SCENE_STORE_SSE
+	const __m128 halfDt = _mm_set1_ps(0.5f * dt);
+	const __m128 dtVec = _mm_set1_ps(dt);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= end; i += 4) {
+		//*************************************************************************
+		//	Integrate
+		//		Four instances per register, one component each. The rotation
+		//		follows dq/dt = 0.5 * (w, 0) * q for world space angular velocity w,
+		//		which needs no trig, then it is normalized again
+		//*************************************************************************
+		__m128 px = _mm_loadu_ps(&positionX_[i]);
+		__m128 py = _mm_loadu_ps(&positionY_[i]);
+		__m128 pz = _mm_loadu_ps(&positionZ_[i]);
+		px = _mm_add_ps(px, _mm_mul_ps(_mm_loadu_ps(&velocityX_[i]), dtVec));
+		py = _mm_add_ps(py, _mm_mul_ps(_mm_loadu_ps(&velocityY_[i]), dtVec));
+		pz = _mm_add_ps(pz, _mm_mul_ps(_mm_loadu_ps(&velocityZ_[i]), dtVec));
+		_mm_storeu_ps(&positionX_[i], px);
+		_mm_storeu_ps(&positionY_[i], py);
+		_mm_storeu_ps(&positionZ_[i], pz);
+
+		__m128 qx = _mm_loadu_ps(&rotationX_[i]);
+		__m128 qy = _mm_loadu_ps(&rotationY_[i]);
+		__m128 qz = _mm_loadu_ps(&rotationZ_[i]);
+		__m128 qw = _mm_loadu_ps(&rotationW_[i]);
+		__m128 wx = _mm_loadu_ps(&angularX_[i]);
+		__m128 wy = _mm_loadu_ps(&angularY_[i]);
+		__m128 wz = _mm_loadu_ps(&angularZ_[i]);
+
+		__m128 dx = _mm_add_ps(_mm_mul_ps(qw, wx), _mm_sub_ps(_mm_mul_ps(wy, qz), _mm_mul_ps(wz, qy)));
+		__m128 dy = _mm_add_ps(_mm_mul_ps(qw, wy), _mm_sub_ps(_mm_mul_ps(wz, qx), _mm_mul_ps(wx, qz)));
+		__m128 dz = _mm_add_ps(_mm_mul_ps(qw, wz), _mm_sub_ps(_mm_mul_ps(wx, qy), _mm_mul_ps(wy, qx)));
+		__m128 dw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, qx), _mm_mul_ps(wy, qy)), _mm_mul_ps(wz, qz));
+		qx = _mm_add_ps(qx, _mm_mul_ps(dx, halfDt));
+		qy = _mm_add_ps(qy, _mm_mul_ps(dy, halfDt));
+		qz = _mm_add_ps(qz, _mm_mul_ps(dz, halfDt));
+		qw = _mm_sub_ps(qw, _mm_mul_ps(dw, halfDt));
+
+		__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)),
+			_mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw)));
+		__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+		qx = _mm_mul_ps(qx, invLength);
+		qy = _mm_mul_ps(qy, invLength);
+		qz = _mm_mul_ps(qz, invLength);
+		qw = _mm_mul_ps(qw, invLength);
+		_mm_storeu_ps(&rotationX_[i], qx);
+		_mm_storeu_ps(&rotationY_[i], qy);
+		_mm_storeu_ps(&rotationZ_[i], qz);
+		_mm_storeu_ps(&rotationW_[i], qw);
+
+		//*************************************************************************
+		//	Compose
+		//		T * R * S, with the rotation matrix built straight from the
+		//		quaternion. Each column comes out as one register per row, and a
+		//		transpose turns that into one register per instance
+		//*************************************************************************
+		__m128 x2 = _mm_mul_ps(qx, two), y2 = _mm_mul_ps(qy, two), z2 = _mm_mul_ps(qz, two);
+		__m128 xx = _mm_mul_ps(qx, x2), yy = _mm_mul_ps(qy, y2), zz = _mm_mul_ps(qz, z2);
+		__m128 xy = _mm_mul_ps(qx, y2), xz = _mm_mul_ps(qx, z2), yz = _mm_mul_ps(qy, z2);
+		__m128 wxq = _mm_mul_ps(qw, x2), wyq = _mm_mul_ps(qw, y2), wzq = _mm_mul_ps(qw, z2);
+		__m128 s = _mm_loadu_ps(&scales_[i]);
+
+		__m128 columns[4][4] = {
+			{ _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), s), _mm_mul_ps(_mm_add_ps(xy, wzq), s), _mm_mul_ps(_mm_sub_ps(xz, wyq), s), zero },
+			{ _mm_mul_ps(_mm_sub_ps(xy, wzq), s), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), s), _mm_mul_ps(_mm_add_ps(yz, wxq), s), zero },
+			{ _mm_mul_ps(_mm_add_ps(xz, wyq), s), _mm_mul_ps(_mm_sub_ps(yz, wxq), s), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), s), zero },
+			{ px, py, pz, one },
+		};
+
+		// Whole 16 byte stores one after the other, which write combined memory takes well
+		float* dst = out + static_cast<size_t>(i) * floatsPerInstance;
+		for (uint32_t column = 0; column < 4; ++column) {
+			__m128* rows = columns[column];
+			_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+			for (uint32_t lane = 0; lane < 4; ++lane)
+				_mm_storeu_ps(dst + lane * floatsPerInstance + column * 4, rows[lane]);
+		}
+		for (uint32_t lane = 0; lane < 4; ++lane)
+			_mm_storeu_ps(dst + lane * floatsPerInstance + 16, _mm_loadu_ps(&colors_[i + lane].x));
+	}
+#endif
+
+	// Whatever didn't fill a register, or everything without SSE
+	for (; i < end; ++i)
+		updateOne(i, dt, out + static_cast<size_t>(i) * floatsPerInstance);
+}
+
+// The same as the SSE path, for one instance
+void SceneStore::updateOne(uint32_t i, float dt, float* out) {
+	positionX_[i] += velocityX_[i] * dt;
+	positionY_[i] += velocityY_[i] * dt;
+	positionZ_[i] += velocityZ_[i] * dt;
+
+	float qx = rotationX_[i], qy = rotationY_[i], qz = rotationZ_[i], qw = rotationW_[i];
+	float wx = angularX_[i], wy = angularY_[i], wz = angularZ_[i];
+	float halfDt = 0.5f * dt;
+	float nx = qx + (qw * wx + (wy * qz - wz * qy)) * halfDt;
+	float ny = qy + (qw * wy + (wz * qx - wx * qz)) * halfDt;
+	float nz = qz + (qw * wz + (wx * qy - wy * qx)) * halfDt;
+	float nw = qw - (wx * qx + wy * qy + wz * qz) * halfDt;
+	float invLength = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz + nw * nw);
+	qx = rotationX_[i] = nx * invLength;
+	qy = rotationY_[i] = ny * invLength;
+	qz = rotationZ_[i] = nz * invLength;
+	qw = rotationW_[i] = nw * invLength;
+
+	float s = scales_[i];
+	float xx = 2.0f * qx * qx, yy = 2.0f * qy * qy, zz = 2.0f * qz * qz;
+	float xy = 2.0f * qx * qy, xz = 2.0f * qx * qz, yz = 2.0f * qy * qz;
+	float wxq = 2.0f * qw * qx, wyq = 2.0f * qw * qy, wzq = 2.0f * qw * qz;
+
+	const float instance[20] = {
+		(1.0f - (yy + zz)) * s, (xy + wzq) * s, (xz - wyq) * s, 0.0f,
+		(xy - wzq) * s, (1.0f - (xx + zz)) * s, (yz + wxq) * s, 0.0f,
+		(xz + wyq) * s, (yz - wxq) * s, (1.0f - (xx + yy)) * s, 0.0f,
+		positionX_[i], positionY_[i], positionZ_[i], 1.0f,
+		colors_[i].x, colors_[i].y, colors_[i].z, colors_[i].w,
+	};
+	memcpy(out, instance, sizeof(instance));
+}
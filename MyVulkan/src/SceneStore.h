@@ -0,0 +1,62 @@
+/**************************************************************************//**
+*	@file   SceneStore.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Every instance's transform, kept as structure of arrays: one array
+*		per component of the positions, rotations (quaternions), scales and
+*		velocities. Each frame the instances are moved forward and their
+*		world matrices composed four at a time with SSE, split over the
+*		workers, and written straight into the mapped instance buffer.
+******************************************************************************/
+
+#pragma once
+
+#include "JobSystem.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <cstdint>
+
+class SceneStore {
+public:
+
+	// What update writes for every instance: the column major world matrix, then the color.
+	//	This is InstanceData's layout
+	static constexpr size_t INSTANCE_STRIDE = 20 * sizeof(float);
+	static constexpr size_t COLOR_OFFSET = 16 * sizeof(float);
+
+	// threadCount includes the device thread, which takes a range of its own
+	void init(uint32_t threadCount);
+	void cleanup();
+
+	// Add an instance that isn't moving. Returns its index
+	uint32_t add(const glm::vec3& position, const glm::quat& rotation, float scale, const glm::vec4& color);
+
+	// World space velocity, and angular velocity in radians per second around each axis
+	void setVelocity(uint32_t instance, const glm::vec3& velocity);
+	void setAngularVelocity(uint32_t instance, const glm::vec3& angularVelocity);
+
+	// Move every instance forward by dt seconds and write all of them to instances,
+	//	INSTANCE_STRIDE bytes apart. The output is only written, so it can be write combined memory
+	void update(float dt, void* instances);
+
+	uint32_t size() const { return static_cast<uint32_t>(scales_.size()); }
+
+private:
+
+	// Update and write [first, first + count). Groups of four go through SSE, the rest one by one
+	void updateRange(uint32_t first, uint32_t count, float dt, float* out);
+	void updateOne(uint32_t i, float dt, float* out);
+
+	JobSystem workers_; //!< Threads the instances are split over, separate from asset loading so the frame doesn't wait on it
+
+	std::vector<float> positionX_, positionY_, positionZ_;
+	std::vector<float> rotationX_, rotationY_, rotationZ_, rotationW_; //!< Unit quaternions
+	std::vector<float> scales_;                                         //!< Uniform scale
+	std::vector<float> velocityX_, velocityY_, velocityZ_;
+	std::vector<float> angularX_, angularY_, angularZ_;
+	std::vector<glm::vec4> colors_; //!< Never change, so kept as they are written
+};
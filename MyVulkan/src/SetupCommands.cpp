@@ -0,0 +1,205 @@
+/**************************************************************************//**
+*	@file   SetupCommands.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the batched setup command recorder
+******************************************************************************/
+
+#include "SetupCommands.h"
+
+#include <stdexcept>
+#include <cstdint>
+
+void SetupCommands::init(VkDevice device, QueueTimeline& timeline, uint32_t queueFamily) {
+	device_ = device;
+	timeline_ = &timeline;
+
+	// Setup command buffers are recorded once and then recycled,
+	//	so they get reset individually and are short lived
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamily;
+
+	if (vkCreateCommandPool(device_, &poolInfo, nullptr, &pool_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create setup command pool!");
+	}
+}
+
+void SetupCommands::cleanup() {
+	// Make sure the GPU is done with everything before destroying it
+	timeline_->wait(lastFlush_);
+	inFlight_.clear();
+	free_.clear();
+
+	// Anything recorded but never flushed is simply thrown away
+	current_ = {};
+
+	// Destroying the pool frees all of its command buffers
+	vkDestroyCommandPool(device_, pool_, nullptr);
+	pool_ = VK_NULL_HANDLE;
+}
+
+//*****************************************************************************
+//	Barriers
+//		Queued up until a command that isn't a barrier is recorded. Two
+//		barriers on the same resource can't go in the same call (the second
+//		one has to happen after the first), so that also ends the batch.
+//*****************************************************************************
+void SetupCommands::pipelineBarrier(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkMemoryBarrier& barrier) {
+	srcStages_ |= srcStages;
+	dstStages_ |= dstStages;
+	memoryBarriers_.push_back(barrier);
+}
+
+void SetupCommands::pipelineBarrier(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkBufferMemoryBarrier& barrier) {
+	for (const auto& pending : bufferBarriers_) {
+		if (pending.buffer == barrier.buffer) {
+			recordPendingBarriers();
+			break;
+		}
+	}
+
+	srcStages_ |= srcStages;
+	dstStages_ |= dstStages;
+	bufferBarriers_.push_back(barrier);
+}
+
+void SetupCommands::pipelineBarrier(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkImageMemoryBarrier& barrier) {
+	for (const auto& pending : imageBarriers_) {
+		if (pending.image == barrier.image) {
+			recordPendingBarriers();
+			break;
+		}
+	}
+
+	srcStages_ |= srcStages;
+	dstStages_ |= dstStages;
+	imageBarriers_.push_back(barrier);
+}
+
+void SetupCommands::copyBuffer(VkBuffer src, VkBuffer dst, const VkBufferCopy& region) {
+	vkCmdCopyBuffer(commandBuffer(), src, dst, 1, &region);
+}
+
+void SetupCommands::copyBufferToImage(VkBuffer src, VkImage dst, VkImageLayout dstLayout, const VkBufferImageCopy& region) {
+	vkCmdCopyBufferToImage(commandBuffer(), src, dst, dstLayout, 1, &region);
+}
+
+VkCommandBuffer SetupCommands::commandBuffer() {
+	// Start a new command buffer if nothing has been recorded since the last flush
+	if (current_.commandBuffer == VK_NULL_HANDLE) {
+		// Reuse a finished one if we can
+		retireCompleted();
+		if (!free_.empty()) {
+			current_ = free_.back();
+			free_.pop_back();
+
+			vkResetCommandBuffer(current_.commandBuffer, 0);
+		}
+		else {
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = pool_;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(device_, &allocInfo, &current_.commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate setup command buffer!");
+			}
+		}
+
+		// Each recording is only submitted once
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(current_.commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin recording setup command buffer!");
+		}
+	}
+
+	// Whatever is recorded next has to come after the queued barriers
+	recordPendingBarriers();
+
+	return current_.commandBuffer;
+}
+
+void SetupCommands::recordPendingBarriers() {
+	if (!hasPendingBarriers())
+		return;
+
+	// Take the barriers out first, commandBuffer() would otherwise try to record them again
+	VkPipelineStageFlags srcStages = srcStages_;
+	VkPipelineStageFlags dstStages = dstStages_;
+	std::vector<VkMemoryBarrier> memoryBarriers;
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	memoryBarriers.swap(memoryBarriers_);
+	bufferBarriers.swap(bufferBarriers_);
+	imageBarriers.swap(imageBarriers_);
+	srcStages_ = 0;
+	dstStages_ = 0;
+
+	vkCmdPipelineBarrier(commandBuffer(),
+		srcStages, dstStages, 0,
+		static_cast<uint32_t>(memoryBarriers.size()), memoryBarriers.data(),
+		static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void SetupCommands::waitSemaphore(const SemaphoreWait& wait) {
+	waits_.push_back(wait);
+}
+
+//*****************************************************************************
+//	Flush
+//		One submit for everything recorded. The timeline is only looked at
+//		when someone asks about the ticket, so the CPU never waits here.
+//*****************************************************************************
+SetupTicket SetupCommands::flush() {
+	// Nothing to submit, the last flush is as good as this one
+	if (empty() && waits_.empty())
+		return SetupTicket{ lastFlush_ };
+
+	// Makes sure there is a command buffer and the last barriers are in it
+	VkCommandBuffer commandBuffer = this->commandBuffer();
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record setup command buffer!");
+	}
+
+	current_.value = timeline_->submit(&commandBuffer, 1, waits_);
+	lastFlush_ = current_.value;
+	waits_.clear();
+
+	inFlight_.push_back(current_);
+	SetupTicket ticket{ current_.value };
+	current_ = {};
+
+	return ticket;
+}
+
+bool SetupCommands::isComplete(SetupTicket ticket) {
+	return timeline_->isComplete(ticket.value);
+}
+
+void SetupCommands::wait(SetupTicket ticket) {
+	if (ticket.value > lastFlush_) {
+		throw std::runtime_error("Waiting on a setup ticket that was never flushed!");
+	}
+
+	timeline_->wait(ticket.value);
+	retireCompleted();
+}
+
+void SetupCommands::retireCompleted() {
+	// Oldest first, stop at the first one that hasn't finished. One read of
+	//	the counter covers every submission
+	uint64_t completed = timeline_->completedValue();
+	size_t retired = 0;
+	while (retired < inFlight_.size() && inFlight_[retired].value <= completed) {
+		free_.push_back(inFlight_[retired]);
+		++retired;
+	}
+
+	inFlight_.erase(inFlight_.begin(), inFlight_.begin() + retired);
+}
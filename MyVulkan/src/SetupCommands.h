@@ -0,0 +1,93 @@
+/**************************************************************************//**
+*	@file   SetupCommands.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Batched setup command recorder. Setup work (layout transitions,
+*		copies) is recorded into one command buffer, adjacent barriers are
+*		merged into a single vkCmdPipelineBarrier, and nothing is submitted
+*		until flush. A flush hands back a ticket instead of blocking.
+*		Tickets are values on the queue's timeline semaphore.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "QueueTimeline.h"
+
+#include <vector>
+
+// Identifies one flush of a SetupCommands. Tickets are handed out in
+//	increasing order, so every ticket before a completed one is also complete
+struct SetupTicket {
+	uint64_t value = 0; //!< Value on the queue's timeline. 0 is a ticket that is always complete
+};
+
+class SetupCommands {
+public:
+
+	// Flushes are submitted through the queue's timeline
+	void init(VkDevice device, QueueTimeline& timeline, uint32_t queueFamily);
+	void cleanup();
+
+	// Queue a barrier. Barriers recorded back to back are merged into a single
+	//	vkCmdPipelineBarrier with the union of the stages
+	void pipelineBarrier(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkMemoryBarrier& barrier);
+	void pipelineBarrier(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkBufferMemoryBarrier& barrier);
+	void pipelineBarrier(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkImageMemoryBarrier& barrier);
+
+	// Copies. The source has to stay alive until the flush's ticket is complete
+	void copyBuffer(VkBuffer src, VkBuffer dst, const VkBufferCopy& region);
+	void copyBufferToImage(VkBuffer src, VkImage dst, VkImageLayout dstLayout, const VkBufferImageCopy& region);
+
+	// The command buffer being recorded, for recording commands directly.
+	//	Any queued barriers are recorded first so the order is kept
+	VkCommandBuffer commandBuffer();
+
+	// Semaphore for the next flush to wait on, usually a value on another queue's timeline.
+	//	The flush always signals this queue's timeline, with the ticket's value
+	void waitSemaphore(const SemaphoreWait& wait);
+
+	// Submit everything recorded since the last flush. Does not wait
+	SetupTicket flush();
+
+	// Check on or wait for a flush to finish on the GPU
+	bool isComplete(SetupTicket ticket);
+	void wait(SetupTicket ticket);
+
+	// Nothing has been recorded since the last flush
+	bool empty() const { return current_.commandBuffer == VK_NULL_HANDLE && !hasPendingBarriers(); }
+
+private:
+
+	// A command buffer and the timeline value that tells us when it is done with
+	struct Submission {
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		uint64_t value = 0;
+	};
+
+	bool hasPendingBarriers() const { return !memoryBarriers_.empty() || !bufferBarriers_.empty() || !imageBarriers_.empty(); }
+	void recordPendingBarriers();
+	void retireCompleted();
+
+	VkDevice device_ = VK_NULL_HANDLE;  //!< Logical device the commands are recorded for
+	QueueTimeline* timeline_ = nullptr; //!< Timeline of the queue that flushes submit to
+	VkCommandPool pool_ = VK_NULL_HANDLE; //!< Pool for the setup command buffers
+
+	Submission current_{};                 //!< Submission being recorded
+	std::vector<Submission> inFlight_;     //!< Flushed, oldest first
+	std::vector<Submission> free_;         //!< Finished submissions that can be recorded again
+
+	uint64_t lastFlush_ = 0; //!< Ticket value of the last flush
+
+	// Barriers waiting to be merged into one vkCmdPipelineBarrier
+	VkPipelineStageFlags srcStages_ = 0;
+	VkPipelineStageFlags dstStages_ = 0;
+	std::vector<VkMemoryBarrier> memoryBarriers_;
+	std::vector<VkBufferMemoryBarrier> bufferBarriers_;
+	std::vector<VkImageMemoryBarrier> imageBarriers_;
+
+	std::vector<SemaphoreWait> waits_; //!< Semaphores the next flush waits on
+};
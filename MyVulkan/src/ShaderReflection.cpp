@@ -0,0 +1,436 @@
+/**************************************************************************//**
+*	@file   ShaderReflection.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the SPIR-V reflection. Only the instructions that
+*		say what resources a shader uses are read, everything else is skipped
+******************************************************************************/
+
+#include "ShaderReflection.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+
+namespace {
+
+	const uint32_t SPIRV_MAGIC = 0x07230203;
+	const size_t SPIRV_HEADER_WORDS = 5;
+
+	// The opcodes, decorations and enums from the SPIR-V spec that are read
+	enum Op : uint32_t {
+		OpEntryPoint = 15,
+		OpTypeInt = 21,
+		OpTypeFloat = 22,
+		OpTypeVector = 23,
+		OpTypeMatrix = 24,
+		OpTypeImage = 25,
+		OpTypeSampler = 26,
+		OpTypeSampledImage = 27,
+		OpTypeArray = 28,
+		OpTypeRuntimeArray = 29,
+		OpTypeStruct = 30,
+		OpTypePointer = 32,
+		OpConstant = 43,
+		OpSpecConstant = 50,
+		OpVariable = 59,
+		OpDecorate = 71,
+		OpMemberDecorate = 72
+	};
+
+	enum Decoration : uint32_t {
+		DecorationBlock = 2,
+		DecorationBufferBlock = 3,
+		DecorationMatrixStride = 7,
+		DecorationBuiltIn = 11,
+		DecorationArrayStride = 6,
+		DecorationLocation = 30,
+		DecorationBinding = 33,
+		DecorationDescriptorSet = 34,
+		DecorationOffset = 35
+	};
+
+	enum StorageClass : uint32_t {
+		StorageUniformConstant = 0,
+		StorageInput = 1,
+		StorageUniform = 2,
+		StoragePushConstant = 9,
+		StorageStorageBuffer = 12
+	};
+
+	const uint32_t DIM_BUFFER = 5;
+	const uint32_t DIM_SUBPASS_DATA = 6;
+	const uint32_t NOT_SET = UINT32_MAX;
+
+	struct Type {
+		uint32_t op = 0;
+		std::vector<uint32_t> operands; //!< Everything after the result id
+	};
+
+	struct Decorations {
+		uint32_t set = NOT_SET;
+		uint32_t binding = NOT_SET;
+		uint32_t location = NOT_SET;
+		uint32_t arrayStride = 0;
+		bool builtIn = false;
+		bool block = false;
+		bool bufferBlock = false;
+	};
+
+	struct MemberDecorations {
+		uint32_t offset = 0;
+		uint32_t matrixStride = 16;
+	};
+
+	struct Variable {
+		uint32_t id;
+		uint32_t pointerType;
+		uint32_t storageClass;
+	};
+
+	struct Module {
+		std::unordered_map<uint32_t, Type> types;
+		std::unordered_map<uint32_t, uint32_t> constants;
+		std::unordered_map<uint32_t, Decorations> decorations;
+		std::unordered_map<uint64_t, MemberDecorations> members; //!< By struct id << 32 | member
+		std::vector<Variable> variables;
+		uint32_t executionModel = NOT_SET;
+
+		const Type& type(uint32_t id) const {
+			auto found = types.find(id);
+			if (found == types.end()) {
+				throw std::runtime_error("SPIR-V uses a type that was never declared!");
+			}
+			return found->second;
+		}
+
+		Decorations decoration(uint32_t id) const {
+			auto found = decorations.find(id);
+			return found != decorations.end() ? found->second : Decorations{};
+		}
+
+		MemberDecorations member(uint32_t structId, uint32_t index) const {
+			auto found = members.find((static_cast<uint64_t>(structId) << 32) | index);
+			return found != members.end() ? found->second : MemberDecorations{};
+		}
+
+		// Size in bytes of a type in a block, laid out by its Offset and stride decorations
+		uint32_t size(uint32_t id, uint32_t matrixStride = 16) const {
+			const Type& t = type(id);
+			switch (t.op) {
+			case OpTypeInt:
+			case OpTypeFloat:
+				return t.operands[0] / 8;
+			case OpTypeVector:
+				return t.operands[1] * size(t.operands[0]);
+			case OpTypeMatrix:
+				return t.operands[1] * matrixStride;
+			case OpTypeArray:
+				return constants.at(t.operands[1]) * decoration(id).arrayStride;
+			case OpTypeStruct: {
+				uint32_t end = 0;
+				for (uint32_t i = 0; i < t.operands.size(); ++i) {
+					MemberDecorations m = member(id, i);
+					end = std::max(end, m.offset + size(t.operands[i], m.matrixStride));
+				}
+				return end;
+			}
+			default:
+				return 0;
+			}
+		}
+	};
+
+	Module parse(const uint32_t* code, size_t wordCount) {
+		if (wordCount < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+			throw std::runtime_error("Shader isn't SPIR-V!");
+		}
+
+		Module module;
+		size_t position = SPIRV_HEADER_WORDS;
+		while (position < wordCount) {
+			uint32_t words = code[position] >> 16;
+			uint32_t opcode = code[position] & 0xFFFF;
+			if (words == 0 || position + words > wordCount) {
+				throw std::runtime_error("SPIR-V instruction runs past the end of the shader!");
+			}
+			const uint32_t* operands = code + position + 1;
+			uint32_t operandCount = words - 1;
+
+			switch (opcode) {
+			case OpEntryPoint:
+				// Only the first entry point, every shader here has just main
+				if (module.executionModel == NOT_SET)
+					module.executionModel = operands[0];
+				break;
+			case OpTypeInt:
+			case OpTypeFloat:
+			case OpTypeVector:
+			case OpTypeMatrix:
+			case OpTypeImage:
+			case OpTypeSampler:
+			case OpTypeSampledImage:
+			case OpTypeArray:
+			case OpTypeRuntimeArray:
+			case OpTypeStruct:
+			case OpTypePointer: {
+				Type& type = module.types[operands[0]];
+				type.op = opcode;
+				type.operands.assign(operands + 1, operands + operandCount);
+				break;
+			}
+			case OpConstant:
+			case OpSpecConstant:
+				// Array lengths are 32 bit, which is the only kind needed. Spec constants use their default
+				if (operandCount >= 3)
+					module.constants[operands[1]] = operands[2];
+				break;
+			case OpVariable:
+				module.variables.push_back({ operands[1], operands[0], operands[2] });
+				break;
+			case OpDecorate: {
+				Decorations& decoration = module.decorations[operands[0]];
+				switch (operands[1]) {
+				case DecorationDescriptorSet: decoration.set = operands[2]; break;
+				case DecorationBinding: decoration.binding = operands[2]; break;
+				case DecorationLocation: decoration.location = operands[2]; break;
+				case DecorationArrayStride: decoration.arrayStride = operands[2]; break;
+				case DecorationBuiltIn: decoration.builtIn = true; break;
+				case DecorationBlock: decoration.block = true; break;
+				case DecorationBufferBlock: decoration.bufferBlock = true; break;
+				}
+				break;
+			}
+			case OpMemberDecorate: {
+				MemberDecorations& member = module.members[(static_cast<uint64_t>(operands[0]) << 32) | operands[1]];
+				if (operands[2] == DecorationOffset)
+					member.offset = operands[3];
+				else if (operands[2] == DecorationMatrixStride)
+					member.matrixStride = operands[3];
+				break;
+			}
+			}
+
+			position += words;
+		}
+
+		return module;
+	}
+
+	VkShaderStageFlagBits stageOf(uint32_t executionModel) {
+		switch (executionModel) {
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		default:
+			throw std::runtime_error("Shader has an execution model that can't be reflected!");
+		}
+	}
+
+	// What a resource variable is bound as, from the type it points to
+	VkDescriptorType descriptorType(const Module& module, uint32_t typeId, uint32_t storageClass) {
+		const Type& type = module.type(typeId);
+		if (storageClass == StorageStorageBuffer)
+			return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		if (storageClass == StorageUniform)
+			return module.decoration(typeId).bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+		switch (type.op) {
+		case OpTypeSampler:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case OpTypeSampledImage:
+			return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case OpTypeImage: {
+			// Operands: sampled type, dim, depth, arrayed, multisampled, sampled (1 sampled, 2 storage)
+			uint32_t dim = type.operands[1];
+			bool storage = type.operands[5] == 2;
+			if (dim == DIM_SUBPASS_DATA)
+				return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			if (dim == DIM_BUFFER)
+				return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		default:
+			throw std::runtime_error("Shader has a resource type that can't be reflected!");
+		}
+	}
+
+	// 32 bit format with as many components as a scalar or vector input
+	VkFormat inputFormat(const Module& module, uint32_t typeId) {
+		const Type& type = module.type(typeId);
+		uint32_t components = 1;
+		const Type* scalar = &type;
+		if (type.op == OpTypeVector) {
+			components = type.operands[1];
+			scalar = &module.type(type.operands[0]);
+		}
+
+		static const VkFormat floats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+		static const VkFormat ints[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+		static const VkFormat uints[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+		if (components < 1 || components > 4 || scalar->operands[0] != 32)
+			return VK_FORMAT_UNDEFINED;
+
+		if (scalar->op == OpTypeFloat)
+			return floats[components - 1];
+		return scalar->operands[1] ? ints[components - 1] : uints[components - 1];
+	}
+
+	VkDescriptorType baseType(VkDescriptorType type) {
+		if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)
+			return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
+			return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		return type;
+	}
+}
+
+ShaderReflection reflectShader(const uint32_t* code, size_t wordCount) {
+	Module module = parse(code, wordCount);
+
+	ShaderReflection reflection;
+	reflection.stage = stageOf(module.executionModel);
+
+	for (const Variable& variable : module.variables) {
+		const Type& pointer = module.type(variable.pointerType);
+		uint32_t typeId = pointer.operands[1];
+		Decorations decoration = module.decoration(variable.id);
+
+		switch (variable.storageClass) {
+		case StorageUniformConstant:
+		case StorageUniform:
+		case StorageStorageBuffer: {
+			if (decoration.binding == NOT_SET)
+				break;
+
+			// Arrays of resources are one binding with a count
+			uint32_t count = 1;
+			const Type& type = module.type(typeId);
+			if (type.op == OpTypeArray) {
+				count = module.constants.at(type.operands[1]);
+				typeId = type.operands[0];
+			}
+			else if (type.op == OpTypeRuntimeArray) {
+				count = 0;
+				typeId = type.operands[0];
+			}
+
+			uint32_t set = decoration.set != NOT_SET ? decoration.set : 0;
+			reflection.bindings.push_back({ set, decoration.binding, descriptorType(module, typeId, variable.storageClass), count });
+			break;
+		}
+		case StoragePushConstant:
+			reflection.pushConstantSize = std::max(reflection.pushConstantSize, module.size(typeId));
+			break;
+		case StorageInput: {
+			if (reflection.stage != VK_SHADER_STAGE_VERTEX_BIT || decoration.builtIn || decoration.location == NOT_SET)
+				break;
+
+			// A matrix is a column vector per location
+			const Type& type = module.type(typeId);
+			if (type.op == OpTypeMatrix) {
+				VkFormat column = inputFormat(module, type.operands[0]);
+				for (uint32_t i = 0; i < type.operands[1]; ++i)
+					reflection.inputs.push_back({ decoration.location + i, column });
+			}
+			else {
+				reflection.inputs.push_back({ decoration.location, inputFormat(module, typeId) });
+			}
+			break;
+		}
+		}
+	}
+
+	std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const ShaderBinding& a, const ShaderBinding& b) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+	std::sort(reflection.inputs.begin(), reflection.inputs.end(),
+		[](const ShaderInput& a, const ShaderInput& b) { return a.location < b.location; });
+	return reflection;
+}
+
+ShaderReflection reflectShaderFile(const std::string& path) {
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open shader file " + path + "!");
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize % sizeof(uint32_t) != 0) {
+		throw std::runtime_error("Shader file " + path + " isn't whole SPIR-V words!");
+	}
+
+	std::vector<uint32_t> code(fileSize / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(code.data()), fileSize);
+	return reflectShader(code.data(), code.size());
+}
+
+std::vector<VkDescriptorSetLayoutBinding> reflectSetLayout(const std::vector<ShaderReflection>& shaders, uint32_t set, bool dynamicBuffers) {
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	for (const ShaderReflection& shader : shaders) {
+		for (const ShaderBinding& binding : shader.bindings) {
+			if (binding.set != set)
+				continue;
+
+			VkDescriptorType type = binding.type;
+			if (dynamicBuffers && type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+				type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			else if (dynamicBuffers && type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+				type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+			// Stages sharing a binding have to agree on what it is
+			auto found = std::find_if(bindings.begin(), bindings.end(),
+				[&binding](const VkDescriptorSetLayoutBinding& b) { return b.binding == binding.binding; });
+			if (found != bindings.end()) {
+				if (found->descriptorType != type || found->descriptorCount != binding.count) {
+					throw std::runtime_error("Shader stages declare set " + std::to_string(set) + " binding " +
+						std::to_string(binding.binding) + " differently!");
+				}
+				found->stageFlags |= shader.stage;
+				continue;
+			}
+
+			// Runtime sized arrays need a count and partially bound flags from whoever makes the layout
+			if (binding.count == 0) {
+				throw std::runtime_error("Runtime sized descriptor arrays can't be made into a layout by reflection!");
+			}
+
+			VkDescriptorSetLayoutBinding layoutBinding{};
+			layoutBinding.binding = binding.binding;
+			layoutBinding.descriptorType = type;
+			layoutBinding.descriptorCount = binding.count;
+			layoutBinding.stageFlags = shader.stage;
+			layoutBinding.pImmutableSamplers = nullptr;
+			bindings.push_back(layoutBinding);
+		}
+	}
+
+	std::sort(bindings.begin(), bindings.end(),
+		[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+	return bindings;
+}
+
+bool matchesSetLayout(const ShaderReflection& shader, uint32_t set, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+	for (const ShaderBinding& binding : shader.bindings) {
+		if (binding.set != set)
+			continue;
+
+		auto found = std::find_if(bindings.begin(), bindings.end(),
+			[&binding](const VkDescriptorSetLayoutBinding& b) { return b.binding == binding.binding; });
+		if (found == bindings.end() || baseType(found->descriptorType) != binding.type ||
+			(found->stageFlags & shader.stage) == 0) {
+			return false;
+		}
+
+		// Runtime sized arrays take whatever the layout has
+		if (binding.count != 0 && binding.count > found->descriptorCount)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,53 @@
+/**************************************************************************//**
+*	@file   ShaderReflection.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Reads what a SPIR-V shader declares straight out of its binary: the
+*		descriptor bindings of every set, the vertex inputs and the push
+*		constant size. Descriptor set layouts are built from it instead of
+*		by hand, so they always match the shaders, and pipelines can check
+*		their vertex attributes against what the shader reads.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// A descriptor the shader reads or writes
+struct ShaderBinding {
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType type; //!< Never one of the DYNAMIC types, the shader can't tell
+	uint32_t count;        //!< Array size, 0 for runtime sized arrays
+};
+
+// A vertex shader input. Matrices take one location per column
+struct ShaderInput {
+	uint32_t location;
+	VkFormat format; //!< The 32 bit format of the shader's type, attributes may be smaller
+};
+
+struct ShaderReflection {
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+	std::vector<ShaderBinding> bindings;
+	std::vector<ShaderInput> inputs; //!< Only for vertex shaders, built-ins are left out
+	uint32_t pushConstantSize = 0;   //!< End of the last push constant member, 0 without any
+};
+
+// Throws if the code isn't valid SPIR-V
+ShaderReflection reflectShader(const uint32_t* code, size_t wordCount);
+ShaderReflection reflectShaderFile(const std::string& path);
+
+// Layout bindings of one set, merged over every stage that uses them. With dynamicBuffers,
+//	uniform and storage buffers are made DYNAMIC, for sets bound with dynamic offsets
+std::vector<VkDescriptorSetLayoutBinding> reflectSetLayout(const std::vector<ShaderReflection>& shaders, uint32_t set, bool dynamicBuffers);
+
+// Whether the shader's bindings in set can be used with a layout made of bindings.
+//	A DYNAMIC binding in the layout matches the plain type in the shader
+bool matchesSetLayout(const ShaderReflection& shader, uint32_t set, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
@@ -0,0 +1,73 @@
+/**************************************************************************//**
+*	@file   ShaderWatcher.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the shader file watcher
+******************************************************************************/
+
+#include "ShaderWatcher.h"
+
+#include <algorithm>
+#include <system_error>
+
+namespace {
+
+	// How often the files are checked. A change is reported one poll after it is seen
+	const auto POLL_INTERVAL = std::chrono::milliseconds(250);
+}
+
+void ShaderWatcher::watch(const std::string& path) {
+	auto found = std::find_if(files_.begin(), files_.end(), [&](const WatchedFile& file) { return file.path == path; });
+	if (found != files_.end())
+		return;
+
+	WatchedFile file;
+	file.path = path;
+	file.lastWrite = writeTime(path);
+	file.pending = file.lastWrite;
+	files_.push_back(file);
+}
+
+std::vector<std::string> ShaderWatcher::poll() {
+	std::vector<std::string> changed;
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastPoll_ < POLL_INTERVAL)
+		return changed;
+	lastPoll_ = now;
+
+	for (WatchedFile& file : files_) {
+		auto time = writeTime(file.path);
+
+		// Missing while the compiler replaces it, try again next poll
+		if (time == std::filesystem::file_time_type{})
+			continue;
+
+		if (time == file.lastWrite) {
+			file.changed = false;
+			continue;
+		}
+
+		// Report it once the time is the same two polls in a row, so the file is
+		//	done being written
+		if (file.changed && time == file.pending) {
+			file.lastWrite = time;
+			file.changed = false;
+			changed.push_back(file.path);
+		}
+		else {
+			file.pending = time;
+			file.changed = true;
+		}
+	}
+
+	return changed;
+}
+
+std::filesystem::file_time_type ShaderWatcher::writeTime(const std::string& path) {
+	// The error_code overload, since the file can vanish between polls
+	std::error_code error;
+	auto time = std::filesystem::last_write_time(path, error);
+	return error ? std::filesystem::file_time_type{} : time;
+}
@@ -0,0 +1,43 @@
+/**************************************************************************//**
+*	@file   ShaderWatcher.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Watches compiled shader files for changes, so the pipelines made from
+*		them can be rebuilt without restarting. Files are polled by their
+*		last write time, and a change is only reported once the file has
+*		stopped changing, so a shader still being written isn't picked up.
+******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <filesystem>
+
+class ShaderWatcher {
+public:
+
+	// Start watching a file. Watching the same file twice does nothing
+	void watch(const std::string& path);
+
+	// The files that changed since the last call. Only checks the disk every POLL_INTERVAL,
+	//	so this is cheap enough to call every frame
+	std::vector<std::string> poll();
+
+private:
+
+	struct WatchedFile {
+		std::string path;
+		std::filesystem::file_time_type lastWrite; //!< Write time the pipelines were built from
+		std::filesystem::file_time_type pending;   //!< Newer write time seen last poll
+		bool changed = false;                      //!< pending is waiting to settle
+	};
+
+	// Write time of the file, or the epoch if it can't be read right now
+	static std::filesystem::file_time_type writeTime(const std::string& path);
+
+	std::vector<WatchedFile> files_;
+	std::chrono::steady_clock::time_point lastPoll_{}; //!< When the disk was last checked
+};
@@ -0,0 +1,316 @@
+/**************************************************************************//**
+*	@file   StagingRing.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the persistently mapped staging ring buffer
+******************************************************************************/
+
+#include "StagingRing.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace {
+
+	// Uploaded buffers can be read as draw commands, vertices, indices or uniforms
+	const VkAccessFlags BUFFER_READ_ACCESS = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+}
+
+void StagingRing::init(VkBuffer buffer, void* mapped, VkDeviceSize capacity) {
+	buffer_ = buffer;
+	mapped_ = static_cast<char*>(mapped);
+	capacity_ = capacity;
+
+	head_ = 0;
+	tail_ = 0;
+	recordedHead_ = 0;
+	retired_.clear();
+}
+
+void StagingRing::setQueueFamilies(uint32_t srcFamily, uint32_t dstFamily) {
+	srcFamily_ = srcFamily;
+	dstFamily_ = dstFamily;
+}
+
+bool StagingRing::tryAllocate(VkDeviceSize size, VkDeviceSize alignment, StagingRegion& region) {
+	if (size > capacity_) {
+		throw std::runtime_error("Upload is larger than the staging ring!");
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// Align the head (alignments are powers of two)
+	uint64_t start = (head_ + alignment - 1) & ~(alignment - 1);
+
+	// A region can't wrap around the end of the buffer, so skip to the start if it doesn't fit
+	uint64_t physical = start % capacity_;
+	if (physical + size > capacity_) {
+		start += capacity_ - physical;
+		physical = 0;
+	}
+
+	// Don't run over data the GPU hasn't read yet
+	if (start + size - tail_ > capacity_)
+		return false;
+
+	head_ = start + size;
+	reserved_.insert(start);
+
+	region.buffer = buffer_;
+	region.offset = physical;
+	region.size = size;
+	region.mapped = mapped_ + physical;
+	region.ringOffset = start;
+	return true;
+}
+
+void StagingRing::commit(const StagingRegion& region) {
+	// Only the first copy out of a region has anything to remove
+	auto it = reserved_.find(region.ringOffset);
+	if (it != reserved_.end())
+		reserved_.erase(it);
+}
+
+uint64_t StagingRing::recordableHead() const {
+	// A region that is still being written can't be counted as recorded,
+	//	even if regions after it already have been
+	return reserved_.empty() ? head_ : std::min(head_, *reserved_.begin());
+}
+
+void StagingRing::cancel(const StagingRegion& region) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	commit(region);
+}
+
+bool StagingRing::hasPendingCopies() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return !bufferCopies_.empty() || !imageCopies_.empty();
+}
+
+void StagingRing::copyToBuffer(const StagingRegion& region, VkBuffer dst, VkDeviceSize dstOffset) {
+	VkBufferCopy copy{};
+	copy.srcOffset = region.offset;
+	copy.dstOffset = dstOffset;
+	copy.size = region.size;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	commit(region);
+	bufferCopies_.push_back({ dst, copy });
+}
+
+void StagingRing::copyToImage(const StagingRegion& region, VkImage dst, const std::vector<VkBufferImageCopy>& levels, uint32_t mipLevels) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	commit(region);
+
+	for (VkBufferImageCopy copy : levels) {
+		copy.bufferOffset += region.offset;
+		imageCopies_.push_back({ dst, copy, mipLevels });
+	}
+}
+
+//*****************************************************************************
+//	Record Pending Copies
+//		One barrier moves every image into TRANSFER_DST, then every copy is
+//		recorded (one vkCmdCopy per destination), then one barrier makes all
+//		of the results visible to the stages that read them.
+//		If the copies run on a different queue family than the one that uses
+//		the resources, the last barrier instead releases them to that family.
+//*****************************************************************************
+void StagingRing::recordPendingCopies(VkCommandBuffer commandBuffer) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (bufferCopies_.empty() && imageCopies_.empty())
+		return;
+
+	// Group the copies by destination so each destination only needs one command
+	std::stable_sort(bufferCopies_.begin(), bufferCopies_.end(),
+		[](const PendingBufferCopy& a, const PendingBufferCopy& b) { return a.dst < b.dst; });
+	std::stable_sort(imageCopies_.begin(), imageCopies_.end(),
+		[](const PendingImageCopy& a, const PendingImageCopy& b) { return a.dst < b.dst; });
+
+	// Every image we are uploading to needs an image barrier, covering all of its mip levels
+	std::vector<const PendingImageCopy*> images;
+	for (const auto& copy : imageCopies_) {
+		if (images.empty() || images.back()->dst != copy.dst)
+			images.push_back(&copy);
+	}
+
+	std::vector<VkImageMemoryBarrier> imageBarriers(images.size());
+	for (size_t i = 0; i < images.size(); ++i) {
+		VkImageMemoryBarrier& barrier = imageBarriers[i];
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = images[i]->dst;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = images[i]->mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		// Going from undefined to a transfer write
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+
+	if (!imageBarriers.empty()) {
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	// Buffer copies, one command per destination buffer
+	std::vector<VkBufferCopy> bufferRegions;
+	for (size_t i = 0; i < bufferCopies_.size(); ++i) {
+		bufferRegions.push_back(bufferCopies_[i].region);
+		if (i + 1 == bufferCopies_.size() || bufferCopies_[i + 1].dst != bufferCopies_[i].dst) {
+			vkCmdCopyBuffer(commandBuffer, buffer_, bufferCopies_[i].dst, static_cast<uint32_t>(bufferRegions.size()), bufferRegions.data());
+			bufferRegions.clear();
+		}
+	}
+
+	// Image copies, one command per destination image
+	std::vector<VkBufferImageCopy> imageRegions;
+	for (size_t i = 0; i < imageCopies_.size(); ++i) {
+		imageRegions.push_back(imageCopies_[i].region);
+		if (i + 1 == imageCopies_.size() || imageCopies_[i + 1].dst != imageCopies_[i].dst) {
+			vkCmdCopyBufferToImage(commandBuffer, buffer_, imageCopies_[i].dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(imageRegions.size()), imageRegions.data());
+			imageRegions.clear();
+		}
+	}
+
+	// Every image is going from a transfer write to a shader read
+	for (auto& barrier : imageBarriers) {
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+
+	if (srcFamily_ == dstFamily_) {
+		// Same queue family, so just make the copies visible. Buffers get a global memory barrier
+		VkPipelineStageFlags dstStages = 0;
+
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = BUFFER_READ_ACCESS;
+		if (!bufferCopies_.empty())
+			dstStages |= VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+				VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+
+		if (!imageBarriers.empty())
+			dstStages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0,
+			bufferCopies_.empty() ? 0 : 1, &memoryBarrier,
+			0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+	else {
+		// Different queue families. Ownership only moves with buffer and image barriers,
+		//	so every destination buffer gets its own barrier
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		for (size_t i = 0; i < bufferCopies_.size(); ++i) {
+			if (i > 0 && bufferCopies_[i - 1].dst == bufferCopies_[i].dst)
+				continue;
+
+			VkBufferMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.buffer = bufferCopies_[i].dst;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = BUFFER_READ_ACCESS;
+			bufferBarriers.push_back(barrier);
+		}
+
+		for (auto& barrier : bufferBarriers) {
+			barrier.srcQueueFamilyIndex = srcFamily_;
+			barrier.dstQueueFamilyIndex = dstFamily_;
+		}
+		for (auto& barrier : imageBarriers) {
+			barrier.srcQueueFamilyIndex = srcFamily_;
+			barrier.dstQueueFamilyIndex = dstFamily_;
+		}
+
+		// The acquire half is identical except for the access masks that don't apply to each side
+		for (auto barrier : bufferBarriers) {
+			barrier.srcAccessMask = 0;
+			acquireBufferBarriers_.push_back(barrier);
+		}
+		for (auto barrier : imageBarriers) {
+			barrier.srcAccessMask = 0;
+			acquireImageBarriers_.push_back(barrier);
+		}
+
+		// Release. The destination access is ignored here, the acquire barrier provides it
+		for (auto& barrier : bufferBarriers)
+			barrier.dstAccessMask = 0;
+		for (auto& barrier : imageBarriers)
+			barrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	bufferCopies_.clear();
+	imageCopies_.clear();
+
+	// Every region allocated so far is now owned by whatever submits this command buffer,
+	//	up to the first one that is still reserved
+	recordedHead_ = recordableHead();
+}
+
+void StagingRing::recordAcquireBarriers(VkCommandBuffer commandBuffer) {
+	if (!hasPendingAcquires())
+		return;
+
+	// The semaphore the copies signaled is waited on at READ_STAGES, so the barrier starts there.
+	//	The image layout transitions are repeated exactly as they were released
+	vkCmdPipelineBarrier(commandBuffer,
+		READ_STAGES, READ_STAGES, 0,
+		0, nullptr,
+		static_cast<uint32_t>(acquireBufferBarriers_.size()), acquireBufferBarriers_.data(),
+		static_cast<uint32_t>(acquireImageBarriers_.size()), acquireImageBarriers_.data());
+
+	acquireBufferBarriers_.clear();
+	acquireImageBarriers_.clear();
+}
+
+void StagingRing::retire(uint64_t value) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// Everything recorded up to now belongs to this submission.
+	//	Regions allocated after the last recording will be read by a later one
+	// Nothing new has been recorded since the last submission, it already covers everything
+	if (recordedHead_ == (retired_.empty() ? tail_ : retired_.back().head))
+		return;
+
+	retired_.push_back({ value, recordedHead_ });
+}
+
+void StagingRing::release(uint64_t completedValue) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// Those submissions finished, so everything they copied out of the ring has been read
+	while (!retired_.empty() && retired_.front().value <= completedValue) {
+		tail_ = std::max(tail_, retired_.front().head);
+		retired_.pop_front();
+	}
+}
+
+uint64_t StagingRing::bytesRecorded() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return recordedHead_;
+}
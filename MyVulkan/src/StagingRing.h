@@ -0,0 +1,137 @@
+/**************************************************************************//**
+*	@file   StagingRing.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Persistently mapped staging ring buffer. Uploads write straight into
+*		the mapped memory and the copies out of it are batched together.
+*		Space is handed back once the submission that used it has finished,
+*		tracked by a value on the consuming queue's timeline.
+*		The copies can run on a separate transfer queue, in which case the
+*		ownership of the resources is handed over to the graphics queue.
+*		Allocating and queueing copies is thread safe, so worker threads can
+*		write their uploads straight into the ring.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <deque>
+#include <set>
+#include <mutex>
+
+// A piece of the staging ring that the CPU can write into
+struct StagingRegion {
+	VkBuffer buffer = VK_NULL_HANDLE; //!< The staging buffer (source of the copy)
+	VkDeviceSize offset = 0;          //!< Offset of the region in the staging buffer
+	VkDeviceSize size = 0;            //!< Size of the region
+	void* mapped = nullptr;           //!< Where the CPU writes the data
+	uint64_t ringOffset = 0;          //!< Position of the region in the ring (internal use)
+};
+
+class StagingRing {
+public:
+
+	// Stages that read the uploaded resources. A queue waiting on the uploads
+	//	should wait at these stages
+	static constexpr VkPipelineStageFlags READ_STAGES = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	// buffer must be a TRANSFER_SRC buffer that stays mapped at mapped for its whole lifetime
+	void init(VkBuffer buffer, void* mapped, VkDeviceSize capacity);
+
+	// Copies are recorded for srcFamily's queue and the resources are used on dstFamily's queue.
+	//	When the families differ, recordPendingCopies only records the release half of a queue family
+	//	ownership transfer, and recordAcquireBarriers records the acquire half on the other queue
+	void setQueueFamilies(uint32_t srcFamily, uint32_t dstFamily);
+
+	// Grab space in the ring. Returns false if the ring is full until a submission finishes.
+	//	The region is reserved until a copy out of it is queued (or it is cancelled),
+	//	so it can be written on another thread and copied later
+	bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, StagingRegion& region);
+
+	// Queue copies out of a region. Nothing is recorded until recordPendingCopies.
+	//	Image copies give a region per mip level, with buffer offsets relative to the staging region.
+	//	Every one of the image's mipLevels is transitioned, copied into or not
+	void copyToBuffer(const StagingRegion& region, VkBuffer dst, VkDeviceSize dstOffset);
+	void copyToImage(const StagingRegion& region, VkImage dst, const std::vector<VkBufferImageCopy>& levels, uint32_t mipLevels);
+
+	// Give up on a region that was allocated but will never be copied from
+	void cancel(const StagingRegion& region);
+
+	// Record every queued copy into a command buffer along with the barriers they need.
+	//	Buffers are made visible to indirect, vertex input and uniform reads,
+	//	images end up in SHADER_READ_ONLY_OPTIMAL for the fragment shader
+	void recordPendingCopies(VkCommandBuffer commandBuffer);
+	bool hasPendingCopies() const;
+
+	// Record the acquire barriers for everything released by recordPendingCopies.
+	//	Goes in a command buffer on the destination queue, submitted after the copies have finished
+	void recordAcquireBarriers(VkCommandBuffer commandBuffer);
+	bool hasPendingAcquires() const { return !acquireBufferBarriers_.empty() || !acquireImageBarriers_.empty(); }
+
+	// Everything recorded so far is read by the submission that signals value.
+	//	Values have to increase, and come from the same timeline every time
+	void retire(uint64_t value);
+
+	// The timeline reached completedValue, so hand back everything retired up to it
+	void release(uint64_t completedValue);
+
+	VkDeviceSize capacity() const { return capacity_; }
+
+	// Bytes of the ring that copies have been recorded out of since init, alignment padding
+	//	included. Over time, that's the upload throughput
+	uint64_t bytesRecorded() const;
+
+private:
+
+	// Nothing at or after this point can be handed back yet,
+	//	either it is reserved or its copy hasn't been recorded. Needs mutex_ held
+	uint64_t recordableHead() const;
+	void commit(const StagingRegion& region);
+
+	struct PendingBufferCopy {
+		VkBuffer dst;
+		VkBufferCopy region;
+	};
+
+	struct PendingImageCopy {
+		VkImage dst;
+		VkBufferImageCopy region;
+		uint32_t mipLevels; //!< Levels in the whole image
+	};
+
+	VkBuffer buffer_ = VK_NULL_HANDLE; //!< The staging buffer
+	char* mapped_ = nullptr;           //!< Start of the mapped staging buffer
+	VkDeviceSize capacity_ = 0;        //!< Size of the staging buffer
+
+	// Head and tail only ever increase. The physical offset is the value modulo capacity,
+	//	that way a full ring and an empty ring can't be confused
+	uint64_t head_ = 0; //!< Where the next allocation goes
+	uint64_t tail_ = 0; //!< Everything before this has been consumed by the GPU
+
+	uint64_t recordedHead_ = 0; //!< Head at the last time copies were recorded into a command buffer
+
+	// Recorded head at the time a submission was retired
+	struct Retired {
+		uint64_t value; //!< Timeline value of the submission
+		uint64_t head;  //!< Everything before this is read by it
+	};
+	std::deque<Retired> retired_; //!< Oldest first
+
+	std::multiset<uint64_t> reserved_; //!< Starts of regions that were allocated but have no copy queued yet
+
+	mutable std::mutex mutex_; //!< Guards the ring and the queued copies, workers allocate from the ring
+
+	std::vector<PendingBufferCopy> bufferCopies_; //!< Buffer copies waiting to be recorded
+	std::vector<PendingImageCopy> imageCopies_;   //!< Image copies waiting to be recorded
+
+	uint32_t srcFamily_ = VK_QUEUE_FAMILY_IGNORED; //!< Queue family the copies run on
+	uint32_t dstFamily_ = VK_QUEUE_FAMILY_IGNORED; //!< Queue family that uses the uploaded resources
+
+	std::vector<VkBufferMemoryBarrier> acquireBufferBarriers_; //!< Buffers released but not yet acquired
+	std::vector<VkImageMemoryBarrier> acquireImageBarriers_;   //!< Images released but not yet acquired
+};
@@ -0,0 +1,405 @@
+/**************************************************************************//**
+*	@file   TextureFile.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of the KTX2 and DDS texture containers
+******************************************************************************/
+
+#include "TextureFile.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+	// KTX2 files start with «KTX 20»\r\n\x1A\n
+	const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// Everything after the identifier up to the level index
+	struct Ktx2Header {
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+
+		// Then the supercompression global data's offset and length, two 64 bit values
+		//	this loader never needs. They'd be misaligned in a struct, so they're skipped
+	};
+	static_assert(sizeof(Ktx2Header) == 52, "The KTX2 header is read straight out of the file");
+
+	struct Ktx2Level {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	// Enough of the start of a file for the headers and the level index of any texture this loader reads
+	const uint64_t TEXTURE_HEADER_READ_SIZE = 4096;
+
+	// "DDS " when read as little endian bytes
+	const uint32_t DDS_MAGIC = 0x20534444;
+
+	struct DdsPixelFormat {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	struct DdsHeader {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DdsPixelFormat pixelFormat;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+	static_assert(sizeof(DdsHeader) == 124, "The DDS header is read straight out of the file");
+
+	// Follows the header when the four character code is "DX10"
+	struct DdsHeaderDx10 {
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDPF_RGB = 0x40;
+	const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+	const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+	constexpr uint32_t fourCC(char a, char b, char c, char d) {
+		return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 | static_cast<uint32_t>(c) << 16 | static_cast<uint32_t>(d) << 24;
+	}
+
+	// Block size in texels and bytes. Uncompressed formats are 1x1 blocks
+	bool blockInfo(VkFormat format, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes) {
+		blockWidth = 4;
+		blockHeight = 4;
+		switch (format) {
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			blockWidth = 1;
+			blockHeight = 1;
+			blockBytes = 4;
+			return true;
+
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK:
+			blockBytes = 8;
+			return true;
+
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC5_SNORM_BLOCK:
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+		case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+			blockBytes = 16;
+			return true;
+
+		// Every ASTC block is 16 bytes, only the footprint changes
+		case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:
+		case VK_FORMAT_ASTC_5x5_SRGB_BLOCK:
+			blockWidth = blockHeight = 5;
+			blockBytes = 16;
+			return true;
+		case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:
+		case VK_FORMAT_ASTC_6x6_SRGB_BLOCK:
+			blockWidth = blockHeight = 6;
+			blockBytes = 16;
+			return true;
+		case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:
+		case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:
+			blockWidth = blockHeight = 8;
+			blockBytes = 16;
+			return true;
+		case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:
+		case VK_FORMAT_ASTC_10x10_SRGB_BLOCK:
+			blockWidth = blockHeight = 10;
+			blockBytes = 16;
+			return true;
+		case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:
+		case VK_FORMAT_ASTC_12x12_SRGB_BLOCK:
+			blockWidth = blockHeight = 12;
+			blockBytes = 16;
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	// DXGI_FORMAT values of the formats DDS files usually hold
+	VkFormat formatFromDxgi(uint32_t dxgiFormat) {
+		switch (dxgiFormat) {
+		case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+		case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+		case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+		case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+		case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+		case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+		case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+		case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+		case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+		case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+		case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+		case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+		case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+		case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+		case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+		default: return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	// Older DDS files name the format with a four character code, or describe it with bit masks
+	VkFormat formatFromDdsPixelFormat(const DdsPixelFormat& pixelFormat) {
+		if (pixelFormat.flags & DDPF_FOURCC) {
+			switch (pixelFormat.fourCC) {
+			case fourCC('D', 'X', 'T', '1'): return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+			case fourCC('D', 'X', 'T', '3'): return VK_FORMAT_BC2_UNORM_BLOCK;
+			case fourCC('D', 'X', 'T', '5'): return VK_FORMAT_BC3_UNORM_BLOCK;
+			case fourCC('A', 'T', 'I', '1'):
+			case fourCC('B', 'C', '4', 'U'): return VK_FORMAT_BC4_UNORM_BLOCK;
+			case fourCC('A', 'T', 'I', '2'):
+			case fourCC('B', 'C', '5', 'U'): return VK_FORMAT_BC5_UNORM_BLOCK;
+			default: return VK_FORMAT_UNDEFINED;
+			}
+		}
+
+		if ((pixelFormat.flags & DDPF_RGB) && pixelFormat.rgbBitCount == 32 &&
+			pixelFormat.rBitMask == 0x000000FF && pixelFormat.gBitMask == 0x0000FF00 && pixelFormat.bBitMask == 0x00FF0000)
+			return VK_FORMAT_R8G8B8A8_UNORM;
+
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	// Pull a struct out of the file bytes, false if it runs past the end
+	template <typename T>
+	bool read(const unsigned char* bytes, uint64_t size, uint64_t offset, T& value) {
+		if (offset + sizeof(T) > size)
+			return false;
+
+		memcpy(&value, bytes + offset, sizeof(T));
+		return true;
+	}
+
+	void parseKtx2(const unsigned char* bytes, uint64_t size, TextureData& texture) {
+		Ktx2Header header;
+		if (!read(bytes, size, sizeof(KTX2_IDENTIFIER), header)) {
+			throw std::runtime_error("KTX2 file is too small");
+		}
+
+		// Supercompressed (Basis) files would need transcoding, which this loader doesn't do
+		if (header.supercompressionScheme != 0 || header.vkFormat == VK_FORMAT_UNDEFINED) {
+			throw std::runtime_error("Supercompressed KTX2 files aren't supported");
+		}
+		if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.pixelHeight == 0) {
+			throw std::runtime_error("Only 2D KTX2 textures with one layer are supported");
+		}
+
+		texture.format = static_cast<VkFormat>(header.vkFormat);
+		texture.width = header.pixelWidth;
+		texture.height = header.pixelHeight;
+
+		// A level count of 0 asks for the mips to be generated
+		uint32_t levelCount = std::max(header.levelCount, 1u);
+		texture.generateMips = header.levelCount == 0;
+		if (levelCount > fullMipLevelCount(texture.width, texture.height)) {
+			throw std::runtime_error("KTX2 file has more levels than its size allows");
+		}
+
+		uint64_t levelIndex = sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header) + 2 * sizeof(uint64_t);
+		for (uint32_t level = 0; level < levelCount; ++level) {
+			Ktx2Level entry;
+			if (!read(bytes, size, levelIndex + sizeof(Ktx2Level) * level, entry)) {
+				throw std::runtime_error("KTX2 level index runs past the end of the file");
+			}
+
+			TextureLevel mip;
+			mip.width = std::max(texture.width >> level, 1u);
+			mip.height = std::max(texture.height >> level, 1u);
+			mip.offset = entry.byteOffset;
+			mip.size = entry.byteLength;
+			texture.levels.push_back(mip);
+		}
+	}
+
+	void parseDds(const unsigned char* bytes, uint64_t size, TextureData& texture) {
+		DdsHeader header;
+		if (!read(bytes, size, sizeof(uint32_t), header) || header.size != sizeof(DdsHeader)) {
+			throw std::runtime_error("Bad DDS header");
+		}
+
+		uint64_t dataOffset = sizeof(uint32_t) + sizeof(DdsHeader);
+		if ((header.pixelFormat.flags & DDPF_FOURCC) && header.pixelFormat.fourCC == fourCC('D', 'X', '1', '0')) {
+			DdsHeaderDx10 dx10;
+			if (!read(bytes, size, dataOffset, dx10)) {
+				throw std::runtime_error("Bad DDS header");
+			}
+			if (dx10.resourceDimension != DDS_DIMENSION_TEXTURE2D || dx10.arraySize > 1) {
+				throw std::runtime_error("Only 2D DDS textures with one layer are supported");
+			}
+
+			texture.format = formatFromDxgi(dx10.dxgiFormat);
+			dataOffset += sizeof(DdsHeaderDx10);
+		}
+		else {
+			texture.format = formatFromDdsPixelFormat(header.pixelFormat);
+		}
+
+		if (header.caps2 & DDSCAPS2_CUBEMAP) {
+			throw std::runtime_error("Only 2D DDS textures with one layer are supported");
+		}
+
+		texture.width = header.width;
+		texture.height = header.height;
+
+		// Levels are packed back to back, so their sizes come from the format
+		uint32_t levelCount = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(header.mipMapCount, 1u) : 1;
+		if (levelCount > fullMipLevelCount(texture.width, texture.height)) {
+			throw std::runtime_error("DDS file has more levels than its size allows");
+		}
+		uint64_t offset = dataOffset;
+		for (uint32_t level = 0; level < levelCount; ++level) {
+			TextureLevel mip;
+			mip.width = std::max(texture.width >> level, 1u);
+			mip.height = std::max(texture.height >> level, 1u);
+			mip.offset = offset;
+			mip.size = textureLevelSize(texture.format, mip.width, mip.height);
+			texture.levels.push_back(mip);
+
+			offset += mip.size;
+		}
+	}
+
+	bool hasExtension(const std::string& path, const std::string& extension) {
+		if (path.size() < extension.size())
+			return false;
+
+		std::string end = path.substr(path.size() - extension.size());
+		std::transform(end.begin(), end.end(), end.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+		return end == extension;
+	}
+}
+
+bool isTextureContainer(const std::string& path) {
+	return hasExtension(path, ".ktx2") || hasExtension(path, ".dds");
+}
+
+uint64_t textureLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+	uint32_t blockWidth, blockHeight, blockBytes;
+	if (!blockInfo(format, blockWidth, blockHeight, blockBytes))
+		return 0;
+
+	// Partial blocks at the edges still take a whole block
+	uint64_t blocksWide = (width + blockWidth - 1) / blockWidth;
+	uint64_t blocksHigh = (height + blockHeight - 1) / blockHeight;
+	return blocksWide * blocksHigh * blockBytes;
+}
+
+uint32_t fullMipLevelCount(uint32_t width, uint32_t height) {
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+		++levels;
+	return levels;
+}
+
+//*****************************************************************************
+//	Loading
+//		The headers and level index are at the start of both containers, so
+//		only that much is read to find the levels. Loading the whole texture
+//		then reads the file in one go (this runs on a worker) and points the
+//		levels inside of it.
+//*****************************************************************************
+void loadTextureFileHeader(const std::string& path, TextureData& texture) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open texture: " + path);
+	}
+
+	uint64_t size = static_cast<uint64_t>(file.tellg());
+	std::vector<unsigned char> header(static_cast<size_t>(std::min(size, TEXTURE_HEADER_READ_SIZE)));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(header.data()), static_cast<std::streamsize>(header.size()));
+	if (!file) {
+		throw std::runtime_error("Failed to read texture: " + path);
+	}
+
+	texture = {};
+	uint32_t magic = 0;
+	if (header.size() >= sizeof(KTX2_IDENTIFIER) && memcmp(header.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0)
+		parseKtx2(header.data(), header.size(), texture);
+	else if (read(header.data(), header.size(), 0, magic) && magic == DDS_MAGIC)
+		parseDds(header.data(), header.size(), texture);
+	else
+		throw std::runtime_error("Not a KTX2 or DDS file: " + path);
+
+	// Check every level is the size its format says and actually in the file
+	if (textureLevelSize(texture.format, texture.width, texture.height) == 0) {
+		throw std::runtime_error("Texture format isn't supported: " + path);
+	}
+	for (TextureLevel& level : texture.levels) {
+		uint64_t expected = textureLevelSize(texture.format, level.width, level.height);
+		if (level.size < expected || level.offset > size || expected > size - level.offset) {
+			throw std::runtime_error("Texture levels run past the end of the file: " + path);
+		}
+
+		// Anything past the level's size is padding
+		level.size = expected;
+	}
+}
+
+void loadTextureFile(const std::string& path, TextureData& texture) {
+	loadTextureFileHeader(path, texture);
+
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	uint64_t size = static_cast<uint64_t>(file.tellg());
+	std::shared_ptr<unsigned char> bytes(new unsigned char[size], std::default_delete<unsigned char[]>());
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(bytes.get()), static_cast<std::streamsize>(size));
+	if (!file) {
+		throw std::runtime_error("Failed to read texture: " + path);
+	}
+
+	texture.bytes = bytes;
+}
@@ -0,0 +1,55 @@
+/**************************************************************************//**
+*	@file   TextureFile.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Texture containers. KTX2 and DDS files hold GPU compressed formats
+*		(BCn, ASTC) with their mip chains already built, so loading them is
+*		finding where each level is and copying it into the staging ring.
+*		Nothing gets decoded.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// One mip level, most detailed first
+struct TextureLevel {
+	uint64_t offset = 0; //!< Where the level starts in the texture's bytes
+	uint64_t size = 0;   //!< Bytes in the level
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+// A texture ready to be copied into an image, either read from a container or decoded
+struct TextureData {
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<TextureLevel> levels;   //!< At least one
+	std::shared_ptr<unsigned char> bytes; //!< Every level, at the offsets in levels
+	bool generateMips = false;          //!< Only level 0 is stored, the rest get blitted on the GPU
+};
+
+// The path is a container this loader reads (.ktx2 or .dds)
+bool isTextureContainer(const std::string& path);
+
+// Read a KTX2 or DDS file, throws if it isn't one this loader can read.
+//	Only 2D textures with one layer and no supercompression are supported
+void loadTextureFile(const std::string& path, TextureData& texture);
+
+// Only read the format and where each level is, bytes is left empty. The level
+//	offsets are offsets into the file, so levels can be read out one at a time later
+void loadTextureFileHeader(const std::string& path, TextureData& texture);
+
+// Bytes in a level of a format the loader knows, 0 for any other format
+uint64_t textureLevelSize(VkFormat format, uint32_t width, uint32_t height);
+
+// Levels in a full mip chain down to 1x1
+uint32_t fullMipLevelCount(uint32_t width, uint32_t height);
@@ -0,0 +1,474 @@
+/**************************************************************************//**
+*	@file   TextureStreamer.cpp
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Implementation of texture streaming under a memory budget
+******************************************************************************/
+
+#include "TextureStreamer.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+	// Alignment of each level in a staging region. Covers the texel blocks of every compressed format
+	const VkDeviceSize LEVEL_ALIGNMENT = 16;
+
+	// Only this much of what the heap has left is used, the driver and other apps need some too
+	const VkDeviceSize HEAP_BUDGET_PERCENT = 90;
+
+	VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Read one level out of a file, throws if the file is cut short
+	void readLevel(std::ifstream& file, const TextureLevel& level, char* dst, const std::string& path) {
+		file.seekg(static_cast<std::streamoff>(level.offset));
+		if (!file.read(dst, static_cast<std::streamsize>(level.size))) {
+			throw std::runtime_error("Failed to read texture level from " + path);
+		}
+	}
+}
+
+void TextureStreamer::init(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator, StagingRing& stagingRing,
+	JobSystem& jobs, QueueTimeline& timeline, bool memoryBudgetExtension) {
+	physicalDevice_ = physicalDevice;
+	device_ = device;
+	allocator_ = &allocator;
+	stagingRing_ = &stagingRing;
+	jobs_ = &jobs;
+	timeline_ = &timeline;
+	memoryBudgetExtension_ = memoryBudgetExtension;
+
+	// The images go in device local memory, so that's the heap the budget is for
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memProperties_);
+	for (uint32_t i = 0; i < memProperties_.memoryTypeCount; ++i) {
+		if (memProperties_.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+			heapIndex_ = memProperties_.memoryTypes[i].heapIndex;
+			break;
+		}
+	}
+}
+
+void TextureStreamer::cleanup() {
+	for (const RetiredImage& retired : retired_)
+		destroy(retired);
+	retired_.clear();
+
+	for (Texture& texture : textures_) {
+		if (texture.image != VK_NULL_HANDLE)
+			destroy({ 0, texture.image, texture.view, texture.memory });
+	}
+	textures_.clear();
+	changed_.clear();
+
+	residentBytes_ = 0;
+	reservedBytes_ = 0;
+}
+
+void TextureStreamer::setBudgets(VkDeviceSize memoryBudget, VkDeviceSize uploadBudget) {
+	memoryBudget_ = memoryBudget;
+	uploadBudget_ = uploadBudget;
+}
+
+//*****************************************************************************
+//	Add
+//		The header and the mip tail are small, so they are read in one go on
+//		a worker. The tail is kept in memory after it's uploaded, evicting a
+//		texture is then just uploading the tail again without touching disk.
+//*****************************************************************************
+uint32_t TextureStreamer::add(const std::string& path) {
+	uint32_t index = static_cast<uint32_t>(textures_.size());
+	textures_.emplace_back();
+	textures_[index].path = path;
+
+	jobs_->submit([this, index, path]() {
+		try {
+			auto info = std::make_shared<TextureData>();
+			loadTextureFileHeader(path, *info);
+
+			// Format queries don't go through the device, so they are fine from a worker
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice_, info->format, &formatProperties);
+			if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+				throw std::runtime_error("Texture format isn't supported by this device: " + path);
+			}
+
+			// The tail starts at the first level that fits in MIP_TAIL_SIZE.
+			//	A chain that stops short of it still keeps its last level resident
+			uint32_t levelCount = static_cast<uint32_t>(info->levels.size());
+			uint32_t tailLevel = levelCount - 1;
+			for (uint32_t level = 0; level < levelCount; ++level) {
+				if (std::max(info->levels[level].width, info->levels[level].height) <= MIP_TAIL_SIZE) {
+					tailLevel = level;
+					break;
+				}
+			}
+
+			// Pack the tail with each level on an aligned offset, the same way it gets staged
+			auto tailCopies = std::make_shared<std::vector<VkBufferImageCopy>>();
+			VkDeviceSize tailSize = 0;
+			for (uint32_t level = tailLevel; level < levelCount; ++level) {
+				const TextureLevel& mip = info->levels[level];
+				tailSize = alignUp(tailSize, LEVEL_ALIGNMENT);
+
+				VkBufferImageCopy copy{};
+				copy.bufferOffset = tailSize;
+				copy.bufferRowLength = 0;
+				copy.bufferImageHeight = 0;
+				copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				copy.imageSubresource.mipLevel = level - tailLevel;
+				copy.imageSubresource.baseArrayLayer = 0;
+				copy.imageSubresource.layerCount = 1;
+				copy.imageOffset = { 0, 0, 0 };
+				copy.imageExtent = { mip.width, mip.height, 1 };
+				tailCopies->push_back(copy);
+
+				tailSize += mip.size;
+			}
+
+			std::shared_ptr<unsigned char> tail(new unsigned char[static_cast<size_t>(tailSize)], std::default_delete<unsigned char[]>());
+			std::ifstream file(path, std::ios::binary);
+			for (uint32_t level = tailLevel; level < levelCount; ++level) {
+				readLevel(file, info->levels[level], reinterpret_cast<char*>(tail.get()) + (*tailCopies)[level - tailLevel].bufferOffset, path);
+			}
+
+			jobs_->postToDevice([this, index, info, tailLevel, tail, tailCopies, tailSize]() {
+				Texture& texture = textures_[index];
+				texture.info = *info;
+				texture.tailLevel = tailLevel;
+				texture.tail = tail;
+				texture.tailCopies = *tailCopies;
+				texture.tailSize = tailSize;
+				texture.loaded = true;
+			});
+		}
+		catch (const std::exception& e) {
+			// Report the error on the device thread, the same as if it was loaded there
+			std::string message = e.what();
+			jobs_->postToDevice([message]() { throw std::runtime_error(message); });
+		}
+	});
+
+	return index;
+}
+
+void TextureStreamer::request(uint32_t texture, uint32_t level) {
+	Texture& t = textures_[texture];
+	t.lastUsed = frame_;
+	t.wantedLevel = std::min(t.wantedLevel, level);
+}
+
+std::vector<uint32_t> TextureStreamer::takeChangedTextures() {
+	std::vector<uint32_t> changed;
+	changed.swap(changed_);
+	return changed;
+}
+
+//*****************************************************************************
+//	Update
+//		In order:
+//			Destroy the images no frame can be using anymore
+//			Upload the tail of anything that arrived
+//			Evict the least recently used textures down to their tail until
+//				the memory in use fits the budget
+//			Stream in more detail for the textures that asked for it, the
+//				most recently used first, as long as both budgets allow
+//*****************************************************************************
+void TextureStreamer::update() {
+	while (!retired_.empty() && timeline_->isComplete(retired_.front().value)) {
+		destroy(retired_.front());
+		retired_.pop_front();
+	}
+
+	for (uint32_t i = 0; i < textures_.size(); ++i) {
+		if (textures_[i].loaded && textures_[i].image == VK_NULL_HANDLE)
+			uploadTail(i);
+	}
+
+	// Textures asked for this frame are never evicted, that would only stream them straight back in
+	VkDeviceSize budget = currentBudget();
+	while (residentBytes_ + reservedBytes_ > budget) {
+		uint32_t victim = NOT_RESIDENT;
+		for (uint32_t i = 0; i < textures_.size(); ++i) {
+			const Texture& texture = textures_[i];
+			if (texture.streaming || texture.wantedLevel != NOT_RESIDENT || texture.residentLevel >= texture.tailLevel)
+				continue;
+			if (victim == NOT_RESIDENT || texture.lastUsed < textures_[victim].lastUsed)
+				victim = i;
+		}
+
+		// Nothing left to evict, or no staging space to put the tail back this frame
+		if (victim == NOT_RESIDENT || !uploadTail(victim))
+			break;
+	}
+
+	std::vector<uint32_t> candidates;
+	for (uint32_t i = 0; i < textures_.size(); ++i) {
+		const Texture& texture = textures_[i];
+		if (texture.residentLevel != NOT_RESIDENT && !texture.streaming && texture.wantedLevel < texture.residentLevel)
+			candidates.push_back(i);
+	}
+
+	// Most recently used first, then whichever is missing the most detail
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+		const Texture& ta = textures_[a];
+		const Texture& tb = textures_[b];
+		if (ta.lastUsed != tb.lastUsed)
+			return ta.lastUsed > tb.lastUsed;
+		return ta.residentLevel - ta.wantedLevel > tb.residentLevel - tb.wantedLevel;
+	});
+
+	VkDeviceSize uploaded = 0;
+	for (uint32_t index : candidates) {
+		const Texture& texture = textures_[index];
+
+		// The old image stays alive until the new one replaces it, so the whole new image has to fit
+		for (uint32_t level = texture.wantedLevel; level < texture.residentLevel; ++level) {
+			VkDeviceSize stagingSize = 0;
+			buildCopies(texture, level, stagingSize);
+
+			bool fitsMemory = residentBytes_ + reservedBytes_ + estimateSize(texture, level) <= budget;
+			bool fitsUpload = uploaded == 0 || uploaded + stagingSize <= uploadBudget_;
+			if (fitsMemory && fitsUpload && stagingSize <= stagingRing_->capacity()) {
+				startStream(index, level);
+				uploaded += stagingSize;
+				break;
+			}
+		}
+	}
+
+	for (Texture& texture : textures_)
+		texture.wantedLevel = NOT_RESIDENT;
+	++frame_;
+}
+
+std::vector<VkBufferImageCopy> TextureStreamer::buildCopies(const Texture& texture, uint32_t firstLevel, VkDeviceSize& stagingSize) const {
+	std::vector<VkBufferImageCopy> copies;
+	stagingSize = 0;
+
+	for (uint32_t level = firstLevel; level < texture.tailLevel; ++level) {
+		const TextureLevel& mip = texture.info.levels[level];
+		stagingSize = alignUp(stagingSize, LEVEL_ALIGNMENT);
+
+		VkBufferImageCopy copy{};
+		copy.bufferOffset = stagingSize;
+		copy.bufferRowLength = 0;
+		copy.bufferImageHeight = 0;
+		copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy.imageSubresource.mipLevel = level - firstLevel;
+		copy.imageSubresource.baseArrayLayer = 0;
+		copy.imageSubresource.layerCount = 1;
+		copy.imageOffset = { 0, 0, 0 };
+		copy.imageExtent = { mip.width, mip.height, 1 };
+		copies.push_back(copy);
+
+		stagingSize += mip.size;
+	}
+
+	// The tail goes after the detail levels as one packed piece
+	VkDeviceSize tailOffset = alignUp(stagingSize, LEVEL_ALIGNMENT);
+	for (VkBufferImageCopy copy : texture.tailCopies) {
+		copy.bufferOffset += tailOffset;
+		copy.imageSubresource.mipLevel += texture.tailLevel - firstLevel;
+		copies.push_back(copy);
+	}
+	stagingSize = tailOffset + texture.tailSize;
+
+	return copies;
+}
+
+VkDeviceSize TextureStreamer::estimateSize(const Texture& texture, uint32_t firstLevel) const {
+	VkDeviceSize size = 0;
+	for (uint32_t level = firstLevel; level < texture.info.levels.size(); ++level)
+		size += texture.info.levels[level].size;
+	return size;
+}
+
+VkDeviceSize TextureStreamer::currentBudget() const {
+	if (!memoryBudgetExtension_)
+		return memoryBudget_;
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT heapBudget{};
+	heapBudget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	properties.pNext = &heapBudget;
+	vkGetPhysicalDeviceMemoryProperties2(physicalDevice_, &properties);
+
+	// The heap's usage counts our images too, so take them back out to see what everything else uses
+	VkDeviceSize usage = heapBudget.heapUsage[heapIndex_];
+	VkDeviceSize others = usage > residentBytes_ ? usage - residentBytes_ : 0;
+	VkDeviceSize available = heapBudget.heapBudget[heapIndex_] > others ? heapBudget.heapBudget[heapIndex_] - others : 0;
+
+	return std::min(memoryBudget_, available / 100 * HEAP_BUDGET_PERCENT);
+}
+
+bool TextureStreamer::uploadTail(uint32_t texture) {
+	Texture& t = textures_[texture];
+
+	StagingRegion staging;
+	if (t.tailSize > stagingRing_->capacity() || !stagingRing_->tryAllocate(t.tailSize, LEVEL_ALIGNMENT, staging))
+		return false;
+
+	memcpy(staging.mapped, t.tail.get(), static_cast<size_t>(t.tailSize));
+	replaceImage(texture, t.tailLevel, staging, t.tailCopies);
+	return true;
+}
+
+//*****************************************************************************
+//	Start Stream
+//		The budget for the new image is held from now until it's created.
+//		The worker grabs the staging space itself and reads the levels
+//		straight into it. If the ring is full the stream is dropped and
+//		tried again on a later frame.
+//*****************************************************************************
+void TextureStreamer::startStream(uint32_t texture, uint32_t level) {
+	Texture& t = textures_[texture];
+	t.streaming = true;
+	t.reserved = estimateSize(t, level);
+	reservedBytes_ += t.reserved;
+
+	VkDeviceSize stagingSize = 0;
+	auto copies = std::make_shared<std::vector<VkBufferImageCopy>>(buildCopies(t, level, stagingSize));
+
+	std::string path = t.path;
+	std::vector<TextureLevel> levels(t.info.levels.begin() + level, t.info.levels.begin() + t.tailLevel);
+	std::shared_ptr<unsigned char> tail = t.tail;
+	VkDeviceSize tailSize = t.tailSize;
+
+	jobs_->submit([this, texture, level, copies, stagingSize, path, levels, tail, tailSize]() {
+		auto finish = [this, texture]() {
+			Texture& t = textures_[texture];
+			reservedBytes_ -= t.reserved;
+			t.reserved = 0;
+			t.streaming = false;
+		};
+
+		StagingRegion staging;
+		if (!stagingRing_->tryAllocate(stagingSize, LEVEL_ALIGNMENT, staging)) {
+			jobs_->postToDevice(finish);
+			return;
+		}
+
+		try {
+			char* mapped = static_cast<char*>(staging.mapped);
+			std::ifstream file(path, std::ios::binary);
+			for (size_t i = 0; i < levels.size(); ++i)
+				readLevel(file, levels[i], mapped + (*copies)[i].bufferOffset, path);
+
+			// The packed tail is the end of the region
+			memcpy(mapped + (stagingSize - tailSize), tail.get(), static_cast<size_t>(tailSize));
+		}
+		catch (const std::exception& e) {
+			stagingRing_->cancel(staging);
+			std::string message = e.what();
+			jobs_->postToDevice([finish, message]() {
+				finish();
+				throw std::runtime_error(message);
+			});
+			return;
+		}
+
+		jobs_->postToDevice([this, texture, level, staging, copies, finish]() {
+			finish();
+			replaceImage(texture, level, staging, *copies);
+		});
+	});
+}
+
+//*****************************************************************************
+//	Replace Image
+//		Creates the image for firstLevel onwards and queues its copies with
+//		the rest of the frame's uploads. The old image may still be sampled
+//		by frames already submitted, so it is retired at the last submitted
+//		value. Anything using the view has to switch over before the next
+//		frame is submitted.
+//*****************************************************************************
+void TextureStreamer::replaceImage(uint32_t texture, uint32_t firstLevel, const StagingRegion& staging, const std::vector<VkBufferImageCopy>& copies) {
+	Texture& t = textures_[texture];
+	const TextureLevel& base = t.info.levels[firstLevel];
+	uint32_t mipLevels = static_cast<uint32_t>(t.info.levels.size()) - firstLevel;
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = base.width;
+	imageInfo.extent.height = base.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = t.info.format;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkImage image;
+	if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create streamed texture image!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(device_, image, &memRequirements);
+
+	uint32_t memoryType = UINT32_MAX;
+	for (uint32_t i = 0; i < memProperties_.memoryTypeCount; ++i) {
+		if ((memRequirements.memoryTypeBits & (1 << i)) && (memProperties_.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			memoryType = i;
+			break;
+		}
+	}
+	if (memoryType == UINT32_MAX) {
+		throw std::runtime_error("Failed to find device local memory for a streamed texture!");
+	}
+
+	Allocation memory = allocator_->allocate(memRequirements, memoryType, ResourceKind::OptimalImage);
+	vkBindImageMemory(device_, image, memory.memory, memory.offset);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = t.info.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	VkImageView view;
+	if (vkCreateImageView(device_, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create streamed texture image view!");
+	}
+
+	// Every level goes from UNDEFINED to SHADER_READ_ONLY with the copies
+	stagingRing_->copyToImage(staging, image, copies, mipLevels);
+
+	if (t.image != VK_NULL_HANDLE) {
+		residentBytes_ -= t.memory.size;
+		retired_.push_back({ timeline_->submittedValue(), t.image, t.view, t.memory });
+	}
+
+	t.image = image;
+	t.view = view;
+	t.memory = memory;
+	t.residentLevel = firstLevel;
+	residentBytes_ += memory.size;
+
+	changed_.push_back(texture);
+}
+
+void TextureStreamer::destroy(const RetiredImage& retired) {
+	vkDestroyImageView(device_, retired.view, nullptr);
+	vkDestroyImage(device_, retired.image, nullptr);
+
+	Allocation memory = retired.memory;
+	allocator_->free(memory);
+}
@@ -0,0 +1,143 @@
+/**************************************************************************//**
+*	@file   TextureStreamer.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Texture streaming under a memory budget. The small levels at the end
+*		of every mip chain (the mip tail) are always resident, so a texture
+*		can be sampled as soon as it is added. Textures report how much
+*		detail they want each frame they are used, and the most detailed
+*		levels that fit are read from disk on a worker and uploaded through
+*		the staging ring, a few per frame. When the budget is exceeded, the
+*		textures used longest ago drop back down to their mip tail.
+*		Every change in residency builds a new image. The old one is
+*		destroyed once the frames that might sample it have finished.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "JobSystem.h"
+#include "QueueTimeline.h"
+#include "TextureFile.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+
+class TextureStreamer {
+public:
+
+	// Levels no bigger than this in either direction are the mip tail, and never leave
+	static constexpr uint32_t MIP_TAIL_SIZE = 64;
+
+	// Frames that may sample the images are submitted on timeline. memoryBudgetExtension
+	//	says VK_EXT_memory_budget is enabled, so the budget can follow the rest of the heap
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator, StagingRing& stagingRing,
+		JobSystem& jobs, QueueTimeline& timeline, bool memoryBudgetExtension);
+
+	// The device has to be idle and the workers stopped
+	void cleanup();
+
+	// Bytes of textures to keep resident at most, and bytes to start uploading each frame.
+	//	The first upload of a frame always goes, so a level bigger than the upload budget still streams
+	void setBudgets(VkDeviceSize memoryBudget, VkDeviceSize uploadBudget);
+
+	// Start streaming a KTX2 or DDS texture. The mip tail loads on a worker,
+	//	the image is null until it arrives
+	uint32_t add(const std::string& path);
+
+	// Usage feedback. The texture was used this frame and wants level to be resident.
+	//	Textures that stop asking are the first to be evicted
+	void request(uint32_t texture, uint32_t level = 0);
+
+	// Once a frame on the device thread, after the device callbacks have run and before
+	//	the frame is recorded. Frees old images, evicts, and starts streaming
+	void update();
+
+	VkImage image(uint32_t texture) const { return textures_[texture].image; }
+	VkImageView view(uint32_t texture) const { return textures_[texture].view; }
+
+	// Level of the full chain that the image's first level is
+	uint32_t residentLevel(uint32_t texture) const { return textures_[texture].residentLevel; }
+
+	// Textures whose image changed since the last call, so anything pointing at their views can be updated
+	std::vector<uint32_t> takeChangedTextures();
+
+	VkDeviceSize residentBytes() const { return residentBytes_; }
+
+private:
+
+	// residentLevel and wantedLevel when there is no image, or nothing was asked for
+	static constexpr uint32_t NOT_RESIDENT = UINT32_MAX;
+
+	struct Texture {
+		std::string path;
+		TextureData info;     //!< Format and where each level is in the file, no bytes
+		bool loaded = false;  //!< info and the tail have been read
+
+		uint32_t tailLevel = 0;                    //!< First level of the mip tail
+		std::shared_ptr<unsigned char> tail;       //!< Every tail level, packed the way they are staged
+		std::vector<VkBufferImageCopy> tailCopies; //!< Where each tail level is in tail
+		VkDeviceSize tailSize = 0;
+
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		Allocation memory;
+		uint32_t residentLevel = NOT_RESIDENT; //!< Most detailed level in the image
+
+		uint32_t wantedLevel = NOT_RESIDENT; //!< Most detailed level asked for since the last update
+		uint64_t lastUsed = 0;               //!< Frame it was last asked for
+		bool streaming = false;              //!< A worker is reading levels for it, nothing else starts until it's done
+		VkDeviceSize reserved = 0;           //!< Budget held for the stream in flight
+	};
+
+	// An image that frames submitted up to value may still sample
+	struct RetiredImage {
+		uint64_t value;
+		VkImage image;
+		VkImageView view;
+		Allocation memory;
+	};
+
+	// Copies for an image holding firstLevel onwards: the detail levels from the file first,
+	//	then the tail. stagingSize is the size of the staging region they need
+	std::vector<VkBufferImageCopy> buildCopies(const Texture& texture, uint32_t firstLevel, VkDeviceSize& stagingSize) const;
+	VkDeviceSize estimateSize(const Texture& texture, uint32_t firstLevel) const;
+
+	// The least of the budget that was set and what the heap has left for us
+	VkDeviceSize currentBudget() const;
+
+	bool uploadTail(uint32_t texture);
+	void startStream(uint32_t texture, uint32_t level);
+	void replaceImage(uint32_t texture, uint32_t firstLevel, const StagingRegion& staging, const std::vector<VkBufferImageCopy>& copies);
+	void destroy(const RetiredImage& retired);
+
+	VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+	VkDevice device_ = VK_NULL_HANDLE;
+	MemoryAllocator* allocator_ = nullptr;
+	StagingRing* stagingRing_ = nullptr;
+	JobSystem* jobs_ = nullptr;
+	QueueTimeline* timeline_ = nullptr;
+
+	VkPhysicalDeviceMemoryProperties memProperties_{}; //!< Memory types the images can go in
+	bool memoryBudgetExtension_ = false;               //!< VK_EXT_memory_budget is enabled
+	uint32_t heapIndex_ = 0;                           //!< Heap of the first device local memory type, the one budgeted
+
+	VkDeviceSize memoryBudget_ = 256ull * 1024 * 1024;
+	VkDeviceSize uploadBudget_ = 8ull * 1024 * 1024;
+
+	VkDeviceSize residentBytes_ = 0; //!< Memory of every image that isn't retired
+	VkDeviceSize reservedBytes_ = 0; //!< Budget held for streams in flight
+
+	uint64_t frame_ = 0; //!< Updates so far, the LRU clock
+
+	std::vector<Texture> textures_;
+	std::deque<RetiredImage> retired_; //!< Oldest first
+	std::vector<uint32_t> changed_;    //!< Textures whose image changed since takeChangedTextures
+};
@@ -0,0 +1,214 @@
+/**************************************************************************//**
+*	@file   VertexFormats.h
+*	@author Hunter Smith
+*	@date   11/05/2023
+*	@brief
+*		Vertex layouts picked at compile time. Each attribute type knows its
+*		own VkFormat and how to pack a full precision value into it, and
+*		VertexLayout puts a position, a color and (optionally) a normal
+*		together and builds the input descriptions from them. Smaller
+*		formats mean less memory and less bandwidth for every vertex fetched.
+******************************************************************************/
+
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Shader input locations. 2 through 6 are taken by the per-instance data
+const uint32_t VERTEX_POSITION_LOCATION = 0;
+const uint32_t VERTEX_COLOR_LOCATION = 1;
+const uint32_t VERTEX_NORMAL_LOCATION = 7;
+
+//*****************************************************************************
+//	Attributes
+//		ID goes into the mesh file's vertexFormat, so a file can only be
+//		loaded with the layout it was written with. The format decides what
+//		the shader sees: SFLOAT, UNORM and SNORM formats all come in as
+//		floats, so the shader doesn't change when only the precision does.
+//		Common formats are:
+//			float - VK_FORMAT_R32_SFLOAT
+//			vec2 - VK_FORMAT_R32G32_SFLOAT
+//			vec3 - VK_FORMAT_R32G32B32_SFLOAT
+//			vec4 - VK_FORMAT_R32G32B32A32_SFLOAT
+//		Make sure to also match the typings correctly:
+//			ivec2 - VK_FORMAT_R32G32_SINT
+//			uvec4 - VK_FORMAT_R32G32B32A32_UINT
+//			double - VK_FORMAT_R64_SFLOAT
+//*****************************************************************************
+
+// Full precision position, 8 bytes
+struct PositionFloat2 {
+	static constexpr VkFormat FORMAT = VK_FORMAT_R32G32_SFLOAT;
+	static constexpr uint32_t ID = 0;
+
+	glm::vec2 value;
+
+	void set(glm::vec2 position) { value = position; }
+};
+
+// Half float position, 4 bytes. Plenty for model space coordinates near the origin
+struct PositionHalf2 {
+	static constexpr VkFormat FORMAT = VK_FORMAT_R16G16_SFLOAT;
+	static constexpr uint32_t ID = 1;
+
+	uint32_t value;
+
+	void set(glm::vec2 position) { value = glm::packHalf2x16(position); }
+};
+
+// Full precision color, 12 bytes
+struct ColorFloat3 {
+	static constexpr VkFormat FORMAT = VK_FORMAT_R32G32B32_SFLOAT;
+	static constexpr uint32_t ID = 0;
+
+	glm::vec3 value;
+
+	void set(glm::vec3 color) { value = color; }
+};
+
+// 8 bits per channel color, 4 bytes. The GPU turns it back into 0 to 1 floats
+struct ColorUnorm8 {
+	static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+	static constexpr uint32_t ID = 1;
+
+	uint32_t value;
+
+	void set(glm::vec3 color) { value = glm::packUnorm4x8(glm::vec4(color, 1.0f)); }
+};
+
+// For layouts without normals. Has no data and no input
+struct NoNormal {
+	static constexpr uint32_t ID = 0;
+};
+
+// Octahedral normal, 4 bytes. The unit sphere is folded onto an octahedron and
+//	flattened to a square, so two snorm values cover every direction evenly.
+//	The vertex shader unfolds it again (see decodeOctahedral in BaseShader.vert)
+struct NormalOct16 {
+	static constexpr VkFormat FORMAT = VK_FORMAT_R16G16_SNORM;
+	static constexpr uint32_t ID = 1;
+
+	uint32_t value;
+
+	void set(glm::vec3 normal) {
+		// Project onto the octahedron |x| + |y| + |z| = 1. Degenerate faces and OBJ files
+		//	can give a zero normal, which has no direction, so it faces +z instead
+		float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (length < 1e-20f) {
+			value = glm::packSnorm2x16(glm::vec2(0.0f, 0.0f));
+			return;
+		}
+		float x = normal.x / length;
+		float y = normal.y / length;
+
+		// The lower half gets folded over the diagonals
+		if (normal.z < 0.0f) {
+			float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+
+		value = glm::packSnorm2x16(glm::vec2(x, y));
+	}
+};
+
+//*****************************************************************************
+//	Layouts
+//*****************************************************************************
+
+// The data of a vertex. Normals are left out entirely when there are none
+template<typename Position, typename Color, typename Normal>
+struct VertexAttributes {
+	Position position; //!< Position of this vertex
+	Color color;       //!< Color at this vertex
+	Normal normal;     //!< Direction the surface faces at this vertex
+
+	void setNormal(glm::vec3 value) { normal.set(value); }
+};
+
+template<typename Position, typename Color>
+struct VertexAttributes<Position, Color, NoNormal> {
+	Position position; //!< Position of this vertex
+	Color color;       //!< Color at this vertex
+
+	// Nowhere to put it, so it is dropped
+	void setNormal(glm::vec3) {}
+};
+
+template<typename Position, typename Color, typename Normal = NoNormal>
+struct VertexLayout : VertexAttributes<Position, Color, Normal> {
+	using Attributes = VertexAttributes<Position, Color, Normal>;
+
+	static constexpr bool HAS_NORMAL = Normal::ID != NoNormal::ID;
+	static constexpr uint32_t ATTRIBUTE_COUNT = HAS_NORMAL ? 3 : 2;
+
+	// Written into mesh files, different for every combination of attributes
+	static constexpr uint32_t FORMAT_ID = Position::ID | (Color::ID << 4) | (Normal::ID << 8);
+
+	// Function for getting how to bind this input
+	static VkVertexInputBindingDescription getBindingDescription() {
+		// Struct for specifying the description
+		VkVertexInputBindingDescription bindingDescription{};
+
+		// Where the input will bind to
+		bindingDescription.binding = 0;
+
+		// The stride of the input
+		bindingDescription.stride = sizeof(VertexLayout);
+
+		// Two options for this:
+		//	VERTEX - Move to next data entry after each vertex
+		//	INSTANCE - Move to next data entry after each instance
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return bindingDescription;
+	}
+
+	// Function for getting attribute descriptions, one per attribute the layout has
+	static std::array<VkVertexInputAttributeDescription, ATTRIBUTE_COUNT> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, ATTRIBUTE_COUNT> attributeDescriptions{};
+
+		// Describe the position attribute
+		//	binding is where the per-vertex data comes from, location is in the shader,
+		//	and offset is the number of bytes since the start of the per-vertex data
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = VERTEX_POSITION_LOCATION;
+		attributeDescriptions[0].format = Position::FORMAT;
+		attributeDescriptions[0].offset = offsetof(Attributes, position);
+
+		// Describe the color attribute
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = VERTEX_COLOR_LOCATION;
+		attributeDescriptions[1].format = Color::FORMAT;
+		attributeDescriptions[1].offset = offsetof(Attributes, color);
+
+		if constexpr (HAS_NORMAL) {
+			attributeDescriptions[2].binding = 0;
+			attributeDescriptions[2].location = VERTEX_NORMAL_LOCATION;
+			attributeDescriptions[2].format = Normal::FORMAT;
+			attributeDescriptions[2].offset = offsetof(Attributes, normal);
+		}
+
+		return attributeDescriptions;
+	}
+};
+
+// The layout every mesh is converted to and drawn with, 8 bytes instead of 20.
+//	Changing it means converting the meshes again. VERTEX_NORMALS adds the normal,
+//	and comes from building the project with /p:VertexNormals=true, which also
+//	builds the vertex shaders with it
+#ifdef VERTEX_NORMALS
+using Vertex = VertexLayout<PositionHalf2, ColorUnorm8, NormalOct16>;
+#else
+using Vertex = VertexLayout<PositionHalf2, ColorUnorm8>;
+#endif
@@ -7,15 +7,138 @@
 ******************************************************************************/
 
 #include "HelloTriangleApplication.h"
+#include "MeshConverter.h"
+#include "Benchmark.h"
 
 #include <iostream>  // cout, endl
-#include <stdexcept> // exception
-#include <cstdlib>   // EXIT_FAILURE, EXIT_SUCCESS
+#include <stdexcept> // exception, runtime_error
+#include <cstdlib>   // EXIT_FAILURE, EXIT_SUCCESS, strtoul, strtod
+#include <cstring>   // strcmp
+#include <string>    // string
 
-int main() {
+int main(int argc, char** argv) {
     HelloTriangleApplication app;
 
     try {
+        // --convert-mesh model.obj model.mesh converts a mesh offline and exits without opening a window.
+        //  Add --meshlets to store meshlets for cluster culling as well
+        MeshConvertOptions convertOptions;
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], "--meshlets") == 0)
+                convertOptions.meshlets = true;
+        }
+
+        for (int i = 1; i + 2 < argc; ++i) {
+            if (strcmp(argv[i], "--convert-mesh") == 0) {
+                convertObjToMesh(argv[i + 1], argv[i + 2], convertOptions);
+                std::cout << "Wrote " << argv[i + 2] << std::endl;
+                return EXIT_SUCCESS;
+            }
+        }
+
+        // --device 1 or --device intel picks a device by index or by part of its name instead of the best one,
+        //  and --tier baseline|standard|high caps the rendering tier below what the device can do.
+        //  Both apply to the benchmark too
+        std::string device;
+        RenderTier maxTier = RenderTier::High;
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--device") == 0) {
+                device = argv[++i];
+            }
+            else if (strcmp(argv[i], "--tier") == 0) {
+                const char* tier = argv[++i];
+                if (strcmp(tier, "baseline") == 0)
+                    maxTier = RenderTier::Baseline;
+                else if (strcmp(tier, "standard") == 0)
+                    maxTier = RenderTier::Standard;
+                else if (strcmp(tier, "high") == 0)
+                    maxTier = RenderTier::High;
+                else
+                    throw std::runtime_error(std::string("Unknown render tier: ") + tier);
+            }
+        }
+        app.setDeviceOverride(device);
+        app.setMaxRenderTier(maxTier);
+
+        // --benchmark results.json renders offscreen at every scene scale and writes the frame time
+        //  statistics without opening a window. --benchmark-frames 600 and --benchmark-scales 64x1,128x8
+        //  (instance grid x textures) change what gets run, --frames-in-flight applies to it too
+        BenchmarkSettings benchmarkSettings;
+        benchmarkSettings.device = device;
+        benchmarkSettings.maxRenderTier = maxTier;
+        const char* benchmarkOutput = nullptr;
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--benchmark") == 0)
+                benchmarkOutput = argv[++i];
+            else if (strcmp(argv[i], "--benchmark-frames") == 0)
+                benchmarkSettings.frames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            else if (strcmp(argv[i], "--benchmark-scales") == 0)
+                benchmarkSettings.scales = parseBenchmarkScales(argv[++i]);
+            else if (strcmp(argv[i], "--frames-in-flight") == 0)
+                benchmarkSettings.framesInFlight = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        }
+
+        if (benchmarkOutput) {
+            runBenchmark(benchmarkSettings, benchmarkOutput);
+            std::cout << "Wrote " << benchmarkOutput << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        // --frames-in-flight 3 trades a frame of latency for smoother frame times
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--frames-in-flight") == 0) {
+                app.setFramesInFlight(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+            }
+        }
+
+        // --present-mode immediate|mailbox|fifo|fifo-relaxed, --swapchain-images 2 and --max-fps 60 pick how
+        //  frames are presented. --low-latency waits for the GPU before reading input each frame,
+        //  and --present-wait waits for the last image to be on screen as well
+        PresentPolicy presentPolicy;
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], "--low-latency") == 0) {
+                presentPolicy.lowLatency = true;
+            }
+            else if (strcmp(argv[i], "--present-wait") == 0) {
+                presentPolicy.lowLatency = true;
+                presentPolicy.presentWait = true;
+            }
+            else if (i + 1 < argc && strcmp(argv[i], "--swapchain-images") == 0) {
+                presentPolicy.imageCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            }
+            else if (i + 1 < argc && strcmp(argv[i], "--max-fps") == 0) {
+                presentPolicy.maxFrameRate = strtod(argv[++i], nullptr);
+            }
+            else if (i + 1 < argc && strcmp(argv[i], "--present-mode") == 0) {
+                const char* mode = argv[++i];
+                if (strcmp(mode, "immediate") == 0)
+                    presentPolicy.mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+                else if (strcmp(mode, "mailbox") == 0)
+                    presentPolicy.mode = VK_PRESENT_MODE_MAILBOX_KHR;
+                else if (strcmp(mode, "fifo") == 0)
+                    presentPolicy.mode = VK_PRESENT_MODE_FIFO_KHR;
+                else if (strcmp(mode, "fifo-relaxed") == 0)
+                    presentPolicy.mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+                else
+                    throw std::runtime_error(std::string("Unknown present mode: ") + mode);
+            }
+        }
+        app.setPresentPolicy(presentPolicy);
+
+        // --profile trace.json times every frame on the CPU and GPU, and writes a Chrome trace on exit
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--profile") == 0) {
+                app.setProfileOutput(argv[++i]);
+            }
+        }
+
+        // --hot-reload rebuilds the pipelines whenever compileShaders.bat writes new shaders
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], "--hot-reload") == 0) {
+                app.setShaderHotReload(true);
+            }
+        }
+
         app.run();
     }
     catch (const std::exception& e) {